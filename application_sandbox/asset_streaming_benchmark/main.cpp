@@ -0,0 +1,418 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "application_sandbox/sample_application_framework/sample_application.h"
+#include "support/entry/entry.h"
+#include "vulkan_helpers/helper_functions.h"
+#include "vulkan_helpers/upload_manager.h"
+#include "vulkan_helpers/vulkan_application.h"
+#include "vulkan_helpers/vulkan_model.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include "mathfu/matrix.h"
+#include "mathfu/vector.h"
+
+using Mat44 = mathfu::Matrix<float, 4, 4>;
+
+namespace cube_model {
+#include "cube.obj.h"
+}
+const auto& cube_data = cube_model::model;
+
+uint32_t vertex_shader[] =
+#include "streaming.vert.spv"
+    ;
+
+uint32_t fragment_shader[] =
+#include "streaming.frag.spv"
+    ;
+
+// The cubes are laid out in a kGridSize x kGridSize grid, one draw each, to
+// give the render queue some work to be held up.
+const uint32_t kGridSize = 32;
+// Every frame of a streaming mode uploads one chunk into the next of
+// kNumStreamBuffers device-local buffers, each of which it overwrites
+// completely. Each chunk holds as many copies of the cube's vertex data as
+// fit in it, and the cubes are drawn from the buffers once they hold data.
+const uint32_t kChunkSize = 1024 * 1024;
+const uint32_t kNumStreamBuffers = 128;
+// The number of frames rendered with one mode before switching to the next.
+// At one chunk per frame, this streams 300MB per mode.
+const uint32_t kFramesPerMode = 300;
+
+// Which queue the chunks are copied on, if any.
+enum class StreamingMode { kNone, kRenderQueue, kTransferQueue };
+
+struct StreamingFrameData {
+  // Owned by the application's framebuffer cache.
+  ::VkFramebuffer framebuffer_;
+};
+
+// This creates an application with enough device buffer memory for the
+// streamed buffers, and enough host-coherent memory for the staging ring of
+// the render queue's upload manager.
+class AssetStreamingSample
+    : public sample_application::Sample<StreamingFrameData> {
+ public:
+  AssetStreamingSample(const entry::EntryData* data)
+      : data_(data),
+        Sample<StreamingFrameData>(
+            data->allocator(), data, 1, 16,
+            kChunkSize * kNumStreamBuffers / (1024 * 1024) + 1, 8,
+            sample_application::SampleOptions()
+                .EnableGpuProfiling()
+                .EnableTransferQueue()),
+        cube_(data->allocator(), data->logger(), cube_data),
+        stream_buffers_(data->allocator()),
+        chunk_(kChunkSize, 0, data->allocator()),
+        copies_per_chunk_(
+            static_cast<uint32_t>(kChunkSize / cube_.vertex_data_size())),
+        next_buffer_(0),
+        num_streamed_buffers_(0),
+        mode_(StreamingMode::kNone),
+        frames_in_mode_(0),
+        frame_time_in_mode_(0),
+        max_frame_time_in_mode_(0),
+        gpu_milliseconds_in_mode_(0.0),
+        bytes_in_mode_(0),
+        baseline_milliseconds_(0.0),
+        has_rendered_(false),
+        rotation_(0.0f) {
+    for (uint32_t i = 0; i < copies_per_chunk_; ++i) {
+      memcpy(&chunk_[i * cube_.vertex_data_size()], cube_.vertex_data(),
+             cube_.vertex_data_size());
+    }
+  }
+
+  virtual void InitializeApplicationData(
+      vulkan::VkCommandBuffer* initialization_buffer,
+      size_t num_swapchain_images) override {
+    cube_.InitializeData(app(), initialization_buffer);
+
+    pipeline_layout_ = containers::make_unique<vulkan::PipelineLayout>(
+        data_->allocator(),
+        app()->CreatePipelineLayout(
+            {}, {{
+                    VK_SHADER_STAGE_VERTEX_BIT,  // stageFlags
+                    0,                           // offset
+                    sizeof(Mat44)                // size
+                }}));
+
+    VkAttachmentReference color_attachment = {
+        0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+
+    render_pass_ = app()->GetCachedRenderPass(
+        {{
+            0,                                         // flags
+            render_format(),                           // format
+            num_samples(),                             // samples
+            VK_ATTACHMENT_LOAD_OP_CLEAR,               // loadOp
+            VK_ATTACHMENT_STORE_OP_STORE,              // storeOp
+            VK_ATTACHMENT_LOAD_OP_DONT_CARE,           // stenilLoadOp
+            VK_ATTACHMENT_STORE_OP_DONT_CARE,          // stenilStoreOp
+            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,  // initialLayout
+            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL   // finalLayout
+        }},  // AttachmentDescriptions
+        {{
+            0,                                // flags
+            VK_PIPELINE_BIND_POINT_GRAPHICS,  // pipelineBindPoint
+            0,                                // inputAttachmentCount
+            nullptr,                          // pInputAttachments
+            1,                                // colorAttachmentCount
+            &color_attachment,                // colorAttachment
+            nullptr,                          // pResolveAttachments
+            nullptr,                          // pDepthStencilAttachment
+            0,                                // preserveAttachmentCount
+            nullptr                           // pPreserveAttachments
+        }},                                   // SubpassDescriptions
+        {}                                    // SubpassDependencies
+        );
+
+    pipeline_ = containers::make_unique<vulkan::VulkanGraphicsPipeline>(
+        data_->allocator(),
+        app()->CreateGraphicsPipeline(pipeline_layout_.get(), render_pass_,
+                                      0));
+    pipeline_->AddShader(VK_SHADER_STAGE_VERTEX_BIT, "main", vertex_shader);
+    pipeline_->AddShader(VK_SHADER_STAGE_FRAGMENT_BIT, "main",
+                         fragment_shader);
+    pipeline_->SetTopology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+    pipeline_->SetInputStreams(&cube_);
+    pipeline_->SetViewport(viewport());
+    pipeline_->SetScissor(scissor());
+    pipeline_->SetSamples(num_samples());
+    pipeline_->AddAttachment();
+    pipeline_->Commit();
+
+    float aspect =
+        (float)app()->swapchain().width() / (float)app()->swapchain().height();
+    projection_ =
+        Mat44::FromScaleVector(mathfu::Vector<float, 3>{1.0f, -1.0f, 1.0f}) *
+        Mat44::Perspective(1.5708f, aspect, 0.1f, 100.0f);
+
+    // The streamed buffers stand in for the vertex data of models that are
+    // loaded while the application is running.
+    stream_buffers_.reserve(kNumStreamBuffers);
+    for (uint32_t i = 0; i < kNumStreamBuffers; ++i) {
+      VkBufferCreateInfo create_info = {
+          VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,  // sType
+          nullptr,                               // pNext
+          0,                                     // flags
+          kChunkSize,                            // size
+          VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+              VK_BUFFER_USAGE_TRANSFER_DST_BIT,  // usage
+          VK_SHARING_MODE_EXCLUSIVE,             // sharingMode
+          0,                                     // queueFamilyIndexCount
+          nullptr                                // pQueueFamilyIndices
+      };
+      stream_buffers_.push_back(app()->CreateAndBindDeviceBuffer(&create_info));
+    }
+
+    // The render queue mode has an upload manager of its own, since the
+    // application's makes its copies on the transfer queue if there is one.
+    VkBufferCreateInfo staging_info = {
+        VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,        // sType
+        nullptr,                                     // pNext
+        0,                                           // flags
+        vulkan::UploadManager::kDefaultStagingSize,  // size
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,            // usage
+        VK_SHARING_MODE_EXCLUSIVE,                   // sharingMode
+        0,                                           // queueFamilyIndexCount
+        nullptr                                      // pQueueFamilyIndices
+    };
+    render_queue_uploads_ = containers::make_unique<vulkan::UploadManager>(
+        data_->allocator(), data_->allocator(), app(), &app()->render_queue(),
+        app()->CreateAndBindCoherentBuffer(&staging_info));
+
+    if (!app()->transfer_queue()) {
+      app()->GetLogger()->LogInfo(
+          "The device has no transfer-only queue family, so only streaming "
+          "on the render queue is measured");
+    }
+  }
+
+  virtual void InitializeFrameData(
+      StreamingFrameData* frame_data,
+      vulkan::VkCommandBuffer* initialization_buffer,
+      size_t frame_index) override {
+    frame_data->framebuffer_ = app()->GetCachedFramebuffer(
+        render_pass_, {color_view(frame_data)}, app()->swapchain().width(),
+        app()->swapchain().height());
+  }
+
+  virtual void Update(float time_since_last_render) override {
+    // The frame times are measured from the start of one frame to the start
+    // of the next, so each frame is accounted for at the start of the next.
+    auto now = std::chrono::high_resolution_clock::now();
+    if (has_rendered_) {
+      AccumulateStatistics(now - last_update_);
+    }
+    last_update_ = now;
+
+    rotation_ += 3.14f * time_since_last_render;
+
+    // The application's upload manager is flushed by the framework before
+    // the frame, and the render queue's one is flushed here, which also
+    // submits it ahead of the frame.
+    vulkan::UploadManager* uploads =
+        mode_ == StreamingMode::kRenderQueue
+            ? render_queue_uploads_.get()
+            : mode_ == StreamingMode::kTransferQueue ? app()->upload_manager()
+                                                     : nullptr;
+    if (uploads) {
+      uploads->UploadBuffer(*stream_buffers_[next_buffer_], 0, chunk_.data(),
+                            kChunkSize, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+                            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+      num_streamed_buffers_ = std::max(num_streamed_buffers_, next_buffer_ + 1);
+      next_buffer_ = (next_buffer_ + 1) % kNumStreamBuffers;
+      bytes_in_mode_ += kChunkSize;
+      if (uploads == render_queue_uploads_.get()) {
+        LOG_ASSERT(==, app()->GetLogger(), VK_SUCCESS,
+                   uploads->Flush(render_submissions()));
+      }
+    }
+  }
+
+  virtual void Render(vulkan::VkQueue* queue, size_t frame_index,
+                      StreamingFrameData* frame_data) override {
+    vulkan::VkCommandBuffer* command_buffer = frame_command_buffers()->Get();
+    vulkan::VkCommandBuffer& cmdBuffer = *command_buffer;
+    cmdBuffer->vkBeginCommandBuffer(cmdBuffer,
+                                    &sample_application::kBeginCommandBuffer);
+
+    VkClearValue clear;
+    vulkan::MemoryClear(&clear);
+
+    VkRenderPassBeginInfo pass_begin = {
+        VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,  // sType
+        nullptr,                                   // pNext
+        render_pass_,                              // renderPass
+        frame_data->framebuffer_,                  // framebuffer
+        {{0, 0},
+         {app()->swapchain().width(),
+          app()->swapchain().height()}},  // renderArea
+        1,                                // clearValueCount
+        &clear                            // clears
+    };
+
+    cmdBuffer->vkCmdBeginRenderPass(cmdBuffer, &pass_begin,
+                                    VK_SUBPASS_CONTENTS_INLINE);
+    cmdBuffer->vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                 *pipeline_);
+    const Mat44 rotation = Mat44::FromRotationMatrix(
+        Mat44::RotationX(rotation_) * Mat44::RotationY(rotation_ * 0.5f));
+    const Mat44 scale = Mat44::FromScaleVector(
+        mathfu::Vector<float, 3>{0.12f, 0.12f, 0.12f});
+    for (uint32_t y = 0; y < kGridSize; ++y) {
+      for (uint32_t x = 0; x < kGridSize; ++x) {
+        const float offset_x = (float(x) - (kGridSize - 1) * 0.5f) * 0.3f;
+        const float offset_y = (float(y) - (kGridSize - 1) * 0.5f) * 0.3f;
+        const Mat44 transform =
+            projection_ *
+            Mat44::FromTranslationVector(
+                mathfu::Vector<float, 3>{offset_x, offset_y, -8.0f}) *
+            rotation * scale;
+        cmdBuffer.PushConstants(*pipeline_layout_, VK_SHADER_STAGE_VERTEX_BIT,
+                                transform);
+        // Every buffer that has been streamed to is drawn from, so the
+        // copies into it have to wait for the draws of earlier frames.
+        const uint32_t draw = y * kGridSize + x;
+        if (num_streamed_buffers_ == 0) {
+          cube_.Draw(&cmdBuffer);
+        } else {
+          cube_.DrawWithVertexBuffer(
+              &cmdBuffer, *stream_buffers_[draw % num_streamed_buffers_],
+              (draw % copies_per_chunk_) * cube_.vertex_data_size());
+        }
+      }
+    }
+    cmdBuffer->vkCmdEndRenderPass(cmdBuffer);
+    cmdBuffer->vkEndCommandBuffer(cmdBuffer);
+    has_rendered_ = true;
+
+    render_submissions()->Submit(command_buffer->get_command_buffer());
+  }
+
+  ~AssetStreamingSample() {
+    render_queue_uploads_->LogStatistics(app()->GetLogger());
+  }
+
+ private:
+  // Adds one frame to the current mode, and logs the averages and moves on
+  // to the next mode once the mode has run for kFramesPerMode frames.
+  void AccumulateStatistics(
+      std::chrono::high_resolution_clock::duration frame_time) {
+    frame_time_in_mode_ += frame_time;
+    max_frame_time_in_mode_ = std::max(max_frame_time_in_mode_, frame_time);
+    const vulkan::GpuProfiler::ScopeTiming* gpu_frame_time =
+        gpu_profiler()->GetTiming(sample_application::kGpuFrameScope);
+    if (gpu_frame_time) {
+      gpu_milliseconds_in_mode_ += gpu_frame_time->last_milliseconds;
+    }
+    if (++frames_in_mode_ < kFramesPerMode) {
+      return;
+    }
+
+    const double milliseconds =
+        std::chrono::duration<double, std::milli>(frame_time_in_mode_)
+            .count() /
+        frames_in_mode_;
+    const double max_milliseconds =
+        std::chrono::duration<double, std::milli>(max_frame_time_in_mode_)
+            .count();
+    const double gpu_milliseconds = gpu_milliseconds_in_mode_ / frames_in_mode_;
+    switch (mode_) {
+      case StreamingMode::kNone:
+        app()->GetLogger()->LogInfo(
+            "No streaming: ", milliseconds, "ms per frame, at most ",
+            max_milliseconds, "ms, ", gpu_milliseconds, "ms on the GPU");
+        baseline_milliseconds_ = milliseconds;
+        break;
+      case StreamingMode::kRenderQueue:
+      case StreamingMode::kTransferQueue:
+        app()->GetLogger()->LogInfo(
+            "Streaming ", bytes_in_mode_ / (1024 * 1024), "MB on the ",
+            mode_ == StreamingMode::kRenderQueue ? "render" : "transfer",
+            " queue: ", milliseconds, "ms per frame, ",
+            baseline_milliseconds_ == 0.0
+                ? 0.0
+                : milliseconds / baseline_milliseconds_,
+            "x the frame time without streaming, at most ", max_milliseconds,
+            "ms, ", gpu_milliseconds, "ms on the GPU");
+        break;
+    }
+    LogPresentStatistics();
+    ResetPresentStatistics();
+
+    // The transfer queue mode is skipped if there is no transfer queue,
+    // since it would measure the render queue again.
+    const bool has_transfer_queue = app()->transfer_queue() != nullptr;
+    mode_ = mode_ == StreamingMode::kNone
+                ? StreamingMode::kRenderQueue
+                : mode_ == StreamingMode::kRenderQueue && has_transfer_queue
+                      ? StreamingMode::kTransferQueue
+                      : StreamingMode::kNone;
+    frames_in_mode_ = 0;
+    frame_time_in_mode_ = std::chrono::high_resolution_clock::duration(0);
+    max_frame_time_in_mode_ = std::chrono::high_resolution_clock::duration(0);
+    gpu_milliseconds_in_mode_ = 0.0;
+    bytes_in_mode_ = 0;
+  }
+
+  const entry::EntryData* data_;
+  containers::unique_ptr<vulkan::PipelineLayout> pipeline_layout_;
+  containers::unique_ptr<vulkan::VulkanGraphicsPipeline> pipeline_;
+  // Owned by the application's render pass cache.
+  ::VkRenderPass render_pass_;
+  vulkan::VulkanModel cube_;
+  Mat44 projection_;
+
+  containers::vector<vulkan::BufferPointer> stream_buffers_;
+  // The data that is uploaded to every streamed buffer.
+  containers::vector<uint8_t> chunk_;
+  const uint32_t copies_per_chunk_;
+  uint32_t next_buffer_;
+  // The number of streamed buffers that hold data, which are the first
+  // ones.
+  uint32_t num_streamed_buffers_;
+  containers::unique_ptr<vulkan::UploadManager> render_queue_uploads_;
+
+  StreamingMode mode_;
+  uint32_t frames_in_mode_;
+  std::chrono::high_resolution_clock::duration frame_time_in_mode_;
+  std::chrono::high_resolution_clock::duration max_frame_time_in_mode_;
+  double gpu_milliseconds_in_mode_;
+  uint64_t bytes_in_mode_;
+  // The average frame time of the last run without streaming, which the
+  // streaming modes are compared against.
+  double baseline_milliseconds_;
+  bool has_rendered_;
+  std::chrono::high_resolution_clock::time_point last_update_;
+  float rotation_;
+};
+
+int main_entry(const entry::EntryData* data) {
+  data->logger()->LogInfo("Application Startup");
+  AssetStreamingSample sample(data);
+  sample.Initialize();
+
+  while (!sample.should_exit() && !data->WindowClosing()) {
+    sample.ProcessFrame();
+  }
+  sample.WaitIdle();
+
+  data->logger()->LogInfo("Application Shutdown");
+  return 0;
+}
@@ -17,6 +17,7 @@
 #include "support/entry/entry.h"
 #include "vulkan_helpers/buffer_frame_data.h"
 #include "vulkan_helpers/helper_functions.h"
+#include "vulkan_helpers/pipeline_build_queue.h"
 #include "vulkan_helpers/vulkan_application.h"
 #include "vulkan_helpers/vulkan_model.h"
 #include "vulkan_helpers/vulkan_texture.h"
@@ -142,6 +143,9 @@ class ASyncThreadRunner {
         app_->CreatePipelineLayout({{compute_descriptor_set_layouts_[0],
                                      compute_descriptor_set_layouts_[1],
                                      compute_descriptor_set_layouts_[2]}}));
+    // Both pipelines are compiled in the background while the simulation
+    // data is being set up.
+    vulkan::PipelineBuildQueue build_queue(allocator_, app_, 2);
     position_update_pipeline_ =
         containers::make_unique<vulkan::VulkanComputePipeline>(
             allocator_,
@@ -150,7 +154,7 @@ class ASyncThreadRunner {
                 VkShaderModuleCreateInfo{
                     VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO, nullptr, 0,
                     sizeof(simulation_shader), simulation_shader},
-                "main"));
+                "main", nullptr, &build_queue));
 
     // This is the pipeline that updates the velocity based on all of the
     // particles positions.
@@ -161,7 +165,7 @@ class ASyncThreadRunner {
             VkShaderModuleCreateInfo{
                 VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO, nullptr, 0,
                 sizeof(velocity_shader), velocity_shader},
-            "main"));
+            "main", nullptr, &build_queue));
 
     auto initial_data_buffer = containers::make_unique<vulkan::VkCommandBuffer>(
         allocator_, app_->GetCommandBuffer());
@@ -214,6 +218,10 @@ class ASyncThreadRunner {
         initial_data_buffer.get(),
         VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
 
+    // The command buffers recorded below bind both pipelines.
+    position_update_pipeline_->Wait();
+    velocity_pipeline_->Wait();
+
     uint32_t queue_family_indices[2] = {app_->render_queue().index(),
                                         app_->async_compute_queue()->index()};
 
@@ -874,7 +882,7 @@ class AsyncSample : public sample_application::Sample<AsyncFrameData> {
     bool swapped_buffer = old_buffer != current_computation_result_buffer_;
     auto* buffer =
         thread_runner_.GetBufferForIndex(current_computation_result_buffer_);
-    aspect_buffer_->UpdateBuffer(&app()->render_queue(), frame_index);
+    aspect_buffer_->UpdateBuffer(render_submissions(), frame_index);
 
     // Write that buffer into the descriptor sets.
     VkDescriptorBufferInfo buffer_infos[2] = {
@@ -1025,9 +1033,7 @@ class AsyncSample : public sample_application::Sample<AsyncFrameData> {
         nullptr  // pSignalSemaphores
     };
 
-    app()->render_queue()->vkQueueSubmit(app()->render_queue(), 1,
-                                         &init_submit_info,
-                                         static_cast<VkFence>(VK_NULL_HANDLE));
+    render_submissions()->Submit(init_submit_info);
   }
 
  private:
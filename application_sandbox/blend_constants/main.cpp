@@ -286,8 +286,8 @@ class blendSample : public sample_application::Sample<BlendFrameData> {
   virtual void Render(vulkan::VkQueue* queue, size_t frame_index,
                       BlendFrameData* frame_data) override {
     // Update our uniform buffers.
-    camera_data_->UpdateBuffer(queue, frame_index);
-    model_data_->UpdateBuffer(queue, frame_index);
+    camera_data_->UpdateBuffer(render_submissions(), frame_index);
+    model_data_->UpdateBuffer(render_submissions(), frame_index);
 
     VkSubmitInfo init_submit_info{
         VK_STRUCTURE_TYPE_SUBMIT_INFO,  // sType
@@ -301,9 +301,7 @@ class blendSample : public sample_application::Sample<BlendFrameData> {
         nullptr  // pSignalSemaphores
     };
 
-    app()->render_queue()->vkQueueSubmit(app()->render_queue(), 1,
-                                         &init_submit_info,
-                                         static_cast<VkFence>(VK_NULL_HANDLE));
+    render_submissions()->Submit(init_submit_info);
   }
 
  private:
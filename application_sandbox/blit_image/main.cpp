@@ -389,8 +389,8 @@ class BlitImageSample : public sample_application::Sample<CubeFrameData> {
   virtual void Render(vulkan::VkQueue* queue, size_t frame_index,
                       CubeFrameData* frame_data) override {
     // Update our uniform buffers.
-    camera_data->UpdateBuffer(queue, frame_index);
-    model_data->UpdateBuffer(queue, frame_index);
+    camera_data->UpdateBuffer(render_submissions(), frame_index);
+    model_data->UpdateBuffer(render_submissions(), frame_index);
 
     VkSubmitInfo init_submit_info{
         VK_STRUCTURE_TYPE_SUBMIT_INFO,  // sType
@@ -404,9 +404,7 @@ class BlitImageSample : public sample_application::Sample<CubeFrameData> {
         nullptr  // pSignalSemaphores
     };
 
-    app()->render_queue()->vkQueueSubmit(app()->render_queue(), 1,
-                                         &init_submit_info,
-                                         static_cast<VkFence>(VK_NULL_HANDLE));
+    render_submissions()->Submit(init_submit_info);
   }
 
  private:
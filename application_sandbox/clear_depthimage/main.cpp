@@ -220,7 +220,7 @@ class ClearDepthImageSample
     cube_render_pipeline_->SetScissor(scissor());
     cube_render_pipeline_->SetSamples(num_samples());
     cube_render_pipeline_->AddAttachment();
-    cube_render_pipeline_->Commit();
+    CommitPipeline(cube_render_pipeline_.get());
 
     depth_render_pipeline_ =
         containers::make_unique<vulkan::VulkanGraphicsPipeline>(
@@ -237,7 +237,7 @@ class ClearDepthImageSample
     depth_render_pipeline_->SetScissor(scissor());
     depth_render_pipeline_->SetSamples(num_samples());
     depth_render_pipeline_->AddAttachment();
-    depth_render_pipeline_->Commit();
+    CommitPipeline(depth_render_pipeline_.get());
 
     camera_data =
         containers::make_unique<vulkan::BufferFrameData<camera_data_>>(
@@ -508,8 +508,8 @@ class ClearDepthImageSample
   virtual void Render(vulkan::VkQueue* queue, size_t frame_index,
                       CubeDepthFrameData* frame_data) override {
     // Update our uniform buffers.
-    camera_data->UpdateBuffer(queue, frame_index);
-    model_data->UpdateBuffer(queue, frame_index);
+    camera_data->UpdateBuffer(render_submissions(), frame_index);
+    model_data->UpdateBuffer(render_submissions(), frame_index);
 
     VkSubmitInfo init_submit_info{
         VK_STRUCTURE_TYPE_SUBMIT_INFO,  // sType
@@ -523,9 +523,7 @@ class ClearDepthImageSample
         nullptr  // pSignalSemaphores
     };
 
-    app()->render_queue()->vkQueueSubmit(app()->render_queue(), 1,
-                                         &init_submit_info,
-                                         static_cast<VkFence>(VK_NULL_HANDLE));
+    render_submissions()->Submit(init_submit_info);
   }
 
  private:
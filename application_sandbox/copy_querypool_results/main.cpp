@@ -457,8 +457,8 @@ class CopyQueryPoolResultSample
   virtual void Render(vulkan::VkQueue* queue, size_t frame_index,
                       WireframeFrameData* frame_data) override {
     // Update our uniform buffers.
-    camera_data_->UpdateBuffer(queue, frame_index);
-    model_data_->UpdateBuffer(queue, frame_index);
+    camera_data_->UpdateBuffer(render_submissions(), frame_index);
+    model_data_->UpdateBuffer(render_submissions(), frame_index);
 
     VkSubmitInfo init_submit_info{
         VK_STRUCTURE_TYPE_SUBMIT_INFO,  // sType
@@ -472,9 +472,7 @@ class CopyQueryPoolResultSample
         nullptr  // pSignalSemaphores
     };
 
-    app()->render_queue()->vkQueueSubmit(app()->render_queue(), 1,
-                                         &init_submit_info,
-                                         static_cast<VkFence>(VK_NULL_HANDLE));
+    render_submissions()->Submit(init_submit_info);
   }
 
  private:
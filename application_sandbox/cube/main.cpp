@@ -41,7 +41,8 @@ uint32_t cube_fragment_shader[] =
 
 struct CubeFrameData {
   containers::unique_ptr<vulkan::VkCommandBuffer> command_buffer_;
-  containers::unique_ptr<vulkan::VkFramebuffer> framebuffer_;
+  // Owned by the application's framebuffer cache.
+  ::VkFramebuffer framebuffer_;
   containers::unique_ptr<vulkan::DescriptorSet> cube_descriptor_set_;
 };
 
@@ -67,55 +68,53 @@ class CubeSample : public sample_application::Sample<CubeFrameData> {
         VK_SHADER_STAGE_VERTEX_BIT,         // stageFlags
         nullptr                             // pImmutableSamplers
     };
-    cube_descriptor_set_layouts_[1] = {
-        1,                                  // binding
-        VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,  // descriptorType
-        1,                                  // descriptorCount
-        VK_SHADER_STAGE_VERTEX_BIT,         // stageFlags
-        nullptr                             // pImmutableSamplers
-    };
 
+    // The model transform changes every frame, so it is passed as a push
+    // constant rather than through a uniform buffer.
     pipeline_layout_ = containers::make_unique<vulkan::PipelineLayout>(
         data_->allocator(),
-        app()->CreatePipelineLayout({{cube_descriptor_set_layouts_[0],
-                                      cube_descriptor_set_layouts_[1]}}));
+        app()->CreatePipelineLayout(
+            {{cube_descriptor_set_layouts_[0]}},
+            {{
+                VK_SHADER_STAGE_VERTEX_BIT,  // stageFlags
+                0,                           // offset
+                sizeof(ModelData)            // size
+            }}));
 
     VkAttachmentReference color_attachment = {
         0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
 
-    render_pass_ = containers::make_unique<vulkan::VkRenderPass>(
-        data_->allocator(),
-        app()->CreateRenderPass(
-            {{
-                0,                                         // flags
-                render_format(),                           // format
-                num_samples(),                             // samples
-                VK_ATTACHMENT_LOAD_OP_CLEAR,               // loadOp
-                VK_ATTACHMENT_STORE_OP_STORE,              // storeOp
-                VK_ATTACHMENT_LOAD_OP_DONT_CARE,           // stenilLoadOp
-                VK_ATTACHMENT_STORE_OP_DONT_CARE,          // stenilStoreOp
-                VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,  // initialLayout
-                VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL   // finalLayout
-            }},  // AttachmentDescriptions
-            {{
-                0,                                // flags
-                VK_PIPELINE_BIND_POINT_GRAPHICS,  // pipelineBindPoint
-                0,                                // inputAttachmentCount
-                nullptr,                          // pInputAttachments
-                1,                                // colorAttachmentCount
-                &color_attachment,                // colorAttachment
-                nullptr,                          // pResolveAttachments
-                nullptr,                          // pDepthStencilAttachment
-                0,                                // preserveAttachmentCount
-                nullptr                           // pPreserveAttachments
-            }},                                   // SubpassDescriptions
-            {}                                    // SubpassDependencies
-            ));
+    render_pass_ = app()->GetCachedRenderPass(
+        {{
+            0,                                         // flags
+            render_format(),                           // format
+            num_samples(),                             // samples
+            VK_ATTACHMENT_LOAD_OP_CLEAR,               // loadOp
+            VK_ATTACHMENT_STORE_OP_STORE,              // storeOp
+            VK_ATTACHMENT_LOAD_OP_DONT_CARE,           // stenilLoadOp
+            VK_ATTACHMENT_STORE_OP_DONT_CARE,          // stenilStoreOp
+            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,  // initialLayout
+            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL   // finalLayout
+        }},  // AttachmentDescriptions
+        {{
+            0,                                // flags
+            VK_PIPELINE_BIND_POINT_GRAPHICS,  // pipelineBindPoint
+            0,                                // inputAttachmentCount
+            nullptr,                          // pInputAttachments
+            1,                                // colorAttachmentCount
+            &color_attachment,                // colorAttachment
+            nullptr,                          // pResolveAttachments
+            nullptr,                          // pDepthStencilAttachment
+            0,                                // preserveAttachmentCount
+            nullptr                           // pPreserveAttachments
+        }},                                   // SubpassDescriptions
+        {}                                    // SubpassDependencies
+        );
 
     cube_pipeline_ = containers::make_unique<vulkan::VulkanGraphicsPipeline>(
         data_->allocator(),
-        app()->CreateGraphicsPipeline(pipeline_layout_.get(),
-                                      render_pass_.get(), 0));
+        app()->CreateGraphicsPipeline(pipeline_layout_.get(), render_pass_,
+                                      0));
     cube_pipeline_->AddShader(VK_SHADER_STAGE_VERTEX_BIT, "main",
                               cube_vertex_shader);
     cube_pipeline_->AddShader(VK_SHADER_STAGE_FRAGMENT_BIT, "main",
@@ -126,23 +125,19 @@ class CubeSample : public sample_application::Sample<CubeFrameData> {
     cube_pipeline_->SetScissor(scissor());
     cube_pipeline_->SetSamples(num_samples());
     cube_pipeline_->AddAttachment();
-    cube_pipeline_->Commit();
+    CommitPipeline(cube_pipeline_.get());
 
     camera_data_ = containers::make_unique<vulkan::BufferFrameData<CameraData>>(
         data_->allocator(), app(), num_swapchain_images,
         VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
 
-    model_data_ = containers::make_unique<vulkan::BufferFrameData<ModelData>>(
-        data_->allocator(), app(), num_swapchain_images,
-        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
-
     float aspect =
         (float)app()->swapchain().width() / (float)app()->swapchain().height();
     camera_data_->data().projection_matrix =
         Mat44::FromScaleVector(mathfu::Vector<float, 3>{1.0f, -1.0f, 1.0f}) *
         Mat44::Perspective(1.5708f, aspect, 0.1f, 100.0f);
 
-    model_data_->data().transform = Mat44::FromTranslationVector(
+    model_data_.transform = Mat44::FromTranslationVector(
         mathfu::Vector<float, 3>{0.0f, 0.0f, -3.0f});
   }
 
@@ -156,20 +151,13 @@ class CubeSample : public sample_application::Sample<CubeFrameData> {
     frame_data->cube_descriptor_set_ =
         containers::make_unique<vulkan::DescriptorSet>(
             data_->allocator(),
-            app()->AllocateDescriptorSet({cube_descriptor_set_layouts_[0],
-                                          cube_descriptor_set_layouts_[1]}));
-
-    VkDescriptorBufferInfo buffer_infos[2] = {
-        {
-            camera_data_->get_buffer(),                       // buffer
-            camera_data_->get_offset_for_frame(frame_index),  // offset
-            camera_data_->size(),                             // range
-        },
-        {
-            model_data_->get_buffer(),                       // buffer
-            model_data_->get_offset_for_frame(frame_index),  // offset
-            model_data_->size(),                             // range
-        }};
+            app()->AllocateDescriptorSet({cube_descriptor_set_layouts_[0]}));
+
+    VkDescriptorBufferInfo buffer_info = {
+        camera_data_->get_buffer(),                       // buffer
+        camera_data_->get_offset_for_frame(frame_index),  // offset
+        camera_data_->size(),                             // range
+    };
 
     VkWriteDescriptorSet write{
         VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,  // sType
@@ -177,38 +165,25 @@ class CubeSample : public sample_application::Sample<CubeFrameData> {
         *frame_data->cube_descriptor_set_,       // dstSet
         0,                                       // dstbinding
         0,                                       // dstArrayElement
-        2,                                       // descriptorCount
+        1,                                       // descriptorCount
         VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,       // descriptorType
         nullptr,                                 // pImageInfo
-        buffer_infos,                            // pBufferInfo
+        &buffer_info,                            // pBufferInfo
         nullptr,                                 // pTexelBufferView
     };
 
     app()->device()->vkUpdateDescriptorSets(app()->device(), 1, &write, 0,
                                             nullptr);
 
-    ::VkImageView raw_view = color_view(frame_data);
-
-    // Create a framebuffer with depth and image attachments
-    VkFramebufferCreateInfo framebuffer_create_info{
-        VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,  // sType
-        nullptr,                                    // pNext
-        0,                                          // flags
-        *render_pass_,                              // renderPass
-        1,                                          // attachmentCount
-        &raw_view,                                  // attachments
-        app()->swapchain().width(),                 // width
-        app()->swapchain().height(),                // height
-        1                                           // layers
-    };
-
-    ::VkFramebuffer raw_framebuffer;
-    app()->device()->vkCreateFramebuffer(
-        app()->device(), &framebuffer_create_info, nullptr, &raw_framebuffer);
-    frame_data->framebuffer_ = containers::make_unique<vulkan::VkFramebuffer>(
-        data_->allocator(),
-        vulkan::VkFramebuffer(raw_framebuffer, nullptr, &app()->device()));
+    // Get a framebuffer with the color attachment
+    frame_data->framebuffer_ = app()->GetCachedFramebuffer(
+        render_pass_, {color_view(frame_data)}, app()->swapchain().width(),
+        app()->swapchain().height());
+  }
 
+  // Records the commands for the frame. This is done every frame, since the
+  // command buffer contains the current model transform.
+  void RecordCommandBuffer(CubeFrameData* frame_data) {
     (*frame_data->command_buffer_)
         ->vkBeginCommandBuffer((*frame_data->command_buffer_),
                                &sample_application::kBeginCommandBuffer);
@@ -220,8 +195,8 @@ class CubeSample : public sample_application::Sample<CubeFrameData> {
     VkRenderPassBeginInfo pass_begin = {
         VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,  // sType
         nullptr,                                   // pNext
-        *render_pass_,                             // renderPass
-        *frame_data->framebuffer_,                 // framebuffer
+        render_pass_,                              // renderPass
+        frame_data->framebuffer_,                  // framebuffer
         {{0, 0},
          {app()->swapchain().width(),
           app()->swapchain().height()}},  // renderArea
@@ -238,6 +213,8 @@ class CubeSample : public sample_application::Sample<CubeFrameData> {
         cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
         ::VkPipelineLayout(*pipeline_layout_), 0, 1,
         &frame_data->cube_descriptor_set_->raw_set(), 0, nullptr);
+    cmdBuffer.PushConstants(::VkPipelineLayout(*pipeline_layout_),
+                            VK_SHADER_STAGE_VERTEX_BIT, model_data_);
     cube_.Draw(&cmdBuffer);
     cmdBuffer->vkCmdEndRenderPass(cmdBuffer);
 
@@ -246,8 +223,8 @@ class CubeSample : public sample_application::Sample<CubeFrameData> {
   }
 
   virtual void Update(float time_since_last_render) override {
-    model_data_->data().transform =
-        model_data_->data().transform *
+    model_data_.transform =
+        model_data_.transform *
         Mat44::FromRotationMatrix(
             Mat44::RotationX(3.14f * time_since_last_render) *
             Mat44::RotationY(3.14f * time_since_last_render * 0.5f));
@@ -255,8 +232,8 @@ class CubeSample : public sample_application::Sample<CubeFrameData> {
   virtual void Render(vulkan::VkQueue* queue, size_t frame_index,
                       CubeFrameData* frame_data) override {
     // Update our uniform buffers.
-    camera_data_->UpdateBuffer(queue, frame_index);
-    model_data_->UpdateBuffer(queue, frame_index);
+    camera_data_->UpdateBuffer(render_submissions(), frame_index);
+    RecordCommandBuffer(frame_data);
 
     VkSubmitInfo init_submit_info{
         VK_STRUCTURE_TYPE_SUBMIT_INFO,  // sType
@@ -270,9 +247,7 @@ class CubeSample : public sample_application::Sample<CubeFrameData> {
         nullptr  // pSignalSemaphores
     };
 
-    app()->render_queue()->vkQueueSubmit(app()->render_queue(), 1,
-                                         &init_submit_info,
-                                         static_cast<VkFence>(VK_NULL_HANDLE));
+    render_submissions()->Submit(init_submit_info);
   }
 
  private:
@@ -287,12 +262,13 @@ class CubeSample : public sample_application::Sample<CubeFrameData> {
   const entry::EntryData* data_;
   containers::unique_ptr<vulkan::PipelineLayout> pipeline_layout_;
   containers::unique_ptr<vulkan::VulkanGraphicsPipeline> cube_pipeline_;
-  containers::unique_ptr<vulkan::VkRenderPass> render_pass_;
-  VkDescriptorSetLayoutBinding cube_descriptor_set_layouts_[2];
+  // Owned by the application's render pass cache.
+  ::VkRenderPass render_pass_;
+  VkDescriptorSetLayoutBinding cube_descriptor_set_layouts_[1];
   vulkan::VulkanModel cube_;
 
   containers::unique_ptr<vulkan::BufferFrameData<CameraData>> camera_data_;
-  containers::unique_ptr<vulkan::BufferFrameData<ModelData>> model_data_;
+  ModelData model_data_;
 };
 
 int main_entry(const entry::EntryData* data) {
@@ -206,7 +206,7 @@ class DepthReadbackSample : public sample_application::Sample<DepthFrameData> {
     render_cube_pipeline_->SetScissor(scissor());
     render_cube_pipeline_->SetSamples(num_samples());
     render_cube_pipeline_->AddAttachment();
-    render_cube_pipeline_->Commit();
+    CommitPipeline(render_cube_pipeline_.get());
 
     depth_read_pipeline_layout_bindings_ = {
         0,                                    // binding
@@ -237,7 +237,7 @@ class DepthReadbackSample : public sample_application::Sample<DepthFrameData> {
     depth_read_pipeline_->SetInputStreams(&plane_);
     depth_read_pipeline_->SetSamples(num_samples());
     depth_read_pipeline_->AddAttachment();
-    depth_read_pipeline_->Commit();
+    CommitPipeline(depth_read_pipeline_.get());
 
     camera_data_ = containers::make_unique<vulkan::BufferFrameData<CameraData>>(
         data_->allocator(), app(), num_swapchain_images,
@@ -399,8 +399,8 @@ class DepthReadbackSample : public sample_application::Sample<DepthFrameData> {
   virtual void Render(vulkan::VkQueue* queue, size_t frame_index,
                       DepthFrameData* frame_data) override {
     // Update our uniform buffers.
-    camera_data_->UpdateBuffer(queue, frame_index);
-    model_data_->UpdateBuffer(queue, frame_index);
+    camera_data_->UpdateBuffer(render_submissions(), frame_index);
+    model_data_->UpdateBuffer(render_submissions(), frame_index);
 
     VkSubmitInfo init_submit_info{
         VK_STRUCTURE_TYPE_SUBMIT_INFO,  // sType
@@ -414,9 +414,7 @@ class DepthReadbackSample : public sample_application::Sample<DepthFrameData> {
         nullptr  // pSignalSemaphores
     };
 
-    app()->render_queue()->vkQueueSubmit(app()->render_queue(), 1,
-                                         &init_submit_info,
-                                         static_cast<VkFence>(VK_NULL_HANDLE));
+    render_submissions()->Submit(init_submit_info);
   }
 
  private:
@@ -358,8 +358,8 @@ class FillSample : public sample_application::Sample<FillFrameData> {
   virtual void Render(vulkan::VkQueue* queue, size_t frame_index,
                       FillFrameData* frame_data) override {
     // Update our uniform buffers.
-    camera_data_->UpdateBuffer(queue, frame_index);
-    model_data_->UpdateBuffer(queue, frame_index);
+    camera_data_->UpdateBuffer(render_submissions(), frame_index);
+    model_data_->UpdateBuffer(render_submissions(), frame_index);
 
     if (frame_number++ > 300) {
       VkSubmitInfo submit_info{
@@ -373,9 +373,7 @@ class FillSample : public sample_application::Sample<FillFrameData> {
           0,       // signalSemaphoreCount
           nullptr  // pSignalSemaphores
       };
-      app()->render_queue()->vkQueueSubmit(
-          app()->render_queue(), 1, &submit_info,
-          static_cast<VkFence>(VK_NULL_HANDLE));
+      render_submissions()->Submit(submit_info);
     }
 
     VkSubmitInfo init_submit_info{
@@ -390,9 +388,7 @@ class FillSample : public sample_application::Sample<FillFrameData> {
         nullptr  // pSignalSemaphores
     };
 
-    app()->render_queue()->vkQueueSubmit(app()->render_queue(), 1,
-                                         &init_submit_info,
-                                         static_cast<VkFence>(VK_NULL_HANDLE));
+    render_submissions()->Submit(init_submit_info);
   }
 
  private:
@@ -0,0 +1,485 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "application_sandbox/sample_application_framework/sample_application.h"
+#include "support/entry/entry.h"
+#include "vulkan_helpers/buffer_frame_data.h"
+#include "vulkan_helpers/helper_functions.h"
+#include "vulkan_helpers/parallel_command_recorder.h"
+#include "vulkan_helpers/vulkan_application.h"
+#include "vulkan_helpers/vulkan_model.h"
+
+#include <chrono>
+#include "mathfu/matrix.h"
+#include "mathfu/vector.h"
+
+using Mat44 = mathfu::Matrix<float, 4, 4>;
+using Vector4 = mathfu::Vector<float, 4>;
+
+namespace cube_model {
+#include "cube.obj.h"
+}
+const auto& cube_data = cube_model::model;
+
+uint32_t vertex_shader[] =
+#include "parallel_recording.vert.spv"
+    ;
+
+uint32_t fragment_shader[] =
+#include "parallel_recording.frag.spv"
+    ;
+
+// The cubes are laid out in a kGridSize x kGridSize grid, one draw each.
+const uint32_t kGridSize = 64;
+const uint32_t kNumDraws = kGridSize * kGridSize;
+// The draws are split into this many chunks, each recorded into its own
+// secondary command buffer.
+const uint32_t kNumChunks = 64;
+const uint32_t kDrawsPerChunk = kNumDraws / kNumChunks;
+// The number of frames rendered with one mode before switching to the next.
+const uint32_t kFramesPerMode = 300;
+
+// How many threads record the secondary command buffers, and whether the
+// frame is submitted and presented from the render thread or from the
+// framework's submission thread.
+enum class RecordingMode { kSerial, kParallel, kSubmissionThread };
+
+struct ParallelRecordingFrameData {
+  // Owned by the application's framebuffer cache.
+  ::VkFramebuffer framebuffer_;
+  // The dynamic offset of this frame's camera data.
+  uint32_t camera_offset_;
+};
+
+// This creates an application with 512MB of image memory, and defaults
+// for host, and device buffer sizes.
+class ParallelRecordingSample
+    : public sample_application::Sample<ParallelRecordingFrameData> {
+ public:
+  ParallelRecordingSample(const entry::EntryData* data,
+                          const VkPhysicalDeviceFeatures& optional_features)
+      : data_(data),
+        Sample<ParallelRecordingFrameData>(
+            data->allocator(), data, 1, 512, 1, 1,
+            sample_application::SampleOptions()
+                .EnableGpuProfiling()
+                .EnableSubmissionThread(),
+            {0}, optional_features),
+        cube_(data->allocator(), data->logger(), cube_data),
+        model_data_(kNumDraws, ModelData(), data->allocator()),
+        mode_(RecordingMode::kSerial),
+        frames_in_mode_(0),
+        record_time_in_mode_(0),
+        submit_time_in_mode_(0),
+        serial_microseconds_(0.0),
+        parallel_submit_microseconds_(0.0),
+        has_rendered_(false),
+        last_record_time_(0),
+        rotation_(0.0f) {}
+
+  virtual void InitializeApplicationData(
+      vulkan::VkCommandBuffer* initialization_buffer,
+      size_t num_swapchain_images) override {
+    cube_.InitializeData(app(), initialization_buffer);
+
+    descriptor_set_layout_ = {
+        0,                                          // binding
+        VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,  // descriptorType
+        1,                                          // descriptorCount
+        VK_SHADER_STAGE_VERTEX_BIT,                 // stageFlags
+        nullptr                                     // pImmutableSamplers
+    };
+
+    pipeline_layout_ = containers::make_unique<vulkan::PipelineLayout>(
+        data_->allocator(),
+        app()->CreatePipelineLayout(
+            {{descriptor_set_layout_}},
+            {{
+                VK_SHADER_STAGE_VERTEX_BIT,  // stageFlags
+                0,                           // offset
+                sizeof(ModelData)            // size
+            }}));
+
+    VkAttachmentReference color_attachment = {
+        0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+
+    render_pass_ = app()->GetCachedRenderPass(
+        {{
+            0,                                         // flags
+            render_format(),                           // format
+            num_samples(),                             // samples
+            VK_ATTACHMENT_LOAD_OP_CLEAR,               // loadOp
+            VK_ATTACHMENT_STORE_OP_STORE,              // storeOp
+            VK_ATTACHMENT_LOAD_OP_DONT_CARE,           // stenilLoadOp
+            VK_ATTACHMENT_STORE_OP_DONT_CARE,          // stenilStoreOp
+            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,  // initialLayout
+            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL   // finalLayout
+        }},  // AttachmentDescriptions
+        {{
+            0,                                // flags
+            VK_PIPELINE_BIND_POINT_GRAPHICS,  // pipelineBindPoint
+            0,                                // inputAttachmentCount
+            nullptr,                          // pInputAttachments
+            1,                                // colorAttachmentCount
+            &color_attachment,                // colorAttachment
+            nullptr,                          // pResolveAttachments
+            nullptr,                          // pDepthStencilAttachment
+            0,                                // preserveAttachmentCount
+            nullptr                           // pPreserveAttachments
+        }},                                   // SubpassDescriptions
+        {}                                    // SubpassDependencies
+        );
+
+    pipeline_ = containers::make_unique<vulkan::VulkanGraphicsPipeline>(
+        data_->allocator(),
+        app()->CreateGraphicsPipeline(pipeline_layout_.get(), render_pass_,
+                                      0));
+    pipeline_->AddShader(VK_SHADER_STAGE_VERTEX_BIT, "main", vertex_shader);
+    pipeline_->AddShader(VK_SHADER_STAGE_FRAGMENT_BIT, "main",
+                         fragment_shader);
+    pipeline_->SetTopology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+    pipeline_->SetInputStreams(&cube_);
+    pipeline_->SetViewport(viewport());
+    pipeline_->SetScissor(scissor());
+    pipeline_->SetSamples(num_samples());
+    pipeline_->AddAttachment();
+    pipeline_->Commit();
+
+    // The camera is written in place in mapped memory, and every frame
+    // selects its copy with a dynamic offset into one descriptor set, so
+    // updating it never adds a copy to the frame.
+    camera_data_ = containers::make_unique<vulkan::BufferFrameData<CameraData>>(
+        data_->allocator(), app(), num_swapchain_images,
+        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+        vulkan::BufferFrameDataMode::kMapped);
+
+    float aspect =
+        (float)app()->swapchain().width() / (float)app()->swapchain().height();
+    camera_data_->data().projection_matrix =
+        Mat44::FromScaleVector(mathfu::Vector<float, 3>{1.0f, -1.0f, 1.0f}) *
+        Mat44::Perspective(1.5708f, aspect, 0.1f, 100.0f);
+    camera_data_->MarkDirty();
+
+    camera_descriptor_set_ = containers::make_unique<vulkan::DescriptorSet>(
+        data_->allocator(),
+        app()->AllocateDescriptorSet({descriptor_set_layout_}));
+
+    VkDescriptorBufferInfo buffer_info = {
+        camera_data_->get_buffer(),  // buffer
+        0,                           // offset
+        camera_data_->size(),        // range
+    };
+
+    VkWriteDescriptorSet write = {
+        VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,     // sType
+        nullptr,                                    // pNext
+        *camera_descriptor_set_,                    // dstSet
+        0,                                          // dstbinding
+        0,                                          // dstArrayElement
+        1,                                          // descriptorCount
+        VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,  // descriptorType
+        nullptr,                                    // pImageInfo
+        &buffer_info,                               // pBufferInfo
+        nullptr,                                    // pTexelBufferView
+    };
+
+    app()->device()->vkUpdateDescriptorSets(app()->device(), 1, &write, 0,
+                                            nullptr);
+
+    // Both recorders produce exactly the same secondary command buffers, so
+    // the only difference between the modes is how many threads record
+    // them. A swapchain image is never rendered again until its previous
+    // frame has completed, so its index can be used as the recorder's frame.
+    const uint32_t num_frames = static_cast<uint32_t>(num_swapchain_images);
+    serial_recorder_ = containers::make_unique<vulkan::ParallelCommandRecorder>(
+        data_->allocator(), data_->allocator(), &app()->device(),
+        app()->render_queue().index(), num_frames, 1);
+    parallel_recorder_ =
+        containers::make_unique<vulkan::ParallelCommandRecorder>(
+            data_->allocator(), data_->allocator(), &app()->device(),
+            app()->render_queue().index(), num_frames);
+  }
+
+  virtual void InitializeFrameData(
+      ParallelRecordingFrameData* frame_data,
+      vulkan::VkCommandBuffer* initialization_buffer,
+      size_t frame_index) override {
+    frame_data->camera_offset_ = camera_data_->get_dynamic_offset(frame_index);
+
+    frame_data->framebuffer_ = app()->GetCachedFramebuffer(
+        render_pass_, {color_view(frame_data)}, app()->swapchain().width(),
+        app()->swapchain().height());
+  }
+
+  virtual void Update(float time_since_last_render) override {
+    // The submit time of a frame is only known once ProcessFrame() has
+    // returned, so each frame is accounted for at the start of the next.
+    if (has_rendered_) {
+      AccumulateStatistics(last_record_time_, last_submit_time());
+    }
+    const bool use_submission_thread =
+        mode_ == RecordingMode::kSubmissionThread;
+    if (uses_submission_thread() != use_submission_thread) {
+      UseSubmissionThread(use_submission_thread);
+    }
+
+    rotation_ += 3.14f * time_since_last_render;
+    const Mat44 rotation = Mat44::FromRotationMatrix(
+        Mat44::RotationX(rotation_) * Mat44::RotationY(rotation_ * 0.5f));
+    const Mat44 scale = Mat44::FromScaleVector(
+        mathfu::Vector<float, 3>{0.06f, 0.06f, 0.06f});
+    for (uint32_t y = 0; y < kGridSize; ++y) {
+      for (uint32_t x = 0; x < kGridSize; ++x) {
+        const float offset_x = (float(x) - (kGridSize - 1) * 0.5f) * 0.15f;
+        const float offset_y = (float(y) - (kGridSize - 1) * 0.5f) * 0.15f;
+        model_data_[y * kGridSize + x].transform =
+            Mat44::FromTranslationVector(
+                mathfu::Vector<float, 3>{offset_x, offset_y, -8.0f}) *
+            rotation * scale;
+      }
+    }
+  }
+
+  virtual void Render(vulkan::VkQueue* queue, size_t frame_index,
+                      ParallelRecordingFrameData* frame_data) override {
+    camera_data_->UpdateBuffer(render_submissions(), frame_index);
+
+    vulkan::VkCommandBuffer* command_buffer =
+        frame_command_buffers()->Get();
+    auto start = std::chrono::high_resolution_clock::now();
+    RecordCommandBuffer(frame_index, frame_data, command_buffer);
+    last_record_time_ = std::chrono::high_resolution_clock::now() - start;
+    has_rendered_ = true;
+
+    render_submissions()->Submit(command_buffer->get_command_buffer());
+  }
+
+  ~ParallelRecordingSample() {
+    serial_recorder_->LogStatistics(app()->GetLogger());
+    parallel_recorder_->LogStatistics(app()->GetLogger());
+  }
+
+ private:
+  struct CameraData {
+    Mat44 projection_matrix;
+  };
+
+  struct ModelData {
+    Mat44 transform;
+  };
+
+  // Records the frame into the given primary command buffer.
+  void RecordCommandBuffer(size_t frame_index,
+                           ParallelRecordingFrameData* frame_data,
+                           vulkan::VkCommandBuffer* command_buffer) {
+    vulkan::VkCommandBuffer& cmdBuffer = *command_buffer;
+    cmdBuffer->vkBeginCommandBuffer(cmdBuffer,
+                                    &sample_application::kBeginCommandBuffer);
+    // The secondary command buffers can only run inside the profiler's pass
+    // if they can inherit its queries. Otherwise the render pass is only
+    // timed.
+    if (app()->enabled_features().inheritedQueries == VK_TRUE) {
+      vulkan::GpuProfiler::Pass draw_pass(gpu_profiler(), &cmdBuffer, "Draws");
+      RecordRenderPass(frame_index, frame_data, VK_TRUE, &cmdBuffer);
+    } else {
+      vulkan::GpuProfiler::Scope draw_scope(gpu_profiler(), &cmdBuffer,
+                                            "Draws");
+      RecordRenderPass(frame_index, frame_data, VK_FALSE, &cmdBuffer);
+    }
+    cmdBuffer->vkEndCommandBuffer(cmdBuffer);
+  }
+
+  // Records the render pass, with the draws themselves recorded into
+  // secondary command buffers by the recorder for the current mode. If
+  // inherit_queries is VK_TRUE, the secondary command buffers inherit the
+  // queries of the profiler's pass around it, so that it can be checked that
+  // recording in parallel changes neither its GPU time nor the work it does.
+  void RecordRenderPass(size_t frame_index,
+                        ParallelRecordingFrameData* frame_data,
+                        VkBool32 inherit_queries,
+                        vulkan::VkCommandBuffer* command_buffer) {
+    vulkan::VkCommandBuffer& cmdBuffer = *command_buffer;
+
+    VkClearValue clear;
+    vulkan::MemoryClear(&clear);
+
+    VkRenderPassBeginInfo pass_begin = {
+        VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,  // sType
+        nullptr,                                   // pNext
+        render_pass_,                              // renderPass
+        frame_data->framebuffer_,                  // framebuffer
+        {{0, 0},
+         {app()->swapchain().width(),
+          app()->swapchain().height()}},  // renderArea
+        1,                                // clearValueCount
+        &clear                            // clears
+    };
+
+    cmdBuffer->vkCmdBeginRenderPass(
+        cmdBuffer, &pass_begin, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+    VkCommandBufferInheritanceInfo inheritance_info = {
+        VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,  // sType
+        nullptr,                                            // pNext
+        render_pass_,                                       // renderPass
+        0,                                                  // subpass
+        frame_data->framebuffer_,                           // framebuffer
+        inherit_queries,  // occlusionQueryEnable
+        0,                // queryFlags
+        inherit_queries ? gpu_profiler()->pipeline_statistics_flags()
+                        : 0,  // pipelineStatistics
+    };
+
+    vulkan::ParallelCommandRecorder* recorder =
+        mode_ == RecordingMode::kSerial ? serial_recorder_.get()
+                                        : parallel_recorder_.get();
+    recorder->Record(static_cast<uint32_t>(frame_index), &cmdBuffer,
+                     inheritance_info, kNumChunks,
+                     [this, frame_data](uint32_t chunk,
+                                        vulkan::VkCommandBuffer* secondary) {
+                       RecordChunk(chunk, frame_data, secondary);
+                     });
+
+    cmdBuffer->vkCmdEndRenderPass(cmdBuffer);
+  }
+
+  // Records the draws for one chunk of the grid. Secondary command buffers
+  // do not inherit any state, so each one binds its own pipeline and
+  // descriptor set, at the frame's offset.
+  void RecordChunk(uint32_t chunk, ParallelRecordingFrameData* frame_data,
+                   vulkan::VkCommandBuffer* command_buffer) {
+    vulkan::VkCommandBuffer& cmdBuffer = *command_buffer;
+    cmdBuffer->vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                 *pipeline_);
+    cmdBuffer->vkCmdBindDescriptorSets(
+        cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, *pipeline_layout_, 0, 1,
+        &camera_descriptor_set_->raw_set(), 1, &frame_data->camera_offset_);
+    for (uint32_t i = chunk * kDrawsPerChunk; i < (chunk + 1) * kDrawsPerChunk;
+         ++i) {
+      cmdBuffer.PushConstants(*pipeline_layout_, VK_SHADER_STAGE_VERTEX_BIT,
+                              model_data_[i]);
+      cube_.Draw(&cmdBuffer);
+    }
+  }
+
+  // Adds the cost of one frame to the current mode, and logs the averages
+  // and moves on to the next mode once the mode has run for kFramesPerMode
+  // frames.
+  void AccumulateStatistics(
+      std::chrono::high_resolution_clock::duration record_time,
+      std::chrono::high_resolution_clock::duration submit_time) {
+    record_time_in_mode_ += record_time;
+    submit_time_in_mode_ += submit_time;
+    if (++frames_in_mode_ < kFramesPerMode) {
+      return;
+    }
+    const double microseconds =
+        std::chrono::duration<double, std::micro>(record_time_in_mode_)
+            .count() /
+        frames_in_mode_;
+    const double submit_microseconds =
+        std::chrono::duration<double, std::micro>(submit_time_in_mode_)
+            .count() /
+        frames_in_mode_;
+    switch (mode_) {
+      case RecordingMode::kSerial:
+        app()->GetLogger()->LogInfo("Serial recording: ", microseconds,
+                                    "us of CPU recording time per frame of ",
+                                    kNumDraws, " draws, ",
+                                    submit_microseconds,
+                                    "us submitting and presenting");
+        serial_microseconds_ = microseconds;
+        break;
+      case RecordingMode::kParallel:
+        app()->GetLogger()->LogInfo(
+            "Parallel recording on ", parallel_recorder_->num_threads(),
+            " threads: ", microseconds,
+            "us of CPU recording time per frame of ", kNumDraws, " draws, ",
+            serial_microseconds_ / microseconds,
+            "x the speed of serial recording, ", submit_microseconds,
+            "us submitting and presenting");
+        parallel_submit_microseconds_ = submit_microseconds;
+        break;
+      case RecordingMode::kSubmissionThread:
+        app()->GetLogger()->LogInfo(
+            "Parallel recording with a submission thread: ", microseconds,
+            "us of CPU recording time per frame, ", submit_microseconds,
+            "us queuing the submit and present on the render thread, "
+            "compared to ",
+            parallel_submit_microseconds_, "us making them directly");
+        break;
+    }
+    gpu_profiler()->LogPassStatistics(app()->GetLogger());
+    LogPresentStatistics();
+    ResetPresentStatistics();
+
+    mode_ = mode_ == RecordingMode::kSerial
+                ? RecordingMode::kParallel
+                : mode_ == RecordingMode::kParallel
+                      ? RecordingMode::kSubmissionThread
+                      : RecordingMode::kSerial;
+    frames_in_mode_ = 0;
+    record_time_in_mode_ = std::chrono::high_resolution_clock::duration(0);
+    submit_time_in_mode_ = std::chrono::high_resolution_clock::duration(0);
+  }
+
+  const entry::EntryData* data_;
+  containers::unique_ptr<vulkan::PipelineLayout> pipeline_layout_;
+  containers::unique_ptr<vulkan::VulkanGraphicsPipeline> pipeline_;
+  // Owned by the application's render pass cache.
+  ::VkRenderPass render_pass_;
+  VkDescriptorSetLayoutBinding descriptor_set_layout_;
+  vulkan::VulkanModel cube_;
+
+  containers::unique_ptr<vulkan::BufferFrameData<CameraData>> camera_data_;
+  containers::unique_ptr<vulkan::DescriptorSet> camera_descriptor_set_;
+  containers::vector<ModelData> model_data_;
+  containers::unique_ptr<vulkan::ParallelCommandRecorder> serial_recorder_;
+  containers::unique_ptr<vulkan::ParallelCommandRecorder> parallel_recorder_;
+
+  RecordingMode mode_;
+  uint32_t frames_in_mode_;
+  std::chrono::high_resolution_clock::duration record_time_in_mode_;
+  std::chrono::high_resolution_clock::duration submit_time_in_mode_;
+  // The average recording time of the last serial run, which parallel
+  // recording is compared against.
+  double serial_microseconds_;
+  // The average submit time of the last parallel run, which the submission
+  // thread is compared against.
+  double parallel_submit_microseconds_;
+  // The recording time of the last frame, which is accounted for in the
+  // next Update().
+  bool has_rendered_;
+  std::chrono::high_resolution_clock::duration last_record_time_;
+  float rotation_;
+};
+
+int main_entry(const entry::EntryData* data) {
+  data->logger()->LogInfo("Application Startup");
+  VkPhysicalDeviceFeatures optional_features = {0};
+  // The draws are executed from secondary command buffers, so they can only
+  // be profiled as a pass if they can inherit its queries.
+  optional_features.inheritedQueries = VK_TRUE;
+  optional_features.pipelineStatisticsQuery = VK_TRUE;
+  ParallelRecordingSample sample(data, optional_features);
+  sample.Initialize();
+
+  while (!sample.should_exit() && !data->WindowClosing()) {
+    sample.ProcessFrame();
+  }
+  sample.WaitIdle();
+
+  data->logger()->LogInfo("Application Shutdown");
+  return 0;
+}
@@ -0,0 +1,495 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "application_sandbox/sample_application_framework/sample_application.h"
+#include "support/entry/entry.h"
+#include "vulkan_helpers/buffer_frame_data.h"
+#include "vulkan_helpers/descriptor_writer.h"
+#include "vulkan_helpers/helper_functions.h"
+#include "vulkan_helpers/vulkan_application.h"
+#include "vulkan_helpers/vulkan_model.h"
+
+#include <chrono>
+#include <cstddef>
+#include "mathfu/matrix.h"
+#include "mathfu/vector.h"
+
+using Mat44 = mathfu::Matrix<float, 4, 4>;
+using Vector4 = mathfu::Vector<float, 4>;
+
+namespace cube_model {
+#include "cube.obj.h"
+}
+const auto& cube_data = cube_model::model;
+
+uint32_t push_constant_vertex_shader[] =
+#include "push_constant.vert.spv"
+    ;
+
+uint32_t uniform_buffer_vertex_shader[] =
+#include "uniform_buffer.vert.spv"
+    ;
+
+uint32_t fragment_shader[] =
+#include "push_constant_benchmark.frag.spv"
+    ;
+
+// The cubes are laid out in a kGridSize x kGridSize grid, one draw each.
+const uint32_t kGridSize = 16;
+const uint32_t kNumDraws = kGridSize * kGridSize;
+// The number of frames rendered with one mode before switching to the other.
+const uint32_t kFramesPerMode = 300;
+// The spec guarantees minUniformBufferOffsetAlignment is at most 256, so
+// model transforms placed this far apart can always be selected with a
+// dynamic offset.
+const VkDeviceSize kModelStride = 256;
+
+// How the per-draw model transform reaches the vertex shader.
+enum class ModelDataMode { kUniformBuffer, kPushConstant };
+
+struct PushConstantBenchmarkFrameData {
+  containers::unique_ptr<vulkan::VkCommandBuffer> command_buffer_;
+  // Owned by the application's framebuffer cache.
+  ::VkFramebuffer framebuffer_;
+  containers::unique_ptr<vulkan::DescriptorSet> descriptor_set_;
+  // Holds kNumDraws model transforms, kModelStride bytes apart.
+  containers::unique_ptr<vulkan::VulkanApplication::Buffer> model_buffer_;
+};
+
+// This creates an application with 512MB of image memory, and defaults
+// for host, and device buffer sizes.
+class PushConstantBenchmarkSample
+    : public sample_application::Sample<PushConstantBenchmarkFrameData> {
+ public:
+  PushConstantBenchmarkSample(const entry::EntryData* data)
+      : data_(data),
+        Sample<PushConstantBenchmarkFrameData>(
+            data->allocator(), data, 1, 512, 1, 1,
+            sample_application::SampleOptions()),
+        cube_(data->allocator(), data->logger(), cube_data),
+        model_data_(kNumDraws, ModelData(), data->allocator()),
+        mode_(ModelDataMode::kUniformBuffer),
+        frames_in_mode_(0),
+        record_time_in_mode_(0),
+        barriers_in_mode_(0),
+        rotation_(0.0f) {}
+
+  virtual void InitializeApplicationData(
+      vulkan::VkCommandBuffer* initialization_buffer,
+      size_t num_swapchain_images) override {
+    cube_.InitializeData(app(), initialization_buffer);
+
+    descriptor_set_layouts_[0] = {
+        0,                                  // binding
+        VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,  // descriptorType
+        1,                                  // descriptorCount
+        VK_SHADER_STAGE_VERTEX_BIT,         // stageFlags
+        nullptr                             // pImmutableSamplers
+    };
+    descriptor_set_layouts_[1] = {
+        1,                                          // binding
+        VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,  // descriptorType
+        1,                                          // descriptorCount
+        VK_SHADER_STAGE_VERTEX_BIT,                 // stageFlags
+        nullptr                                     // pImmutableSamplers
+    };
+
+    // Both modes share the descriptor set layout, so that the only
+    // difference in the recorded commands is how the transform is passed.
+    uniform_buffer_pipeline_layout_ =
+        containers::make_unique<vulkan::PipelineLayout>(
+            data_->allocator(),
+            app()->CreatePipelineLayout(
+                {{descriptor_set_layouts_[0], descriptor_set_layouts_[1]}}));
+    push_constant_pipeline_layout_ =
+        containers::make_unique<vulkan::PipelineLayout>(
+            data_->allocator(),
+            app()->CreatePipelineLayout(
+                {{descriptor_set_layouts_[0], descriptor_set_layouts_[1]}},
+                {{
+                    VK_SHADER_STAGE_VERTEX_BIT,  // stageFlags
+                    0,                           // offset
+                    sizeof(ModelData)            // size
+                }}));
+
+    VkAttachmentReference color_attachment = {
+        0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+
+    render_pass_ = app()->GetCachedRenderPass(
+        {{
+            0,                                         // flags
+            render_format(),                           // format
+            num_samples(),                             // samples
+            VK_ATTACHMENT_LOAD_OP_CLEAR,               // loadOp
+            VK_ATTACHMENT_STORE_OP_STORE,              // storeOp
+            VK_ATTACHMENT_LOAD_OP_DONT_CARE,           // stenilLoadOp
+            VK_ATTACHMENT_STORE_OP_DONT_CARE,          // stenilStoreOp
+            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,  // initialLayout
+            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL   // finalLayout
+        }},  // AttachmentDescriptions
+        {{
+            0,                                // flags
+            VK_PIPELINE_BIND_POINT_GRAPHICS,  // pipelineBindPoint
+            0,                                // inputAttachmentCount
+            nullptr,                          // pInputAttachments
+            1,                                // colorAttachmentCount
+            &color_attachment,                // colorAttachment
+            nullptr,                          // pResolveAttachments
+            nullptr,                          // pDepthStencilAttachment
+            0,                                // preserveAttachmentCount
+            nullptr                           // pPreserveAttachments
+        }},                                   // SubpassDescriptions
+        {}                                    // SubpassDependencies
+        );
+
+    uniform_buffer_pipeline_ = CreatePipeline(
+        uniform_buffer_pipeline_layout_.get(), uniform_buffer_vertex_shader);
+    push_constant_pipeline_ = CreatePipeline(
+        push_constant_pipeline_layout_.get(), push_constant_vertex_shader);
+
+    camera_data_ = containers::make_unique<vulkan::BufferFrameData<CameraData>>(
+        data_->allocator(), app(), num_swapchain_images,
+        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+
+    float aspect =
+        (float)app()->swapchain().width() / (float)app()->swapchain().height();
+    camera_data_->data().projection_matrix =
+        Mat44::FromScaleVector(mathfu::Vector<float, 3>{1.0f, -1.0f, 1.0f}) *
+        Mat44::Perspective(1.5708f, aspect, 0.1f, 100.0f);
+
+    descriptor_template_ = CreateDescriptorTemplate(
+        app()->HasDeviceExtension(
+            VK_KHR_DESCRIPTOR_UPDATE_TEMPLATE_EXTENSION_NAME));
+    fallback_descriptor_template_ = CreateDescriptorTemplate(false);
+    app()->GetLogger()->LogInfo(
+        "Descriptor sets are written with ",
+        descriptor_template_->uses_extension()
+            ? "VK_KHR_descriptor_update_template and vkUpdateDescriptorSets"
+            : "vkUpdateDescriptorSets only");
+  }
+
+  virtual void InitializeFrameData(
+      PushConstantBenchmarkFrameData* frame_data,
+      vulkan::VkCommandBuffer* initialization_buffer,
+      size_t frame_index) override {
+    frame_data->command_buffer_ =
+        containers::make_unique<vulkan::VkCommandBuffer>(
+            data_->allocator(), app()->GetCommandBuffer());
+
+    frame_data->model_buffer_ =
+        app()->CreateAndBindDefaultExclusiveDeviceBuffer(
+            kModelStride * kNumDraws, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT |
+                                          VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+
+    frame_data->descriptor_set_ =
+        containers::make_unique<vulkan::DescriptorSet>(
+            data_->allocator(),
+            app()->AllocateDescriptorSet(
+                {descriptor_set_layouts_[0], descriptor_set_layouts_[1]}));
+
+    const DescriptorData descriptor_data = {
+        {
+            camera_data_->get_buffer(),                       // buffer
+            camera_data_->get_offset_for_frame(frame_index),  // offset
+            camera_data_->size(),                             // range
+        },
+        {
+            *frame_data->model_buffer_,  // buffer
+            0,                           // offset
+            sizeof(ModelData),           // range
+        }};
+    // Every other frame is written through the fallback, so that both ways
+    // of applying a template are used even if the extension is supported.
+    vulkan::DescriptorUpdateTemplate* update_template =
+        frame_index % 2 ? fallback_descriptor_template_.get()
+                        : descriptor_template_.get();
+    update_template->Update(*frame_data->descriptor_set_, &descriptor_data);
+
+    frame_data->framebuffer_ = app()->GetCachedFramebuffer(
+        render_pass_, {color_view(frame_data)}, app()->swapchain().width(),
+        app()->swapchain().height());
+  }
+
+  virtual void Update(float time_since_last_render) override {
+    rotation_ += 3.14f * time_since_last_render;
+    const Mat44 rotation = Mat44::FromRotationMatrix(
+        Mat44::RotationX(rotation_) * Mat44::RotationY(rotation_ * 0.5f));
+    const Mat44 scale = Mat44::FromScaleVector(
+        mathfu::Vector<float, 3>{0.25f, 0.25f, 0.25f});
+    for (uint32_t y = 0; y < kGridSize; ++y) {
+      for (uint32_t x = 0; x < kGridSize; ++x) {
+        const float offset_x = (float(x) - (kGridSize - 1) * 0.5f) * 0.6f;
+        const float offset_y = (float(y) - (kGridSize - 1) * 0.5f) * 0.6f;
+        model_data_[y * kGridSize + x].transform =
+            Mat44::FromTranslationVector(
+                mathfu::Vector<float, 3>{offset_x, offset_y, -8.0f}) *
+            rotation * scale;
+      }
+    }
+  }
+
+  virtual void Render(vulkan::VkQueue* queue, size_t frame_index,
+                      PushConstantBenchmarkFrameData* frame_data) override {
+    // The camera only needs to be copied when it changes, and not at all
+    // with unified memory.
+    uint32_t num_barriers =
+        camera_data_->UpdateBuffer(render_submissions(), frame_index)
+            ? vulkan::BufferFrameData<CameraData>::kBarriersPerUpdate
+            : 0;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    num_barriers += RecordCommandBuffer(frame_data);
+    auto end = std::chrono::high_resolution_clock::now();
+    AccumulateStatistics(end - start, num_barriers);
+
+    VkSubmitInfo init_submit_info{
+        VK_STRUCTURE_TYPE_SUBMIT_INFO,  // sType
+        nullptr,                        // pNext
+        0,                              // waitSemaphoreCount
+        nullptr,                        // pWaitSemaphores
+        nullptr,                        // pWaitDstStageMask,
+        1,                              // commandBufferCount
+        &(frame_data->command_buffer_->get_command_buffer()),
+        0,       // signalSemaphoreCount
+        nullptr  // pSignalSemaphores
+    };
+
+    render_submissions()->Submit(init_submit_info);
+  }
+
+ private:
+  struct CameraData {
+    Mat44 projection_matrix;
+  };
+
+  struct ModelData {
+    Mat44 transform;
+  };
+
+  // The descriptors of a frame's set, as written by its update template.
+  struct DescriptorData {
+    VkDescriptorBufferInfo camera;
+    VkDescriptorBufferInfo model;
+  };
+
+  // Creates an update template for the descriptor sets of the frames, which
+  // only uses VK_KHR_descriptor_update_template if use_extension is true.
+  containers::unique_ptr<vulkan::DescriptorUpdateTemplate>
+  CreateDescriptorTemplate(bool use_extension) {
+    std::initializer_list<VkDescriptorUpdateTemplateEntryKHR> entries = {
+        {
+            0,                                  // dstBinding
+            0,                                  // dstArrayElement
+            1,                                  // descriptorCount
+            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,  // descriptorType
+            offsetof(DescriptorData, camera),   // offset
+            sizeof(VkDescriptorBufferInfo)      // stride
+        },
+        {
+            1,                                          // dstBinding
+            0,                                          // dstArrayElement
+            1,                                          // descriptorCount
+            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,  // descriptorType
+            offsetof(DescriptorData, model),            // offset
+            sizeof(VkDescriptorBufferInfo)              // stride
+        }};
+    return containers::make_unique<vulkan::DescriptorUpdateTemplate>(
+        data_->allocator(), data_->allocator(), &app()->device(),
+        use_extension,
+        app()->GetCachedDescriptorSetLayout(
+            {descriptor_set_layouts_[0], descriptor_set_layouts_[1]}),
+        entries);
+  }
+
+  // Creates a pipeline drawing cube_ with the given layout and vertex shader.
+  template <int N>
+  containers::unique_ptr<vulkan::VulkanGraphicsPipeline> CreatePipeline(
+      vulkan::PipelineLayout* layout, uint32_t (&vertex_shader)[N]) {
+    containers::unique_ptr<vulkan::VulkanGraphicsPipeline> pipeline =
+        containers::make_unique<vulkan::VulkanGraphicsPipeline>(
+            data_->allocator(),
+            app()->CreateGraphicsPipeline(layout, render_pass_, 0));
+    pipeline->AddShader(VK_SHADER_STAGE_VERTEX_BIT, "main", vertex_shader);
+    pipeline->AddShader(VK_SHADER_STAGE_FRAGMENT_BIT, "main",
+                        fragment_shader);
+    pipeline->SetTopology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+    pipeline->SetInputStreams(&cube_);
+    pipeline->SetViewport(viewport());
+    pipeline->SetScissor(scissor());
+    pipeline->SetSamples(num_samples());
+    pipeline->AddAttachment();
+    pipeline->Commit();
+    return pipeline;
+  }
+
+  // Records the draws for the current mode, and returns the number of
+  // pipeline barriers that were recorded.
+  uint32_t RecordCommandBuffer(PushConstantBenchmarkFrameData* frame_data) {
+    vulkan::VkCommandBuffer& cmdBuffer = (*frame_data->command_buffer_);
+    cmdBuffer->vkBeginCommandBuffer(cmdBuffer,
+                                    &sample_application::kBeginCommandBuffer);
+    uint32_t num_barriers = 0;
+
+    const bool use_push_constants = mode_ == ModelDataMode::kPushConstant;
+    ::VkPipelineLayout layout =
+        use_push_constants
+            ? ::VkPipelineLayout(*push_constant_pipeline_layout_)
+            : ::VkPipelineLayout(*uniform_buffer_pipeline_layout_);
+
+    if (!use_push_constants) {
+      // Transfers are not allowed inside a render pass, so every transform
+      // is written up front, and then made visible to the vertex shader by a
+      // single barrier.
+      for (uint32_t i = 0; i < kNumDraws; ++i) {
+        cmdBuffer->vkCmdUpdateBuffer(cmdBuffer, *frame_data->model_buffer_,
+                                     i * kModelStride, sizeof(ModelData),
+                                     &model_data_[i]);
+      }
+      VkBufferMemoryBarrier barrier = {
+          VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,  // sType
+          nullptr,                                  // pNext
+          VK_ACCESS_TRANSFER_WRITE_BIT,             // srcAccessMask
+          VK_ACCESS_UNIFORM_READ_BIT,               // dstAccessMask
+          VK_QUEUE_FAMILY_IGNORED,                  // srcQueueFamilyIndex
+          VK_QUEUE_FAMILY_IGNORED,                  // dstQueueFamilyIndex
+          *frame_data->model_buffer_,               // buffer
+          0,                                        // offset
+          kNumDraws * kModelStride,                 // size
+      };
+      cmdBuffer->vkCmdPipelineBarrier(
+          cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+          VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 0, nullptr, 1, &barrier, 0,
+          nullptr);
+      ++num_barriers;
+    }
+
+    VkClearValue clear;
+    vulkan::MemoryClear(&clear);
+
+    VkRenderPassBeginInfo pass_begin = {
+        VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,  // sType
+        nullptr,                                   // pNext
+        render_pass_,                              // renderPass
+        frame_data->framebuffer_,                  // framebuffer
+        {{0, 0},
+         {app()->swapchain().width(),
+          app()->swapchain().height()}},  // renderArea
+        1,                                // clearValueCount
+        &clear                            // clears
+    };
+
+    cmdBuffer->vkCmdBeginRenderPass(cmdBuffer, &pass_begin,
+                                    VK_SUBPASS_CONTENTS_INLINE);
+    cmdBuffer->vkCmdBindPipeline(
+        cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+        use_push_constants ? *push_constant_pipeline_
+                           : *uniform_buffer_pipeline_);
+
+    if (use_push_constants) {
+      // The push constant shader never reads binding 1, so the descriptor
+      // set is bound once at offset 0.
+      const uint32_t dynamic_offset = 0;
+      cmdBuffer->vkCmdBindDescriptorSets(
+          cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1,
+          &frame_data->descriptor_set_->raw_set(), 1, &dynamic_offset);
+    }
+
+    for (uint32_t i = 0; i < kNumDraws; ++i) {
+      if (use_push_constants) {
+        cmdBuffer.PushConstants(layout, VK_SHADER_STAGE_VERTEX_BIT,
+                                model_data_[i]);
+      } else {
+        const uint32_t dynamic_offset =
+            static_cast<uint32_t>(i * kModelStride);
+        cmdBuffer->vkCmdBindDescriptorSets(
+            cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1,
+            &frame_data->descriptor_set_->raw_set(), 1, &dynamic_offset);
+      }
+      cube_.Draw(&cmdBuffer);
+    }
+    cmdBuffer->vkCmdEndRenderPass(cmdBuffer);
+
+    cmdBuffer->vkEndCommandBuffer(cmdBuffer);
+    return num_barriers;
+  }
+
+  // Adds the cost of one frame to the current mode, and logs the averages
+  // once the mode has run for kFramesPerMode frames.
+  void AccumulateStatistics(std::chrono::high_resolution_clock::duration time,
+                            uint32_t num_barriers) {
+    record_time_in_mode_ += time;
+    barriers_in_mode_ += num_barriers;
+    if (++frames_in_mode_ < kFramesPerMode) {
+      return;
+    }
+    const double microseconds =
+        std::chrono::duration<double, std::micro>(record_time_in_mode_)
+            .count();
+    app()->GetLogger()->LogInfo(
+        mode_ == ModelDataMode::kPushConstant ? "Push constants: "
+                                              : "Uniform buffer: ",
+        microseconds / (double(frames_in_mode_) * kNumDraws),
+        "us of CPU recording time per draw, ",
+        double(barriers_in_mode_) / frames_in_mode_, " barriers per frame");
+
+    mode_ = mode_ == ModelDataMode::kPushConstant
+                ? ModelDataMode::kUniformBuffer
+                : ModelDataMode::kPushConstant;
+    frames_in_mode_ = 0;
+    record_time_in_mode_ = std::chrono::high_resolution_clock::duration(0);
+    barriers_in_mode_ = 0;
+  }
+
+  const entry::EntryData* data_;
+  containers::unique_ptr<vulkan::PipelineLayout>
+      uniform_buffer_pipeline_layout_;
+  containers::unique_ptr<vulkan::PipelineLayout> push_constant_pipeline_layout_;
+  containers::unique_ptr<vulkan::VulkanGraphicsPipeline>
+      uniform_buffer_pipeline_;
+  containers::unique_ptr<vulkan::VulkanGraphicsPipeline>
+      push_constant_pipeline_;
+  // Owned by the application's render pass cache.
+  ::VkRenderPass render_pass_;
+  VkDescriptorSetLayoutBinding descriptor_set_layouts_[2];
+  // Writes the descriptor sets with VK_KHR_descriptor_update_template if the
+  // device supports it, and the fallback always with vkUpdateDescriptorSets.
+  containers::unique_ptr<vulkan::DescriptorUpdateTemplate>
+      descriptor_template_;
+  containers::unique_ptr<vulkan::DescriptorUpdateTemplate>
+      fallback_descriptor_template_;
+  vulkan::VulkanModel cube_;
+
+  containers::unique_ptr<vulkan::BufferFrameData<CameraData>> camera_data_;
+  containers::vector<ModelData> model_data_;
+
+  ModelDataMode mode_;
+  uint32_t frames_in_mode_;
+  std::chrono::high_resolution_clock::duration record_time_in_mode_;
+  uint64_t barriers_in_mode_;
+  float rotation_;
+};
+
+int main_entry(const entry::EntryData* data) {
+  data->logger()->LogInfo("Application Startup");
+  PushConstantBenchmarkSample sample(data);
+  sample.Initialize();
+
+  while (!sample.should_exit() && !data->WindowClosing()) {
+    sample.ProcessFrame();
+  }
+  sample.WaitIdle();
+
+  data->logger()->LogInfo("Application Shutdown");
+  return 0;
+}
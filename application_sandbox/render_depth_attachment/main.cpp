@@ -221,7 +221,7 @@ class RenderQuadSample
     rendering_output_pipeline_->SetViewport(viewport());
     rendering_output_pipeline_->SetSamples(num_samples());
     rendering_output_pipeline_->AddAttachment();
-    rendering_output_pipeline_->Commit();
+    CommitPipeline(rendering_output_pipeline_.get());
 
     // Create the renderpass for populating the attachment images.
     o_att_desc.format = VK_FORMAT_D16_UNORM;
@@ -268,7 +268,7 @@ class RenderQuadSample
     populating_attachments_pipeline_->SetViewport(viewport());
     populating_attachments_pipeline_->SetSamples(VK_SAMPLE_COUNT_1_BIT);
     populating_attachments_pipeline_->DepthStencilState().depthCompareOp = VK_COMPARE_OP_ALWAYS;
-    populating_attachments_pipeline_->Commit();
+    CommitPipeline(populating_attachments_pipeline_.get());
 
     depth_data_ = containers::make_unique<vulkan::BufferFrameData<DepthData>>(
         data_->allocator(), app(), num_swapchain_images,
@@ -608,7 +608,7 @@ class RenderQuadSample
   virtual void Render(vulkan::VkQueue* queue, size_t frame_index,
                       RenderInputAttachmentFrameData* frame_data) override {
     if (frame_data->render_counter_ == 0) {
-      depth_data_->UpdateBuffer(queue, frame_index);
+      depth_data_->UpdateBuffer(render_submissions(), frame_index);
       ::VkCommandBuffer cmd_bufs[2] = {
           frame_data->initial_rendering_command_buffer_->get_command_buffer(),
           frame_data->followup_command_buffer_->get_command_buffer()};
@@ -621,9 +621,7 @@ class RenderQuadSample
                                     cmd_bufs,
                                     0,
                                     nullptr};
-      app()->render_queue()->vkQueueSubmit(
-          app()->render_queue(), 1, &init_submit_info,
-          static_cast<VkFence>(VK_NULL_HANDLE));
+      render_submissions()->Submit(init_submit_info);
     } else {
       VkSubmitInfo init_submit_info{
           VK_STRUCTURE_TYPE_SUBMIT_INFO,  // sType
@@ -636,9 +634,7 @@ class RenderQuadSample
           0,       // signalSemaphoreCount
           nullptr  // pSignalSemaphores
       };
-      app()->render_queue()->vkQueueSubmit(
-          app()->render_queue(), 1, &init_submit_info,
-          static_cast<VkFence>(VK_NULL_HANDLE));
+      render_submissions()->Submit(init_submit_info);
     }
     frame_data->render_counter_++;
   }
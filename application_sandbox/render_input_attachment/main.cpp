@@ -221,7 +221,7 @@ class RenderQuadSample
     rendering_output_pipeline_->SetViewport(viewport());
     rendering_output_pipeline_->SetSamples(num_samples());
     rendering_output_pipeline_->AddAttachment();
-    rendering_output_pipeline_->Commit();
+    CommitPipeline(rendering_output_pipeline_.get());
 
     // Create the renderpass for populating the attachment images.
     o_c_att_desc.format = VK_FORMAT_R8G8B8A8_UINT;
@@ -261,7 +261,7 @@ class RenderQuadSample
     populating_attachments_pipeline_->SetViewport(viewport());
     populating_attachments_pipeline_->SetSamples(VK_SAMPLE_COUNT_1_BIT);
     populating_attachments_pipeline_->AddAttachment();
-    populating_attachments_pipeline_->Commit();
+    CommitPipeline(populating_attachments_pipeline_.get());
 
     color_data_ = containers::make_unique<vulkan::BufferFrameData<ColorData>>(
         data_->allocator(), app(), num_swapchain_images,
@@ -395,20 +395,11 @@ class RenderQuadSample
         *frame_data->trans_dst_img_view_,          // imageView
         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,  // imageLayout
     };
-    VkWriteDescriptorSet write{
-        VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,               // sType
-        nullptr,                                              // pNext
-        *frame_data->populating_attachments_descriptor_set_,  // dstSet
-        0,                                                    // dstBinding
-        0,                                                    // dstArrayElement
-        1,                                                    // descriptorCount
-        VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,                  // descriptorType
-        &input_attachment_info,                               // pImageInfo
-        nullptr,                                              // pBufferInfo
-        nullptr,  // pTexelBufferView
-    };
-    app()->device()->vkUpdateDescriptorSets(app()->device(), 1, &write, 0,
-                                            nullptr);
+    // Both sets are updated with a single vkUpdateDescriptorSets call.
+    vulkan::DescriptorWriter writer(data_->allocator(), &app()->device());
+    writer.WriteImages(*frame_data->populating_attachments_descriptor_set_, 0,
+                       VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,
+                       {input_attachment_info});
 
     // Update the descripotors used for rendering output
     frame_data->rendering_output_descriptor_set_ =
@@ -416,9 +407,10 @@ class RenderQuadSample
             data_->allocator(),
             app()->AllocateDescriptorSet({descriptor_set_layout_binding_}));
     input_attachment_info.imageView = *frame_data->attachment_img_view_;
-    write.dstSet = *frame_data->rendering_output_descriptor_set_;
-    app()->device()->vkUpdateDescriptorSets(app()->device(), 1, &write, 0,
-                                            nullptr);
+    writer.WriteImages(*frame_data->rendering_output_descriptor_set_, 0,
+                       VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,
+                       {input_attachment_info});
+    writer.Flush();
 
     // Recording the attachment populating commands: 1) copy data to trans_dst
     // images, 2) render trans_dst image to color attachment image.
@@ -598,7 +590,7 @@ class RenderQuadSample
   virtual void Render(vulkan::VkQueue* queue, size_t frame_index,
                       RenderInputAttachmentFrameData* frame_data) override {
     if (frame_data->render_counter_ == 0) {
-      color_data_->UpdateBuffer(queue, frame_index);
+      color_data_->UpdateBuffer(render_submissions(), frame_index);
       ::VkCommandBuffer cmd_bufs[2] = {
           frame_data->initial_rendering_command_buffer_->get_command_buffer(),
           frame_data->followup_command_buffer_->get_command_buffer()};
@@ -611,9 +603,7 @@ class RenderQuadSample
                                     cmd_bufs,
                                     0,
                                     nullptr};
-      app()->render_queue()->vkQueueSubmit(
-          app()->render_queue(), 1, &init_submit_info,
-          static_cast<VkFence>(VK_NULL_HANDLE));
+      render_submissions()->Submit(init_submit_info);
     } else {
       VkSubmitInfo init_submit_info{
           VK_STRUCTURE_TYPE_SUBMIT_INFO,  // sType
@@ -626,9 +616,7 @@ class RenderQuadSample
           0,       // signalSemaphoreCount
           nullptr  // pSignalSemaphores
       };
-      app()->render_queue()->vkQueueSubmit(
-          app()->render_queue(), 1, &init_submit_info,
-          static_cast<VkFence>(VK_NULL_HANDLE));
+      render_submissions()->Submit(init_submit_info);
     }
     frame_data->render_counter_++;
   }
@@ -527,8 +527,8 @@ class RenderQuadSample
 
   virtual void Render(vulkan::VkQueue* queue, size_t frame_index,
                       RenderQuadFrameData* frame_data) override {
-    color_data_->UpdateBuffer(queue, frame_index);
-    depth_data_->UpdateBuffer(queue, frame_index);
+    color_data_->UpdateBuffer(render_submissions(), frame_index);
+    depth_data_->UpdateBuffer(render_submissions(), frame_index);
     VkSubmitInfo init_submit_info{
         VK_STRUCTURE_TYPE_SUBMIT_INFO,  // sType
         nullptr,                        // pNext
@@ -541,9 +541,7 @@ class RenderQuadSample
         nullptr  // pSignalSemaphores
     };
 
-    app()->render_queue()->vkQueueSubmit(app()->render_queue(), 1,
-                                         &init_submit_info,
-                                         static_cast<VkFence>(VK_NULL_HANDLE));
+    render_submissions()->Submit(init_submit_info);
   }
 
  private:
@@ -16,11 +16,20 @@
 #define SAMPLE_APPLICATION_FRAMEWORK_SAMPLE_APPLICATION_H_
 
 #include "support/entry/entry.h"
+#include "vulkan_helpers/command_buffer_ring.h"
+#include "vulkan_helpers/gpu_profiler.h"
 #include "vulkan_helpers/helper_functions.h"
+#include "vulkan_helpers/pipeline_build_queue.h"
+#include "vulkan_helpers/submission_batcher.h"
+#include "vulkan_helpers/submission_thread.h"
+#include "vulkan_helpers/upload_manager.h"
 #include "vulkan_helpers/vulkan_application.h"
 
+#include <algorithm>
 #include <chrono>
 #include <cstddef>
+#include <mutex>
+#include <thread>
 
 namespace sample_application {
 
@@ -34,6 +43,33 @@ struct SampleOptions {
   bool verbose_output = false;
   bool async_compute = false;
   bool sparse_binding = false;
+  // The number of frames the CPU may run ahead of the GPU. Each frame in
+  // flight has its own fence, acquire semaphore and transient descriptor
+  // sets, and the depth and multisampled targets are shared between the
+  // swapchain images so that only this many of them exist.
+  // 0 means one frame in flight per swapchain image.
+  uint32_t frames_in_flight = 0;
+  // Measures the GPU time of every frame, and of any scope or pass that the
+  // sample adds with gpu_profiler(). Passes also collect pipeline statistics
+  // if the sample enables the pipelineStatisticsQuery device feature.
+  bool gpu_profiling = false;
+  // Makes the frame's vkQueueSubmit and vkQueuePresentKHR calls on a
+  // separate thread, so that the time they take in the driver does not hold
+  // up the next frame. All work for the render and present queues must then
+  // be queued through render_submissions(), and anything that uses the
+  // queues directly must call WaitForSubmissions() first. It can be turned
+  // off and on again with UseSubmissionThread().
+  bool submission_thread = false;
+  // The present mode and number of images that the swapchain should use,
+  // if the surface supports them. -present-mode= and -swapchain-images= on
+  // the command line override these. VK_PRESENT_MODE_MAX_ENUM_KHR and 0
+  // leave the choice to the surface.
+  VkPresentModeKHR present_mode = VK_PRESENT_MODE_MAX_ENUM_KHR;
+  uint32_t swapchain_images = 0;
+  // Makes the copies that app()->upload_manager() flushes on a transfer-only
+  // queue, if the device has one, so that streaming data does not hold up
+  // rendering. The frame then waits for them with a semaphore.
+  bool transfer_queue = false;
 
   SampleOptions& EnableMultisampling() {
     enable_multisampling = true;
@@ -55,8 +91,51 @@ struct SampleOptions {
     sparse_binding = true;
     return *this;
   }
+  SampleOptions& SetFramesInFlight(uint32_t num_frames) {
+    frames_in_flight = num_frames;
+    return *this;
+  }
+  SampleOptions& EnableGpuProfiling() {
+    gpu_profiling = true;
+    return *this;
+  }
+  SampleOptions& EnableSubmissionThread() {
+    submission_thread = true;
+    return *this;
+  }
+  SampleOptions& SetPresentMode(VkPresentModeKHR mode) {
+    present_mode = mode;
+    return *this;
+  }
+  SampleOptions& SetSwapchainImages(uint32_t num_images) {
+    swapchain_images = num_images;
+    return *this;
+  }
+  SampleOptions& EnableTransferQueue() {
+    transfer_queue = true;
+    return *this;
+  }
+};
+
+// Proxies for the latency between a frame reading its input and the frame
+// being shown, gathered over a number of frames.
+struct PresentStatistics {
+  uint64_t frames;
+  // The CPU time spent waiting in vkAcquireNextImageKHR.
+  std::chrono::high_resolution_clock::duration acquire_time;
+  // The CPU time from the start of the acquire to the present being made,
+  // or queued on the submission thread.
+  std::chrono::high_resolution_clock::duration acquire_to_present_time;
+  std::chrono::high_resolution_clock::duration max_acquire_to_present_time;
+  // The number of frames, including the one just presented, that the GPU
+  // had not finished when each frame was presented.
+  uint64_t queue_depth_total;
+  uint32_t max_queue_depth;
 };
 
+// The name of the GPU profiler scope that covers a whole frame.
+const char* const kGpuFrameScope = "Frame";
+
 const VkCommandBufferBeginInfo kBeginCommandBuffer = {
     VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,  // sType
     nullptr,                                      // pNext
@@ -88,6 +167,33 @@ const VkSubmitInfo kEmptySubmitInfo{
 
 template <typename FrameData>
 class Sample {
+  // The depth and multisampled render targets. These are shared by every
+  // swapchain image whose index is the same modulo the number of targets.
+  struct RenderTargets {
+    // The depth_stencil image, if it exists.
+    vulkan::ImagePointer depth_stencil_;
+    // The multisampled render target if it exists.
+    vulkan::ImagePointer multisampled_target_;
+  };
+
+  // The data for one frame that the CPU is recording or that the GPU has not
+  // finished yet. These are used round-robin, independently of which
+  // swapchain image is acquired.
+  // The fences and semaphores come from the application's SyncObjectPool,
+  // which destroys them along with the application.
+  struct FrameContext {
+    // Signalled once the GPU has finished the last frame that used this
+    // context.
+    ::VkFence ready_fence_;
+    // Set once a frame has been submitted with ready_fence_.
+    bool submitted_;
+    // The semaphore that the swapchain image is acquired with.
+    ::VkSemaphore ready_semaphore_;
+    // Descriptor sets that only live for a single frame. These are all
+    // returned when the context is reused.
+    containers::unique_ptr<vulkan::DescriptorAllocator> transient_descriptors_;
+  };
+
   // The per-frame data for an application.
   struct SampleFrameData {
     // The swapchain-image that this frame will use for rendering
@@ -111,15 +217,12 @@ class Sample {
         transfer_from_graphics_command_buffer_;
     // The semaphore that handles transfering the swapchain image
     // between the present and render queues.
-    containers::unique_ptr<vulkan::VkSemaphore> transfer_semaphore_;
-    // The depth_stencil image, if it exists.
-    vulkan::ImagePointer depth_stencil_;
-    // The multisampled render target if it exists.
-    vulkan::ImagePointer multisampled_target_;
-    // The semaphore controlling access to the swapchain.
-    containers::unique_ptr<vulkan::VkSemaphore> ready_semaphore_;
-    // The fence that signals that the resources for this frame are free.
-    containers::unique_ptr<vulkan::VkFence> ready_fence_;
+    ::VkSemaphore transfer_semaphore_;
+    // The depth and multisampled targets this image renders with.
+    RenderTargets* render_targets_;
+    // The ready_fence_ of the FrameContext that last rendered to this image,
+    // or VK_NULL_HANDLE if it has not been rendered to yet.
+    ::VkFence last_fence_;
     // The application-specific data for this frame.
     FrameData child_data_;
   };
@@ -129,7 +232,9 @@ class Sample {
          uint32_t host_buffer_size_in_MB, uint32_t image_memory_size_in_MB,
          uint32_t device_buffer_size_in_MB, uint32_t coherent_buffer_size_in_MB,
          const SampleOptions& options,
-         const VkPhysicalDeviceFeatures& physical_device_features = {0})
+         const VkPhysicalDeviceFeatures& physical_device_features = {0},
+         const VkPhysicalDeviceFeatures& optional_physical_device_features =
+             {0})
       : options_(options),
         data_(entry_data),
         allocator_(allocator),
@@ -139,12 +244,33 @@ class Sample {
                      image_memory_size_in_MB * 1024 * 1024,
                      device_buffer_size_in_MB * 1024 * 1024,
                      coherent_buffer_size_in_MB * 1024 * 1024,
-                     options.async_compute, options.sparse_binding),
+                     options.async_compute, options.sparse_binding,
+                     options.present_mode, options.swapchain_images,
+                     options.transfer_queue,
+                     // Used by app()->CreateDescriptorUpdateTemplate when
+                     // the device supports it.
+                     {VK_KHR_DESCRIPTOR_UPDATE_TEMPLATE_EXTENSION_NAME},
+                     optional_physical_device_features),
+        render_submissions_(allocator, &application_.render_queue()),
+        present_submissions_(allocator, &application_.present_queue()),
+        frame_command_pools_(allocator),
+        frame_present_command_pools_(allocator),
+        render_targets_(allocator),
         frame_data_(allocator),
+        frame_contexts_(allocator),
+        current_frame_context_(0),
+        last_ready_fence_(VK_NULL_HANDLE),
+        last_present_ticket_(0),
+        queued_pipelines_(allocator),
+        pipeline_statistics_query_(
+            application_.enabled_features().pipelineStatisticsQuery ==
+            VK_TRUE),
         swapchain_images_(application_.swapchain_images()),
         last_frame_time_(std::chrono::high_resolution_clock::now()),
         initialization_command_buffer_(application_.GetCommandBuffer()),
         average_frame_time_(0),
+        last_submit_time_(0),
+        present_statistics_(),
         is_valid_(true) {
     if (data_->fixed_timestep()) {
       app()->GetLogger()->LogInfo("Running with a fixed timestep of 0.1s");
@@ -173,45 +299,266 @@ class Sample {
   // all of the data for this application. It calls InitializeApplicationData
   // on the subclass, as well as InitializeLocalFrameData for every
   // image in the swapchain.
+  // The framework's own per-frame resources do not depend on anything the
+  // subclass creates, so they are built on worker threads, each with its own
+  // command pools, while InitializeApplicationData runs on this thread.
+  // Every piece of work is submitted as soon as it has been recorded.
+  // The pipelines that InitializeApplicationData passes to CommitPipeline()
+  // are compiled on the threads of a PipelineBuildQueue in the meantime.
+  // InitializeFrameData is still called on this thread, after
+  // InitializeApplicationData and those pipelines, since it usually depends
+  // on them.
   void Initialize() {
-    initialization_command_buffer_->vkBeginCommandBuffer(
-        initialization_command_buffer_, &kBeginCommandBuffer);
+    auto initialization_start = std::chrono::high_resolution_clock::now();
+    const size_t num_images = swapchain_images_.size();
+    const size_t num_workers = std::max<size_t>(
+        1, std::min<size_t>(num_images, std::thread::hardware_concurrency()));
+    pipeline_build_queue_ =
+        containers::make_unique<vulkan::PipelineBuildQueue>(
+            allocator_, allocator_, &application_);
+
+    const size_t num_frame_contexts =
+        options_.frames_in_flight == 0 ? num_images
+                                       : options_.frames_in_flight;
+    frame_contexts_.resize(num_frame_contexts);
+    vulkan::SyncObjectPool* sync_objects = application_.sync_object_pool();
+    for (auto& context : frame_contexts_) {
+      context.ready_fence_ = sync_objects->AcquireFence();
+      context.submitted_ = false;
+      context.ready_semaphore_ = sync_objects->AcquireSemaphore();
+      context.transient_descriptors_ =
+          containers::make_unique<vulkan::DescriptorAllocator>(
+              allocator_, allocator_, &application_.device(), false);
+    }
+    frame_command_buffers_ =
+        containers::make_unique<vulkan::CommandBufferRing>(
+            allocator_, allocator_, &application_.device(),
+            application_.render_queue().index(),
+            static_cast<uint32_t>(num_frame_contexts));
+    if (options_.gpu_profiling) {
+      gpu_profiler_ = containers::make_unique<vulkan::GpuProfiler>(
+          allocator_, allocator_, &application_,
+          static_cast<uint32_t>(num_frame_contexts), 32,
+          pipeline_statistics_query_);
+    }
+    // Only one frame at a time can render into a set of targets, so there
+    // is no need for more of them than there are frames in flight.
+    render_targets_.resize(std::min(num_images, num_frame_contexts));
+    for (auto& targets : render_targets_) {
+      CreateRenderTargets(&targets);
+    }
 
-    InitializeApplicationData(&initialization_command_buffer_,
-                              swapchain_images_.size());
+    frame_data_.resize(num_images);
+    // Everything each worker uses is created up front, so that the
+    // workers never touch the same pool or the same containers.
+    frame_command_pools_.reserve(num_workers);
+    frame_present_command_pools_.reserve(num_workers);
+    containers::vector<vulkan::VkCommandBuffer> worker_command_buffers(
+        allocator_);
+    worker_command_buffers.reserve(num_workers);
+    for (size_t i = 0; i < num_workers; ++i) {
+      frame_command_pools_.push_back(vulkan::CreateDefaultCommandPool(
+          allocator_, application_.device(),
+          application_.render_queue().index()));
+      if (application_.HasSeparatePresentQueue()) {
+        frame_present_command_pools_.push_back(vulkan::CreateDefaultCommandPool(
+            allocator_, application_.device(),
+            application_.present_queue().index()));
+      }
+      worker_command_buffers.push_back(vulkan::CreateDefaultCommandBuffer(
+          &frame_command_pools_.back(), &application_.device()));
+    }
+    containers::vector<float> worker_times(allocator_);
+    worker_times.resize(num_workers, 0.0f);
+
+    std::mutex submit_mutex;
+    auto submit = [this, &submit_mutex](vulkan::VkCommandBuffer* cmd_buf,
+                                        ::VkFence fence) {
+      VkSubmitInfo submit_info = kEmptySubmitInfo;
+      submit_info.commandBufferCount = 1;
+      submit_info.pCommandBuffers = &(cmd_buf->get_command_buffer());
+      std::lock_guard<std::mutex> lock(submit_mutex);
+      LOG_ASSERT(==, data_->logger(), VK_SUCCESS,
+                 application_.render_queue()->vkQueueSubmit(
+                     application_.render_queue(), 1, &submit_info, fence));
+    };
 
-    for (size_t i = 0; i < swapchain_images_.size(); ++i) {
-      frame_data_.push_back(SampleFrameData());
-      InitializeLocalFrameData(&frame_data_.back(),
-                               &initialization_command_buffer_, i);
+    containers::vector<std::thread> workers(allocator_);
+    workers.reserve(num_workers);
+    for (size_t i = 0; i < num_workers; ++i) {
+      workers.push_back(std::thread([this, i, num_workers, num_images, &submit,
+                                     &worker_command_buffers, &worker_times]() {
+        auto worker_start = std::chrono::high_resolution_clock::now();
+        vulkan::VkCommandPool* pool = &frame_command_pools_[i];
+        vulkan::VkCommandPool* present_pool =
+            application_.HasSeparatePresentQueue()
+                ? &frame_present_command_pools_[i]
+                : pool;
+        vulkan::VkCommandBuffer* cmd_buf = &worker_command_buffers[i];
+        (*cmd_buf)->vkBeginCommandBuffer(*cmd_buf, &kBeginCommandBuffer);
+        for (size_t frame = i; frame < num_images; frame += num_workers) {
+          InitializeLocalFrameData(&frame_data_[frame], cmd_buf, pool,
+                                   present_pool, frame);
+        }
+        (*cmd_buf)->vkEndCommandBuffer(*cmd_buf);
+        submit(cmd_buf, static_cast<::VkFence>(VK_NULL_HANDLE));
+        worker_times[i] = std::chrono::duration<float, std::milli>(
+                              std::chrono::high_resolution_clock::now() -
+                              worker_start)
+                              .count();
+      }));
     }
 
+    auto application_data_start = std::chrono::high_resolution_clock::now();
+    initialization_command_buffer_->vkBeginCommandBuffer(
+        initialization_command_buffer_, &kBeginCommandBuffer);
+    InitializeApplicationData(&initialization_command_buffer_, num_images);
     initialization_command_buffer_->vkEndCommandBuffer(
         initialization_command_buffer_);
+    submit(&initialization_command_buffer_,
+           static_cast<::VkFence>(VK_NULL_HANDLE));
+    auto application_data_end = std::chrono::high_resolution_clock::now();
 
-    VkSubmitInfo submit_info = kEmptySubmitInfo;
-    submit_info.commandBufferCount = 1;
-    submit_info.pCommandBuffers =
-        &(initialization_command_buffer_.get_command_buffer());
-
-    vulkan::VkFence init_fence = vulkan::CreateFence(&application_.device());
+    for (auto& worker : workers) {
+      worker.join();
+    }
+    auto workers_end = std::chrono::high_resolution_clock::now();
 
-    application_.render_queue()->vkQueueSubmit(application_.render_queue(), 1,
-                                               &submit_info,
-                                               init_fence.get_raw_object());
+    const size_t num_queued_pipelines = queued_pipelines_.size();
+    for (vulkan::VulkanGraphicsPipeline* pipeline : queued_pipelines_) {
+      pipeline->Wait();
+    }
+    queued_pipelines_.clear();
+    // This joins the build threads, which are not needed after this.
+    const uint32_t num_build_threads = pipeline_build_queue_->num_threads();
+    pipeline_build_queue_.reset();
+    auto pipelines_end = std::chrono::high_resolution_clock::now();
+
+    vulkan::VkCommandBuffer frame_initialization_command_buffer =
+        application_.GetCommandBuffer();
+    frame_initialization_command_buffer->vkBeginCommandBuffer(
+        frame_initialization_command_buffer, &kBeginCommandBuffer);
+    for (size_t i = 0; i < num_images; ++i) {
+      InitializeFrameData(&frame_data_[i].child_data_,
+                          &frame_initialization_command_buffer, i);
+    }
+    frame_initialization_command_buffer->vkEndCommandBuffer(
+        frame_initialization_command_buffer);
+    auto frame_data_end = std::chrono::high_resolution_clock::now();
+
+    // A fence signalled by vkQueueSubmit also waits for everything submitted
+    // to the queue before it, so this covers all of the work above.
+    ::VkFence init_fence = sync_objects->AcquireFence();
+    submit(&frame_initialization_command_buffer, init_fence);
+    // This submits anything that was queued on the upload manager but not
+    // recorded, and reclaims the staging space of what was.
+    LOG_ASSERT(==, data_->logger(), VK_SUCCESS,
+               application_.upload_manager()->Flush(&render_submissions_));
     application_.device()->vkWaitForFences(application_.device(), 1,
-                                           &init_fence.get_raw_object(), false,
+                                           &init_fence, false,
                                            0xFFFFFFFFFFFFFFFF);
-    // Bit gross but submit all of the fences here
+    sync_objects->ReleaseFence(init_fence);
+    auto initialization_end = std::chrono::high_resolution_clock::now();
+
+    typedef std::chrono::duration<float, std::milli> milliseconds;
+    app()->GetLogger()->LogInfo(
+        "Initialization took ",
+        milliseconds(initialization_end - initialization_start).count(),
+        "ms");
+    app()->GetLogger()->LogInfo(
+        "    Application data: ",
+        milliseconds(application_data_end - application_data_start).count(),
+        "ms");
+    app()->GetLogger()->LogInfo(
+        "    Framework frame data: ",
+        *std::max_element(worker_times.begin(), worker_times.end()),
+        "ms on ", num_workers, " threads, ",
+        milliseconds(workers_end - application_data_end).count(),
+        "ms spent waiting after the application data");
+    app()->GetLogger()->LogInfo(
+        "    Pipelines: ", num_queued_pipelines, " built on ",
+        num_build_threads, " threads, ",
+        milliseconds(pipelines_end - workers_end).count(),
+        "ms spent waiting for them");
+    app()->GetLogger()->LogInfo(
+        "    Application frame data: ",
+        milliseconds(frame_data_end - pipelines_end).count(), "ms");
+    app()->GetLogger()->LogInfo(
+        "    Waiting for the GPU: ",
+        milliseconds(initialization_end - frame_data_end).count(), "ms");
+    app()->GetLogger()->LogInfo(num_frame_contexts, " frames in flight, ",
+                                render_targets_.size(),
+                                " sets of render targets for ", num_images,
+                                " swapchain images");
+
+    InitializationComplete();
+
+    // This is only started once the subclass has finished with the queues.
+    if (options_.submission_thread) {
+      submission_thread_ = containers::make_unique<vulkan::SubmissionThread>(
+          allocator_, allocator_, app()->GetLogger(),
+          static_cast<uint32_t>(2 * num_frame_contexts));
+      UseSubmissionThread(true);
+    }
+  }
+
+  ~Sample() {
+    render_submissions_.LogStatistics(app()->GetLogger(), "Render queue");
+    if (frame_command_buffers_) {
+      frame_command_buffers_->LogStatistics(app()->GetLogger(), "Per-frame");
+    }
+    if (gpu_profiler_) {
+      gpu_profiler_->LogTimings(app()->GetLogger());
+      gpu_profiler_->LogPassStatistics(app()->GetLogger());
+    }
+    if (application_.HasSeparatePresentQueue()) {
+      present_submissions_.LogStatistics(app()->GetLogger(), "Present queue");
+    }
+    if (submission_thread_) {
+      submission_thread_->LogStatistics(app()->GetLogger());
+    }
+    LogPresentStatistics();
+    // The views of every frame are destroyed along with frame_data_, so the
+    // application must drop the framebuffers that it cached for them first,
+    // or a later view that reuses one of the handles would get them.
+    WaitIdle();
     for (auto& frame_data : frame_data_) {
-      application_.render_queue()->vkQueueSubmit(
-          application_.render_queue(), 0, nullptr, *frame_data.ready_fence_);
+      app()->EvictFramebuffers(*frame_data.image_view);
+      if (frame_data.depth_view_) {
+        app()->EvictFramebuffers(*frame_data.depth_view_);
+      }
     }
+  }
 
-    InitializationComplete();
+  void WaitIdle() {
+    WaitForSubmissions();
+    app()->device()->vkDeviceWaitIdle(app()->device());
+  }
+
+  // Blocks until every submit and present queued on the submission thread
+  // has been made, so that the queues can be used directly.
+  void WaitForSubmissions() {
+    if (submission_thread_) {
+      submission_thread_->WaitIdle();
+    }
   }
 
-  void WaitIdle() { app()->device()->vkDeviceWaitIdle(app()->device()); }
+  // Switches between submitting on the submission thread and on the calling
+  // thread. This only has an effect if the submission_thread option was
+  // enabled, and must not be called during Render().
+  void UseSubmissionThread(bool use) {
+    if (!submission_thread_) {
+      return;
+    }
+    WaitForSubmissions();
+    vulkan::SubmissionThread* thread =
+        use ? submission_thread_.get() : nullptr;
+    render_submissions_.set_submission_thread(thread);
+    present_submissions_.set_submission_thread(thread);
+  }
+  bool uses_submission_thread() {
+    return render_submissions_.submission_thread() != nullptr;
+  }
 
   // The format that we are using to render. This will be either the swapchain
   // format if we are not rendering multi-sampled, or the multisampled image
@@ -243,39 +590,93 @@ class Sample {
     average_frame_time_ =
         elapsed_time.count() * 0.05f + average_frame_time_ * 0.95f;
 
-    uint32_t image_idx;
+    // The ring advances once per frame, so it comes back around to a slot
+    // at the same time as the frame contexts, and waits for the same fence
+    // before the context below resets it.
+    if (last_ready_fence_ != VK_NULL_HANDLE) {
+      frame_command_buffers_->Advance(last_ready_fence_);
+    }
 
-    // This is a bit weird as we have to make new semaphores every frame, but
-    // for now this will do. It will get cleaned up the next time
-    // this image is used.
-    vulkan::VkSemaphore temp_semaphore =
-        vulkan::CreateSemaphore(&app()->device());
+    // Wait for the oldest frame in flight before acquiring an image, so
+    // that the CPU never gets more than frames_in_flight frames ahead, and
+    // the image is acquired as late as possible.
+    FrameContext& context = frame_contexts_[current_frame_context_];
+    ::VkFence ready_fence = context.ready_fence_;
+    if (context.submitted_) {
+      LOG_ASSERT(
+          ==, app()->GetLogger(), VK_SUCCESS,
+          app()->device()->vkWaitForFences(app()->device(), 1, &ready_fence,
+                                           VK_FALSE, 0xFFFFFFFFFFFFFFFF));
+      LOG_ASSERT(
+          ==, app()->GetLogger(), VK_SUCCESS,
+          app()->device()->vkResetFences(app()->device(), 1, &ready_fence));
+    }
+    context.transient_descriptors_->Reset();
+
+    vulkan::SubmissionThread* submission_thread =
+        render_submissions_.submission_thread();
+    if (submission_thread) {
+      // vkAcquireNextImageKHR and vkQueuePresentKHR both need the swapchain
+      // to be externally synchronized, so the last present has to have been
+      // made before this acquires. Only the present call itself is waited
+      // for, not the frame that it presents, and the submit queued before
+      // it has had the whole of Update() and the fence wait above to go
+      // through, so this rarely blocks.
+      submission_thread->Wait(last_present_ticket_);
+    }
 
+    uint32_t image_idx;
+    ::VkSemaphore ready_semaphore = context.ready_semaphore_;
+    auto acquire_start = std::chrono::high_resolution_clock::now();
     LOG_ASSERT(==, app()->GetLogger(), VK_SUCCESS,
                app()->device()->vkAcquireNextImageKHR(
                    app()->device(), app()->swapchain(), 0xFFFFFFFFFFFFFFFF,
-                   temp_semaphore.get_raw_object(),
-                   static_cast<::VkFence>(VK_NULL_HANDLE), &image_idx));
-
-    ::VkFence ready_fence = *frame_data_[image_idx].ready_fence_;
-
-    LOG_ASSERT(
-        ==, app()->GetLogger(), VK_SUCCESS,
-        app()->device()->vkWaitForFences(app()->device(), 1, &ready_fence,
-                                         VK_FALSE, 0xFFFFFFFFFFFFFFFF));
-    LOG_ASSERT(
-        ==, app()->GetLogger(), VK_SUCCESS,
-        app()->device()->vkResetFences(app()->device(), 1, &ready_fence));
+                   ready_semaphore, static_cast<::VkFence>(VK_NULL_HANDLE),
+                   &image_idx));
+    present_statistics_.acquire_time +=
+        std::chrono::high_resolution_clock::now() - acquire_start;
+
+    // The per-image command buffers and buffer offsets may still be in use
+    // if the image was last rendered by a different frame context.
+    ::VkFence image_fence = frame_data_[image_idx].last_fence_;
+    if (image_fence != VK_NULL_HANDLE && image_fence != ready_fence) {
+      LOG_ASSERT(
+          ==, app()->GetLogger(), VK_SUCCESS,
+          app()->device()->vkWaitForFences(app()->device(), 1, &image_fence,
+                                           VK_FALSE, 0xFFFFFFFFFFFFFFFF));
+    }
+    frame_data_[image_idx].last_fence_ = ready_fence;
     if (options_.verbose_output) {
       app()->GetLogger()->LogInfo("Rendering frame <", elapsed_time.count(),
-                                  ">: <", image_idx, ">", " Average: <",
+                                  ">: <", image_idx, "> context <",
+                                  current_frame_context_, ">", " Average: <",
                                   average_frame_time_, ">");
+      const vulkan::GpuProfiler::ScopeTiming* gpu_frame_time =
+          gpu_profiler_ ? gpu_profiler_->GetTiming(kGpuFrameScope) : nullptr;
+      if (gpu_frame_time) {
+        app()->GetLogger()->LogInfo(
+            "GPU frame time <", gpu_frame_time->last_milliseconds,
+            "ms> Average: <", gpu_frame_time->average_milliseconds, "ms>");
+      }
+      if (gpu_profiler_ && !gpu_profiler_->pass_statistics().empty()) {
+        const vulkan::GpuProfiler::PassStatistics& statistics =
+            gpu_profiler_->frame_statistics();
+        app()->GetLogger()->LogInfo("GPU frame passes: <",
+                                    statistics.samples_passed,
+                                    "> samples passed");
+        if (gpu_profiler_->collects_pipeline_statistics()) {
+          app()->GetLogger()->LogInfo(
+              "GPU frame passes: <", statistics.vertex_shader_invocations,
+              "> vertex and <", statistics.fragment_shader_invocations,
+              "> fragment shader invocations");
+        }
+      }
     }
 
-    frame_data_[image_idx].ready_semaphore_ =
-        containers::make_unique<vulkan::VkSemaphore>(allocator_,
-                                                     std::move(temp_semaphore));
-    ::VkSemaphore ready_semaphore = *frame_data_[image_idx].ready_semaphore_;
+    // The uploads queued by Update() go in a submit of their own, ahead of
+    // the frame, so that their fence can reclaim the staging space.
+    LOG_ASSERT(==, app()->GetLogger(), VK_SUCCESS,
+               app()->upload_manager()->Flush(&render_submissions_));
 
     ::VkSemaphore render_wait_semaphore = ready_semaphore;
 
@@ -283,7 +684,7 @@ class Sample {
         VkPipelineStageFlags(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
 
     if (application_.HasSeparatePresentQueue()) {
-      render_wait_semaphore = *frame_data_[image_idx].transfer_semaphore_;
+      render_wait_semaphore = frame_data_[image_idx].transfer_semaphore_;
       VkSubmitInfo transfer_submit_info{
           VK_STRUCTURE_TYPE_SUBMIT_INFO,  // sType
           nullptr,                        // pNext
@@ -297,9 +698,10 @@ class Sample {
           &render_wait_semaphore  // pSignalSemaphores
       };
 
-      app()->present_queue()->vkQueueSubmit(
-          app()->present_queue(), 1, &transfer_submit_info,
-          static_cast<::VkFence>(VK_NULL_HANDLE));
+      // The render queue waits on this, so it has to be submitted first.
+      present_submissions_.Submit(transfer_submit_info);
+      LOG_ASSERT(==, app()->GetLogger(), VK_SUCCESS,
+                 present_submissions_.Flush());
     }
 
     VkSubmitInfo init_submit_info{
@@ -316,12 +718,22 @@ class Sample {
 
     ::VkSemaphore present_ready_semaphore = render_wait_semaphore;
     if (application_.HasSeparatePresentQueue()) {
-      present_ready_semaphore = *frame_data_[image_idx].transfer_semaphore_;
+      present_ready_semaphore = frame_data_[image_idx].transfer_semaphore_;
     }
 
-    app()->render_queue()->vkQueueSubmit(
-        app()->render_queue(), 1, &init_submit_info,
-        static_cast<::VkFence>(VK_NULL_HANDLE));
+    render_submissions_.Submit(init_submit_info);
+
+    // The frame is timed from the end of the setup to the end of the
+    // resolve, which covers all of the work submitted by Render().
+    uint32_t frame_scope = vulkan::GpuProfiler::kInvalidScope;
+    if (gpu_profiler_) {
+      vulkan::VkCommandBuffer* begin_frame = frame_command_buffers_->Get();
+      (*begin_frame)->vkBeginCommandBuffer(*begin_frame, &kBeginCommandBuffer);
+      gpu_profiler_->BeginFrame(begin_frame);
+      frame_scope = gpu_profiler_->BeginScope(begin_frame, kGpuFrameScope);
+      (*begin_frame)->vkEndCommandBuffer(*begin_frame);
+      render_submissions_.Submit(begin_frame->get_command_buffer());
+    }
 
     Render(&app()->render_queue(), image_idx,
            &frame_data_[image_idx].child_data_);
@@ -334,12 +746,25 @@ class Sample {
     init_submit_info.signalSemaphoreCount = 1;
     init_submit_info.pSignalSemaphores = &present_ready_semaphore;
 
-    app()->render_queue()->vkQueueSubmit(
-        app()->render_queue(), 1, &init_submit_info, ::VkFence(ready_fence));
+    render_submissions_.Submit(init_submit_info);
+    if (gpu_profiler_) {
+      vulkan::VkCommandBuffer* end_frame = frame_command_buffers_->Get();
+      (*end_frame)->vkBeginCommandBuffer(*end_frame, &kBeginCommandBuffer);
+      gpu_profiler_->EndScope(end_frame, frame_scope);
+      (*end_frame)->vkEndCommandBuffer(*end_frame);
+      render_submissions_.Submit(end_frame->get_command_buffer());
+      gpu_profiler_->EndFrame();
+    }
+    auto submit_start = std::chrono::high_resolution_clock::now();
+    // Everything for this frame on the render queue goes in one submit.
+    LOG_ASSERT(==, app()->GetLogger(), VK_SUCCESS,
+               render_submissions_.Flush(ready_fence));
+    context.submitted_ = true;
+    last_ready_fence_ = ready_fence;
 
     if (application_.HasSeparatePresentQueue()) {
       ::VkSemaphore transfer_semaphore =
-          *frame_data_[image_idx].transfer_semaphore_;
+          frame_data_[image_idx].transfer_semaphore_;
       present_ready_semaphore = render_wait_semaphore;
       VkSubmitInfo transfer_submit_info{
           VK_STRUCTURE_TYPE_SUBMIT_INFO,  // sType
@@ -354,9 +779,9 @@ class Sample {
           &present_ready_semaphore  // pSignalSemaphores
       };
 
-      app()->present_queue()->vkQueueSubmit(
-          app()->present_queue(), 1, &transfer_submit_info,
-          static_cast<::VkFence>(VK_NULL_HANDLE));
+      present_submissions_.Submit(transfer_submit_info);
+      LOG_ASSERT(==, app()->GetLogger(), VK_SUCCESS,
+                 present_submissions_.Flush());
     }
 
     VkPresentInfoKHR present_info{
@@ -369,17 +794,125 @@ class Sample {
         &image_idx,                            // pImageIndices
         nullptr,                               // pResults
     };
-    LOG_ASSERT(==, app()->GetLogger(),
-               app()->present_queue()->vkQueuePresentKHR(app()->present_queue(),
-                                                         &present_info),
-               VK_SUCCESS);
+    if (submission_thread) {
+      last_present_ticket_ =
+          submission_thread->Present(&app()->present_queue(), present_info);
+    } else {
+      LOG_ASSERT(==, app()->GetLogger(),
+                 app()->present_queue()->vkQueuePresentKHR(
+                     app()->present_queue(), &present_info),
+                 VK_SUCCESS);
+    }
+    auto present_end = std::chrono::high_resolution_clock::now();
+    last_submit_time_ = present_end - submit_start;
+    present_statistics_.frames += 1;
+    present_statistics_.acquire_to_present_time += present_end - acquire_start;
+    present_statistics_.max_acquire_to_present_time =
+        std::max(present_statistics_.max_acquire_to_present_time,
+                 present_end - acquire_start);
+    uint32_t queue_depth = 0;
+    for (const auto& frame_context : frame_contexts_) {
+      if (frame_context.submitted_ &&
+          app()->device()->vkGetFenceStatus(app()->device(),
+                                            frame_context.ready_fence_) !=
+              VK_SUCCESS) {
+        queue_depth += 1;
+      }
+    }
+    present_statistics_.queue_depth_total += queue_depth;
+    present_statistics_.max_queue_depth =
+        std::max(present_statistics_.max_queue_depth, queue_depth);
+    current_frame_context_ =
+        (current_frame_context_ + 1) % frame_contexts_.size();
   }
 
   void set_invalid(bool invaid) { is_valid_ = false; }
   const bool is_valid() { return is_valid_; }
 
+  // The work for the frame being rendered should be queued here during
+  // Render(), rather than submitted to the render queue directly. It is
+  // submitted after Render() returns, together with the framework's own
+  // work for the frame, in a single vkQueueSubmit. Anything that has to wait
+  // for the queued work must call Flush() first.
+  vulkan::SubmissionBatcher* render_submissions() {
+    return &render_submissions_;
+  }
+
+  // The number of frames that the CPU may record before waiting for the GPU.
+  size_t frames_in_flight() const { return frame_contexts_.size(); }
+  // The allocator for descriptor sets that are only used by the frame
+  // currently being rendered. Every set allocated from it is returned once
+  // the GPU has finished that frame, so the sets do not have to be freed.
+  // This is only valid during Render().
+  vulkan::DescriptorAllocator* transient_descriptor_allocator() {
+    return frame_contexts_[current_frame_context_]
+        .transient_descriptors_.get();
+  }
+
+  // Command buffers for work that is recorded and submitted every frame.
+  // A command buffer taken from here is only valid for the frame currently
+  // being rendered, and must be submitted through render_submissions().
+  // This is only valid during Render().
+  vulkan::CommandBufferRing* frame_command_buffers() {
+    return frame_command_buffers_.get();
+  }
+  // The profiler for the GPU time of the sample's work, if gpu_profiling
+  // was enabled, otherwise nullptr. Scopes may be added to any command
+  // buffer submitted through render_submissions() during Render(). The
+  // whole frame is measured as the "Frame" scope, and frame_statistics()
+  // sums the passes the sample adds.
+  vulkan::GpuProfiler* gpu_profiler() { return gpu_profiler_.get(); }
+  // The exponentially smoothed CPU time between frames, in seconds.
+  float average_frame_time() const { return average_frame_time_; }
+  // The CPU time that the last frame spent submitting its work and
+  // presenting, or queuing them on the submission thread.
+  std::chrono::high_resolution_clock::duration last_submit_time() const {
+    return last_submit_time_;
+  }
+  // The latency statistics of every frame since the last
+  // ResetPresentStatistics().
+  const PresentStatistics& present_statistics() const {
+    return present_statistics_;
+  }
+  void ResetPresentStatistics() { present_statistics_ = PresentStatistics(); }
+  // Logs the averages of present_statistics().
+  void LogPresentStatistics() {
+    const PresentStatistics& statistics = present_statistics_;
+    if (statistics.frames == 0) {
+      return;
+    }
+    using milliseconds = std::chrono::duration<double, std::milli>;
+    app()->GetLogger()->LogInfo(
+        "Presented ", statistics.frames, " frames: ",
+        milliseconds(statistics.acquire_to_present_time).count() /
+            statistics.frames,
+        "ms from acquire to present on average, ",
+        milliseconds(statistics.max_acquire_to_present_time).count(),
+        "ms at most, ",
+        milliseconds(statistics.acquire_time).count() / statistics.frames,
+        "ms of it waiting to acquire");
+    app()->GetLogger()->LogInfo(
+        "    ",
+        double(statistics.queue_depth_total) / statistics.frames,
+        " frames queued on the GPU at present on average, ",
+        statistics.max_queue_depth, " at most");
+  }
+
   bool should_exit() const { return app()->should_exit(); }
 
+  // Queues the creation of pipeline on the build threads of Initialize(),
+  // instead of creating it on this thread, like pipeline->Commit() would.
+  // This may only be called from InitializeApplicationData. The pipeline is
+  // created by the time InitializeFrameData is called, and must neither be
+  // used, modified nor moved until then.
+  void CommitPipeline(vulkan::VulkanGraphicsPipeline* pipeline) {
+    LOG_ASSERT(!=, app()->GetLogger(),
+               static_cast<vulkan::PipelineBuildQueue*>(nullptr),
+               pipeline_build_queue_.get());
+    pipeline->Commit(pipeline_build_queue_.get());
+    queued_pipelines_.push_back(pipeline);
+  }
+
  private:
   const size_t sample_frame_data_offset =
       reinterpret_cast<size_t>(
@@ -408,7 +941,7 @@ class Sample {
   const ::VkImage& depth_image(FrameData* data) {
     SampleFrameData* base = reinterpret_cast<SampleFrameData*>(
         reinterpret_cast<uint8_t*>(data) - sample_frame_data_offset);
-    return base->depth_stencil_->get_raw_image();
+    return base->render_targets_->depth_stencil_->get_raw_image();
   }
 
  private:
@@ -430,7 +963,8 @@ class Sample {
   virtual void InitializationComplete() {}
 
   // Will be called to instruct the application to update it's non
-  // frame-specific data.
+  // frame-specific data. Anything queued on app()->upload_manager() here is
+  // copied before the commands of the frame.
   virtual void Update(float time_since_last_render) = 0;
 
   // Will be called to instruct the application to enqueue the necessary
@@ -438,21 +972,9 @@ class Sample {
   virtual void Render(vulkan::VkQueue* queue, size_t frame_index,
                       FrameData* data) = 0;
 
-  // This initializes the per-frame data for the sample application framework.
-  //  This is equivalent to the InitializeFrameData(), except this handles
-  //  all of the under-the-hood data that the application itself should not
-  //  have to worry about.
-  void InitializeLocalFrameData(SampleFrameData* data,
-                                vulkan::VkCommandBuffer* initialization_buffer,
-                                size_t frame_index) {
-    data->swapchain_image_ = swapchain_images_[frame_index];
-
-    data->ready_semaphore_ = containers::make_unique<vulkan::VkSemaphore>(
-        allocator_, vulkan::CreateSemaphore(&application_.device()));
-
-    data->ready_fence_ = containers::make_unique<vulkan::VkFence>(
-        allocator_, vulkan::CreateFence(&application_.device()));
-
+  // Creates the depth and multisampled render targets that are enabled in
+  // the options. They are transitioned by InitializeLocalFrameData.
+  void CreateRenderTargets(RenderTargets* targets) {
     VkImageCreateInfo image_create_info{
         /* sType = */
         VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
@@ -483,6 +1005,44 @@ class Sample {
         VK_IMAGE_LAYOUT_UNDEFINED,
     };
 
+    if (options_.enable_depth_buffer) {
+      targets->depth_stencil_ =
+          application_.CreateAndBindImage(&image_create_info);
+    }
+
+    if (options_.enable_multisampling) {
+      image_create_info.format = render_target_format_;
+      image_create_info.usage =
+          VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+
+      targets->multisampled_target_ =
+          application_.CreateAndBindImage(&image_create_info);
+    }
+  }
+
+  // This initializes the per-frame data for the sample application framework.
+  //  This is equivalent to the InitializeFrameData(), except this handles
+  //  all of the under-the-hood data that the application itself should not
+  //  have to worry about.
+  //  The command buffers for this frame are allocated from |pool|, or
+  //  |present_pool| for those submitted to the present queue. This may be
+  //  called from any thread, as long as no other thread is using the pools.
+  void InitializeLocalFrameData(SampleFrameData* data,
+                                vulkan::VkCommandBuffer* initialization_buffer,
+                                vulkan::VkCommandPool* pool,
+                                vulkan::VkCommandPool* present_pool,
+                                size_t frame_index) {
+    data->swapchain_image_ = swapchain_images_[frame_index];
+    data->render_targets_ =
+        &render_targets_[frame_index % render_targets_.size()];
+    data->last_fence_ = VK_NULL_HANDLE;
+    data->transfer_semaphore_ = VK_NULL_HANDLE;
+    RenderTargets* targets = data->render_targets_;
+    // The first image that uses a set of render targets transitions them.
+    const bool owns_render_targets = frame_index < render_targets_.size();
+    const bool shares_render_targets =
+        render_targets_.size() < swapchain_images_.size();
+
     VkImageViewCreateInfo view_create_info = {
         VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,  // sType
         nullptr,                                   // pNext
@@ -497,41 +1057,34 @@ class Sample {
     ::VkImageView raw_view;
 
     if (options_.enable_depth_buffer) {
-      data->depth_stencil_ =
-          application_.CreateAndBindImage(&image_create_info);
-      view_create_info.image = *data->depth_stencil_;
+      view_create_info.image = *targets->depth_stencil_;
 
-      LOG_ASSERT(
-          ==, data_->logger(), VK_SUCCESS,
-          application_.device()->vkCreateImageView(
-              application_.device(), &view_create_info, nullptr, &raw_view));
+      LOG_ASSERT(==, data_->logger(), VK_SUCCESS,
+                 application_.device()->vkCreateImageView(
+                     application_.device(), &view_create_info,
+                     application_.device().allocation_callbacks(), &raw_view));
       data->depth_view_ = containers::make_unique<vulkan::VkImageView>(
           allocator_,
-          vulkan::VkImageView(raw_view, nullptr, &application_.device()));
-    }
-
-    if (options_.enable_multisampling) {
-      image_create_info.format = render_target_format_;
-      image_create_info.usage =
-          VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
-
-      data->multisampled_target_ =
-          application_.CreateAndBindImage(&image_create_info);
+          vulkan::VkImageView(raw_view,
+                              application_.device().allocation_callbacks(),
+                              &application_.device()));
     }
 
     view_create_info.image = options_.enable_multisampling
-                                 ? *data->multisampled_target_
+                                 ? *targets->multisampled_target_
                                  : data->swapchain_image_;
     view_create_info.format = render_target_format_;
     view_create_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 
-    LOG_ASSERT(
-        ==, data_->logger(), VK_SUCCESS,
-        application_.device()->vkCreateImageView(
-            application_.device(), &view_create_info, nullptr, &raw_view));
+    LOG_ASSERT(==, data_->logger(), VK_SUCCESS,
+               application_.device()->vkCreateImageView(
+                   application_.device(), &view_create_info,
+                   application_.device().allocation_callbacks(), &raw_view));
     data->image_view = containers::make_unique<vulkan::VkImageView>(
         allocator_,
-        vulkan::VkImageView(raw_view, nullptr, &application_.device()));
+        vulkan::VkImageView(raw_view,
+                            application_.device().allocation_callbacks(),
+                            &application_.device()));
 
     VkImageMemoryBarrier barriers[2] = {
         {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,            // sType
@@ -543,7 +1096,7 @@ class Sample {
          VK_QUEUE_FAMILY_IGNORED,  // srcQueueFamilyIndex
          VK_QUEUE_FAMILY_IGNORED,  // dstQueueFamilyIndex
          options_.enable_depth_buffer
-             ? static_cast<::VkImage>(*data->depth_stencil_)
+             ? static_cast<::VkImage>(*targets->depth_stencil_)
              : static_cast<::VkImage>(VK_NULL_HANDLE),  // image
          {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1}},
         {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,    // sType
@@ -554,22 +1107,31 @@ class Sample {
          VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,  // newLayout
          VK_QUEUE_FAMILY_IGNORED,                   // srcQueueFamilyIndex
          VK_QUEUE_FAMILY_IGNORED,                   // dstQueueFamilyIndex
-         options_.enable_multisampling ? *data->multisampled_target_
-                                       : data->swapchain_image_,  // image
+         options_.enable_multisampling
+             ? static_cast<::VkImage>(*targets->multisampled_target_)
+             : data->swapchain_image_,  // image
          {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1}}};
 
-    (*initialization_buffer)
-        ->vkCmdPipelineBarrier(
-            (*initialization_buffer), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-            VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT, 0, 0, nullptr, 0, nullptr,
-            options_.enable_depth_buffer ? 2 : 1,
-            &barriers[options_.enable_depth_buffer ? 0 : 1]);
+    // The swapchain image always needs its transition, the shared targets
+    // only need it once.
+    const bool transition_depth =
+        options_.enable_depth_buffer && owns_render_targets;
+    const bool transition_color =
+        !options_.enable_multisampling || owns_render_targets;
+    if (transition_depth || transition_color) {
+      (*initialization_buffer)
+          ->vkCmdPipelineBarrier(
+              (*initialization_buffer), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+              VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT, 0, 0, nullptr, 0, nullptr,
+              (transition_depth ? 1 : 0) + (transition_color ? 1 : 0),
+              &barriers[transition_depth ? 0 : 1]);
+    }
 
     uint32_t srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
     uint32_t dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
     if (application_.HasSeparatePresentQueue()) {
-      data->transfer_semaphore_ = containers::make_unique<vulkan::VkSemaphore>(
-          allocator_, vulkan::CreateSemaphore(&application_.device()));
+      data->transfer_semaphore_ =
+          application_.sync_object_pool()->AcquireSemaphore();
       srcQueueFamilyIndex = application_.present_queue().index();
       dstQueueFamilyIndex = application_.render_queue().index();
       VkImageMemoryBarrier barrier = {
@@ -586,7 +1148,8 @@ class Sample {
 
       data->transfer_from_present_command_buffer_ =
           containers::make_unique<vulkan::VkCommandBuffer>(
-              allocator_, app()->GetCommandBuffer());
+              allocator_, vulkan::CreateDefaultCommandBuffer(
+                              present_pool, &application_.device()));
 
       (*data->transfer_from_present_command_buffer_)
           ->vkBeginCommandBuffer((*data->transfer_from_present_command_buffer_),
@@ -607,19 +1170,18 @@ class Sample {
 
       data->transfer_from_graphics_command_buffer_ =
           containers::make_unique<vulkan::VkCommandBuffer>(
-              allocator_, app()->GetCommandBuffer());
-
-      (*data->transfer_from_graphics_command_buffer_)
-          ->vkBeginCommandBuffer((*data->setup_command_buffer_),
-                                 &kBeginCommandBuffer);
-
-      (*data->transfer_from_graphics_command_buffer_)
-          ->vkCmdPipelineBarrier((*data->setup_command_buffer_),
-                                 VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                                 VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                                 0, 0, nullptr, 0, nullptr, 1, &barrier);
-      (*data->transfer_from_graphics_command_buffer_)
-          ->vkEndCommandBuffer(*data->setup_command_buffer_);
+              allocator_, vulkan::CreateDefaultCommandBuffer(
+                              present_pool, &application_.device()));
+
+      vulkan::VkCommandBuffer& release_buffer =
+          *data->transfer_from_graphics_command_buffer_;
+      release_buffer->vkBeginCommandBuffer(release_buffer,
+                                           &kBeginCommandBuffer);
+      release_buffer->vkCmdPipelineBarrier(
+          release_buffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+          VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, 0, nullptr, 0,
+          nullptr, 1, &barrier);
+      release_buffer->vkEndCommandBuffer(release_buffer);
     }
 
     VkImageMemoryBarrier barrier = {
@@ -631,13 +1193,47 @@ class Sample {
         VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,  // newLayout
         srcQueueFamilyIndex,                       // srcQueueFamilyIndex
         dstQueueFamilyIndex,                       // dstQueueFamilyIndex
-        options_.enable_multisampling ? *data->multisampled_target_
+        options_.enable_multisampling ? *targets->multisampled_target_
                                       : data->swapchain_image_,  // image
         {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1}};
 
+    // When render targets are shared, the previous frame that used them may
+    // still be resolving from them or testing against them.
+    VkPipelineStageFlags setup_src_stages =
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    VkPipelineStageFlags setup_dst_stages =
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    VkImageMemoryBarrier setup_barriers[2] = {
+        barrier,
+        {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,             // sType
+         nullptr,                                            // pNext
+         VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,       // srcAccessMask
+         VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+             VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,   // dstAccessMask
+         VK_IMAGE_LAYOUT_UNDEFINED,                          // oldLayout
+         VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,   // newLayout
+         VK_QUEUE_FAMILY_IGNORED,  // srcQueueFamilyIndex
+         VK_QUEUE_FAMILY_IGNORED,  // dstQueueFamilyIndex
+         options_.enable_depth_buffer
+             ? static_cast<::VkImage>(*targets->depth_stencil_)
+             : static_cast<::VkImage>(VK_NULL_HANDLE),  // image
+         {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1}}};
+    uint32_t num_setup_barriers = 1;
+    if (shares_render_targets) {
+      if (options_.enable_multisampling) {
+        setup_src_stages |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+      }
+      if (options_.enable_depth_buffer) {
+        setup_src_stages |= VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        setup_dst_stages |= VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+        num_setup_barriers = 2;
+      }
+    }
+
     data->setup_command_buffer_ =
         containers::make_unique<vulkan::VkCommandBuffer>(
-            allocator_, app()->GetCommandBuffer());
+            allocator_,
+            vulkan::CreateDefaultCommandBuffer(pool, &application_.device()));
 
     (*data->setup_command_buffer_)
         ->vkBeginCommandBuffer((*data->setup_command_buffer_),
@@ -645,15 +1241,16 @@ class Sample {
 
     (*data->setup_command_buffer_)
         ->vkCmdPipelineBarrier((*data->setup_command_buffer_),
-                               VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                               VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0,
-                               0, nullptr, 0, nullptr, 1, &barrier);
+                               setup_src_stages, setup_dst_stages, 0, 0,
+                               nullptr, 0, nullptr, num_setup_barriers,
+                               setup_barriers);
     (*data->setup_command_buffer_)
         ->vkEndCommandBuffer(*data->setup_command_buffer_);
 
     data->resolve_command_buffer_ =
         containers::make_unique<vulkan::VkCommandBuffer>(
-            allocator_, app()->GetCommandBuffer());
+            allocator_,
+            vulkan::CreateDefaultCommandBuffer(pool, &application_.device()));
 
     (*data->resolve_command_buffer_)
         ->vkBeginCommandBuffer((*data->resolve_command_buffer_),
@@ -672,7 +1269,7 @@ class Sample {
            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,      // newLayout
            VK_QUEUE_FAMILY_IGNORED,                   // srcQueueFamilyIndex
            VK_QUEUE_FAMILY_IGNORED,                   // dstQueueFamilyIndex
-           *data->multisampled_target_,               // image
+           *targets->multisampled_target_,            // image
            {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1}},
           {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,  // sType
            nullptr,                                 // pNext
@@ -720,7 +1317,7 @@ class Sample {
       };
       (*data->resolve_command_buffer_)
           ->vkCmdResolveImage(
-              (*data->resolve_command_buffer_), *data->multisampled_target_,
+              (*data->resolve_command_buffer_), *targets->multisampled_target_,
               VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, data->swapchain_image_,
               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
     }
@@ -743,8 +1340,6 @@ class Sample {
                                nullptr, 0, nullptr, 1, &present_barrier);
     (*data->resolve_command_buffer_)
         ->vkEndCommandBuffer(*data->resolve_command_buffer_);
-
-    InitializeFrameData(&data->child_data_, initialization_buffer, frame_index);
   }
 
   SampleOptions options_;
@@ -753,10 +1348,45 @@ class Sample {
   // The VulkanApplication that we build on, we want this to be the
   // last thing deleted, it goes at the top.
   vulkan::VulkanApplication application_;
-
+  // Collect the submissions for each frame, so that they can be submitted
+  // together.
+  vulkan::SubmissionBatcher render_submissions_;
+  vulkan::SubmissionBatcher present_submissions_;
+  // Only created if the submission_thread option is enabled. This is
+  // destroyed, making any outstanding calls, before the batchers.
+  containers::unique_ptr<vulkan::SubmissionThread> submission_thread_;
+
+  // The command pools that the per-frame command buffers are allocated from,
+  // one per initialization worker thread. The present pools are only created
+  // if there is a separate present queue. These must outlive frame_data_.
+  containers::vector<vulkan::VkCommandPool> frame_command_pools_;
+  containers::vector<vulkan::VkCommandPool> frame_present_command_pools_;
+  // The depth and multisampled targets, one set per frame in flight, or per
+  // swapchain image if there are fewer images. These must outlive
+  // frame_data_, which holds views of them.
+  containers::vector<RenderTargets> render_targets_;
   // This contains one SampleFrameData per swapchain image. It will be used
   // to render frames to the appropriate swapchains
   containers::vector<SampleFrameData> frame_data_;
+  // The ring of frames in flight, and the one the next frame will use.
+  containers::vector<FrameContext> frame_contexts_;
+  size_t current_frame_context_;
+  // The fence for the last frame that was submitted.
+  ::VkFence last_ready_fence_;
+  // The ticket for the last present made on the submission thread.
+  uint64_t last_present_ticket_;
+  // One slot per frame in flight.
+  containers::unique_ptr<vulkan::CommandBufferRing> frame_command_buffers_;
+  // Only created if gpu_profiling is enabled.
+  containers::unique_ptr<vulkan::GpuProfiler> gpu_profiler_;
+  // Only exists during Initialize(). The pipelines passed to
+  // CommitPipeline() are built on it, and waited for before
+  // InitializeFrameData.
+  containers::unique_ptr<vulkan::PipelineBuildQueue> pipeline_build_queue_;
+  containers::vector<vulkan::VulkanGraphicsPipeline*> queued_pipelines_;
+  // Whether the device was created with pipeline statistics queries, so
+  // that gpu_profiler_ can collect them.
+  const bool pipeline_statistics_query_;
   // The number of samples that we will render with
   VkSampleCountFlagBits num_samples_;
   // The format of our render_target
@@ -776,6 +1406,8 @@ class Sample {
   vulkan::VkCommandBuffer initialization_command_buffer_;
   // The exponentially smoothed average frame time.
   float average_frame_time_;
+  std::chrono::high_resolution_clock::duration last_submit_time_;
+  PresentStatistics present_statistics_;
   // If this is set to false, the application cannot be safely run.
   bool is_valid_;
 };  // namespace sample_application
@@ -338,8 +338,8 @@ class SetEventSample : public sample_application::Sample<CubeFrameData> {
   virtual void Render(vulkan::VkQueue* queue, size_t frame_index,
                       CubeFrameData* frame_data) override {
     // Update our uniform buffers.
-    camera_data->UpdateBuffer(queue, frame_index);
-    model_data->UpdateBuffer(queue, frame_index);
+    camera_data->UpdateBuffer(render_submissions(), frame_index);
+    model_data->UpdateBuffer(render_submissions(), frame_index);
     app()->device()->vkResetEvent(
         app()->device(),
         frame_data->color_data_update_event_->get_raw_object());
@@ -356,9 +356,11 @@ class SetEventSample : public sample_application::Sample<CubeFrameData> {
         nullptr  // pSignalSemaphores
     };
 
-    app()->render_queue()->vkQueueSubmit(app()->render_queue(), 1,
-                                         &init_submit_info,
-                                         static_cast<VkFence>(VK_NULL_HANDLE));
+    render_submissions()->Submit(init_submit_info);
+    // The queue cannot go idle before the work that waits for the event has
+    // been submitted.
+    LOG_ASSERT(==, app()->GetLogger(), VK_SUCCESS,
+               render_submissions()->Flush());
     std::thread wait_idle([&]() {
       app()->render_queue()->vkQueueWaitIdle(app()->render_queue());
     });
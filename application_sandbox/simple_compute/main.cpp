@@ -27,7 +27,8 @@ uint32_t compute_shader[] =
 int main_entry(const entry::EntryData* data) {
   data->logger()->LogInfo("Application Startup");
 
-  vulkan::VulkanApplication app(data->allocator(), data->logger(), data);
+  vulkan::VulkanApplication app(data->allocator(), data->logger(), data,
+                                vulkan::VulkanApplication::ComputeOnly());
   vulkan::VkDevice& device = app.device();
 
   const uint32_t kOutputBuffer =
@@ -170,7 +170,7 @@ class StencilSample : public sample_application::Sample<StencilFrameData> {
     cube_pipeline_->SetScissor(scissor());
     cube_pipeline_->SetSamples(num_samples());
     cube_pipeline_->AddAttachment();
-    cube_pipeline_->Commit();
+    CommitPipeline(cube_pipeline_.get());
 
     // Initialize floor shaders
     floor_pipeline_ = containers::make_unique<vulkan::VulkanGraphicsPipeline>(
@@ -196,7 +196,7 @@ class StencilSample : public sample_application::Sample<StencilFrameData> {
     floor_pipeline_->DepthStencilState().front.compareOp = VK_COMPARE_OP_ALWAYS;
     floor_pipeline_->DepthStencilState().front.passOp = VK_STENCIL_OP_REPLACE;
 
-    floor_pipeline_->Commit();
+    CommitPipeline(floor_pipeline_.get());
 
     // Initialize mirror pipeline
     mirror_pipeline_ = containers::make_unique<vulkan::VulkanGraphicsPipeline>(
@@ -237,7 +237,7 @@ class StencilSample : public sample_application::Sample<StencilFrameData> {
     // Disable depth test, so the reflection can be shown on the floor.
     mirror_pipeline_->DepthStencilState().depthTestEnable = VK_FALSE;
 
-    mirror_pipeline_->Commit();
+    CommitPipeline(mirror_pipeline_.get());
 
     // Transformation data for viewing and cube/floor rotation.
     camera_data_ = containers::make_unique<vulkan::BufferFrameData<CameraData>>(
@@ -421,8 +421,8 @@ class StencilSample : public sample_application::Sample<StencilFrameData> {
   virtual void Render(vulkan::VkQueue* queue, size_t frame_index,
                       StencilFrameData* frame_data) override {
     // Update our uniform buffers.
-    camera_data_->UpdateBuffer(queue, frame_index);
-    model_data_->UpdateBuffer(queue, frame_index);
+    camera_data_->UpdateBuffer(render_submissions(), frame_index);
+    model_data_->UpdateBuffer(render_submissions(), frame_index);
 
     VkSubmitInfo init_submit_info{
         VK_STRUCTURE_TYPE_SUBMIT_INFO,  // sType
@@ -436,9 +436,7 @@ class StencilSample : public sample_application::Sample<StencilFrameData> {
         nullptr  // pSignalSemaphores
     };
 
-    app()->render_queue()->vkQueueSubmit(app()->render_queue(), 1,
-                                         &init_submit_info,
-                                         static_cast<VkFence>(VK_NULL_HANDLE));
+    render_submissions()->Submit(init_submit_info);
   }
 
  private:
@@ -77,20 +77,13 @@ class TexturedCubeSample
         nullptr                             // pImmutableSamplers
     };
     cube_descriptor_set_layouts_[1] = {
-        1,                                  // binding
-        VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,  // descriptorType
-        1,                                  // descriptorCount
-        VK_SHADER_STAGE_VERTEX_BIT,         // stageFlags
-        nullptr                             // pImmutableSamplers
-    };
-    cube_descriptor_set_layouts_[2] = {
         2,                             // binding
         VK_DESCRIPTOR_TYPE_SAMPLER,    // descriptorType
         1,                             // descriptorCount
         VK_SHADER_STAGE_FRAGMENT_BIT,  // stageFlags
         nullptr                        // pImmutableSamplers
     };
-    cube_descriptor_set_layouts_[3] = {
+    cube_descriptor_set_layouts_[2] = {
         3,                                 // binding
         VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,  // descriptorType
         1,                                 // descriptorCount
@@ -103,12 +96,18 @@ class TexturedCubeSample
         vulkan::CreateSampler(&app()->device(), VK_FILTER_LINEAR,
                               VK_FILTER_LINEAR));
 
+    // The model transform changes every frame, so it is passed as a push
+    // constant rather than through a uniform buffer.
     pipeline_layout_ = containers::make_unique<vulkan::PipelineLayout>(
         data_->allocator(),
         app()->CreatePipelineLayout(
             {{cube_descriptor_set_layouts_[0], cube_descriptor_set_layouts_[1],
-              cube_descriptor_set_layouts_[2],
-              cube_descriptor_set_layouts_[3]}}));
+              cube_descriptor_set_layouts_[2]}},
+            {{
+                VK_SHADER_STAGE_VERTEX_BIT,  // stageFlags
+                0,                           // offset
+                sizeof(ModelData)            // size
+            }}));
 
     VkAttachmentReference color_attachment = {
         0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
@@ -162,17 +161,13 @@ class TexturedCubeSample
         data_->allocator(), app(), num_swapchain_images,
         VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
 
-    model_data_ = containers::make_unique<vulkan::BufferFrameData<ModelData>>(
-        data_->allocator(), app(), num_swapchain_images,
-        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
-
     float aspect =
         (float)app()->swapchain().width() / (float)app()->swapchain().height();
     camera_data_->data().projection_matrix =
         Mat44::FromScaleVector(mathfu::Vector<float, 3>{1.0f, -1.0f, 1.0f}) *
         Mat44::Perspective(1.5708f, aspect, 0.1f, 100.0f);
 
-    model_data_->data().transform = Mat44::FromTranslationVector(
+    model_data_.transform = Mat44::FromTranslationVector(
         mathfu::Vector<float, 3>{0.0f, 0.0f, -3.0f});
   }
 
@@ -193,20 +188,14 @@ class TexturedCubeSample
         data_->allocator(),
         app()->AllocateDescriptorSet({
             cube_descriptor_set_layouts_[0], cube_descriptor_set_layouts_[1],
-            cube_descriptor_set_layouts_[2], cube_descriptor_set_layouts_[3],
+            cube_descriptor_set_layouts_[2],
         }));
 
-    VkDescriptorBufferInfo buffer_infos[2] = {
-        {
-            camera_data_->get_buffer(),                       // buffer
-            camera_data_->get_offset_for_frame(frame_index),  // offset
-            camera_data_->size(),                             // range
-        },
-        {
-            model_data_->get_buffer(),                       // buffer
-            model_data_->get_offset_for_frame(frame_index),  // offset
-            model_data_->size(),                             // range
-        }};
+    VkDescriptorBufferInfo buffer_info = {
+        camera_data_->get_buffer(),                       // buffer
+        camera_data_->get_offset_for_frame(frame_index),  // offset
+        camera_data_->size(),                             // range
+    };
 
     VkDescriptorImageInfo sampler_info = {
         *sampler_,                 // sampler
@@ -219,47 +208,15 @@ class TexturedCubeSample
         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,  // imageLayout
     };
 
-    VkWriteDescriptorSet writes[3] = {
-        {
-            VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,  // sType
-            nullptr,                                 // pNext
-            *frame_data->cube_descriptor_set_,       // dstSet
-            0,                                       // dstbinding
-            0,                                       // dstArrayElement
-            2,                                       // descriptorCount
-            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,       // descriptorType
-            nullptr,                                 // pImageInfo
-            &buffer_infos[0],                        // pBufferInfo
-            nullptr,                                 // pTexelBufferView
-        },
-        {
-            VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,  // sType
-            nullptr,                                 // pNext
-            *frame_data->cube_descriptor_set_,       // dstSet
-            2,                                       // dstbinding
-            0,                                       // dstArrayElement
-            1,                                       // descriptorCount
-            VK_DESCRIPTOR_TYPE_SAMPLER,              // descriptorType
-            &sampler_info,                           // pImageInfo
-            nullptr,                                 // pBufferInfo
-            nullptr,                                 // pTexelBufferView
-        },
-        {
-            VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,  // sType
-            nullptr,                                 // pNext
-            *frame_data->cube_descriptor_set_,       // dstSet
-            3,                                       // dstbinding
-            0,                                       // dstArrayElement
-            1,                                       // descriptorCount
-            VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,        // descriptorType
-            &texture_info,                           // pImageInfo
-            nullptr,                                 // pBufferInfo
-            nullptr,                                 // pTexelBufferView
-        },
-    };
-
-    app()->device()->vkUpdateDescriptorSets(app()->device(), 3, writes, 0,
-                                            nullptr);
+    vulkan::DescriptorWriter writer(data_->allocator(), &app()->device());
+    writer
+        .WriteBuffers(*frame_data->cube_descriptor_set_, 0,
+                      VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, {buffer_info})
+        .WriteImages(*frame_data->cube_descriptor_set_, 2,
+                     VK_DESCRIPTOR_TYPE_SAMPLER, {sampler_info})
+        .WriteImages(*frame_data->cube_descriptor_set_, 3,
+                     VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, {texture_info});
+    writer.Flush();
 
     ::VkImageView raw_view = color_view(frame_data);
 
@@ -282,7 +239,11 @@ class TexturedCubeSample
     frame_data->framebuffer_ = containers::make_unique<vulkan::VkFramebuffer>(
         data_->allocator(),
         vulkan::VkFramebuffer(raw_framebuffer, nullptr, &app()->device()));
+  }
 
+  // Records the commands for the frame. This is done every frame, since the
+  // command buffer contains the current model transform.
+  void RecordCommandBuffer(TexturedCubeFrameData* frame_data) {
     (*frame_data->command_buffer_)
         ->vkBeginCommandBuffer((*frame_data->command_buffer_),
                                &sample_application::kBeginCommandBuffer);
@@ -312,6 +273,8 @@ class TexturedCubeSample
         cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
         ::VkPipelineLayout(*pipeline_layout_), 0, 1,
         &frame_data->cube_descriptor_set_->raw_set(), 0, nullptr);
+    cmdBuffer.PushConstants(::VkPipelineLayout(*pipeline_layout_),
+                            VK_SHADER_STAGE_VERTEX_BIT, model_data_);
     cube_.Draw(&cmdBuffer);
     cmdBuffer->vkCmdEndRenderPass(cmdBuffer);
 
@@ -320,8 +283,8 @@ class TexturedCubeSample
   }
 
   virtual void Update(float time_since_last_render) override {
-    model_data_->data().transform =
-        model_data_->data().transform *
+    model_data_.transform =
+        model_data_.transform *
         Mat44::FromRotationMatrix(
             Mat44::RotationX(3.14f * time_since_last_render) *
             Mat44::RotationY(3.14f * time_since_last_render * 0.5f));
@@ -329,8 +292,8 @@ class TexturedCubeSample
   virtual void Render(vulkan::VkQueue* queue, size_t frame_index,
                       TexturedCubeFrameData* frame_data) override {
     // Update our uniform buffers.
-    camera_data_->UpdateBuffer(queue, frame_index);
-    model_data_->UpdateBuffer(queue, frame_index);
+    camera_data_->UpdateBuffer(render_submissions(), frame_index);
+    RecordCommandBuffer(frame_data);
 
     VkSubmitInfo init_submit_info{
         VK_STRUCTURE_TYPE_SUBMIT_INFO,  // sType
@@ -344,9 +307,7 @@ class TexturedCubeSample
         nullptr  // pSignalSemaphores
     };
 
-    app()->render_queue()->vkQueueSubmit(app()->render_queue(), 1,
-                                         &init_submit_info,
-                                         static_cast<VkFence>(VK_NULL_HANDLE));
+    render_submissions()->Submit(init_submit_info);
   }
 
  private:
@@ -362,13 +323,13 @@ class TexturedCubeSample
   containers::unique_ptr<vulkan::PipelineLayout> pipeline_layout_;
   containers::unique_ptr<vulkan::VulkanGraphicsPipeline> cube_pipeline_;
   containers::unique_ptr<vulkan::VkRenderPass> render_pass_;
-  VkDescriptorSetLayoutBinding cube_descriptor_set_layouts_[4];
+  VkDescriptorSetLayoutBinding cube_descriptor_set_layouts_[3];
   vulkan::VulkanModel cube_;
   vulkan::VulkanTexture texture_;
   containers::unique_ptr<vulkan::VkSampler> sampler_;
 
   containers::unique_ptr<vulkan::BufferFrameData<CameraData>> camera_data_;
-  containers::unique_ptr<vulkan::BufferFrameData<ModelData>> model_data_;
+  ModelData model_data_;
 };
 
 int main_entry(const entry::EntryData* data) {
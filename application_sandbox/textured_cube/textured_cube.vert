@@ -22,7 +22,7 @@ layout (binding = 0, set = 0) uniform camera_data {
     layout(column_major) mat4x4 projection;
 };
 
-layout (binding = 1, set = 0) uniform model_data {
+layout (push_constant) uniform model_data {
     layout(column_major) mat4x4 transform;
 };
 
@@ -372,8 +372,8 @@ class WriteTimestampSample
   virtual void Render(vulkan::VkQueue* queue, size_t frame_index,
                       WriteTimestampFrameData* frame_data) override {
     // Update our uniform buffers.
-    camera_data_->UpdateBuffer(queue, frame_index);
-    model_data_->UpdateBuffer(queue, frame_index);
+    camera_data_->UpdateBuffer(render_submissions(), frame_index);
+    model_data_->UpdateBuffer(render_submissions(), frame_index);
 
     uint64_t time_stamp = 0;
     app()->device()->vkGetQueryPoolResults(
@@ -383,7 +383,7 @@ class WriteTimestampSample
 
     // Trim the time stamp value to an uint32.
     timestamp_data_->data().value = uint32_t(time_stamp);
-    timestamp_data_->UpdateBuffer(queue, frame_index);
+    timestamp_data_->UpdateBuffer(render_submissions(), frame_index);
 
     VkSubmitInfo init_submit_info{
         VK_STRUCTURE_TYPE_SUBMIT_INFO,  // sType
@@ -397,9 +397,7 @@ class WriteTimestampSample
         nullptr  // pSignalSemaphores
     };
 
-    app()->render_queue()->vkQueueSubmit(app()->render_queue(), 1,
-                                         &init_submit_info,
-                                         static_cast<VkFence>(VK_NULL_HANDLE));
+    render_submissions()->Submit(init_submit_info);
   }
 
   // Return true if the sample for quering timestamp
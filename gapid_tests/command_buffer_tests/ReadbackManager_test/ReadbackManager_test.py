@@ -0,0 +1,93 @@
+# Copyright 2017 Google Inc.
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#     http://www.apache.org/licenses/LICENSE-2.0
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+from gapit_test_framework import gapit_test, require, require_equal
+from gapit_test_framework import require_not_equal, little_endian_bytes_to_int
+from gapit_test_framework import GapitTest, get_read_offset_function
+import gapit_test_framework
+from struct_offsets import VulkanStruct, UINT32_T, SIZE_T, POINTER
+from struct_offsets import HANDLE, FLOAT, CHAR, ARRAY, DEVICE_SIZE
+from vulkan_constants import *
+
+BUFFER_COPY = [
+    ("srcOffset", DEVICE_SIZE),
+    ("dstOffset", DEVICE_SIZE),
+    ("size", DEVICE_SIZE),
+]
+
+RING_SIZE = 1024
+CHUNK_SIZE = 384
+NUM_CHUNKS = 6
+OVERSIZED_SIZE = 2 * RING_SIZE
+
+
+def get_buffer_copy(test, copy_buffer):
+    require_equal(1, copy_buffer.int_regionCount)
+    return VulkanStruct(
+        test.architecture, BUFFER_COPY,
+        get_read_offset_function(copy_buffer, copy_buffer.hex_pRegions))
+
+
+@gapit_test("ReadbackManager_test")
+class RingWrapsAround(GapitTest):
+
+    def expect(self):
+        """Check that each released readback is copied right after the
+        previous one, until the next one does not fit, and then to the start
+        again"""
+        ring = None
+        for i in range(NUM_CHUNKS):
+            copy_buffer = require(self.next_call_of("vkCmdCopyBuffer"))
+            if ring is None:
+                ring = copy_buffer.int_dstBuffer
+            require_equal(ring, copy_buffer.int_dstBuffer)
+            region = get_buffer_copy(self, copy_buffer)
+            require_equal(i * CHUNK_SIZE, region.srcOffset)
+            require_equal((i % 2) * CHUNK_SIZE, region.dstOffset)
+            require_equal(CHUNK_SIZE, region.size)
+
+
+@gapit_test("ReadbackManager_test")
+class OversizedReadbackHasItsOwnBuffer(GapitTest):
+
+    def expect(self):
+        """Check that a readback larger than the ring is copied elsewhere"""
+        ring = require(self.next_call_of("vkCmdCopyBuffer")).int_dstBuffer
+        copy_buffer = require(self.nth_call_of("vkCmdCopyBuffer", NUM_CHUNKS))
+        require_not_equal(ring, copy_buffer.int_dstBuffer)
+        region = get_buffer_copy(self, copy_buffer)
+        require_equal(RING_SIZE, region.srcOffset)
+        require_equal(0, region.dstOffset)
+        require_equal(OVERSIZED_SIZE, region.size)
+
+
+@gapit_test("ReadbackManager_test")
+class OutOfOrderReleaseKeepsTicketsInUse(GapitTest):
+
+    def expect(self):
+        """Check that the space of the first of three readbacks is reused
+        once it is released, that the space of the third is not while the
+        second is still in use, and that the whole ring is used once every
+        ticket has been released"""
+        ring = require(self.next_call_of("vkCmdCopyBuffer")).int_dstBuffer
+        copies = [require(self.nth_call_of("vkCmdCopyBuffer", NUM_CHUNKS + 1))]
+        copies += [
+            require(self.next_call_of("vkCmdCopyBuffer")) for i in range(5)
+        ]
+        regions = [get_buffer_copy(self, copy) for copy in copies]
+        for i in [0, 1, 2, 3, 5]:
+            require_equal(ring, copies[i].int_dstBuffer)
+        require_equal(regions[0].dstOffset, regions[3].dstOffset)
+        require_equal(regions[0].dstOffset + regions[0].size,
+                      regions[1].dstOffset)
+        require_not_equal(ring, copies[4].int_dstBuffer)
+        require_equal(0, regions[5].dstOffset)
+        require_equal(RING_SIZE, regions[5].size)
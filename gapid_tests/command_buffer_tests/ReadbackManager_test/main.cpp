@@ -0,0 +1,158 @@
+/* Copyright 2017 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "support/containers/vector.h"
+#include "support/entry/entry.h"
+#include "support/log/log.h"
+#include "vulkan_helpers/readback_manager.h"
+#include "vulkan_helpers/vulkan_application.h"
+
+namespace {
+// Small enough that a few readbacks wrap around it.
+const VkDeviceSize kRingSize = 1024;
+// Three of these do not fit in the ring at once.
+const VkDeviceSize kChunkSize = 384;
+const size_t kNumChunks = 6;
+const VkDeviceSize kOversizedSize = 2 * kRingSize;
+const VkDeviceSize kSourceSize = 4 * kRingSize;
+
+// Returns the byte at index of the source buffer. It repeats only every 256
+// * 256 bytes, so data read from the wrong offset does not match.
+uint8_t PatternByte(size_t index) {
+  return static_cast<uint8_t>(index * 7 + index / 256);
+}
+
+// Checks that span holds the size bytes at source_offset of the source
+// buffer.
+void CheckPattern(logging::Logger* log, vulkan::ReadbackManager::Span span,
+                  VkDeviceSize source_offset, VkDeviceSize size) {
+  LOG_ASSERT(==, log, static_cast<size_t>(size), span.size);
+  for (size_t i = 0; i < span.size; ++i) {
+    LOG_ASSERT(==, log, PatternByte(static_cast<size_t>(source_offset) + i),
+               span.data[i]);
+  }
+}
+}  // namespace
+
+int main_entry(const entry::EntryData* data) {
+  data->logger()->LogInfo("Application Startup");
+
+  containers::Allocator* allocator = data->allocator();
+  logging::Logger* log = data->logger();
+  vulkan::VulkanApplication application(allocator, data->logger(), data);
+
+  VkBufferCreateInfo create_info = {
+      VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,  // sType
+      nullptr,                               // pNext
+      0,                                     // createFlags
+      kRingSize,                             // size
+      VK_BUFFER_USAGE_TRANSFER_DST_BIT,      // usage
+      VK_SHARING_MODE_EXCLUSIVE,             // sharingMode
+      0,                                     // queueFamilyIndexCount
+      nullptr                                // pQueueFamilyIndices
+  };
+  vulkan::ReadbackManager readbacks(
+      allocator, &application, &application.render_queue(),
+      application.CreateAndBindHostBuffer(&create_info));
+
+  create_info.size = kSourceSize;
+  create_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+  vulkan::BufferPointer source =
+      application.CreateAndBindCoherentBuffer(&create_info);
+  for (size_t i = 0; i < kSourceSize; ++i) {
+    source->base_address()[i] = static_cast<char>(PatternByte(i));
+  }
+
+  typedef vulkan::ReadbackManager::Ticket Ticket;
+  {
+    // Each readback is flushed, checked and released on its own, so the
+    // ring wraps around at every other one.
+    for (size_t i = 0; i < kNumChunks; ++i) {
+      const VkDeviceSize offset = i * kChunkSize;
+      Ticket ticket =
+          readbacks.ReadBuffer(*source, offset, kChunkSize,
+                               VK_ACCESS_HOST_WRITE_BIT,
+                               VK_PIPELINE_STAGE_HOST_BIT);
+      readbacks.Flush();
+      CheckPattern(log, readbacks.Wait(ticket), offset, kChunkSize);
+      readbacks.Release(ticket);
+    }
+  }
+
+  {
+    // This does not fit in the ring at all.
+    Ticket ticket = readbacks.ReadBuffer(*source, kRingSize, kOversizedSize,
+                                         VK_ACCESS_HOST_WRITE_BIT,
+                                         VK_PIPELINE_STAGE_HOST_BIT);
+    readbacks.Flush();
+    containers::vector<uint8_t> copy(static_cast<size_t>(kOversizedSize), 0,
+                                     allocator);
+    readbacks.CopyTo(ticket, copy.data());
+    CheckPattern(log, {copy.data(), copy.size()}, kRingSize, kOversizedSize);
+    readbacks.Release(ticket);
+  }
+
+  {
+    // Three readbacks fill the ring, and the first and last are released
+    // while the middle one is still in use. Only the space of the first can
+    // be reused, by the fourth, and the fifth goes through a buffer of its
+    // own until the middle one is released, after which the sixth uses the
+    // whole ring.
+    const VkDeviceSize sizes[6] = {384, 256, 384, 384, 384, kRingSize};
+    Ticket tickets[6];
+    VkDeviceSize offsets[6];
+    for (size_t i = 0; i < 3; ++i) {
+      offsets[i] = (i + 1) * 32;
+      tickets[i] = readbacks.ReadBuffer(*source, offsets[i], sizes[i],
+                                        VK_ACCESS_HOST_WRITE_BIT,
+                                        VK_PIPELINE_STAGE_HOST_BIT);
+    }
+    readbacks.Flush();
+    readbacks.WaitIdle();
+    LOG_ASSERT(==, log, true, readbacks.IsComplete(tickets[2]));
+    CheckPattern(log, readbacks.Wait(tickets[2]), offsets[2], sizes[2]);
+    readbacks.Release(tickets[2]);
+    CheckPattern(log, readbacks.Wait(tickets[0]), offsets[0], sizes[0]);
+    readbacks.Release(tickets[0]);
+
+    for (size_t i = 3; i < 5; ++i) {
+      offsets[i] = (i + 1) * 32;
+      tickets[i] = readbacks.ReadBuffer(*source, offsets[i], sizes[i],
+                                        VK_ACCESS_HOST_WRITE_BIT,
+                                        VK_PIPELINE_STAGE_HOST_BIT);
+      readbacks.Flush();
+    }
+    // The readbacks that came after the middle one must not have touched
+    // its data.
+    CheckPattern(log, readbacks.Wait(tickets[3]), offsets[3], sizes[3]);
+    CheckPattern(log, readbacks.Wait(tickets[4]), offsets[4], sizes[4]);
+    CheckPattern(log, readbacks.Wait(tickets[1]), offsets[1], sizes[1]);
+    readbacks.Release(tickets[4]);
+    readbacks.Release(tickets[1]);
+    readbacks.Release(tickets[3]);
+
+    offsets[5] = 6 * 32;
+    tickets[5] = readbacks.ReadBuffer(*source, offsets[5], sizes[5],
+                                      VK_ACCESS_HOST_WRITE_BIT,
+                                      VK_PIPELINE_STAGE_HOST_BIT);
+    readbacks.Flush();
+    CheckPattern(log, readbacks.Wait(tickets[5]), offsets[5], sizes[5]);
+    readbacks.Release(tickets[5]);
+  }
+
+  readbacks.LogStatistics(data->logger());
+  data->logger()->LogInfo("Application Shutdown");
+  return 0;
+}
@@ -0,0 +1,39 @@
+# Copyright 2017 Google Inc.
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#     http://www.apache.org/licenses/LICENSE-2.0
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+from gapit_test_framework import gapit_test, require, require_equal
+from gapit_test_framework import require_not_equal, little_endian_bytes_to_int
+from gapit_test_framework import GapitTest, get_read_offset_function
+import gapit_test_framework
+from vulkan_constants import *
+
+# The frame data is read back once per frame, and twice more for frame 0.
+NUM_READBACKS = 4
+
+
+@gapit_test("UnifiedMemory_test")
+class NothingIsCopiedIntoDeviceBuffers(GapitTest):
+
+    def expect(self):
+        """Check that the only buffer copies are the readbacks of the frame
+        data, which all go to the readback ring, and that neither the model
+        nor the frame data is written through a copy"""
+        first_copy = self.next_call_of("vkCmdCopyBuffer")[0]
+        if first_copy is None:
+            # The device has no unified memory, so nothing was done.
+            return
+        ring = first_copy.int_dstBuffer
+        source = first_copy.int_srcBuffer
+        for i in range(NUM_READBACKS - 1):
+            copy_buffer = require(self.next_call_of("vkCmdCopyBuffer"))
+            require_equal(ring, copy_buffer.int_dstBuffer)
+            require_equal(source, copy_buffer.int_srcBuffer)
+        require_equal(None, self.next_call_of("vkCmdCopyBuffer")[0])
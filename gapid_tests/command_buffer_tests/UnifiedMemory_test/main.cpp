@@ -0,0 +1,133 @@
+/* Copyright 2017 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstring>
+
+#include "support/entry/entry.h"
+#include "support/log/log.h"
+#include "vulkan_helpers/buffer_frame_data.h"
+#include "vulkan_helpers/readback_manager.h"
+#include "vulkan_helpers/upload_manager.h"
+#include "vulkan_helpers/vulkan_application.h"
+#include "vulkan_helpers/vulkan_model.h"
+
+namespace {
+const size_t kNumFrames = 2;
+
+// A single triangle, with its positions, texture coordinates and normals
+// one after the other, as VulkanModel expects them.
+const float kTriangleVertexData[] = {
+    // positions
+    0.0f, 0.5f, 0.0f, -0.5f, -0.5f, 0.0f, 0.5f, -0.5f, 0.0f,
+    // texture coordinates
+    0.5f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f,
+    // normals
+    0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f};
+const uint32_t kTriangleIndices[] = {0, 1, 2};
+
+struct FrameData {
+  float values[16];
+};
+
+// Reads back the copy of data's frame buffer_index through the application's
+// readback manager, and checks that it holds data.data().
+void CheckFrame(logging::Logger* log, vulkan::VulkanApplication* application,
+                vulkan::BufferFrameData<FrameData>* data,
+                size_t buffer_index) {
+  vulkan::ReadbackManager* readbacks = application->readback_manager();
+  vulkan::ReadbackManager::Ticket ticket = readbacks->ReadBuffer(
+      data->get_buffer(), data->get_offset_for_frame(buffer_index),
+      data->size(), VK_ACCESS_HOST_WRITE_BIT, VK_PIPELINE_STAGE_HOST_BIT);
+  readbacks->Flush();
+  vulkan::ReadbackManager::Span span = readbacks->Wait(ticket);
+  LOG_ASSERT(==, log, data->size(), span.size);
+  LOG_ASSERT(==, log, 0, memcmp(&data->data(), span.data, span.size));
+  readbacks->Release(ticket);
+}
+}  // namespace
+
+int main_entry(const entry::EntryData* data) {
+  data->logger()->LogInfo("Application Startup");
+
+  containers::Allocator* allocator = data->allocator();
+  logging::Logger* log = data->logger();
+  vulkan::VulkanApplication application(allocator, data->logger(), data);
+  if (!application.unified_memory()) {
+    // The rest only applies to devices whose main device-local memory is
+    // also host-visible and coherent, such as an ICD that is configured to
+    // advertise such a memory type.
+    log->LogInfo("The device has no unified memory, there is nothing to test");
+    log->LogInfo("Application Shutdown");
+    return 0;
+  }
+
+  {
+    // Device buffers are mapped.
+    VkBufferCreateInfo create_info = {
+        VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,  // sType
+        nullptr,                               // pNext
+        0,                                     // createFlags
+        1024,                                  // size
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,      // usage
+        VK_SHARING_MODE_EXCLUSIVE,             // sharingMode
+        0,                                     // queueFamilyIndexCount
+        nullptr                                // pQueueFamilyIndices
+    };
+    vulkan::BufferPointer buffer =
+        application.CreateAndBindDeviceBuffer(&create_info);
+    LOG_ASSERT(!=, log, static_cast<char*>(nullptr), buffer->base_address());
+  }
+
+  {
+    // A model writes its data in place, and stages nothing.
+    vulkan::VulkanModel triangle(
+        allocator, log, 3, kTriangleVertexData, kTriangleVertexData + 9,
+        kTriangleVertexData + 15, 3, kTriangleIndices);
+    vulkan::VkCommandBuffer command_buffer = application.GetCommandBuffer();
+    VkCommandBufferBeginInfo begin_info{
+        VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, nullptr, 0, nullptr};
+    command_buffer->vkBeginCommandBuffer(command_buffer, &begin_info);
+    triangle.InitializeData(&application, &command_buffer);
+    command_buffer->vkEndCommandBuffer(command_buffer);
+    LOG_ASSERT(==, log, false,
+               application.upload_manager()->has_pending_uploads());
+  }
+
+  {
+    // Staged frame data is written in place too, and never needs a command
+    // buffer, whether it changed or not.
+    vulkan::BufferFrameData<FrameData> frame_data(
+        &application, kNumFrames,
+        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+    for (size_t i = 0; i < 16; ++i) {
+      frame_data.data().values[i] = static_cast<float>(i);
+    }
+    for (size_t frame = 0; frame < kNumFrames; ++frame) {
+      LOG_ASSERT(==, log, false,
+                 frame_data.UpdateBuffer(&application.render_queue(), frame));
+      CheckFrame(log, &application, &frame_data, frame);
+    }
+    frame_data.data().values[3] = 42.0f;
+    LOG_ASSERT(==, log, false,
+               frame_data.UpdateBuffer(&application.render_queue(), 0));
+    CheckFrame(log, &application, &frame_data, 0);
+    LOG_ASSERT(==, log, false,
+               frame_data.UpdateBuffer(&application.render_queue(), 0));
+    CheckFrame(log, &application, &frame_data, 0);
+  }
+
+  data->logger()->LogInfo("Application Shutdown");
+  return 0;
+}
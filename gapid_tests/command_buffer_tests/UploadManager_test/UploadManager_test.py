@@ -0,0 +1,88 @@
+# Copyright 2017 Google Inc.
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#     http://www.apache.org/licenses/LICENSE-2.0
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+from gapit_test_framework import gapit_test, require, require_equal
+from gapit_test_framework import require_not_equal, little_endian_bytes_to_int
+from gapit_test_framework import GapitTest, get_read_offset_function
+import gapit_test_framework
+from struct_offsets import VulkanStruct, UINT32_T, SIZE_T, POINTER
+from struct_offsets import HANDLE, FLOAT, CHAR, ARRAY, DEVICE_SIZE
+from vulkan_constants import *
+
+BUFFER_COPY = [
+    ("srcOffset", DEVICE_SIZE),
+    ("dstOffset", DEVICE_SIZE),
+    ("size", DEVICE_SIZE),
+]
+
+RING_SIZE = 1024
+CHUNK_SIZE = 384
+NUM_CHUNKS = 6
+OVERSIZED_SIZE = 2 * RING_SIZE
+
+
+def get_buffer_copy(test, copy_buffer):
+    require_equal(1, copy_buffer.int_regionCount)
+    return VulkanStruct(
+        test.architecture, BUFFER_COPY,
+        get_read_offset_function(copy_buffer, copy_buffer.hex_pRegions))
+
+
+@gapit_test("UploadManager_test")
+class RingWrapsAround(GapitTest):
+
+    def expect(self):
+        """Check that each flushed upload is staged right after the previous
+        one, until the next one does not fit, and then at the start again"""
+        ring = None
+        for i in range(NUM_CHUNKS):
+            copy_buffer = require(self.next_call_of("vkCmdCopyBuffer"))
+            if ring is None:
+                ring = copy_buffer.int_srcBuffer
+            require_equal(ring, copy_buffer.int_srcBuffer)
+            region = get_buffer_copy(self, copy_buffer)
+            require_equal((i % 2) * CHUNK_SIZE, region.srcOffset)
+            require_equal(i * CHUNK_SIZE, region.dstOffset)
+            require_equal(CHUNK_SIZE, region.size)
+
+
+@gapit_test("UploadManager_test")
+class OversizedUploadHasItsOwnBuffer(GapitTest):
+
+    def expect(self):
+        """Check that an upload larger than the ring is staged elsewhere"""
+        ring = require(self.next_call_of("vkCmdCopyBuffer")).int_srcBuffer
+        copy_buffer = require(self.nth_call_of("vkCmdCopyBuffer", NUM_CHUNKS))
+        require_not_equal(ring, copy_buffer.int_srcBuffer)
+        region = get_buffer_copy(self, copy_buffer)
+        require_equal(0, region.srcOffset)
+        require_equal(NUM_CHUNKS * CHUNK_SIZE, region.dstOffset)
+        require_equal(OVERSIZED_SIZE, region.size)
+
+
+@gapit_test("UploadManager_test")
+class UnsubmittedRecordIsNotReclaimed(GapitTest):
+
+    def expect(self):
+        """Check that the upload recorded after a fenced one completed does
+        not reuse the ring space of a command buffer that was recorded
+        before it, but not submitted yet"""
+        ring = require(self.next_call_of("vkCmdCopyBuffer")).int_srcBuffer
+        first = get_buffer_copy(
+            self, require(self.nth_call_of("vkCmdCopyBuffer", NUM_CHUNKS + 1)))
+        third_copy = require(self.nth_call_of("vkCmdCopyBuffer", 2))
+        third = get_buffer_copy(self, third_copy)
+        require_equal(512, first.size)
+        require_equal(512, third.size)
+        if third_copy.int_srcBuffer == ring:
+            require_equal(True, third.srcOffset + third.size <=
+                          first.srcOffset or
+                          first.srcOffset + first.size <= third.srcOffset)
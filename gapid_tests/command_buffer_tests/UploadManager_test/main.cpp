@@ -0,0 +1,193 @@
+/* Copyright 2017 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "support/containers/vector.h"
+#include "support/entry/entry.h"
+#include "support/log/log.h"
+#include "vulkan_helpers/upload_manager.h"
+#include "vulkan_helpers/vulkan_application.h"
+
+namespace {
+// Small enough that a few uploads wrap around it.
+const VkDeviceSize kRingSize = 1024;
+// Three of these do not fit in the ring at once.
+const VkDeviceSize kChunkSize = 384;
+const size_t kNumChunks = 6;
+const VkDeviceSize kOversizedSize = 2 * kRingSize;
+const VkDeviceSize kDestinationSize = 8 * kRingSize;
+
+// Returns the byte at index of the data uploaded with seed.
+uint8_t PatternByte(uint8_t seed, size_t index) {
+  return static_cast<uint8_t>(seed * 31 + index);
+}
+
+containers::vector<uint8_t> MakePattern(containers::Allocator* allocator,
+                                        VkDeviceSize size, uint8_t seed) {
+  containers::vector<uint8_t> data(static_cast<size_t>(size), 0, allocator);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = PatternByte(seed, i);
+  }
+  return data;
+}
+
+void CheckPattern(logging::Logger* log, const char* data, VkDeviceSize size,
+                  uint8_t seed) {
+  for (size_t i = 0; i < size; ++i) {
+    LOG_ASSERT(==, log, PatternByte(seed, i), static_cast<uint8_t>(data[i]));
+  }
+}
+
+void BeginCommandBuffer(vulkan::VkCommandBuffer* command_buffer) {
+  VkCommandBufferBeginInfo begin_info{
+      VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, nullptr, 0, nullptr};
+  (*command_buffer)->vkBeginCommandBuffer(*command_buffer, &begin_info);
+}
+
+void Submit(vulkan::VkQueue* queue, vulkan::VkCommandBuffer* command_buffer,
+            ::VkFence fence) {
+  ::VkCommandBuffer raw_command_buffer = command_buffer->get_command_buffer();
+  VkSubmitInfo submit{VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                      nullptr,
+                      0,
+                      nullptr,
+                      nullptr,
+                      1,
+                      &raw_command_buffer,
+                      0,
+                      nullptr};
+  (*queue)->vkQueueSubmit(*queue, 1, &submit, fence);
+}
+}  // namespace
+
+int main_entry(const entry::EntryData* data) {
+  data->logger()->LogInfo("Application Startup");
+
+  containers::Allocator* allocator = data->allocator();
+  vulkan::VulkanApplication application(allocator, data->logger(), data);
+  vulkan::VkQueue& queue = application.render_queue();
+
+  VkBufferCreateInfo create_info = {
+      VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,  // sType
+      nullptr,                               // pNext
+      0,                                     // createFlags
+      kRingSize,                             // size
+      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,      // usage
+      VK_SHARING_MODE_EXCLUSIVE,             // sharingMode
+      0,                                     // queueFamilyIndexCount
+      nullptr                                // pQueueFamilyIndices
+  };
+  vulkan::UploadManager uploads(
+      allocator, &application, &queue,
+      application.CreateAndBindCoherentBuffer(&create_info));
+
+  create_info.size = kDestinationSize;
+  create_info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  vulkan::BufferPointer destination =
+      application.CreateAndBindHostBuffer(&create_info);
+
+  uint8_t seed = 0;
+  VkDeviceSize offset = 0;
+  {
+    // Each upload is flushed on its own, so the ring wraps around, and
+    // waits for the oldest flush, at every other upload.
+    for (size_t i = 0; i < kNumChunks; ++i) {
+      containers::vector<uint8_t> chunk =
+          MakePattern(allocator, kChunkSize, static_cast<uint8_t>(seed + i));
+      uploads.UploadBuffer(*destination, offset + i * kChunkSize,
+                           chunk.data(), kChunkSize,
+                           VK_ACCESS_HOST_READ_BIT, VK_PIPELINE_STAGE_HOST_BIT);
+      uploads.Flush();
+    }
+    uploads.WaitIdle();
+    destination->invalidate();
+    for (size_t i = 0; i < kNumChunks; ++i) {
+      CheckPattern(data->logger(),
+                   destination->base_address() + offset + i * kChunkSize,
+                   kChunkSize, static_cast<uint8_t>(seed + i));
+    }
+    seed += kNumChunks;
+    offset += kNumChunks * kChunkSize;
+  }
+
+  {
+    // This does not fit in the ring at all.
+    containers::vector<uint8_t> oversized =
+        MakePattern(allocator, kOversizedSize, seed);
+    uploads.UploadBuffer(*destination, offset, oversized.data(),
+                         kOversizedSize, VK_ACCESS_HOST_READ_BIT,
+                         VK_PIPELINE_STAGE_HOST_BIT);
+    uploads.Flush();
+    uploads.WaitIdle();
+    destination->invalidate();
+    CheckPattern(data->logger(), destination->base_address() + offset,
+                 kOversizedSize, seed);
+    seed += 1;
+    offset += kOversizedSize;
+  }
+
+  {
+    // The first upload is recorded into a command buffer that is only
+    // submitted at the end, so its staging data has to survive the second
+    // upload, whose command buffer completes first, and the third, which
+    // only fits in the ring if the first one's space is reused.
+    const VkDeviceSize sizes[3] = {512, 256, 512};
+    containers::vector<uint8_t> first =
+        MakePattern(allocator, sizes[0], seed);
+    containers::vector<uint8_t> second =
+        MakePattern(allocator, sizes[1], seed + 1);
+    containers::vector<uint8_t> third =
+        MakePattern(allocator, sizes[2], seed + 2);
+
+    vulkan::VkCommandBuffer late_command_buffer =
+        application.GetCommandBuffer();
+    BeginCommandBuffer(&late_command_buffer);
+    uploads.UploadBuffer(*destination, offset, first.data(), sizes[0],
+                         VK_ACCESS_HOST_READ_BIT, VK_PIPELINE_STAGE_HOST_BIT);
+    uploads.Record(&late_command_buffer);
+    late_command_buffer->vkEndCommandBuffer(late_command_buffer);
+
+    vulkan::VkCommandBuffer early_command_buffer =
+        application.GetCommandBuffer();
+    BeginCommandBuffer(&early_command_buffer);
+    uploads.UploadBuffer(*destination, offset + sizes[0], second.data(),
+                         sizes[1], VK_ACCESS_HOST_READ_BIT,
+                         VK_PIPELINE_STAGE_HOST_BIT);
+    ::VkFence fence = uploads.RecordWithFence(&early_command_buffer);
+    early_command_buffer->vkEndCommandBuffer(early_command_buffer);
+    Submit(&queue, &early_command_buffer, fence);
+    queue->vkQueueWaitIdle(queue);
+
+    uploads.UploadBuffer(*destination, offset + sizes[0] + sizes[1],
+                         third.data(), sizes[2], VK_ACCESS_HOST_READ_BIT,
+                         VK_PIPELINE_STAGE_HOST_BIT);
+    Submit(&queue, &late_command_buffer,
+           static_cast<::VkFence>(VK_NULL_HANDLE));
+    uploads.Flush();
+    uploads.WaitIdle();
+    destination->invalidate();
+    CheckPattern(data->logger(), destination->base_address() + offset,
+                 sizes[0], seed);
+    CheckPattern(data->logger(),
+                 destination->base_address() + offset + sizes[0], sizes[1],
+                 seed + 1);
+    CheckPattern(data->logger(),
+                 destination->base_address() + offset + sizes[0] + sizes[1],
+                 sizes[2], seed + 2);
+  }
+
+  uploads.LogStatistics(data->logger());
+  data->logger()->LogInfo("Application Shutdown");
+  return 0;
+}
@@ -88,7 +88,7 @@ int main_entry(const entry::EntryData* data) {
   ::VkSemaphore layout_transition_semaphores[2] = {
       src_layout_transition_semaphore, dst_layout_transition_semaphore};
 
-  std::tuple<bool, vulkan::VkCommandBuffer, vulkan::BufferPointer> fill_result =
+  std::tuple<bool, vulkan::VkCommandBuffer> fill_result =
       application.FillImageLayersData(
           src_image.get(),
           {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},   // subresourcelayer
@@ -86,8 +86,8 @@ int main_entry(const entry::EntryData* data) {
         layout_transition_semaphore, nullptr, &device);
 
     // Fill initial data in the source image
-    std::tuple<bool, vulkan::VkCommandBuffer, vulkan::BufferPointer>
-        fill_result = application.FillImageLayersData(
+    std::tuple<bool, vulkan::VkCommandBuffer> fill_result =
+        application.FillImageLayersData(
             src_image.get(),
             {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},   // subresourcelayer
             {0, 0, 0},                              // offset
@@ -233,8 +233,8 @@ int main_entry(const entry::EntryData* data) {
         copy_image_data[i] = i & 0xFF;
       }
 
-      std::tuple<bool, vulkan::VkCommandBuffer, vulkan::BufferPointer>
-          fill_result = application.FillImageLayersData(
+      std::tuple<bool, vulkan::VkCommandBuffer> fill_result =
+          application.FillImageLayersData(
               src_image.get(),
               {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},   // subresourcelayer
               {8, 12, 0},                             // offset
@@ -70,9 +70,9 @@ vulkan::VkQueryPool QueryWithoutDrawingAnything(
       );
 
   // Create shader modules.
-  vulkan::VkShaderModule vertex_shader_module =
+  vulkan::SharedShaderModule vertex_shader_module =
       app->CreateShaderModule(vertex_shader);
-  vulkan::VkShaderModule fragment_shader_module =
+  vulkan::SharedShaderModule fragment_shader_module =
       app->CreateShaderModule(fragment_shader);
   VkPipelineShaderStageCreateInfo shader_stage_create_infos[2] = {
       {
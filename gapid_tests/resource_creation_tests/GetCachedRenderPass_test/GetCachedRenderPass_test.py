@@ -0,0 +1,27 @@
+# Copyright 2017 Google Inc.
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#     http://www.apache.org/licenses/LICENSE-2.0
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+from gapit_test_framework import gapit_test, require, require_equal
+from gapit_test_framework import require_not_equal, little_endian_bytes_to_int
+from gapit_test_framework import GapitTest, get_read_offset_function
+from vulkan_constants import *
+
+
+@gapit_test("GetCachedRenderPass_test")
+class CacheHitCreatesNothing(GapitTest):
+
+    def expect(self):
+        """Check that the three requests only create two render passes"""
+        first = require(self.next_call_of("vkCreateRenderPass"))
+        second = require(self.next_call_of("vkCreateRenderPass"))
+        require_equal(VK_SUCCESS, int(first.return_val))
+        require_equal(VK_SUCCESS, int(second.return_val))
+        require_equal(None, self.next_call_of("vkCreateRenderPass")[0])
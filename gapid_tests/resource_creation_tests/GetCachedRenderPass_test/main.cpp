@@ -0,0 +1,80 @@
+/* Copyright 2017 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "support/entry/entry.h"
+#include "support/log/log.h"
+#include "vulkan_helpers/vulkan_application.h"
+
+namespace {
+// Returns the cached render pass with a single color attachment of the given
+// format.
+::VkRenderPass GetColorRenderPass(vulkan::VulkanApplication* application,
+                                  VkFormat format) {
+  VkAttachmentReference color_attachment = {
+      0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+  return application->GetCachedRenderPass(
+      {{
+          0,                                         // flags
+          format,                                    // format
+          VK_SAMPLE_COUNT_1_BIT,                     // samples
+          VK_ATTACHMENT_LOAD_OP_CLEAR,               // loadOp
+          VK_ATTACHMENT_STORE_OP_STORE,              // storeOp
+          VK_ATTACHMENT_LOAD_OP_DONT_CARE,           // stencilLoadOp
+          VK_ATTACHMENT_STORE_OP_DONT_CARE,          // stencilStoreOp
+          VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,  // initialLayout
+          VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL   // finalLayout
+      }},  // AttachmentDescriptions
+      {{
+          0,                                // flags
+          VK_PIPELINE_BIND_POINT_GRAPHICS,  // pipelineBindPoint
+          0,                                // inputAttachmentCount
+          nullptr,                          // pInputAttachments
+          1,                                // colorAttachmentCount
+          &color_attachment,                // colorAttachment
+          nullptr,                          // pResolveAttachments
+          nullptr,                          // pDepthStencilAttachment
+          0,                                // preserveAttachmentCount
+          nullptr                           // pPreserveAttachments
+      }},                                   // SubpassDescriptions
+      {}                                    // SubpassDependencies
+  );
+}
+}  // namespace
+
+int main_entry(const entry::EntryData* data) {
+  data->logger()->LogInfo("Application Startup");
+  vulkan::VulkanApplication application(data->allocator(), data->logger(),
+                                        data);
+
+  {
+    // The first request creates the render pass, and the second, with the
+    // same arguments, returns it from the cache.
+    ::VkRenderPass first =
+        GetColorRenderPass(&application, VK_FORMAT_R8G8B8A8_UNORM);
+    ::VkRenderPass second =
+        GetColorRenderPass(&application, VK_FORMAT_R8G8B8A8_UNORM);
+    LOG_ASSERT(!=, data->logger(), static_cast<::VkRenderPass>(VK_NULL_HANDLE),
+               first);
+    LOG_ASSERT(==, data->logger(), first, second);
+
+    // Different arguments miss the cache.
+    ::VkRenderPass other =
+        GetColorRenderPass(&application, VK_FORMAT_B8G8R8A8_UNORM);
+    LOG_ASSERT(!=, data->logger(), first, other);
+  }
+
+  data->logger()->LogInfo("Application Shutdown");
+  return 0;
+}
@@ -97,9 +97,9 @@ int main_entry(const entry::EntryData* data) {
         {}                                    // SubpassDependencies
         );
 
-    vulkan::VkShaderModule vertex_shader_module =
+    vulkan::SharedShaderModule vertex_shader_module =
         app.CreateShaderModule(vertex_shader);
-    vulkan::VkShaderModule fragment_shader_module =
+    vulkan::SharedShaderModule fragment_shader_module =
         app.CreateShaderModule(fragment_shader);
     VkPipelineShaderStageCreateInfo shader_stage_create_infos[2] = {
         {
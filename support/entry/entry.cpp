@@ -46,7 +46,9 @@ void dummy_function() {}
 EntryData::EntryData(containers::Allocator* allocator, uint32_t width,
                      uint32_t height, bool fixed_timestep,
                      bool separate_present, int64_t output_frame_index,
-                     const char* output_frame_file, const char* shader_compiler
+                     const char* output_frame_file, const char* shader_compiler,
+                     const char* pipeline_cache_file,
+                     const char* present_mode, uint32_t swapchain_images
 #if defined __ANDROID__
                      ,
                      android_app* app
@@ -59,6 +61,9 @@ EntryData::EntryData(containers::Allocator* allocator, uint32_t width,
       output_frame_index_(output_frame_index),
       output_frame_file_(output_frame_file),
       shader_compiler_(shader_compiler),
+      pipeline_cache_file_(pipeline_cache_file),
+      present_mode_(present_mode),
+      swapchain_images_(swapchain_images),
       log_(logging::GetLogger(allocator)),
       allocator_(allocator)
 #if defined __ANDROID__
@@ -125,6 +130,9 @@ struct CommandLineArgs {
   int32_t output_frame;
   const char* output_file;
   const char* shader_compiler;
+  const char* pipeline_cache_file;
+  const char* present_mode;
+  uint32_t swapchain_images;
 };
 
 void parse_args(CommandLineArgs* args, int argc, const char** argv) {
@@ -135,6 +143,9 @@ void parse_args(CommandLineArgs* args, int argc, const char** argv) {
   args->output_frame = OUTPUT_FRAME;
   args->output_file = OUTPUT_FILE;
   args->shader_compiler = SHADER_COMPILER;
+  args->pipeline_cache_file = PIPELINE_CACHE_FILE;
+  args->present_mode = PRESENT_MODE;
+  args->swapchain_images = SWAPCHAIN_IMAGES;
 
   for (int i = 0; i < argc; ++i) {
     if (strncmp(argv[i], "-w=", 3) == 0) {
@@ -158,6 +169,15 @@ void parse_args(CommandLineArgs* args, int argc, const char** argv) {
     if (strncmp(argv[i], "-shader-compiler=", 17) == 0) {
       args->shader_compiler = argv[i] + 17;
     }
+    if (strncmp(argv[i], "-pipeline-cache=", 16) == 0) {
+      args->pipeline_cache_file = argv[i] + 16;
+    }
+    if (strncmp(argv[i], "-present-mode=", 14) == 0) {
+      args->present_mode = argv[i] + 14;
+    }
+    if (strncmp(argv[i], "-swapchain-images=", 18) == 0) {
+      args->swapchain_images = atoi(argv[i] + 18);
+    }
   }
 }
 #endif
@@ -218,10 +238,19 @@ void android_main(android_app* app) {
 
     containers::LeakCheckAllocator root_allocator;
     {
+      // Keep the pipeline cache, if there is one, in the application's
+      // internal storage.
+      std::string pipeline_cache_file;
+      if (PIPELINE_CACHE_FILE[0] != '\0') {
+        pipeline_cache_file = std::string(app->activity->internalDataPath) +
+                              "/" + PIPELINE_CACHE_FILE;
+      }
       entry::EntryData entry_data(&root_allocator, static_cast<uint32_t>(width),
                                   static_cast<uint32_t>(height), FIXED_TIMESTEP,
                                   PREFER_SEPARATE_PRESENT, output_frame,
-                                  output_file, shader_compiler, app);
+                                  output_file, shader_compiler,
+                                  pipeline_cache_file.c_str(), PRESENT_MODE,
+                                  SWAPCHAIN_IMAGES, app);
       data.entry_data = &entry_data;
       int return_value = main_entry(&entry_data);
       // Do not modify this line, scripts may look for it in the output.
@@ -298,6 +327,7 @@ static char file_path[1024 * 1024] = {};
 // It maps it onto the screen and passes it on to the main_entry function.
 // -w=X will set the window width to X
 // -h=Y will set the window height to Y
+// -pipeline-cache=F will load the pipeline cache from F, and save it back to F
 int main(int argc, const char** argv) {
   int path_len = readlink("/proc/self/exe", file_path, 1024 * 1024 - 1);
   if (path_len != -1) {
@@ -327,7 +357,9 @@ int main(int argc, const char** argv) {
     entry::EntryData entry_data(&root_allocator, args.window_width,
                                 args.window_height, args.fixed_timestep,
                                 args.prefer_separate_present, args.output_frame,
-                                args.output_file, args.shader_compiler);
+                                args.output_file, args.shader_compiler,
+                                args.pipeline_cache_file, args.present_mode,
+                                args.swapchain_images);
     if (args.output_frame == -1) {
       bool window_created = entry_data.CreateWindow();
       if (!window_created) {
@@ -436,7 +468,9 @@ int main(int argc, const char** argv) {
   entry::EntryData entry_data(&root_allocator, args.window_width,
                               args.window_height, args.fixed_timestep,
                               args.prefer_separate_present, args.output_frame,
-                              args.output_file, args.shader_compiler);
+                              args.output_file, args.shader_compiler,
+                              args.pipeline_cache_file, args.present_mode,
+                              args.swapchain_images);
 
   if (args.output_frame == -1) {
     bool window_created = entry_data.CreateWindowWin32();
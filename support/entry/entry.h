@@ -65,7 +65,8 @@ class EntryData {
     EntryData(containers::Allocator* allocator, uint32_t width, uint32_t height,
               bool fixed_timestep, bool separate_present,
               int64_t output_frame_index, const char* output_frame_file,
-              const char* shader_compiler
+              const char* shader_compiler, const char* pipeline_cache_file,
+              const char* present_mode, uint32_t swapchain_images
 #if defined __ANDROID__
               ,
               android_app* app
@@ -117,6 +118,23 @@ class EntryData {
     int64_t output_frame_index() const { return output_frame_index_; }
     const char* output_frame_file() const { return output_frame_file_; }
     const char* shader_compiler() const { return shader_compiler_; }
+    // Returns the file that the pipeline cache should be loaded from and
+    // saved to, or nullptr if the pipeline cache should not be persisted.
+    const char* pipeline_cache_file() const {
+      return pipeline_cache_file_ && pipeline_cache_file_[0] != '\0'
+                 ? pipeline_cache_file_
+                 : nullptr;
+    }
+    // Returns the name of the present mode that the swapchain should use
+    // if the surface supports it, or nullptr to leave it to the
+    // application.
+    const char* present_mode() const {
+      return present_mode_ && present_mode_[0] != '\0' ? present_mode_
+                                                        : nullptr;
+    }
+    // Returns the number of swapchain images to ask for, or 0 to leave it
+    // to the application.
+    uint32_t swapchain_images() const { return swapchain_images_; }
 
    private:
     bool fixed_timestep_;
@@ -126,6 +144,9 @@ class EntryData {
     int64_t output_frame_index_;
     const char* output_frame_file_;
     const char* shader_compiler_;
+    const char* pipeline_cache_file_;
+    const char* present_mode_;
+    uint32_t swapchain_images_;
     containers::unique_ptr<logging::Logger> log_;
     containers::Allocator* allocator_;
 
@@ -0,0 +1,189 @@
+/* Copyright 2017 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "vulkan_helpers/allocation_callbacks.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace vulkan {
+namespace {
+// Every block handed to the driver is preceded by this header, which records
+// what is needed to return the block to the containers::Allocator.
+// Its size is a multiple of kMinAlignment, so that placing it directly in
+// front of an aligned block keeps the header itself aligned.
+struct alignas(16) AllocationHeader {
+  void* base;
+  size_t allocated_size;
+  size_t size;
+  VkSystemAllocationScope scope;
+};
+
+// containers::Allocator::construct assumes 16 bytes is the maximum natural
+// alignment, do the same here.
+const size_t kMinAlignment = 16;
+
+static_assert(sizeof(AllocationHeader) % kMinAlignment == 0,
+              "AllocationHeader must keep the user block aligned");
+
+AllocationHeader* GetHeader(void* memory) {
+  return reinterpret_cast<AllocationHeader*>(static_cast<char*>(memory) -
+                                             sizeof(AllocationHeader));
+}
+
+const char* ScopeName(VkSystemAllocationScope scope) {
+  switch (scope) {
+    case VK_SYSTEM_ALLOCATION_SCOPE_COMMAND:
+      return "command";
+    case VK_SYSTEM_ALLOCATION_SCOPE_OBJECT:
+      return "object";
+    case VK_SYSTEM_ALLOCATION_SCOPE_CACHE:
+      return "cache";
+    case VK_SYSTEM_ALLOCATION_SCOPE_DEVICE:
+      return "device";
+    case VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE:
+      return "instance";
+    default:
+      break;
+  }
+  return "unknown";
+}
+}  // namespace
+
+AllocationCallbacks::AllocationCallbacks(containers::Allocator* allocator,
+                                         logging::Logger* log)
+    : allocator_(allocator), log_(log) {
+  callbacks_.pUserData = this;
+  callbacks_.pfnAllocation = &AllocationCallbacks::Allocate;
+  callbacks_.pfnReallocation = &AllocationCallbacks::Reallocate;
+  callbacks_.pfnFree = &AllocationCallbacks::Free;
+  callbacks_.pfnInternalAllocation = &AllocationCallbacks::InternalAllocate;
+  callbacks_.pfnInternalFree = &AllocationCallbacks::InternalFree;
+  for (auto& scope : scopes_) {
+    scope.current_bytes.store(0);
+    scope.peak_bytes.store(0);
+    scope.total_allocations.store(0);
+    scope.internal_bytes.store(0);
+  }
+}
+
+AllocationCallbacks::~AllocationCallbacks() {
+  if (log_) {
+    LogStatistics(log_);
+  }
+}
+
+void* AllocationCallbacks::DoAllocate(size_t size, size_t alignment,
+                                      VkSystemAllocationScope scope) {
+  if (size == 0) {
+    return nullptr;
+  }
+  alignment = std::max(alignment, kMinAlignment);
+  // alignment is guaranteed by the spec to be a power of two.
+  const size_t allocated_size = sizeof(AllocationHeader) + size + alignment - 1;
+  char* base = static_cast<char*>(allocator_->malloc(allocated_size));
+  if (!base) {
+    return nullptr;
+  }
+  const uintptr_t first_usable =
+      reinterpret_cast<uintptr_t>(base) + sizeof(AllocationHeader);
+  char* memory = reinterpret_cast<char*>((first_usable + alignment - 1) &
+                                         ~(uintptr_t(alignment) - 1));
+  AllocationHeader* header = GetHeader(memory);
+  header->base = base;
+  header->allocated_size = allocated_size;
+  header->size = size;
+  header->scope = scope;
+
+  ScopeStatistics& stats = scopes_[scope];
+  size_t current = (stats.current_bytes += size);
+  size_t peak = stats.peak_bytes.load();
+  while (current > peak &&
+         !stats.peak_bytes.compare_exchange_weak(peak, current)) {
+  }
+  stats.total_allocations += 1;
+  return memory;
+}
+
+void AllocationCallbacks::DoFree(void* memory) {
+  if (!memory) {
+    return;
+  }
+  AllocationHeader* header = GetHeader(memory);
+  scopes_[header->scope].current_bytes -= header->size;
+  allocator_->free(header->base, header->allocated_size);
+}
+
+void* VKAPI_PTR AllocationCallbacks::Allocate(void* user_data, size_t size,
+                                              size_t alignment,
+                                              VkSystemAllocationScope scope) {
+  return static_cast<AllocationCallbacks*>(user_data)->DoAllocate(
+      size, alignment, scope);
+}
+
+void* VKAPI_PTR AllocationCallbacks::Reallocate(void* user_data,
+                                                void* original, size_t size,
+                                                size_t alignment,
+                                                VkSystemAllocationScope scope) {
+  AllocationCallbacks* self = static_cast<AllocationCallbacks*>(user_data);
+  if (!original) {
+    return self->DoAllocate(size, alignment, scope);
+  }
+  if (size == 0) {
+    self->DoFree(original);
+    return nullptr;
+  }
+  // The spec requires the original allocation to be left untouched if the
+  // reallocation fails, so only free it once the new block exists.
+  void* memory = self->DoAllocate(size, alignment, scope);
+  if (!memory) {
+    return nullptr;
+  }
+  memcpy(memory, original, std::min(size, GetHeader(original)->size));
+  self->DoFree(original);
+  return memory;
+}
+
+void VKAPI_PTR AllocationCallbacks::Free(void* user_data, void* memory) {
+  static_cast<AllocationCallbacks*>(user_data)->DoFree(memory);
+}
+
+void VKAPI_PTR AllocationCallbacks::InternalAllocate(
+    void* user_data, size_t size, VkInternalAllocationType,
+    VkSystemAllocationScope scope) {
+  static_cast<AllocationCallbacks*>(user_data)->scopes_[scope].internal_bytes +=
+      size;
+}
+
+void VKAPI_PTR AllocationCallbacks::InternalFree(
+    void* user_data, size_t size, VkInternalAllocationType,
+    VkSystemAllocationScope scope) {
+  static_cast<AllocationCallbacks*>(user_data)->scopes_[scope].internal_bytes -=
+      size;
+}
+
+void AllocationCallbacks::LogStatistics(logging::Logger* log) const {
+  log->LogInfo("Driver host memory by allocation scope:");
+  for (uint32_t i = VK_SYSTEM_ALLOCATION_SCOPE_BEGIN_RANGE;
+       i <= VK_SYSTEM_ALLOCATION_SCOPE_END_RANGE; ++i) {
+    VkSystemAllocationScope scope = static_cast<VkSystemAllocationScope>(i);
+    log->LogInfo("    ", ScopeName(scope), ": ", current_bytes(scope),
+                 " bytes live, ", peak_bytes(scope), " bytes peak, ",
+                 total_allocations(scope), " allocations, ",
+                 internal_bytes(scope), " internal bytes");
+  }
+}
+
+}  // namespace vulkan
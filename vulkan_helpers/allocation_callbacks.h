@@ -0,0 +1,107 @@
+/* Copyright 2017 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_HELPERS_ALLOCATION_CALLBACKS_H_
+#define VULKAN_HELPERS_ALLOCATION_CALLBACKS_H_
+
+#include <atomic>
+#include <cstddef>
+
+#include "support/containers/allocator.h"
+#include "support/log/log.h"
+#include "vulkan_helpers/vulkan_header_wrapper.h"
+
+namespace vulkan {
+
+// AllocationCallbacks exposes a containers::Allocator to the driver as a
+// VkAllocationCallbacks structure, so that host memory allocated by the
+// Vulkan implementation is accounted for by our own allocators.
+// Every allocation respects the alignment requested by the driver, and the
+// number of bytes is tracked per VkSystemAllocationScope.
+// The VkAllocationCallbacks returned from get() point back to this object, so
+// it must outlive every Vulkan object created with them. It is therefore
+// neither copyable nor movable.
+class AllocationCallbacks {
+ public:
+  // If log is not nullptr, the statistics are logged to it on destruction,
+  // when anything still live has been leaked by the driver or the caller.
+  explicit AllocationCallbacks(containers::Allocator* allocator,
+                               logging::Logger* log = nullptr);
+  ~AllocationCallbacks();
+  AllocationCallbacks(const AllocationCallbacks&) = delete;
+  AllocationCallbacks(AllocationCallbacks&&) = delete;
+  AllocationCallbacks& operator=(const AllocationCallbacks&) = delete;
+  AllocationCallbacks& operator=(AllocationCallbacks&&) = delete;
+
+  // Returns the callbacks to be passed as pAllocator to Vulkan commands.
+  VkAllocationCallbacks* get() { return &callbacks_; }
+
+  // Returns the number of bytes the driver currently holds in the given scope.
+  size_t current_bytes(VkSystemAllocationScope scope) const {
+    return scopes_[scope].current_bytes.load();
+  }
+  // Returns the largest number of bytes the driver has held at one time in
+  // the given scope.
+  size_t peak_bytes(VkSystemAllocationScope scope) const {
+    return scopes_[scope].peak_bytes.load();
+  }
+  // Returns the number of allocations the driver has made in the given scope.
+  uint64_t total_allocations(VkSystemAllocationScope scope) const {
+    return scopes_[scope].total_allocations.load();
+  }
+  // Returns the number of bytes the driver reports to have allocated on its
+  // own (through the internal allocation notifications) in the given scope.
+  size_t internal_bytes(VkSystemAllocationScope scope) const {
+    return scopes_[scope].internal_bytes.load();
+  }
+
+  // Logs the current, peak and internal usage of every allocation scope.
+  void LogStatistics(logging::Logger* log) const;
+
+ private:
+  static void* VKAPI_PTR Allocate(void* user_data, size_t size,
+                                  size_t alignment,
+                                  VkSystemAllocationScope scope);
+  static void* VKAPI_PTR Reallocate(void* user_data, void* original,
+                                    size_t size, size_t alignment,
+                                    VkSystemAllocationScope scope);
+  static void VKAPI_PTR Free(void* user_data, void* memory);
+  static void VKAPI_PTR InternalAllocate(void* user_data, size_t size,
+                                         VkInternalAllocationType type,
+                                         VkSystemAllocationScope scope);
+  static void VKAPI_PTR InternalFree(void* user_data, size_t size,
+                                     VkInternalAllocationType type,
+                                     VkSystemAllocationScope scope);
+
+  void* DoAllocate(size_t size, size_t alignment,
+                   VkSystemAllocationScope scope);
+  void DoFree(void* memory);
+
+  struct ScopeStatistics {
+    std::atomic<size_t> current_bytes;
+    std::atomic<size_t> peak_bytes;
+    std::atomic<uint64_t> total_allocations;
+    std::atomic<size_t> internal_bytes;
+  };
+
+  containers::Allocator* allocator_;
+  logging::Logger* log_;
+  VkAllocationCallbacks callbacks_;
+  ScopeStatistics scopes_[VK_SYSTEM_ALLOCATION_SCOPE_RANGE_SIZE];
+};
+
+}  // namespace vulkan
+
+#endif  // VULKAN_HELPERS_ALLOCATION_CALLBACKS_H_
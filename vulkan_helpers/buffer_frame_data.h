@@ -16,6 +16,9 @@
 #ifndef VULKAN_HELPERS_BUFFER_FRAME_DATA_H
 #define VULKAN_HELPERS_BUFFER_FRAME_DATA_H
 
+#include <algorithm>
+
+#include "vulkan_helpers/submission_batcher.h"
 #include "vulkan_helpers/vulkan_application.h"
 
 namespace vulkan {
@@ -27,6 +30,19 @@ size_t RoundUp(size_t to_round, size_t power_of_2_to_round) {
   return (to_round + power_of_2_to_round - 1) & ~(power_of_2_to_round - 1);
 }
 
+// How a BufferFrameData gets its data to the GPU.
+enum class BufferFrameDataMode {
+  // Every frame's data is copied from a host buffer into a device-local
+  // buffer, by a command buffer that is submitted whenever it changes. With
+  // unified memory, the device-local buffer is mapped, and the data is
+  // written to it directly instead, with no copy.
+  kStaged,
+  // Every frame's data lives in persistently mapped host-coherent memory,
+  // and is written in place, with no copy, barrier or submission. This
+  // suits small data that changes every frame.
+  kMapped,
+};
+
 template <typename T>
 class BufferFrameData {
   // BufferFrameData is a class that wraps some amount of data for multi-frame
@@ -37,18 +53,28 @@ class BufferFrameData {
   // byte for byte into a uniform buffer, so it it must have the proper
   // alignment as defined in SPIR-V.
  public:
+  // The number of pipeline barriers around the copy in every update command
+  // buffer.
+  static const uint32_t kBarriersPerUpdate = 2;
+
   // |buffered_data_count| is the number of buffered frames the uniform data
   // should produce. Typcially this is one per swapchain image. |usage| is the
   // VkBufferUsageFlags used for the underlying VkBuffer(s) that stores the
   // uniform data. Note that VK_BUFFER_USAGE_TRANSFER_DST_BIT will be added
   // along with |usage| to guarantee data can be copied to the underlying
-  // VkBuffer(s).
+  // VkBuffer(s). In kMapped mode, nothing is added to |usage|.
+  // Every frame's data is at an offset in a single buffer, so it can also be
+  // bound through one descriptor of a dynamic type, with
+  // get_dynamic_offset() as its dynamic offset.
   BufferFrameData(VulkanApplication* application, size_t buffered_data_count,
-                  VkBufferUsageFlags usage)
+                  VkBufferUsageFlags usage,
+                  BufferFrameDataMode mode = BufferFrameDataMode::kStaged)
       : application_(application),
-        uninitialized_(application->GetAllocator()),
+        mode_(mode),
+        stale_(application->GetAllocator()),
+        written_(application->GetAllocator()),
         update_commands_(application->GetAllocator()) {
-    uninitialized_.insert(uninitialized_.begin(), buffered_data_count, true);
+    stale_.insert(stale_.begin(), buffered_data_count, true);
     const size_t aligned_data_size =
         RoundUp(sizeof(set_value_), kMaxOffsetAlignment);
 
@@ -61,7 +87,16 @@ class BufferFrameData {
         VK_SHARING_MODE_EXCLUSIVE,
         0,
         nullptr};
+    if (mode_ == BufferFrameDataMode::kMapped) {
+      create_info.usage = usage;
+      buffer_ = application_->CreateAndBindCoherentBuffer(&create_info);
+      return;
+    }
     buffer_ = application_->CreateAndBindDeviceBuffer(&create_info);
+    if (buffer_->base_address()) {
+      written_.resize(buffered_data_count);
+      return;
+    }
 
     create_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
     host_buffer_ = application_->CreateAndBindHostBuffer(&create_info);
@@ -111,18 +146,31 @@ class BufferFrameData {
 
   T& data() { return set_value_; }
 
+  // Marks data() as changed, so that the next UpdateBuffer() for each frame
+  // updates that frame's copy. In kMapped mode this replaces comparing
+  // data() with the frame's copy, and must be called after every change.
+  void MarkDirty() { std::fill(stale_.begin(), stale_.end(), true); }
+
+  // In kMapped mode, returns the copy of the data that the GPU reads for the
+  // given frame, so that data that changes every frame can be written in
+  // place instead of through data(). It must only be written once the
+  // frame's previous commands have completed, and is overwritten by the next
+  // UpdateBuffer() for the frame after a MarkDirty(). In kStaged mode,
+  // returns nullptr.
+  T* mapped_data(size_t buffer_index) {
+    if (mode_ != BufferFrameDataMode::kMapped) {
+      return nullptr;
+    }
+    return reinterpret_cast<T*>(buffer_->base_address() +
+                                get_offset_for_frame(buffer_index));
+  }
+
   // Enqueues an update operation on the queue if needed, to ensure
-  // that the buffer is correct for the given index.
-  void UpdateBuffer(VkQueue* update_queue, size_t buffer_index) {
-    const size_t offset = get_offset_for_frame(buffer_index);
-    bool equal =
-        memcmp(&set_value_, host_buffer_->base_address() + offset, size()) == 0;
-    if (!equal || uninitialized_[buffer_index]) {
-      // If the data for this frame is not what was previously recorded into
-      // the buffer, then copy the data into the buffer and update it.
-      uninitialized_[buffer_index] = false;
-      memcpy(host_buffer_->base_address() + offset, &set_value_, size());
-      host_buffer_->flush(offset, aligned_data_size());
+  // that the buffer is correct for the given index. Returns whether an
+  // update command buffer was submitted.
+  bool UpdateBuffer(VkQueue* update_queue, size_t buffer_index) {
+    ::VkCommandBuffer update_command = PrepareUpdate(buffer_index);
+    if (update_command != VK_NULL_HANDLE) {
       VkSubmitInfo init_submit_info{
           VK_STRUCTURE_TYPE_SUBMIT_INFO,  // sType
           nullptr,                        // pNext
@@ -130,13 +178,25 @@ class BufferFrameData {
           nullptr,                        // pWaitSemaphores
           nullptr,                        // pWaitDstStageMask,
           1,                              // commandBufferCount
-          &update_commands_[buffer_index].get_command_buffer(),
+          &update_command,
           0,       // signalSemaphoreCount
           nullptr  // pSignalSemaphores
       };
       (*update_queue)
           ->vkQueueSubmit(*update_queue, 1, &init_submit_info, ::VkFence(0));
     }
+    return update_command != VK_NULL_HANDLE;
+  }
+
+  // Queues the update operation in submissions if needed, so that it is
+  // submitted along with the rest of the frame. Returns whether an update
+  // command buffer was queued.
+  bool UpdateBuffer(SubmissionBatcher* submissions, size_t buffer_index) {
+    ::VkCommandBuffer update_command = PrepareUpdate(buffer_index);
+    if (update_command != VK_NULL_HANDLE) {
+      submissions->Submit(update_command);
+    }
+    return update_command != VK_NULL_HANDLE;
   }
 
   // Returns the Uniform buffer backing the uniform data.
@@ -145,6 +205,12 @@ class BufferFrameData {
   size_t get_offset_for_frame(size_t buffer_index) const {
     return aligned_data_size() * buffer_index;
   }
+  // Returns the dynamic offset that selects the given frame, for a
+  // descriptor that covers the first frame.
+  uint32_t get_dynamic_offset(size_t buffer_index) const {
+    return static_cast<uint32_t>(get_offset_for_frame(buffer_index));
+  }
+  BufferFrameDataMode mode() const { return mode_; }
   // Returns the size of the data used for each frame.
   size_t size() const { return sizeof(set_value_); }
 
@@ -154,11 +220,58 @@ class BufferFrameData {
   }
 
  private:
+  // If the data for this frame is not what was previously recorded into the
+  // buffer, then copies the data into the buffer and returns the command
+  // buffer that updates it. Otherwise returns VK_NULL_HANDLE.
+  // In kMapped mode, and with unified memory, the data is written straight
+  // into the memory that the GPU reads, which is coherent, and the submit
+  // that follows makes the write visible, so there is never a command
+  // buffer.
+  ::VkCommandBuffer PrepareUpdate(size_t buffer_index) {
+    const size_t offset = get_offset_for_frame(buffer_index);
+    if (mode_ == BufferFrameDataMode::kMapped) {
+      if (stale_[buffer_index]) {
+        stale_[buffer_index] = false;
+        memcpy(buffer_->base_address() + offset, &set_value_, size());
+      }
+      return VK_NULL_HANDLE;
+    }
+    if (!host_buffer_) {
+      // Reading back device-local memory is slow, even where it is mapped,
+      // so the data is compared with what was last written, on the host.
+      if (!stale_[buffer_index] &&
+          memcmp(&set_value_, &written_[buffer_index], size()) == 0) {
+        return VK_NULL_HANDLE;
+      }
+      stale_[buffer_index] = false;
+      written_[buffer_index] = set_value_;
+      memcpy(buffer_->base_address() + offset, &set_value_, size());
+      return VK_NULL_HANDLE;
+    }
+    char* copy = host_buffer_->base_address() + offset;
+    bool equal = memcmp(&set_value_, copy, size()) == 0;
+    if (equal && !stale_[buffer_index]) {
+      return VK_NULL_HANDLE;
+    }
+    stale_[buffer_index] = false;
+    memcpy(copy, &set_value_, size());
+    host_buffer_->flush(offset, aligned_data_size());
+    return update_commands_[buffer_index].get_command_buffer();
+  }
+
   VulkanApplication* application_;
-  containers::vector<bool> uninitialized_;
+  const BufferFrameDataMode mode_;
+  // Whether each frame's copy may differ from data(), without comparing
+  // them.
+  containers::vector<bool> stale_;
+  // With unified memory, what was last written to each frame's copy, which
+  // is compared with data() instead of the copy itself.
+  containers::vector<T> written_;
   // This is the actual host piece of data that can be updated by the user.
   T set_value_;
-  // This is the gpu-side buffer that contains the uniforms.
+  // This is the gpu-side buffer that contains the uniforms. In kMapped mode,
+  // and with unified memory, it is persistently mapped, and there is no
+  // host buffer.
   containers::unique_ptr<VulkanApplication::Buffer> buffer_;
   // This is the host-side buffer that contains the data that can be copied to
   // the uniforms.
@@ -0,0 +1,90 @@
+/* Copyright 2017 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "vulkan_helpers/command_buffer_ring.h"
+
+#include <algorithm>
+
+#include "vulkan_helpers/helper_functions.h"
+
+namespace vulkan {
+
+CommandBufferRing::CommandBufferRing(containers::Allocator* allocator,
+                                     VkDevice* device,
+                                     uint32_t queue_family_index,
+                                     uint32_t num_slots)
+    : allocator_(allocator),
+      device_(device),
+      slots_(allocator),
+      current_slot_(0),
+      gets_(0),
+      allocations_(0),
+      pool_resets_(0),
+      fence_waits_(0) {
+  num_slots = std::max(num_slots, 1u);
+  slots_.reserve(num_slots);
+  for (uint32_t i = 0; i < num_slots; ++i) {
+    slots_.emplace_back(
+        allocator, CreateCommandPool(device_,
+                                     VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+                                     queue_family_index));
+  }
+}
+
+VkCommandBuffer* CommandBufferRing::Get(VkCommandBufferLevel level) {
+  Slot& slot = slots_[current_slot_];
+  const bool primary = level == VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  auto& command_buffers = primary ? slot.primaries : slot.secondaries;
+  size_t& num_used =
+      primary ? slot.num_primaries_used : slot.num_secondaries_used;
+  gets_ += 1;
+  if (num_used == command_buffers.size()) {
+    command_buffers.push_back(containers::make_unique<VkCommandBuffer>(
+        allocator_, CreateCommandBuffer(&slot.pool, level, device_)));
+    allocations_ += 1;
+  }
+  return command_buffers[num_used++].get();
+}
+
+void CommandBufferRing::Advance(::VkFence fence) {
+  slots_[current_slot_].fence = fence;
+  current_slot_ = (current_slot_ + 1) % slots_.size();
+
+  Slot& slot = slots_[current_slot_];
+  if (slot.fence != VK_NULL_HANDLE) {
+    LOG_ASSERT(==, device_->GetLogger(), VK_SUCCESS,
+               (*device_)->vkWaitForFences(*device_, 1, &slot.fence, VK_FALSE,
+                                           0xFFFFFFFFFFFFFFFF));
+    fence_waits_ += 1;
+    slot.fence = VK_NULL_HANDLE;
+  }
+  if (slot.num_primaries_used != 0 || slot.num_secondaries_used != 0) {
+    LOG_ASSERT(==, device_->GetLogger(), VK_SUCCESS,
+               (*device_)->vkResetCommandPool(*device_, slot.pool, 0));
+    pool_resets_ += 1;
+    slot.num_primaries_used = 0;
+    slot.num_secondaries_used = 0;
+  }
+}
+
+void CommandBufferRing::LogStatistics(logging::Logger* log,
+                                      const char* name) const {
+  log->LogInfo(name, " command buffers: ", gets_, " handed out, ",
+               allocations_, " allocated, ", num_allocations_avoided(),
+               " allocations avoided, ", pool_resets_, " pool resets, ",
+               fence_waits_, " fence waits");
+}
+
+}  // namespace vulkan
@@ -0,0 +1,101 @@
+/* Copyright 2017 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_HELPERS_COMMAND_BUFFER_RING_H_
+#define VULKAN_HELPERS_COMMAND_BUFFER_RING_H_
+
+#include "support/containers/allocator.h"
+#include "support/containers/unique_ptr.h"
+#include "support/containers/vector.h"
+#include "support/log/log.h"
+#include "vulkan_helpers/vulkan_header_wrapper.h"
+#include "vulkan_wrapper/command_buffer_wrapper.h"
+#include "vulkan_wrapper/device_wrapper.h"
+#include "vulkan_wrapper/sub_objects.h"
+
+namespace vulkan {
+
+// CommandBufferRing hands out command buffers that are only recorded and
+// submitted once, without allocating a new one every time.
+// The ring has num_slots slots, each with its own transient command pool.
+// Command buffers are taken from the current slot until Advance() is called
+// with a fence for the work they were submitted with. When the ring comes
+// back around to a slot, it waits for that fence, resets the slot's pool
+// with a single vkResetCommandPool, and hands out the same command buffers
+// again.
+// This is not thread-safe.
+class CommandBufferRing {
+ public:
+  CommandBufferRing(containers::Allocator* allocator, VkDevice* device,
+                    uint32_t queue_family_index, uint32_t num_slots);
+
+  CommandBufferRing(const CommandBufferRing&) = delete;
+  CommandBufferRing& operator=(const CommandBufferRing&) = delete;
+
+  // Returns a command buffer of the given level, in the initial state. It
+  // remains valid until the ring comes back around to the current slot.
+  VkCommandBuffer* Get(
+      VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+
+  // Finishes the current slot, and moves on to the next one. fence must be
+  // signalled once every command buffer taken from the current slot has
+  // completed, and must not be reset before the ring has come back around
+  // to the current slot. If they have already completed, fence may be
+  // VK_NULL_HANDLE.
+  void Advance(::VkFence fence);
+
+  uint32_t num_slots() const { return static_cast<uint32_t>(slots_.size()); }
+
+  // The number of command buffers that were handed out without having to
+  // be allocated.
+  uint64_t num_allocations_avoided() const { return gets_ - allocations_; }
+
+  // Logs how many command buffers were handed out and allocated, and how
+  // many pool resets and fence waits that took.
+  void LogStatistics(logging::Logger* log, const char* name) const;
+
+ private:
+  struct Slot {
+    Slot(containers::Allocator* allocator, VkCommandPool pool)
+        : pool(std::move(pool)),
+          primaries(allocator),
+          secondaries(allocator),
+          num_primaries_used(0),
+          num_secondaries_used(0),
+          fence(VK_NULL_HANDLE) {}
+    VkCommandPool pool;
+    // These are held by pointer, so that growing the vectors does not move
+    // command buffers that have already been handed out.
+    containers::vector<containers::unique_ptr<VkCommandBuffer>> primaries;
+    containers::vector<containers::unique_ptr<VkCommandBuffer>> secondaries;
+    size_t num_primaries_used;
+    size_t num_secondaries_used;
+    ::VkFence fence;
+  };
+
+  containers::Allocator* allocator_;
+  VkDevice* device_;
+  containers::vector<Slot> slots_;
+  size_t current_slot_;
+  // Statistics.
+  uint64_t gets_;
+  uint64_t allocations_;
+  uint64_t pool_resets_;
+  uint64_t fence_waits_;
+};
+
+}  // namespace vulkan
+
+#endif  // VULKAN_HELPERS_COMMAND_BUFFER_RING_H_
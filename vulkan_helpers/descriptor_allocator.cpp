@@ -0,0 +1,222 @@
+/* Copyright 2017 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "vulkan_helpers/descriptor_allocator.h"
+
+#include <algorithm>
+
+namespace vulkan {
+
+DescriptorAllocator::DescriptorAllocator(containers::Allocator* allocator,
+                                         VkDevice* device,
+                                         bool free_individual_sets,
+                                         uint32_t initial_sets_per_pool,
+                                         uint32_t max_sets_per_pool)
+    : allocator_(allocator),
+      device_(device),
+      free_individual_sets_(free_individual_sets),
+      initial_sets_per_pool_(initial_sets_per_pool),
+      max_sets_per_pool_(std::max(initial_sets_per_pool, max_sets_per_pool)),
+      pool_lists_(allocator),
+      live_sets_(0),
+      peak_live_sets_(0),
+      total_allocations_(0),
+      resets_(0) {}
+
+DescriptorAllocator::PoolList* DescriptorAllocator::GetPoolList(
+    std::initializer_list<VkDescriptorSetLayoutBinding> bindings) {
+  containers::vector<VkDescriptorPoolSize> sizes(allocator_);
+  for (auto& binding : bindings) {
+    if (binding.descriptorCount == 0) {
+      continue;
+    }
+    auto it = std::find_if(sizes.begin(), sizes.end(),
+                           [&binding](const VkDescriptorPoolSize& size) {
+                             return size.type == binding.descriptorType;
+                           });
+    if (it == sizes.end()) {
+      sizes.push_back({binding.descriptorType, binding.descriptorCount});
+    } else {
+      it->descriptorCount += binding.descriptorCount;
+    }
+  }
+  // A pool needs at least one pool size, even if its sets are empty.
+  if (sizes.empty()) {
+    sizes.push_back({VK_DESCRIPTOR_TYPE_SAMPLER, 1});
+  }
+  std::sort(sizes.begin(), sizes.end(),
+            [](const VkDescriptorPoolSize& a, const VkDescriptorPoolSize& b) {
+              return a.type < b.type;
+            });
+
+  for (auto& list : pool_lists_) {
+    if (list.sizes_per_set.size() == sizes.size() &&
+        std::equal(sizes.begin(), sizes.end(), list.sizes_per_set.begin(),
+                   [](const VkDescriptorPoolSize& a,
+                      const VkDescriptorPoolSize& b) {
+                     return a.type == b.type &&
+                            a.descriptorCount == b.descriptorCount;
+                   })) {
+      return &list;
+    }
+  }
+  pool_lists_.push_back(
+      PoolList{std::move(sizes), containers::vector<Pool>(allocator_), 0});
+  return &pool_lists_.back();
+}
+
+DescriptorAllocator::Pool DescriptorAllocator::CreatePool(
+    const PoolList& list) {
+  const uint32_t max_sets =
+      list.pools.empty()
+          ? initial_sets_per_pool_
+          : std::min(list.pools.back().max_sets * 2, max_sets_per_pool_);
+
+  containers::vector<VkDescriptorPoolSize> pool_sizes(
+      list.sizes_per_set.begin(), list.sizes_per_set.end(), allocator_);
+  for (auto& size : pool_sizes) {
+    size.descriptorCount *= max_sets;
+  }
+
+  VkDescriptorPoolCreateInfo info{
+      /* sType = */ VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+      /* pNext = */ nullptr,
+      /* flags = */ free_individual_sets_
+          ? VkDescriptorPoolCreateFlags(
+                VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT)
+          : VkDescriptorPoolCreateFlags(0),
+      /* maxSets = */ max_sets,
+      /* poolSizeCount = */ static_cast<uint32_t>(pool_sizes.size()),
+      /* pPoolSizes = */ pool_sizes.data()};
+
+  ::VkDescriptorPool raw_pool;
+  LOG_ASSERT(==, device_->GetLogger(),
+             (*device_)->vkCreateDescriptorPool(
+                 *device_, &info, device_->allocation_callbacks(), &raw_pool),
+             VK_SUCCESS);
+  return Pool{VkDescriptorPool(raw_pool, device_->allocation_callbacks(),
+                               device_),
+              max_sets, 0, false};
+}
+
+::VkDescriptorSet DescriptorAllocator::Allocate(
+    ::VkDescriptorSetLayout layout,
+    std::initializer_list<VkDescriptorSetLayoutBinding> bindings,
+    ::VkDescriptorPool* pool) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  PoolList* list = GetPoolList(bindings);
+
+  VkDescriptorSetAllocateInfo alloc_info{
+      /* sType = */ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+      /* pNext = */ nullptr,
+      /* descriptorPool = */ VK_NULL_HANDLE,
+      /* descriptorSetCount = */ 1,
+      /* pSetLayouts = */ &layout,
+  };
+  ::VkDescriptorSet raw_set = VK_NULL_HANDLE;
+
+  auto try_allocate = [&](size_t index) {
+    Pool& candidate = list->pools[index];
+    if (candidate.exhausted || candidate.allocated_sets == candidate.max_sets) {
+      return false;
+    }
+    alloc_info.descriptorPool = candidate.pool;
+    VkResult result =
+        (*device_)->vkAllocateDescriptorSets(*device_, &alloc_info, &raw_set);
+    if (result == VK_ERROR_FRAGMENTED_POOL ||
+        result == VK_ERROR_OUT_OF_POOL_MEMORY_KHR) {
+      candidate.exhausted = true;
+      return false;
+    }
+    LOG_ASSERT(==, device_->GetLogger(), VK_SUCCESS, result);
+    candidate.allocated_sets += 1;
+    list->current = index;
+    *pool = candidate.pool;
+    return true;
+  };
+
+  // Start with the pool the last set came from, since the pools before it
+  // are most likely full, and only add a pool if none of them have room.
+  bool allocated = false;
+  const size_t num_pools = list->pools.size();
+  for (size_t i = 0; i < num_pools && !allocated; ++i) {
+    allocated = try_allocate((list->current + i) % num_pools);
+  }
+  if (!allocated) {
+    list->pools.push_back(CreatePool(*list));
+    allocated = try_allocate(num_pools);
+  }
+  LOG_ASSERT(==, device_->GetLogger(), true, allocated);
+
+  live_sets_ += 1;
+  peak_live_sets_ = std::max(peak_live_sets_, live_sets_);
+  total_allocations_ += 1;
+  return raw_set;
+}
+
+void DescriptorAllocator::Free(::VkDescriptorPool pool,
+                               ::VkDescriptorSet set) {
+  LOG_ASSERT(==, device_->GetLogger(), true, free_individual_sets_);
+  std::lock_guard<std::mutex> lock(mutex_);
+  (*device_)->vkFreeDescriptorSets(*device_, pool, 1, &set);
+  for (auto& list : pool_lists_) {
+    for (auto& candidate : list.pools) {
+      if (candidate.pool.get_raw_object() == pool) {
+        candidate.allocated_sets -= 1;
+        // Freeing a set may have made room for a fragmented allocation.
+        candidate.exhausted = false;
+        live_sets_ -= 1;
+        return;
+      }
+    }
+  }
+}
+
+void DescriptorAllocator::Reset() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto& list : pool_lists_) {
+    for (auto& candidate : list.pools) {
+      if (candidate.allocated_sets == 0) {
+        continue;
+      }
+      (*device_)->vkResetDescriptorPool(*device_, candidate.pool, 0);
+      candidate.allocated_sets = 0;
+      candidate.exhausted = false;
+    }
+    list.current = 0;
+  }
+  live_sets_ = 0;
+  resets_ += 1;
+}
+
+void DescriptorAllocator::LogStatistics(logging::Logger* log) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  size_t num_pools = 0;
+  uint64_t capacity = 0;
+  for (auto& list : pool_lists_) {
+    num_pools += list.pools.size();
+    for (auto& candidate : list.pools) {
+      capacity += candidate.max_sets;
+    }
+  }
+  log->LogInfo("Descriptor allocator: ", num_pools, " pools for ",
+               pool_lists_.size(), " layout signatures, ", live_sets_, "/",
+               capacity, " sets in use (",
+               capacity ? 100.0f * live_sets_ / capacity : 0.0f, "%), ",
+               peak_live_sets_, " peak, ", total_allocations_,
+               " sets allocated, ", resets_, " resets");
+}
+
+}  // namespace vulkan
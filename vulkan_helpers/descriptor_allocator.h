@@ -0,0 +1,112 @@
+/* Copyright 2017 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_HELPERS_DESCRIPTOR_ALLOCATOR_H_
+#define VULKAN_HELPERS_DESCRIPTOR_ALLOCATOR_H_
+
+#include <initializer_list>
+#include <mutex>
+
+#include "support/containers/allocator.h"
+#include "support/containers/vector.h"
+#include "support/log/log.h"
+#include "vulkan_helpers/vulkan_header_wrapper.h"
+#include "vulkan_wrapper/device_wrapper.h"
+#include "vulkan_wrapper/sub_objects.h"
+
+namespace vulkan {
+
+// DescriptorAllocator hands out descriptor sets from large shared pools,
+// rather than creating a pool for every set.
+// Layouts that need the same number of descriptors of each type share a list
+// of pools. When every pool in a list is full, a new pool, twice as large as
+// the previous one, is added to it.
+// Sets that only live for a frame should come from an allocator created
+// without free_individual_sets, and be returned all at once with Reset().
+// All of the member functions are thread-safe.
+class DescriptorAllocator {
+ public:
+  // If free_individual_sets is false, the pools are created without
+  // VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT, and sets can only be
+  // returned with Reset().
+  DescriptorAllocator(containers::Allocator* allocator, VkDevice* device,
+                      bool free_individual_sets,
+                      uint32_t initial_sets_per_pool = 64,
+                      uint32_t max_sets_per_pool = 4096);
+
+  DescriptorAllocator(const DescriptorAllocator&) = delete;
+  DescriptorAllocator& operator=(const DescriptorAllocator&) = delete;
+
+  // Allocates a descriptor set with the given layout, which must have been
+  // created from the given bindings. The pool the set was allocated from is
+  // written to pool.
+  ::VkDescriptorSet Allocate(
+      ::VkDescriptorSetLayout layout,
+      std::initializer_list<VkDescriptorSetLayoutBinding> bindings,
+      ::VkDescriptorPool* pool);
+  // Returns a single set to the pool it was allocated from. Only valid if
+  // the allocator was created with free_individual_sets.
+  void Free(::VkDescriptorPool pool, ::VkDescriptorSet set);
+  // Returns every set allocated so far to its pool. None of the sets may
+  // still be in use by the device.
+  void Reset();
+
+  // Logs the number of pools, and how many of the sets they can hold are in
+  // use.
+  void LogStatistics(logging::Logger* log);
+
+ private:
+  struct Pool {
+    VkDescriptorPool pool;
+    uint32_t max_sets;
+    uint32_t allocated_sets;
+    // Set if an allocation failed even though allocated_sets < max_sets,
+    // which happens once a pool is fragmented. Cleared by Reset().
+    bool exhausted;
+  };
+  // The pools for every layout with the same descriptor counts.
+  struct PoolList {
+    // The number of descriptors of each type that one set needs, sorted by
+    // type.
+    containers::vector<VkDescriptorPoolSize> sizes_per_set;
+    containers::vector<Pool> pools;
+    // The pool that the last set was allocated from.
+    size_t current;
+  };
+
+  PoolList* GetPoolList(
+      std::initializer_list<VkDescriptorSetLayoutBinding> bindings);
+  Pool CreatePool(const PoolList& list);
+
+  containers::Allocator* allocator_;
+  VkDevice* device_;
+  const bool free_individual_sets_;
+  const uint32_t initial_sets_per_pool_;
+  const uint32_t max_sets_per_pool_;
+
+  std::mutex mutex_;
+  // There are only ever a handful of distinct descriptor counts, so these
+  // are searched linearly.
+  containers::vector<PoolList> pool_lists_;
+  // Statistics.
+  uint32_t live_sets_;
+  uint32_t peak_live_sets_;
+  uint64_t total_allocations_;
+  uint32_t resets_;
+};
+
+}  // namespace vulkan
+
+#endif  // VULKAN_HELPERS_DESCRIPTOR_ALLOCATOR_H_
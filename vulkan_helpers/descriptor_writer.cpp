@@ -0,0 +1,217 @@
+/* Copyright 2017 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "vulkan_helpers/descriptor_writer.h"
+
+namespace vulkan {
+namespace {
+enum class DescriptorInfoKind { kBuffer, kImage, kTexelBuffer };
+
+DescriptorInfoKind GetInfoKind(VkDescriptorType type) {
+  switch (type) {
+    case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+    case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+    case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
+    case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:
+      return DescriptorInfoKind::kBuffer;
+    case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
+    case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+      return DescriptorInfoKind::kTexelBuffer;
+    default:
+      break;
+  }
+  return DescriptorInfoKind::kImage;
+}
+}  // namespace
+
+DescriptorWriter::DescriptorWriter(containers::Allocator* allocator,
+                                   VkDevice* device)
+    : device_(device),
+      writes_(allocator),
+      first_infos_(allocator),
+      buffer_infos_(allocator),
+      image_infos_(allocator),
+      texel_buffer_views_(allocator) {}
+
+VkWriteDescriptorSet DescriptorWriter::MakeWrite(::VkDescriptorSet set,
+                                                 uint32_t binding,
+                                                 VkDescriptorType type,
+                                                 uint32_t count,
+                                                 uint32_t array_element) {
+  return VkWriteDescriptorSet{
+      VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,  // sType
+      nullptr,                                 // pNext
+      set,                                     // dstSet
+      binding,                                 // dstBinding
+      array_element,                           // dstArrayElement
+      count,                                   // descriptorCount
+      type,                                    // descriptorType
+      nullptr,                                 // pImageInfo
+      nullptr,                                 // pBufferInfo
+      nullptr,                                 // pTexelBufferView
+  };
+}
+
+DescriptorWriter& DescriptorWriter::WriteBuffers(
+    ::VkDescriptorSet set, uint32_t binding, VkDescriptorType type,
+    const VkDescriptorBufferInfo* infos, uint32_t count,
+    uint32_t array_element) {
+  writes_.push_back(MakeWrite(set, binding, type, count, array_element));
+  first_infos_.push_back(buffer_infos_.size());
+  buffer_infos_.insert(buffer_infos_.end(), infos, infos + count);
+  return *this;
+}
+
+DescriptorWriter& DescriptorWriter::WriteImages(
+    ::VkDescriptorSet set, uint32_t binding, VkDescriptorType type,
+    const VkDescriptorImageInfo* infos, uint32_t count,
+    uint32_t array_element) {
+  writes_.push_back(MakeWrite(set, binding, type, count, array_element));
+  first_infos_.push_back(image_infos_.size());
+  image_infos_.insert(image_infos_.end(), infos, infos + count);
+  return *this;
+}
+
+DescriptorWriter& DescriptorWriter::WriteTexelBuffers(
+    ::VkDescriptorSet set, uint32_t binding, VkDescriptorType type,
+    const ::VkBufferView* views, uint32_t count, uint32_t array_element) {
+  writes_.push_back(MakeWrite(set, binding, type, count, array_element));
+  first_infos_.push_back(texel_buffer_views_.size());
+  texel_buffer_views_.insert(texel_buffer_views_.end(), views, views + count);
+  return *this;
+}
+
+void DescriptorWriter::Flush() {
+  if (writes_.empty()) {
+    return;
+  }
+  for (size_t i = 0; i < writes_.size(); ++i) {
+    VkWriteDescriptorSet& write = writes_[i];
+    switch (GetInfoKind(write.descriptorType)) {
+      case DescriptorInfoKind::kBuffer:
+        write.pBufferInfo = &buffer_infos_[first_infos_[i]];
+        break;
+      case DescriptorInfoKind::kImage:
+        write.pImageInfo = &image_infos_[first_infos_[i]];
+        break;
+      case DescriptorInfoKind::kTexelBuffer:
+        write.pTexelBufferView = &texel_buffer_views_[first_infos_[i]];
+        break;
+    }
+  }
+  (*device_)->vkUpdateDescriptorSets(
+      *device_, static_cast<uint32_t>(writes_.size()), writes_.data(), 0,
+      nullptr);
+  writes_.clear();
+  first_infos_.clear();
+  buffer_infos_.clear();
+  image_infos_.clear();
+  texel_buffer_views_.clear();
+}
+
+DescriptorUpdateTemplate::DescriptorUpdateTemplate(
+    containers::Allocator* allocator, VkDevice* device, bool use_extension,
+    ::VkDescriptorSetLayout layout,
+    std::initializer_list<VkDescriptorUpdateTemplateEntryKHR> entries)
+    : device_(device),
+      entries_(entries, allocator),
+      writer_(allocator, device),
+      update_template_(VK_NULL_HANDLE),
+      destroy_update_template_(nullptr),
+      update_with_template_(nullptr) {
+  if (!use_extension) {
+    return;
+  }
+  PFN_vkCreateDescriptorUpdateTemplateKHR create_update_template =
+      reinterpret_cast<PFN_vkCreateDescriptorUpdateTemplateKHR>(
+          device->getProcAddr(*device, "vkCreateDescriptorUpdateTemplateKHR"));
+  destroy_update_template_ =
+      reinterpret_cast<PFN_vkDestroyDescriptorUpdateTemplateKHR>(
+          device->getProcAddr(*device,
+                              "vkDestroyDescriptorUpdateTemplateKHR"));
+  update_with_template_ =
+      reinterpret_cast<PFN_vkUpdateDescriptorSetWithTemplateKHR>(
+          device->getProcAddr(*device,
+                              "vkUpdateDescriptorSetWithTemplateKHR"));
+  if (!create_update_template || !destroy_update_template_ ||
+      !update_with_template_) {
+    device->GetLogger()->LogInfo(
+        "Descriptor update templates are unavailable, falling back to "
+        "vkUpdateDescriptorSets");
+    return;
+  }
+
+  VkDescriptorUpdateTemplateCreateInfoKHR create_info = {
+      VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO_KHR,  // sType
+      nullptr,                                                       // pNext
+      0,                                                             // flags
+      static_cast<uint32_t>(entries_.size()),  // descriptorUpdateEntryCount
+      entries_.data(),                         // pDescriptorUpdateEntries
+      VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET_KHR,  // templateType
+      layout,                           // descriptorSetLayout
+      VK_PIPELINE_BIND_POINT_GRAPHICS,  // pipelineBindPoint, ignored
+      VK_NULL_HANDLE,                   // pipelineLayout, ignored
+      0,                                // set, ignored
+  };
+  LOG_ASSERT(==, device->GetLogger(), VK_SUCCESS,
+             create_update_template(*device, &create_info,
+                                    device->allocation_callbacks(),
+                                    &update_template_));
+}
+
+DescriptorUpdateTemplate::~DescriptorUpdateTemplate() {
+  if (update_template_ != VK_NULL_HANDLE) {
+    destroy_update_template_(*device_, update_template_,
+                             device_->allocation_callbacks());
+  }
+}
+
+void DescriptorUpdateTemplate::Update(::VkDescriptorSet set,
+                                      const void* data) {
+  if (update_template_ != VK_NULL_HANDLE) {
+    update_with_template_(*device_, set, update_template_, data);
+    return;
+  }
+  const char* bytes = static_cast<const char*>(data);
+  for (const auto& entry : entries_) {
+    // The entries may be strided, so queue each descriptor on its own.
+    for (uint32_t i = 0; i < entry.descriptorCount; ++i) {
+      const char* info = bytes + entry.offset + i * entry.stride;
+      switch (GetInfoKind(entry.descriptorType)) {
+        case DescriptorInfoKind::kBuffer:
+          writer_.WriteBuffers(
+              set, entry.dstBinding, entry.descriptorType,
+              reinterpret_cast<const VkDescriptorBufferInfo*>(info), 1,
+              entry.dstArrayElement + i);
+          break;
+        case DescriptorInfoKind::kImage:
+          writer_.WriteImages(
+              set, entry.dstBinding, entry.descriptorType,
+              reinterpret_cast<const VkDescriptorImageInfo*>(info), 1,
+              entry.dstArrayElement + i);
+          break;
+        case DescriptorInfoKind::kTexelBuffer:
+          writer_.WriteTexelBuffers(
+              set, entry.dstBinding, entry.descriptorType,
+              reinterpret_cast<const ::VkBufferView*>(info), 1,
+              entry.dstArrayElement + i);
+          break;
+      }
+    }
+  }
+  writer_.Flush();
+}
+
+}  // namespace vulkan
@@ -0,0 +1,135 @@
+/* Copyright 2017 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_HELPERS_DESCRIPTOR_WRITER_H_
+#define VULKAN_HELPERS_DESCRIPTOR_WRITER_H_
+
+#include <initializer_list>
+
+#include "support/containers/allocator.h"
+#include "support/containers/vector.h"
+#include "vulkan_helpers/vulkan_header_wrapper.h"
+#include "vulkan_wrapper/device_wrapper.h"
+
+namespace vulkan {
+
+// DescriptorWriter accumulates descriptor writes for any number of
+// descriptor sets, and applies all of them with a single
+// vkUpdateDescriptorSets call in Flush().
+// The descriptor infos are copied when a write is queued, so they do not
+// have to outlive the call that queued them.
+class DescriptorWriter {
+ public:
+  DescriptorWriter(containers::Allocator* allocator, VkDevice* device);
+
+  DescriptorWriter(const DescriptorWriter&) = delete;
+  DescriptorWriter& operator=(const DescriptorWriter&) = delete;
+
+  // Queues a write of count consecutive array elements of the given binding,
+  // starting at array_element.
+  DescriptorWriter& WriteBuffers(::VkDescriptorSet set, uint32_t binding,
+                                 VkDescriptorType type,
+                                 const VkDescriptorBufferInfo* infos,
+                                 uint32_t count, uint32_t array_element = 0);
+  DescriptorWriter& WriteImages(::VkDescriptorSet set, uint32_t binding,
+                                VkDescriptorType type,
+                                const VkDescriptorImageInfo* infos,
+                                uint32_t count, uint32_t array_element = 0);
+  DescriptorWriter& WriteTexelBuffers(::VkDescriptorSet set, uint32_t binding,
+                                      VkDescriptorType type,
+                                      const ::VkBufferView* views,
+                                      uint32_t count,
+                                      uint32_t array_element = 0);
+
+  DescriptorWriter& WriteBuffers(
+      ::VkDescriptorSet set, uint32_t binding, VkDescriptorType type,
+      std::initializer_list<VkDescriptorBufferInfo> infos) {
+    return WriteBuffers(set, binding, type, infos.begin(),
+                        static_cast<uint32_t>(infos.size()));
+  }
+  DescriptorWriter& WriteImages(
+      ::VkDescriptorSet set, uint32_t binding, VkDescriptorType type,
+      std::initializer_list<VkDescriptorImageInfo> infos) {
+    return WriteImages(set, binding, type, infos.begin(),
+                       static_cast<uint32_t>(infos.size()));
+  }
+  DescriptorWriter& WriteTexelBuffers(
+      ::VkDescriptorSet set, uint32_t binding, VkDescriptorType type,
+      std::initializer_list<::VkBufferView> views) {
+    return WriteTexelBuffers(set, binding, type, views.begin(),
+                             static_cast<uint32_t>(views.size()));
+  }
+
+  // Applies every queued write with one call to vkUpdateDescriptorSets.
+  void Flush();
+
+  size_t num_pending_writes() const { return writes_.size(); }
+
+ private:
+  VkWriteDescriptorSet MakeWrite(::VkDescriptorSet set, uint32_t binding,
+                                 VkDescriptorType type, uint32_t count,
+                                 uint32_t array_element);
+
+  VkDevice* device_;
+  containers::vector<VkWriteDescriptorSet> writes_;
+  // The index of the first info of each write in the vector matching its
+  // descriptor type. The pointers in writes_ are only filled in by Flush(),
+  // since the vectors may move while writes are being queued.
+  containers::vector<size_t> first_infos_;
+  containers::vector<VkDescriptorBufferInfo> buffer_infos_;
+  containers::vector<VkDescriptorImageInfo> image_infos_;
+  containers::vector<::VkBufferView> texel_buffer_views_;
+};
+
+// DescriptorUpdateTemplate rewrites the descriptors of a set from a block of
+// application memory, whose layout is described by a list of
+// VkDescriptorUpdateTemplateEntryKHRs.
+// If the device was created with VK_KHR_descriptor_update_template, this
+// uses vkUpdateDescriptorSetWithTemplateKHR. Otherwise the equivalent writes
+// are applied with a single vkUpdateDescriptorSets call.
+class DescriptorUpdateTemplate {
+ public:
+  DescriptorUpdateTemplate(
+      containers::Allocator* allocator, VkDevice* device, bool use_extension,
+      ::VkDescriptorSetLayout layout,
+      std::initializer_list<VkDescriptorUpdateTemplateEntryKHR> entries);
+  ~DescriptorUpdateTemplate();
+
+  DescriptorUpdateTemplate(const DescriptorUpdateTemplate&) = delete;
+  DescriptorUpdateTemplate& operator=(const DescriptorUpdateTemplate&) =
+      delete;
+
+  // Updates the descriptors of set from data.
+  void Update(::VkDescriptorSet set, const void* data);
+
+  // Returns true if the update template extension is being used.
+  bool uses_extension() const {
+    return update_template_ != VK_NULL_HANDLE;
+  }
+
+ private:
+  VkDevice* device_;
+  containers::vector<VkDescriptorUpdateTemplateEntryKHR> entries_;
+  // Only used if the extension is not available.
+  DescriptorWriter writer_;
+
+  ::VkDescriptorUpdateTemplateKHR update_template_;
+  PFN_vkDestroyDescriptorUpdateTemplateKHR destroy_update_template_;
+  PFN_vkUpdateDescriptorSetWithTemplateKHR update_with_template_;
+};
+
+}  // namespace vulkan
+
+#endif  // VULKAN_HELPERS_DESCRIPTOR_WRITER_H_
@@ -0,0 +1,393 @@
+/* Copyright 2017 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "vulkan_helpers/gpu_profiler.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "vulkan_helpers/helper_functions.h"
+#include "vulkan_helpers/vulkan_application.h"
+
+namespace vulkan {
+namespace {
+// The pipeline statistics counted for every pass. The results are written in
+// the order of these bits.
+const VkQueryPipelineStatisticFlags kPipelineStatistics =
+    VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+const uint32_t kNumPipelineStatistics = 7;
+
+// Returns the element of |entries| with the given name, or nullptr.
+template <typename T>
+T* FindByName(containers::vector<T>* entries, const char* name) {
+  for (auto& entry : *entries) {
+    if (entry.name == name || strcmp(entry.name, name) == 0) {
+      return &entry;
+    }
+  }
+  return nullptr;
+}
+
+void AddPassStatistics(GpuProfiler::PassStatistics* total,
+                       const GpuProfiler::PassStatistics& pass) {
+  total->samples_passed += pass.samples_passed;
+  total->input_assembly_vertices += pass.input_assembly_vertices;
+  total->input_assembly_primitives += pass.input_assembly_primitives;
+  total->vertex_shader_invocations += pass.vertex_shader_invocations;
+  total->clipping_invocations += pass.clipping_invocations;
+  total->clipping_primitives += pass.clipping_primitives;
+  total->fragment_shader_invocations += pass.fragment_shader_invocations;
+  total->compute_shader_invocations += pass.compute_shader_invocations;
+}
+
+void LogStatistics(logging::Logger* log,
+                   const GpuProfiler::PassStatistics& statistics,
+                   bool pipeline_statistics) {
+  if (!pipeline_statistics) {
+    log->LogInfo("Pass ", statistics.name, ": ", statistics.samples_passed,
+                 " samples passed");
+    return;
+  }
+  log->LogInfo("Pass ", statistics.name, ": ", statistics.samples_passed,
+               " samples passed, ", statistics.input_assembly_vertices,
+               " vertices, ", statistics.input_assembly_primitives,
+               " primitives, ", statistics.vertex_shader_invocations,
+               " vertex shader invocations, ",
+               statistics.clipping_primitives, " of ",
+               statistics.clipping_invocations,
+               " primitives output by clipping, ",
+               statistics.fragment_shader_invocations,
+               " fragment shader invocations, ",
+               statistics.compute_shader_invocations,
+               " compute shader invocations");
+}
+}  // namespace
+
+const uint32_t GpuProfiler::kInvalidScope;
+
+GpuProfiler::GpuProfiler(containers::Allocator* allocator,
+                         VulkanApplication* application, uint32_t num_frames,
+                         uint32_t max_scopes_per_frame,
+                         bool pipeline_statistics)
+    : device_(&application->device()),
+      max_scopes_per_frame_(std::max(max_scopes_per_frame, 1u)),
+      pipeline_statistics_(pipeline_statistics),
+      timestamp_period_(0.0f),
+      valid_bits_mask_(0),
+      slots_(allocator),
+      current_slot_(0),
+      results_(allocator),
+      timings_(allocator),
+      pass_statistics_(allocator),
+      frame_statistics_(),
+      dropped_results_(0) {
+  frame_statistics_.name = "Frame";
+  ::VkPhysicalDevice physical_device = device_->physical_device();
+  VkPhysicalDeviceProperties properties;
+  application->instance()->vkGetPhysicalDeviceProperties(physical_device,
+                                                         &properties);
+  timestamp_period_ = properties.limits.timestampPeriod;
+  containers::vector<VkQueueFamilyProperties> queue_families =
+      GetQueueFamilyProperties(allocator, application->instance(),
+                               physical_device);
+  const uint32_t valid_bits =
+      queue_families[application->render_queue().index()].timestampValidBits;
+  if (valid_bits == 0) {
+    device_->GetLogger()->LogInfo(
+        "The render queue does not support timestamps, GPU profiling is "
+        "disabled");
+    return;
+  }
+  valid_bits_mask_ = valid_bits >= 64 ? ~0ull : (1ull << valid_bits) - 1;
+
+  VkQueryPoolCreateInfo timestamp_info = {
+      VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,  // sType
+      nullptr,                                   // pNext
+      0,                                         // flags
+      VK_QUERY_TYPE_TIMESTAMP,                   // queryType
+      2 * max_scopes_per_frame_,                 // queryCount
+      0,                                         // pipelineStatistics
+  };
+  VkQueryPoolCreateInfo occlusion_info = timestamp_info;
+  occlusion_info.queryType = VK_QUERY_TYPE_OCCLUSION;
+  occlusion_info.queryCount = max_scopes_per_frame_;
+  VkQueryPoolCreateInfo statistics_info = occlusion_info;
+  statistics_info.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+  statistics_info.pipelineStatistics = kPipelineStatistics;
+
+  num_frames = std::max(num_frames, 1u);
+  slots_.reserve(num_frames);
+  for (uint32_t i = 0; i < num_frames; ++i) {
+    slots_.emplace_back(allocator, CreateQueryPool(device_, timestamp_info),
+                        CreateQueryPool(device_, occlusion_info));
+    FrameSlot& slot = slots_.back();
+    if (pipeline_statistics_) {
+      slot.statistics_pool = containers::make_unique<VkQueryPool>(
+          allocator, CreateQueryPool(device_, statistics_info));
+    }
+    slot.scope_names.reserve(max_scopes_per_frame_);
+    slot.passes.reserve(max_scopes_per_frame_);
+  }
+  // Room for either both timestamps of every scope, or the occlusion and
+  // pipeline statistics results of every pass.
+  results_.resize((2 + kNumPipelineStatistics + 1) * max_scopes_per_frame_);
+}
+
+void GpuProfiler::BeginFrame(VkCommandBuffer* command_buffer) {
+  if (!is_valid()) {
+    return;
+  }
+  FrameSlot& slot = slots_[current_slot_];
+  CollectResults(&slot);
+  CollectPassStatistics(&slot);
+  slot.scope_names.clear();
+  slot.passes.clear();
+  (*command_buffer)
+      ->vkCmdResetQueryPool(*command_buffer, slot.pool, 0,
+                            2 * max_scopes_per_frame_);
+  (*command_buffer)
+      ->vkCmdResetQueryPool(*command_buffer, slot.occlusion_pool, 0,
+                            max_scopes_per_frame_);
+  if (slot.statistics_pool) {
+    (*command_buffer)
+        ->vkCmdResetQueryPool(*command_buffer, *slot.statistics_pool, 0,
+                              max_scopes_per_frame_);
+  }
+}
+
+void GpuProfiler::EndFrame() {
+  if (!is_valid()) {
+    return;
+  }
+  current_slot_ = (current_slot_ + 1) % slots_.size();
+}
+
+uint32_t GpuProfiler::BeginScope(VkCommandBuffer* command_buffer,
+                                 const char* name) {
+  if (!is_valid()) {
+    return kInvalidScope;
+  }
+  FrameSlot& slot = slots_[current_slot_];
+  if (slot.scope_names.size() == max_scopes_per_frame_) {
+    return kInvalidScope;
+  }
+  const uint32_t scope = static_cast<uint32_t>(slot.scope_names.size());
+  slot.scope_names.push_back(name);
+  (*command_buffer)
+      ->vkCmdWriteTimestamp(*command_buffer,
+                            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, slot.pool,
+                            2 * scope);
+  return scope;
+}
+
+void GpuProfiler::EndScope(VkCommandBuffer* command_buffer, uint32_t scope) {
+  if (scope == kInvalidScope) {
+    return;
+  }
+  (*command_buffer)
+      ->vkCmdWriteTimestamp(*command_buffer,
+                            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                            slots_[current_slot_].pool, 2 * scope + 1);
+}
+
+uint32_t GpuProfiler::BeginPass(VkCommandBuffer* command_buffer,
+                                const char* name) {
+  if (!is_valid()) {
+    return kInvalidScope;
+  }
+  FrameSlot& slot = slots_[current_slot_];
+  // There are as many passes as scopes, and every pass uses a scope.
+  const uint32_t scope = BeginScope(command_buffer, name);
+  if (scope == kInvalidScope) {
+    return kInvalidScope;
+  }
+  const uint32_t pass = static_cast<uint32_t>(slot.passes.size());
+  slot.passes.push_back(PassRecord{name, scope});
+  (*command_buffer)
+      ->vkCmdBeginQuery(*command_buffer, slot.occlusion_pool, pass, 0);
+  if (slot.statistics_pool) {
+    (*command_buffer)
+        ->vkCmdBeginQuery(*command_buffer, *slot.statistics_pool, pass, 0);
+  }
+  return pass;
+}
+
+void GpuProfiler::EndPass(VkCommandBuffer* command_buffer, uint32_t pass) {
+  if (pass == kInvalidScope) {
+    return;
+  }
+  FrameSlot& slot = slots_[current_slot_];
+  if (slot.statistics_pool) {
+    (*command_buffer)
+        ->vkCmdEndQuery(*command_buffer, *slot.statistics_pool, pass);
+  }
+  (*command_buffer)->vkCmdEndQuery(*command_buffer, slot.occlusion_pool, pass);
+  EndScope(command_buffer, slot.passes[pass].scope);
+}
+
+void GpuProfiler::CollectResults(FrameSlot* slot) {
+  if (slot->scope_names.empty()) {
+    return;
+  }
+  const uint32_t num_queries =
+      2 * static_cast<uint32_t>(slot->scope_names.size());
+  // This returns VK_NOT_READY if any of the queries is not available yet,
+  // but still writes the availability of each of them.
+  (*device_)->vkGetQueryPoolResults(
+      *device_, slot->pool, 0, num_queries,
+      num_queries * 2 * sizeof(uint64_t), results_.data(),
+      2 * sizeof(uint64_t),
+      VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+  for (size_t i = 0; i < slot->scope_names.size(); ++i) {
+    const uint64_t* begin = &results_[4 * i];
+    const uint64_t* end = &results_[4 * i + 2];
+    if (begin[1] == 0 || end[1] == 0) {
+      dropped_results_ += 1;
+      continue;
+    }
+    const uint64_t ticks = (end[0] - begin[0]) & valid_bits_mask_;
+    const double milliseconds = double(ticks) * timestamp_period_ / 1000000.0;
+    ScopeTiming* timing = FindByName(&timings_, slot->scope_names[i]);
+    if (!timing) {
+      timings_.push_back(
+          ScopeTiming{slot->scope_names[i], milliseconds, milliseconds, 0});
+      timing = &timings_.back();
+    }
+    timing->last_milliseconds = milliseconds;
+    timing->average_milliseconds =
+        milliseconds * 0.05 + timing->average_milliseconds * 0.95;
+    timing->num_samples += 1;
+  }
+}
+
+void GpuProfiler::CollectPassStatistics(FrameSlot* slot) {
+  if (slot->passes.empty()) {
+    return;
+  }
+  const uint32_t num_passes = static_cast<uint32_t>(slot->passes.size());
+  const uint32_t statistics_stride = kNumPipelineStatistics + 1;
+  uint64_t* occlusion_results = results_.data();
+  uint64_t* statistics_results = results_.data() + 2 * num_passes;
+  // As for the timestamps, unavailable results are dropped rather than
+  // waited for.
+  (*device_)->vkGetQueryPoolResults(
+      *device_, slot->occlusion_pool, 0, num_passes,
+      num_passes * 2 * sizeof(uint64_t), occlusion_results,
+      2 * sizeof(uint64_t),
+      VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+  if (slot->statistics_pool) {
+    (*device_)->vkGetQueryPoolResults(
+        *device_, *slot->statistics_pool, 0, num_passes,
+        num_passes * statistics_stride * sizeof(uint64_t), statistics_results,
+        statistics_stride * sizeof(uint64_t),
+        VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+  }
+
+  PassStatistics frame = PassStatistics();
+  frame.name = frame_statistics_.name;
+  bool any_available = false;
+  for (uint32_t i = 0; i < num_passes; ++i) {
+    const uint64_t* occlusion = &occlusion_results[2 * i];
+    const uint64_t* statistics = &statistics_results[statistics_stride * i];
+    if (occlusion[1] == 0 ||
+        (slot->statistics_pool && statistics[kNumPipelineStatistics] == 0)) {
+      dropped_results_ += 1;
+      continue;
+    }
+    PassStatistics pass = PassStatistics();
+    pass.name = slot->passes[i].name;
+    pass.samples_passed = occlusion[0];
+    if (slot->statistics_pool) {
+      pass.input_assembly_vertices = statistics[0];
+      pass.input_assembly_primitives = statistics[1];
+      pass.vertex_shader_invocations = statistics[2];
+      pass.clipping_invocations = statistics[3];
+      pass.clipping_primitives = statistics[4];
+      pass.fragment_shader_invocations = statistics[5];
+      pass.compute_shader_invocations = statistics[6];
+    }
+    AddPassStatistics(&frame, pass);
+    any_available = true;
+
+    // A pass name seen more than once in a frame is reported as their sum.
+    PassStatistics* total = FindByName(&pass_statistics_, pass.name);
+    if (!total) {
+      pass_statistics_.push_back(pass);
+      continue;
+    }
+    if (std::find_if(slot->passes.begin(), slot->passes.begin() + i,
+                     [&pass](const PassRecord& record) {
+                       return strcmp(record.name, pass.name) == 0;
+                     }) == slot->passes.begin() + i) {
+      *total = pass;
+    } else {
+      AddPassStatistics(total, pass);
+    }
+  }
+  if (any_available) {
+    frame_statistics_ = frame;
+  }
+}
+
+VkQueryPipelineStatisticFlags GpuProfiler::pipeline_statistics_flags() const {
+  return collects_pipeline_statistics() ? kPipelineStatistics : 0;
+}
+
+const GpuProfiler::ScopeTiming* GpuProfiler::GetTiming(
+    const char* name) const {
+  return FindByName(const_cast<containers::vector<ScopeTiming>*>(&timings_),
+                    name);
+}
+
+void GpuProfiler::LogTimings(logging::Logger* log) const {
+  if (!is_valid()) {
+    return;
+  }
+  for (const auto& timing : timings_) {
+    log->LogInfo("GPU time for ", timing.name, ": ",
+                 timing.average_milliseconds, "ms on average over ",
+                 timing.num_samples, " measurements");
+  }
+  log->LogInfo("GPU profiler: ", dropped_results_,
+               " results dropped because they were not available in time");
+}
+
+void GpuProfiler::LogPassStatistics(logging::Logger* log) const {
+  if (!is_valid() || pass_statistics_.empty()) {
+    return;
+  }
+  for (const auto& statistics : pass_statistics_) {
+    LogStatistics(log, statistics, pipeline_statistics_);
+  }
+  LogStatistics(log, frame_statistics_, pipeline_statistics_);
+  if (pipeline_statistics_ && frame_statistics_.clipping_invocations != 0) {
+    const uint64_t culled = frame_statistics_.clipping_invocations -
+                            std::min(frame_statistics_.clipping_primitives,
+                                     frame_statistics_.clipping_invocations);
+    log->LogInfo("Frame: ",
+                 100.0 * double(culled) /
+                     double(frame_statistics_.clipping_invocations),
+                 "% of the primitives reaching clipping were culled");
+  }
+}
+
+}  // namespace vulkan
@@ -0,0 +1,234 @@
+/* Copyright 2017 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_HELPERS_GPU_PROFILER_H_
+#define VULKAN_HELPERS_GPU_PROFILER_H_
+
+#include "support/containers/allocator.h"
+#include "support/containers/unique_ptr.h"
+#include "support/containers/vector.h"
+#include "support/log/log.h"
+#include "vulkan_helpers/vulkan_header_wrapper.h"
+#include "vulkan_wrapper/command_buffer_wrapper.h"
+#include "vulkan_wrapper/device_wrapper.h"
+#include "vulkan_wrapper/sub_objects.h"
+
+namespace vulkan {
+class VulkanApplication;
+
+// GpuProfiler measures how long named scopes of a frame's commands take on
+// the GPU, with a pair of timestamp queries around each scope.
+// Passes are scopes that are also wrapped in an occlusion query and, if the
+// device was created with the pipelineStatisticsQuery feature and the
+// profiler was told so, a pipeline statistics query. These count the work
+// that the pass did, so that changes in shader invocations or in how much
+// is culled can be spotted.
+// Every frame slot has its own query pools. The results for a slot are only
+// read back when the profiler comes back around to it, by which time the
+// work that wrote them has normally finished, so reading them never blocks.
+// Results that are still not available then are dropped.
+// Timestamps are only comparable within a queue family, so every scope must
+// be recorded into command buffers for the application's render queue.
+// If that queue family does not support timestamps, every member function
+// does nothing.
+// This is not thread-safe.
+class GpuProfiler {
+ public:
+  static const uint32_t kInvalidScope = ~0u;
+
+  // The measured GPU time of every scope with the same name.
+  struct ScopeTiming {
+    const char* name;
+    double last_milliseconds;
+    // An exponentially smoothed average, like the CPU frame time.
+    double average_milliseconds;
+    uint64_t num_samples;
+  };
+
+  // The work done by a pass, or by every pass of a frame.
+  struct PassStatistics {
+    const char* name;
+    // The number of samples that passed the depth and stencil tests.
+    uint64_t samples_passed;
+    // These are only counted if pipeline statistics are collected.
+    uint64_t input_assembly_vertices;
+    uint64_t input_assembly_primitives;
+    uint64_t vertex_shader_invocations;
+    uint64_t clipping_invocations;
+    uint64_t clipping_primitives;
+    uint64_t fragment_shader_invocations;
+    uint64_t compute_shader_invocations;
+  };
+
+  // Ends a scope when it goes out of scope.
+  class Scope {
+   public:
+    Scope(GpuProfiler* profiler, VkCommandBuffer* command_buffer,
+          const char* name)
+        : profiler_(profiler),
+          command_buffer_(command_buffer),
+          scope_(profiler->BeginScope(command_buffer, name)) {}
+    ~Scope() { profiler_->EndScope(command_buffer_, scope_); }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+   private:
+    GpuProfiler* profiler_;
+    VkCommandBuffer* command_buffer_;
+    uint32_t scope_;
+  };
+
+  // Ends a pass when it goes out of scope.
+  class Pass {
+   public:
+    Pass(GpuProfiler* profiler, VkCommandBuffer* command_buffer,
+         const char* name)
+        : profiler_(profiler),
+          command_buffer_(command_buffer),
+          pass_(profiler->BeginPass(command_buffer, name)) {}
+    ~Pass() { profiler_->EndPass(command_buffer_, pass_); }
+
+    Pass(const Pass&) = delete;
+    Pass& operator=(const Pass&) = delete;
+
+   private:
+    GpuProfiler* profiler_;
+    VkCommandBuffer* command_buffer_;
+    uint32_t pass_;
+  };
+
+  // Creates query pools for num_frames frames, each with room for
+  // max_scopes_per_frame scopes, and as many passes. pipeline_statistics
+  // must only be true if the device was created with the
+  // pipelineStatisticsQuery feature enabled.
+  GpuProfiler(containers::Allocator* allocator, VulkanApplication* application,
+              uint32_t num_frames, uint32_t max_scopes_per_frame = 32,
+              bool pipeline_statistics = false);
+
+  GpuProfiler(const GpuProfiler&) = delete;
+  GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+  // Reads back the results from the last time the current frame slot was
+  // used, and records the reset of its queries into command_buffer. This
+  // must be called outside of a render pass, before any scope of the frame
+  // is begun, and command_buffer must be submitted before any other command
+  // buffer that the frame's scopes are recorded into.
+  void BeginFrame(VkCommandBuffer* command_buffer);
+  // Moves on to the next frame slot. Every scope begun in the frame must
+  // have been ended.
+  void EndFrame();
+
+  // Records the timestamp that starts a scope, and returns the scope to
+  // pass to EndScope(). name must remain valid for the lifetime of the
+  // profiler; it is normally a string literal. If the frame has no queries
+  // left, this returns kInvalidScope, and the scope is not measured.
+  uint32_t BeginScope(VkCommandBuffer* command_buffer, const char* name);
+  // Records the timestamp that ends the scope, once all previous commands
+  // have completed. This may be in a different command buffer from the one
+  // that the scope began in.
+  void EndScope(VkCommandBuffer* command_buffer, uint32_t scope);
+
+  // Begins a scope, and the queries that count the work done by the pass,
+  // and returns the pass to pass to EndPass(). A pass must end in the same
+  // command buffer that it began in, and either both inside the same
+  // subpass or both outside of a render pass. Passes cannot be nested.
+  // Secondary command buffers executed inside a pass must inherit the
+  // occlusion query and pipeline_statistics_flags(), which needs the
+  // inheritedQueries feature. name must remain valid for the lifetime of the
+  // profiler. If the frame has no queries left, this returns kInvalidScope.
+  uint32_t BeginPass(VkCommandBuffer* command_buffer, const char* name);
+  void EndPass(VkCommandBuffer* command_buffer, uint32_t pass);
+
+  bool is_valid() const { return valid_bits_mask_ != 0; }
+
+  // The timings of every scope name seen so far, in the order that they
+  // were first measured.
+  const containers::vector<ScopeTiming>& timings() const { return timings_; }
+  // Returns the timing of the scopes with the given name, or nullptr if none
+  // has been measured yet.
+  const ScopeTiming* GetTiming(const char* name) const;
+
+  bool collects_pipeline_statistics() const {
+    return is_valid() && pipeline_statistics_;
+  }
+  // The pipeline statistics counted by every pass, or 0 if they are not
+  // collected.
+  VkQueryPipelineStatisticFlags pipeline_statistics_flags() const;
+  // The statistics of every pass name seen so far, from the last frame in
+  // which that pass was measured.
+  const containers::vector<PassStatistics>& pass_statistics() const {
+    return pass_statistics_;
+  }
+  // The sum of the statistics of every pass in the last frame that had any.
+  const PassStatistics& frame_statistics() const { return frame_statistics_; }
+
+  // Logs the average GPU time of every scope, and how many results were
+  // dropped because they were not available in time.
+  void LogTimings(logging::Logger* log) const;
+  // Logs the statistics of every pass, and of the last frame.
+  void LogPassStatistics(logging::Logger* log) const;
+
+ private:
+  // A pass begun in a frame.
+  struct PassRecord {
+    const char* name;
+    // The scope that times the pass.
+    uint32_t scope;
+  };
+
+  struct FrameSlot {
+    FrameSlot(containers::Allocator* allocator, VkQueryPool pool,
+              VkQueryPool occlusion_pool)
+        : pool(std::move(pool)),
+          occlusion_pool(std::move(occlusion_pool)),
+          scope_names(allocator),
+          passes(allocator) {}
+    VkQueryPool pool;
+    VkQueryPool occlusion_pool;
+    // Only created if pipeline statistics are collected.
+    containers::unique_ptr<VkQueryPool> statistics_pool;
+    // The name of every scope begun in the frame, by scope index.
+    containers::vector<const char*> scope_names;
+    // Every pass begun in the frame, by pass index.
+    containers::vector<PassRecord> passes;
+  };
+
+  // Converts the results read back for the current slot into timings and
+  // pass statistics.
+  void CollectResults(FrameSlot* slot);
+  void CollectPassStatistics(FrameSlot* slot);
+
+  VkDevice* device_;
+  const uint32_t max_scopes_per_frame_;
+  const bool pipeline_statistics_;
+  // The number of nanoseconds per timestamp tick.
+  float timestamp_period_;
+  // Masks off the bits of a timestamp that the queue does not write.
+  uint64_t valid_bits_mask_;
+  containers::vector<FrameSlot> slots_;
+  size_t current_slot_;
+  // Kept between frames so that it does not have to be reallocated. Each
+  // query has its values followed by its availability.
+  containers::vector<uint64_t> results_;
+  containers::vector<ScopeTiming> timings_;
+  containers::vector<PassStatistics> pass_statistics_;
+  PassStatistics frame_statistics_;
+  uint64_t dropped_results_;
+};
+
+}  // namespace vulkan
+
+#endif  // VULKAN_HELPERS_GPU_PROFILER_H_
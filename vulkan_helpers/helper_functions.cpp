@@ -16,6 +16,7 @@
 #include "vulkan_helpers/helper_functions.h"
 
 #include <algorithm>
+#include <cstring>
 #include <tuple>
 
 #include "support/containers/vector.h"
@@ -23,7 +24,8 @@
 
 namespace vulkan {
 VkInstance CreateEmptyInstance(containers::Allocator* allocator,
-                               LibraryWrapper* wrapper) {
+                               LibraryWrapper* wrapper,
+                               VkAllocationCallbacks* allocation_callbacks) {
   // Test a non-nullptr pApplicationInfo
   VkApplicationInfo app_info{VK_STRUCTURE_TYPE_APPLICATION_INFO,
                              nullptr,
@@ -43,15 +45,18 @@ VkInstance CreateEmptyInstance(containers::Allocator* allocator,
                             nullptr};
 
   ::VkInstance raw_instance;
-  LOG_ASSERT(==, wrapper->GetLogger(),
-             wrapper->vkCreateInstance(&info, nullptr, &raw_instance),
-             VK_SUCCESS);
+  LOG_ASSERT(
+      ==, wrapper->GetLogger(),
+      wrapper->vkCreateInstance(&info, allocation_callbacks, &raw_instance),
+      VK_SUCCESS);
   // vulkan::VkInstance will handle destroying the instance
-  return vulkan::VkInstance(allocator, raw_instance, nullptr, wrapper);
+  return vulkan::VkInstance(allocator, raw_instance, allocation_callbacks,
+                            wrapper);
 }
 
 VkInstance CreateDefaultInstance(containers::Allocator* allocator,
-                                 LibraryWrapper* wrapper) {
+                                 LibraryWrapper* wrapper,
+                                 VkAllocationCallbacks* allocation_callbacks) {
   // Similar to Empty Instance, but turns on the platform specific
   // swapchian functions.
   // Test a non-nullptr pApplicationInfo
@@ -89,16 +94,19 @@ VkInstance CreateDefaultInstance(containers::Allocator* allocator,
                             extensions};
 
   ::VkInstance raw_instance;
-  LOG_ASSERT(==, wrapper->GetLogger(),
-             wrapper->vkCreateInstance(&info, nullptr, &raw_instance),
-             VK_SUCCESS);
+  LOG_ASSERT(
+      ==, wrapper->GetLogger(),
+      wrapper->vkCreateInstance(&info, allocation_callbacks, &raw_instance),
+      VK_SUCCESS);
   // vulkan::VkInstance will handle destroying the instance
-  return vulkan::VkInstance(allocator, raw_instance, nullptr, wrapper);
+  return vulkan::VkInstance(allocator, raw_instance, allocation_callbacks,
+                            wrapper);
 }
 
-VkInstance CreateInstanceForApplication(containers::Allocator* allocator,
-                                        LibraryWrapper* wrapper,
-                                        const entry::EntryData* data) {
+VkInstance CreateInstanceForApplication(
+    containers::Allocator* allocator, LibraryWrapper* wrapper,
+    const entry::EntryData* data,
+    VkAllocationCallbacks* allocation_callbacks) {
   // Similar to CreateDefaultInstance, but turns on the virtual swapchain
   // if the requested by entry_data.
 
@@ -140,11 +148,13 @@ VkInstance CreateInstanceForApplication(containers::Allocator* allocator,
                             extensions};
 
   ::VkInstance raw_instance;
-  LOG_ASSERT(==, wrapper->GetLogger(),
-             wrapper->vkCreateInstance(&info, nullptr, &raw_instance),
-             VK_SUCCESS);
+  LOG_ASSERT(
+      ==, wrapper->GetLogger(),
+      wrapper->vkCreateInstance(&info, allocation_callbacks, &raw_instance),
+      VK_SUCCESS);
   // vulkan::VkInstance will handle destroying the instance
-  return vulkan::VkInstance(allocator, raw_instance, nullptr, wrapper);
+  return vulkan::VkInstance(allocator, raw_instance, allocation_callbacks,
+                            wrapper);
 }
 
 containers::vector<VkPhysicalDevice> GetPhysicalDevices(
@@ -200,6 +210,39 @@ inline uint32_t GetQueueFamily(containers::Allocator* allocator,
   return ~0u;
 }
 
+uint32_t GetComputeQueueFamily(containers::Allocator* allocator,
+                               VkInstance& instance,
+                               ::VkPhysicalDevice device) {
+  auto properties = GetQueueFamilyProperties(allocator, instance, device);
+  uint32_t first_compute_queue = ~0u;
+  for (uint32_t i = 0; i < properties.size(); ++i) {
+    if (!HasQueueFlags(properties[i], VK_QUEUE_COMPUTE_BIT)) {
+      continue;
+    }
+    if (!(properties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
+      return i;
+    }
+    if (first_compute_queue == ~0u) {
+      first_compute_queue = i;
+    }
+  }
+  return first_compute_queue;
+}
+
+uint32_t GetTransferQueueFamily(containers::Allocator* allocator,
+                                VkInstance& instance,
+                                ::VkPhysicalDevice device) {
+  auto properties = GetQueueFamilyProperties(allocator, instance, device);
+  for (uint32_t i = 0; i < properties.size(); ++i) {
+    if (HasQueueFlags(properties[i], VK_QUEUE_TRANSFER_BIT) &&
+        !(properties[i].queueFlags &
+          (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+      return i;
+    }
+  }
+  return ~0u;
+}
+
 // Any queue family that supports only compute, or any queue that supports
 // both compute and graphics that is not the "first" one can be used
 // for async compute.
@@ -272,11 +315,13 @@ VkDevice CreateDefaultDevice(containers::Allocator* allocator,
                           nullptr};
 
   ::VkDevice raw_device;
-  LOG_ASSERT(
-      ==, instance.GetLogger(),
-      instance->vkCreateDevice(physical_device, &info, nullptr, &raw_device),
-      VK_SUCCESS);
-  return vulkan::VkDevice(allocator, raw_device, nullptr, &instance,
+  LOG_ASSERT(==, instance.GetLogger(),
+             instance->vkCreateDevice(physical_device, &info,
+                                      instance.allocation_callbacks(),
+                                      &raw_device),
+             VK_SUCCESS);
+  return vulkan::VkDevice(allocator, raw_device,
+                          instance.allocation_callbacks(), &instance,
                           &properties, physical_device);
 }
 
@@ -387,6 +432,32 @@ struct QueueCreateInfo {
   uint32_t queue_count;
   containers::vector<float> priorities;
 };
+
+// Returns true if the given physical |device| supports all of the given
+// device |extensions|.
+bool SupportsDeviceExtensions(
+    containers::Allocator* allocator, VkInstance* instance,
+    ::VkPhysicalDevice device,
+    const std::initializer_list<const char*> extensions) {
+  containers::vector<VkExtensionProperties> available_extensions(allocator);
+  uint32_t num_extensions = 0;
+  (*instance)->vkEnumerateDeviceExtensionProperties(device, nullptr,
+                                                    &num_extensions, nullptr);
+
+  available_extensions.resize(num_extensions);
+  (*instance)->vkEnumerateDeviceExtensionProperties(
+      device, nullptr, &num_extensions, available_extensions.data());
+
+  for (auto ext : extensions) {
+    if (std::find_if(available_extensions.begin(), available_extensions.end(),
+                     [&](const VkExtensionProperties& dat) {
+                       return strcmp(ext, dat.extensionName) == 0;
+                     }) == available_extensions.end()) {
+      return false;
+    }
+  }
+  return true;
+}
 }  // namespace
 
 VkDevice CreateDeviceForSwapchain(
@@ -396,7 +467,10 @@ VkDevice CreateDeviceForSwapchain(
     const std::initializer_list<const char*> extensions,
     const VkPhysicalDeviceFeatures& features,
     bool try_to_find_separate_present_queue,
-    uint32_t* async_compute_queue_index, uint32_t* sparse_binding_queue_index) {
+    uint32_t* async_compute_queue_index, uint32_t* sparse_binding_queue_index,
+    uint32_t* transfer_queue_index,
+    containers::vector<const char*>* optional_extensions,
+    VkPhysicalDeviceFeatures* optional_features) {
   containers::vector<VkPhysicalDevice> physical_devices =
       GetPhysicalDevices(allocator, *instance);
   float priority = 1.f;
@@ -415,26 +489,7 @@ VkDevice CreateDeviceForSwapchain(
     (*instance)->vkGetPhysicalDeviceProperties(device,
                                                &physical_device_properties);
 
-    containers::vector<VkExtensionProperties> available_extensions(allocator);
-    uint32_t num_extensions = 0;
-    (*instance)->vkEnumerateDeviceExtensionProperties(device, nullptr,
-                                                      &num_extensions, nullptr);
-
-    available_extensions.resize(num_extensions);
-    (*instance)->vkEnumerateDeviceExtensionProperties(
-        device, nullptr, &num_extensions, available_extensions.data());
-
-    bool valid_extensions = true;
-    for (auto ext : extensions) {
-      if (std::find_if(available_extensions.begin(), available_extensions.end(),
-                       [&](const VkExtensionProperties& dat) {
-                         return strcmp(ext, dat.extensionName) == 0;
-                       }) == available_extensions.end()) {
-        valid_extensions = false;
-        break;
-      }
-    }
-    if (!valid_extensions) {
+    if (!SupportsDeviceExtensions(allocator, instance, device, extensions)) {
       continue;
     }
 
@@ -474,7 +529,7 @@ VkDevice CreateDeviceForSwapchain(
     }
 
     containers::vector<QueueCreateInfo> queue_create_infos(allocator);
-    queue_create_infos.reserve(4);
+    queue_create_infos.reserve(5);
     queue_create_infos.emplace_back(
         QueueCreateInfo(allocator, graphics_queue_family_index, 0));
     queue_create_infos.back().AddQueue(1.0f);
@@ -521,6 +576,23 @@ VkDevice CreateDeviceForSwapchain(
         }
       }
     }
+    if (transfer_queue_index != nullptr) {
+      *transfer_queue_index =
+          GetTransferQueueFamily(allocator, *instance, device);
+      for (auto& qi : queue_create_infos) {
+        if (qi.queue_family_index == *transfer_queue_index) {
+          // The family is already used for presentation or sparse binding,
+          // so copies would not get an engine of their own anyway.
+          *transfer_queue_index = 0xFFFFFFFF;
+          break;
+        }
+      }
+      if (*transfer_queue_index != 0xFFFFFFFF) {
+        queue_create_infos.emplace_back(
+            QueueCreateInfo(allocator, *transfer_queue_index, 0));
+        queue_create_infos.back().AddQueue(1.0f);
+      }
+    }
 
     const char* forced_extensions[] = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
     containers::vector<const char*> enabled_extensions(allocator);
@@ -530,9 +602,39 @@ VkDevice CreateDeviceForSwapchain(
     for (auto ext : extensions) {
       enabled_extensions.push_back(ext);
     }
+    if (optional_extensions) {
+      optional_extensions->erase(
+          std::remove_if(optional_extensions->begin(),
+                         optional_extensions->end(),
+                         [&](const char* ext) {
+                           return !SupportsDeviceExtensions(
+                               allocator, instance, device, {ext});
+                         }),
+          optional_extensions->end());
+      enabled_extensions.insert(enabled_extensions.end(),
+                                optional_extensions->begin(),
+                                optional_extensions->end());
+    }
+    VkPhysicalDeviceFeatures enabled_features = features;
+    if (optional_features) {
+      VkPhysicalDeviceFeatures supported_features = {0};
+      (*instance)->vkGetPhysicalDeviceFeatures(physical_device,
+                                               &supported_features);
+      // VkPhysicalDeviceFeatures is nothing but VkBool32s.
+      VkBool32* optional = reinterpret_cast<VkBool32*>(optional_features);
+      VkBool32* enabled = reinterpret_cast<VkBool32*>(&enabled_features);
+      const VkBool32* supported =
+          reinterpret_cast<const VkBool32*>(&supported_features);
+      const size_t num_features =
+          sizeof(VkPhysicalDeviceFeatures) / sizeof(VkBool32);
+      for (size_t i = 0; i < num_features; ++i) {
+        optional[i] = optional[i] && supported[i] ? VK_TRUE : VK_FALSE;
+        enabled[i] = enabled[i] || optional[i] ? VK_TRUE : VK_FALSE;
+      }
+    }
 
     containers::vector<VkDeviceQueueCreateInfo> raw_queue_infos(allocator);
-    raw_queue_infos.reserve(4);
+    raw_queue_infos.reserve(5);
     for (const auto& qi : queue_create_infos) {
       raw_queue_infos.emplace_back(qi.GetVkDeviceQueueCreateInfo());
     }
@@ -548,12 +650,13 @@ VkDevice CreateDeviceForSwapchain(
         static_cast<uint32_t>(
             enabled_extensions.size()),  // enabledExtensionCount
         enabled_extensions.data(),       // ppEnabledExtensionNames
-        &features                        // ppEnabledFeatures
+        &enabled_features                // ppEnabledFeatures
     };
 
     ::VkDevice raw_device;
     LOG_ASSERT(==, instance->GetLogger(),
-               (*instance)->vkCreateDevice(physical_device, &info, nullptr,
+               (*instance)->vkCreateDevice(physical_device, &info,
+                                           instance->allocation_callbacks(),
                                            &raw_device),
                VK_SUCCESS);
 
@@ -564,7 +667,8 @@ VkDevice CreateDeviceForSwapchain(
 
     *present_queue_index = present_queue_family_index;
     *graphics_queue_index = graphics_queue_family_index;
-    return vulkan::VkDevice(allocator, raw_device, nullptr, instance,
+    return vulkan::VkDevice(allocator, raw_device,
+                            instance->allocation_callbacks(), instance,
                             &physical_device_properties, physical_device);
   }
   instance->GetLogger()->LogError(
@@ -575,24 +679,116 @@ VkDevice CreateDeviceForSwapchain(
                           &throwaway_properties, VK_NULL_HANDLE);
 }
 
+VkDevice CreateComputeDevice(
+    containers::Allocator* allocator, VkInstance* instance,
+    uint32_t* compute_queue_index,
+    const std::initializer_list<const char*> extensions,
+    const VkPhysicalDeviceFeatures& features) {
+  containers::vector<VkPhysicalDevice> physical_devices =
+      GetPhysicalDevices(allocator, *instance);
+  float priority = 1.f;
+
+  for (auto device : physical_devices) {
+    VkPhysicalDevice physical_device = device;
+
+    if (!SupportRequestPhysicalDeviceFeatures(instance, physical_device,
+                                              features)) {
+      continue;
+    }
+    if (!SupportsDeviceExtensions(allocator, instance, device, extensions)) {
+      continue;
+    }
+    const uint32_t queue_family_index =
+        GetComputeQueueFamily(allocator, *instance, physical_device);
+    if (queue_family_index == ~0u) {
+      continue;
+    }
+
+    VkPhysicalDeviceProperties physical_device_properties;
+    (*instance)->vkGetPhysicalDeviceProperties(device,
+                                               &physical_device_properties);
+
+    VkDeviceQueueCreateInfo queue_info{
+        VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,  // sType
+        nullptr,                                     // pNext
+        0,                                           // flags
+        queue_family_index,                          // queueFamilyIndex
+        1,                                           // queueCount
+        &priority                                    // pQueuePriorities
+    };
+
+    containers::vector<const char*> enabled_extensions(allocator);
+    for (auto ext : extensions) {
+      enabled_extensions.push_back(ext);
+    }
+
+    VkDeviceCreateInfo info{
+        VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,  // stype
+        nullptr,                               // pNext
+        0,                                     // flags
+        1,                                     // queueCreateInfoCount
+        &queue_info,                           // pQueueCreateInfos
+        0,                                     // enabledLayerCount
+        nullptr,                               // ppEnabledLayerNames
+        static_cast<uint32_t>(
+            enabled_extensions.size()),  // enabledExtensionCount
+        enabled_extensions.data(),       // ppEnabledExtensionNames
+        &features                        // ppEnabledFeatures
+    };
+
+    ::VkDevice raw_device;
+    LOG_ASSERT(==, instance->GetLogger(),
+               (*instance)->vkCreateDevice(physical_device, &info,
+                                           instance->allocation_callbacks(),
+                                           &raw_device),
+               VK_SUCCESS);
+
+    instance->GetLogger()->LogInfo("Enabled Device Extensions: ");
+    for (auto& extension : enabled_extensions) {
+      instance->GetLogger()->LogInfo("    ", extension);
+    }
+
+    *compute_queue_index = queue_family_index;
+    return vulkan::VkDevice(allocator, raw_device,
+                            instance->allocation_callbacks(), instance,
+                            &physical_device_properties, physical_device);
+  }
+  instance->GetLogger()->LogError(
+      "Could not find physical device with a compute queue");
+
+  VkPhysicalDeviceProperties throwaway_properties;
+  return vulkan::VkDevice(allocator, VK_NULL_HANDLE, nullptr, instance,
+                          &throwaway_properties, VK_NULL_HANDLE);
+}
+
 VkCommandPool CreateDefaultCommandPool(containers::Allocator* allocator,
-                                       VkDevice& device) {
+                                       VkDevice& device,
+                                       uint32_t queue_family_index) {
+  return CreateCommandPool(&device,
+                           VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+                           queue_family_index);
+}
+
+VkCommandPool CreateCommandPool(VkDevice* device,
+                                VkCommandPoolCreateFlags flags,
+                                uint32_t queue_family_index) {
   VkCommandPoolCreateInfo info = {
       /* sType = */ VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
       /* pNext = */ nullptr,
-      /* flags = */ VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
-      // TODO(antiagainst): use a graphics + compute queue family.
-      /* queueFamilyIndex = */ 0,
+      /* flags = */ flags,
+      /* queueFamilyIndex = */ queue_family_index,
   };
 
   ::VkCommandPool raw_command_pool = VK_NULL_HANDLE;
-  if (device.is_valid()) {
-    LOG_ASSERT(
-        ==, device.GetLogger(),
-        device->vkCreateCommandPool(device, &info, nullptr, &raw_command_pool),
-        VK_SUCCESS);
+  if (device->is_valid()) {
+    LOG_ASSERT(==, device->GetLogger(),
+               (*device)->vkCreateCommandPool(*device, &info,
+                                              device->allocation_callbacks(),
+                                              &raw_command_pool),
+               VK_SUCCESS);
   }
-  return vulkan::VkCommandPool(raw_command_pool, nullptr, &device);
+  return vulkan::VkCommandPool(raw_command_pool,
+                               device->allocation_callbacks(), device);
 }
 
 VkSurfaceKHR CreateDefaultSurface(VkInstance* instance,
@@ -603,25 +799,25 @@ VkSurfaceKHR CreateDefaultSurface(VkInstance* instance,
       VK_STRUCTURE_TYPE_ANDROID_SURFACE_CREATE_INFO_KHR, 0, 0,
       data->native_window_handle()};
 
-  (*instance)->vkCreateAndroidSurfaceKHR(*instance, &create_info, nullptr,
-                                         &surface);
+  (*instance)->vkCreateAndroidSurfaceKHR(
+      *instance, &create_info, instance->allocation_callbacks(), &surface);
 #elif defined __linux__
   VkXcbSurfaceCreateInfoKHR create_info{
       VK_STRUCTURE_TYPE_XCB_SURFACE_CREATE_INFO_KHR, 0, 0,
       data->native_connection(), data->native_window_handle()};
 
-  (*instance)->vkCreateXcbSurfaceKHR(*instance, &create_info, nullptr,
-                                     &surface);
+  (*instance)->vkCreateXcbSurfaceKHR(
+      *instance, &create_info, instance->allocation_callbacks(), &surface);
 #elif defined _WIN32
   VkWin32SurfaceCreateInfoKHR create_info{
       VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR, 0, 0,
       data->native_hinstance(), data->native_window_handle()};
 
-  (*instance)->vkCreateWin32SurfaceKHR(*instance, &create_info, nullptr,
-                                       &surface);
+  (*instance)->vkCreateWin32SurfaceKHR(
+      *instance, &create_info, instance->allocation_callbacks(), &surface);
 #endif
 
-  return VkSurfaceKHR(surface, nullptr, instance);
+  return VkSurfaceKHR(surface, instance->allocation_callbacks(), instance);
 }
 
 VkCommandBuffer CreateDefaultCommandBuffer(VkCommandPool* pool,
@@ -647,12 +843,73 @@ VkCommandBuffer CreateCommandBuffer(VkCommandPool* pool,
   return vulkan::VkCommandBuffer(raw_command_buffer, pool, device);
 }
 
-VkSwapchainKHR CreateDefaultSwapchain(VkInstance* instance, VkDevice* device,
-                                      VkSurfaceKHR* surface,
-                                      containers::Allocator* allocator,
-                                      uint32_t graphics_queue_index,
-                                      uint32_t present_queue_index,
-                                      const entry::EntryData* data) {
+namespace {
+struct PresentModeName {
+  VkPresentModeKHR mode;
+  const char* name;
+};
+const PresentModeName kPresentModeNames[] = {
+    {VK_PRESENT_MODE_FIFO_KHR, "fifo"},
+    {VK_PRESENT_MODE_FIFO_RELAXED_KHR, "fifo-relaxed"},
+    {VK_PRESENT_MODE_MAILBOX_KHR, "mailbox"},
+    {VK_PRESENT_MODE_IMMEDIATE_KHR, "immediate"},
+};
+
+// Returns present_mode if it is one of supported_modes, otherwise the
+// supported mode that behaves most like it. FIFO is always supported.
+VkPresentModeKHR ChoosePresentMode(
+    VkPresentModeKHR present_mode,
+    const containers::vector<VkPresentModeKHR>& supported_modes) {
+  auto is_supported = [&supported_modes](VkPresentModeKHR mode) {
+    return std::find(supported_modes.begin(), supported_modes.end(), mode) !=
+           supported_modes.end();
+  };
+  // Mailbox and immediate are both uncapped, and fifo-relaxed only differs
+  // from fifo once a frame is late.
+  VkPresentModeKHR fallback = VK_PRESENT_MODE_FIFO_KHR;
+  switch (present_mode) {
+    case VK_PRESENT_MODE_MAILBOX_KHR:
+      fallback = VK_PRESENT_MODE_IMMEDIATE_KHR;
+      break;
+    case VK_PRESENT_MODE_IMMEDIATE_KHR:
+      fallback = VK_PRESENT_MODE_MAILBOX_KHR;
+      break;
+    default:
+      break;
+  }
+  if (is_supported(present_mode)) {
+    return present_mode;
+  }
+  if (is_supported(fallback)) {
+    return fallback;
+  }
+  return VK_PRESENT_MODE_FIFO_KHR;
+}
+}  // namespace
+
+VkPresentModeKHR GetPresentModeFromName(const char* name) {
+  for (const auto& present_mode : kPresentModeNames) {
+    if (strcmp(present_mode.name, name) == 0) {
+      return present_mode.mode;
+    }
+  }
+  return VK_PRESENT_MODE_MAX_ENUM_KHR;
+}
+
+const char* GetPresentModeName(VkPresentModeKHR present_mode) {
+  for (const auto& name : kPresentModeNames) {
+    if (name.mode == present_mode) {
+      return name.name;
+    }
+  }
+  return "unknown";
+}
+
+VkSwapchainKHR CreateDefaultSwapchain(
+    VkInstance* instance, VkDevice* device, VkSurfaceKHR* surface,
+    containers::Allocator* allocator, uint32_t graphics_queue_index,
+    uint32_t present_queue_index, const entry::EntryData* data,
+    VkPresentModeKHR present_mode, uint32_t image_count) {
   ::VkSwapchainKHR swapchain = VK_NULL_HANDLE;
   VkExtent2D image_extent = {0, 0};
   containers::vector<VkSurfaceFormatKHR> surface_formats(allocator);
@@ -713,13 +970,47 @@ VkSwapchainKHR CreateDefaultSwapchain(VkInstance* instance, VkDevice* device,
     uint32_t maxSwapchains =
         std::max(surface_caps.maxImageCount, surface_caps.minImageCount + 1);
 
+    // The command line overrides what the application asked for.
+    if (data->present_mode()) {
+      present_mode = GetPresentModeFromName(data->present_mode());
+      if (present_mode == VK_PRESENT_MODE_MAX_ENUM_KHR) {
+        instance->GetLogger()->LogError("Unknown present mode ",
+                                        data->present_mode());
+      }
+    }
+    if (data->swapchain_images() != 0) {
+      image_count = data->swapchain_images();
+    }
+    const VkPresentModeKHR chosen_present_mode =
+        present_mode == VK_PRESENT_MODE_MAX_ENUM_KHR
+            ? present_modes.front()
+            : ChoosePresentMode(present_mode, present_modes);
+    if (present_mode != VK_PRESENT_MODE_MAX_ENUM_KHR &&
+        chosen_present_mode != present_mode) {
+      instance->GetLogger()->LogInfo(
+          "Present mode ", GetPresentModeName(present_mode),
+          " is not supported, falling back to ",
+          GetPresentModeName(chosen_present_mode));
+    }
+    // A maxImageCount of 0 means that there is no limit.
+    const uint32_t chosen_image_count =
+        image_count == 0
+            ? std::min(surface_caps.minImageCount + 1, maxSwapchains)
+            : std::max(surface_caps.minImageCount,
+                       surface_caps.maxImageCount == 0
+                           ? image_count
+                           : std::min(image_count, surface_caps.maxImageCount));
+    instance->GetLogger()->LogInfo(
+        "Creating a swapchain with present mode ",
+        GetPresentModeName(chosen_present_mode), " and at least ",
+        chosen_image_count, " images");
+
     VkSwapchainCreateInfoKHR swapchainCreateInfo{
         VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,  // sType
         nullptr,                                      // pNext
         0,                                            // flags
         *surface,                                     // surface
-        std::min(surface_caps.minImageCount + 1,
-                 maxSwapchains),        // minImageCount
+        chosen_image_count,                           // minImageCount
         surface_formats[0].format,      // surfaceFormat
         surface_formats[0].colorSpace,  // colorSpace
         image_extent,                   // imageExtent
@@ -733,19 +1024,21 @@ VkSwapchainKHR CreateDefaultSwapchain(VkInstance* instance, VkDevice* device,
         surface_caps.currentTransform,           // preTransform,
         static_cast<VkCompositeAlphaFlagBitsKHR>(
             chosenAlpha),       // compositeAlpha
-        present_modes.front(),  // presentModes
-        false,                  // clipped
-        VK_NULL_HANDLE          // oldSwapchain
+        chosen_present_mode,  // presentModes
+        false,                // clipped
+        VK_NULL_HANDLE        // oldSwapchain
     };
 
     LOG_ASSERT(==, instance->GetLogger(),
                (*device)->vkCreateSwapchainKHR(*device, &swapchainCreateInfo,
-                                               nullptr, &swapchain),
+                                               device->allocation_callbacks(),
+                                               &swapchain),
                VK_SUCCESS);
   }
 
-  return VkSwapchainKHR(swapchain, nullptr, device, image_extent.width,
-                        image_extent.height, 1u, surface_formats[0].format);
+  return VkSwapchainKHR(swapchain, device->allocation_callbacks(), device,
+                        image_extent.width, image_extent.height, 1u,
+                        surface_formats[0].format);
 }
 
 VkImage CreateDefault2DColorImage(VkDevice* device, uint32_t width,
@@ -774,9 +1067,11 @@ VkImage CreateDefault2DColorImage(VkDevice* device, uint32_t width,
   };
   ::VkImage raw_image;
   LOG_ASSERT(==, device->GetLogger(),
-             (*device)->vkCreateImage(*device, &info, nullptr, &raw_image),
+             (*device)->vkCreateImage(*device, &info,
+                                      device->allocation_callbacks(),
+                                      &raw_image),
              VK_SUCCESS);
-  return vulkan::VkImage(raw_image, nullptr, device);
+  return vulkan::VkImage(raw_image, device->allocation_callbacks(), device);
 }
 
 VkSampler CreateDefaultSampler(VkDevice* device) {
@@ -802,9 +1097,12 @@ VkSampler CreateDefaultSampler(VkDevice* device) {
   };
   ::VkSampler raw_sampler;
   LOG_ASSERT(==, device->GetLogger(),
-             (*device)->vkCreateSampler(*device, &info, nullptr, &raw_sampler),
+             (*device)->vkCreateSampler(*device, &info,
+                                        device->allocation_callbacks(),
+                                        &raw_sampler),
              VK_SUCCESS);
-  return vulkan::VkSampler(raw_sampler, nullptr, device);
+  return vulkan::VkSampler(raw_sampler, device->allocation_callbacks(),
+                           device);
 }
 
 VkSampler CreateSampler(VkDevice* device, VkFilter minFilter,
@@ -831,9 +1129,12 @@ VkSampler CreateSampler(VkDevice* device, VkFilter minFilter,
   };
   ::VkSampler raw_sampler;
   LOG_ASSERT(==, device->GetLogger(),
-             (*device)->vkCreateSampler(*device, &info, nullptr, &raw_sampler),
+             (*device)->vkCreateSampler(*device, &info,
+                                        device->allocation_callbacks(),
+                                        &raw_sampler),
              VK_SUCCESS);
-  return vulkan::VkSampler(raw_sampler, nullptr, device);
+  return vulkan::VkSampler(raw_sampler, device->allocation_callbacks(),
+                           device);
 }
 
 VkDescriptorSetLayout CreateDescriptorSetLayout(
@@ -856,27 +1157,30 @@ VkDescriptorSetLayout CreateDescriptorSetLayout(
   LOG_ASSERT(
       ==, device->GetLogger(), VK_SUCCESS,
       (*device)->vkCreateDescriptorSetLayout(
-          *device, &descriptor_set_layout_create_info, nullptr, &layout));
-  return VkDescriptorSetLayout(layout, nullptr, device);
+          *device, &descriptor_set_layout_create_info,
+          device->allocation_callbacks(), &layout));
+  return VkDescriptorSetLayout(layout, device->allocation_callbacks(), device);
 }
 
-// Creates a default pipeline cache, it does not load anything from disk.
-VkPipelineCache CreateDefaultPipelineCache(VkDevice* device) {
+VkPipelineCache CreateDefaultPipelineCache(VkDevice* device,
+                                           const void* initial_data,
+                                           size_t initial_data_size) {
   ::VkPipelineCache cache = VK_NULL_HANDLE;
 
   VkPipelineCacheCreateInfo create_info{
       VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,  // sType
       nullptr,                                       // pNext
       0,                                             // flags
-      0,                                             // initialDataSize
-      nullptr                                        // pInitialData
+      initial_data ? initial_data_size : 0,          // initialDataSize
+      initial_data                                   // pInitialData
   };
   if (device->is_valid()) {
     LOG_ASSERT(==, device->GetLogger(), VK_SUCCESS,
-               (*device)->vkCreatePipelineCache(*device, &create_info, nullptr,
+               (*device)->vkCreatePipelineCache(*device, &create_info,
+                                                device->allocation_callbacks(),
                                                 &cache));
   }
-  return VkPipelineCache(cache, nullptr, device);
+  return VkPipelineCache(cache, device->allocation_callbacks(), device);
 }
 
 VkQueryPool CreateQueryPool(VkDevice* device,
@@ -884,10 +1188,11 @@ VkQueryPool CreateQueryPool(VkDevice* device,
   ::VkQueryPool query_pool = VK_NULL_HANDLE;
   if (device->is_valid()) {
     LOG_ASSERT(==, device->GetLogger(), VK_SUCCESS,
-               (*device)->vkCreateQueryPool(*device, &create_info, nullptr,
+               (*device)->vkCreateQueryPool(*device, &create_info,
+                                            device->allocation_callbacks(),
                                             &query_pool));
   }
-  return VkQueryPool(query_pool, nullptr, device);
+  return VkQueryPool(query_pool, device->allocation_callbacks(), device);
 }
 
 VkDescriptorPool CreateDescriptorPool(VkDevice* device, uint32_t num_pool_size,
@@ -902,11 +1207,12 @@ VkDescriptorPool CreateDescriptorPool(VkDevice* device, uint32_t num_pool_size,
       /* pPoolSizes = */ pool_sizes};
 
   ::VkDescriptorPool raw_pool;
-  LOG_ASSERT(
-      ==, device->GetLogger(),
-      (*device)->vkCreateDescriptorPool(*device, &info, nullptr, &raw_pool),
-      VK_SUCCESS);
-  return vulkan::VkDescriptorPool(raw_pool, nullptr, device);
+  LOG_ASSERT(==, device->GetLogger(),
+             (*device)->vkCreateDescriptorPool(
+                 *device, &info, device->allocation_callbacks(), &raw_pool),
+             VK_SUCCESS);
+  return vulkan::VkDescriptorPool(raw_pool, device->allocation_callbacks(),
+                                  device);
 }
 
 VkDescriptorSetLayout CreateDescriptorSetLayout(VkDevice* device,
@@ -929,10 +1235,11 @@ VkDescriptorSetLayout CreateDescriptorSetLayout(VkDevice* device,
 
   ::VkDescriptorSetLayout raw_layout;
   LOG_ASSERT(==, device->GetLogger(),
-             (*device)->vkCreateDescriptorSetLayout(*device, &info, nullptr,
-                                                    &raw_layout),
+             (*device)->vkCreateDescriptorSetLayout(
+                 *device, &info, device->allocation_callbacks(), &raw_layout),
              VK_SUCCESS);
-  return vulkan::VkDescriptorSetLayout(raw_layout, nullptr, device);
+  return vulkan::VkDescriptorSetLayout(raw_layout,
+                                       device->allocation_callbacks(), device);
 }
 
 VkDescriptorSet AllocateDescriptorSet(VkDevice* device, ::VkDescriptorPool pool,
@@ -962,11 +1269,13 @@ VkDeviceMemory AllocateDeviceMemory(VkDevice* device,
       /* memoryTypeIndex = */ memory_type_index,
   };
   ::VkDeviceMemory raw_memory;
-  LOG_ASSERT(
-      ==, device->GetLogger(),
-      (*device)->vkAllocateMemory(*device, &alloc_info, nullptr, &raw_memory),
-      VK_SUCCESS);
-  return vulkan::VkDeviceMemory(raw_memory, nullptr, device);
+  LOG_ASSERT(==, device->GetLogger(),
+             (*device)->vkAllocateMemory(*device, &alloc_info,
+                                         device->allocation_callbacks(),
+                                         &raw_memory),
+             VK_SUCCESS);
+  return vulkan::VkDeviceMemory(raw_memory, device->allocation_callbacks(),
+                                device);
 }
 
 void RecordImageLayoutTransition(
@@ -1055,4 +1364,42 @@ size_t GetImageExtentSizeInBytes(const VkExtent3D& extent, VkFormat format) {
   size_t h = size_t(RoundUpTo(extent.height, tb_height_size));
   return w * h * element_size;
 }
+
+bool HasUnifiedMemory(const VkDevice& device) {
+  const VkPhysicalDeviceMemoryProperties& properties =
+      device.physical_device_memory_properties();
+  VkDeviceSize largest_heap_size = 0;
+  uint32_t largest_heap = properties.memoryHeapCount;
+  for (uint32_t i = 0; i < properties.memoryHeapCount; ++i) {
+    const VkMemoryHeap& heap = properties.memoryHeaps[i];
+    if ((heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) &&
+        heap.size > largest_heap_size) {
+      largest_heap_size = heap.size;
+      largest_heap = i;
+    }
+  }
+  const VkMemoryPropertyFlags unified_flags =
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  for (uint32_t i = 0; i < properties.memoryTypeCount; ++i) {
+    const VkMemoryType& type = properties.memoryTypes[i];
+    if (type.heapIndex == largest_heap &&
+        (type.propertyFlags & unified_flags) == unified_flags) {
+      return true;
+    }
+  }
+  return false;
+}
+
+VkDeviceSize GetBufferImageCopyAlignment(VkFormat format,
+                                         VkDeviceSize minimum_alignment) {
+  const VkDeviceSize element_size =
+      std::get<0>(GetElementAndTexelBlockSize(format));
+  VkDeviceSize alignment = minimum_alignment;
+  while (element_size != 0 && alignment % element_size != 0) {
+    alignment += minimum_alignment;
+  }
+  return alignment;
+}
 }  // namespace vulkan
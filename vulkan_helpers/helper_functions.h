@@ -41,22 +41,27 @@ void MemoryClear(T* val) {
 // Create an empty instance. Vulkan functions that are resolved by the created
 // instance will be stored in the space allocated by the given |allocator|. The
 // |allocator| must continue to exist until the instance is destroied.
-VkInstance CreateEmptyInstance(containers::Allocator* allocator,
-                               LibraryWrapper* _wrapper);
+// If |allocation_callbacks| is not nullptr, the instance, and every device and
+// object created from it by the helpers here, will use them for host memory.
+VkInstance CreateEmptyInstance(
+    containers::Allocator* allocator, LibraryWrapper* _wrapper,
+    VkAllocationCallbacks* allocation_callbacks = nullptr);
 
 // Creates an instance with the swapchain and surface layers enabled. Vulkan
 // functions that are resolved through the created instance will be stored in
 // the space allocated by the given |allocator|. The |allocator| must continue
 // to exist until the instance is destroied.
-VkInstance CreateDefaultInstance(containers::Allocator* allocator,
-                                 LibraryWrapper* _wrapper);
+VkInstance CreateDefaultInstance(
+    containers::Allocator* allocator, LibraryWrapper* _wrapper,
+    VkAllocationCallbacks* allocation_callbacks = nullptr);
 
 // Creates an instance with either a real or virtual swapchain based on
 // whether or not data requests an external swapchain. Otherwise
 // identical to CreateDefaultInstance.
-VkInstance CreateInstanceForApplication(containers::Allocator* allocator,
-                                        LibraryWrapper* wrapper,
-                                        const entry::EntryData* data);
+VkInstance CreateInstanceForApplication(
+    containers::Allocator* allocator, LibraryWrapper* wrapper,
+    const entry::EntryData* data,
+    VkAllocationCallbacks* allocation_callbacks = nullptr);
 
 containers::vector<VkPhysicalDevice> GetPhysicalDevices(
     containers::Allocator* allocator, VkInstance& instance);
@@ -81,19 +86,44 @@ uint32_t GetGraphicsAndComputeQueueFamily(containers::Allocator* allocator,
 uint32_t GetQueueFamily(containers::Allocator* allocator, VkInstance& instance,
                         ::VkPhysicalDevice device, VkQueueFlags queue_flags);
 
+// Returns the index for the queue family best suited to compute-only work for
+// the given physical |device|. A family that supports compute but not
+// graphics is preferred, since it is the most likely to be a dedicated
+// (async) compute family. Otherwise the first family with compute capabilities
+// is returned. Returns the max uint32_t value if no such queue.
+uint32_t GetComputeQueueFamily(containers::Allocator* allocator,
+                               VkInstance& instance, ::VkPhysicalDevice device);
+
+// Returns the index for the first queue family of the given physical |device|
+// that supports transfers, but neither graphics nor compute. Such a family is
+// usually backed by a dedicated DMA engine, which copies data without taking
+// any time from rendering. Returns the max uint32_t value if no such queue.
+uint32_t GetTransferQueueFamily(containers::Allocator* allocator,
+                                VkInstance& instance,
+                                ::VkPhysicalDevice device);
+
 // Creates a device from the given |instance| with one queue. If
 // |require_graphics_and_compute_queue| is true, the queue is of both graphics
 // and compute capabilities. Vulkan functions that are resolved through the
 // create device will be stored in the space allocated by the given |allocator|.
 // The |allocator| must continue to exist until the device is destroyed.
+// The device uses the same allocation callbacks as the |instance|.
 VkDevice CreateDefaultDevice(containers::Allocator* allocator,
                              VkInstance& instance,
                              bool require_graphics_compute_queue = false);
 
 // Creates a command pool with VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT
-// set.
+// set, for command buffers to be submitted to queues of the given
+// |queue_family_index|.
 VkCommandPool CreateDefaultCommandPool(containers::Allocator* allocator,
-                                       VkDevice& device);
+                                       VkDevice& device,
+                                       uint32_t queue_family_index = 0);
+
+// Creates a command pool with the given |flags|, for command buffers to be
+// submitted to queues of the given |queue_family_index|.
+VkCommandPool CreateCommandPool(VkDevice* device,
+                                VkCommandPoolCreateFlags flags,
+                                uint32_t queue_family_index = 0);
 
 // Creates a surface to render into the the default window
 // provided in entry_data.
@@ -112,7 +142,17 @@ VkSurfaceKHR CreateDefaultSurface(VkInstance* instance,
 // async_compute_queue_index with the queue family of the compute queue.
 // If no async compute queue could be created, *async_compute_queue_index
 // will be 0xFFFFFFFF
+// If transfer_queue_index is not nullptr, then the device will also be created
+// with a queue from the family returned by GetTransferQueueFamily, if that
+// family is not already used by one of the other queues, and its index is
+// returned in *transfer_queue_index. Otherwise *transfer_queue_index will be
+// 0xFFFFFFFF.
 // Note: They may be the same or different.
+// If optional_extensions is not nullptr, the extensions in it that the chosen
+// physical device supports are enabled as well, and the others are removed
+// from it. The same goes for the features set in optional_features, which
+// are cleared in it if they are not supported.
+// The device uses the same allocation callbacks as the |instance|.
 VkDevice CreateDeviceForSwapchain(
     containers::Allocator* allocator, VkInstance* instance,
     VkSurfaceKHR* surface, uint32_t* graphics_queue_index,
@@ -121,7 +161,23 @@ VkDevice CreateDeviceForSwapchain(
     const VkPhysicalDeviceFeatures& features = {0},
     bool try_to_find_separate_present_queue = false,
     uint32_t* aync_compute_queue_index = nullptr,
-    uint32_t* sparse_binding_queue_index = nullptr);
+    uint32_t* sparse_binding_queue_index = nullptr,
+    uint32_t* transfer_queue_index = nullptr,
+    containers::vector<const char*>* optional_extensions = nullptr,
+    VkPhysicalDeviceFeatures* optional_features = nullptr);
+
+// Creates a device with a single queue from the family returned by
+// GetComputeQueueFamily, and returns that family in |compute_queue_index|.
+// No WSI extensions are enabled, so the device can be created without a
+// surface. The device is created with the given extensions and features; the
+// first physical device that supports both, and has a compute queue, is used.
+// If there is no such physical device, an invalid device is returned.
+// The device uses the same allocation callbacks as the |instance|.
+VkDevice CreateComputeDevice(
+    containers::Allocator* allocator, VkInstance* instance,
+    uint32_t* compute_queue_index,
+    const std::initializer_list<const char*> extensions = {},
+    const VkPhysicalDeviceFeatures& features = {0});
 
 // Creates a primary level default command buffer from the given command pool
 // and the device.
@@ -137,12 +193,25 @@ VkCommandBuffer CreateCommandBuffer(VkCommandPool* pool,
 // Creates a swapchain with a default layout and number of images.
 // It will be able to be rendered to from graphics_queue_index,
 // and it will be presentable on present_queue_index.
-VkSwapchainKHR CreateDefaultSwapchain(VkInstance* instance, VkDevice* device,
-                                      VkSurfaceKHR* surface,
-                                      containers::Allocator* allocator,
-                                      uint32_t present_queue_index,
-                                      uint32_t graphics_queue_index,
-                                      const entry::EntryData* data);
+// The present mode and number of images given on the command line are used
+// if there are any, otherwise present_mode and image_count. If the surface
+// does not support the present mode, the closest one that it does is used,
+// and the number of images is clamped to what the surface supports.
+// VK_PRESENT_MODE_MAX_ENUM_KHR and 0 leave the choice to the surface.
+VkSwapchainKHR CreateDefaultSwapchain(
+    VkInstance* instance, VkDevice* device, VkSurfaceKHR* surface,
+    containers::Allocator* allocator, uint32_t present_queue_index,
+    uint32_t graphics_queue_index, const entry::EntryData* data,
+    VkPresentModeKHR present_mode = VK_PRESENT_MODE_MAX_ENUM_KHR,
+    uint32_t image_count = 0);
+
+// Returns the present mode with the given name, one of "fifo",
+// "fifo-relaxed", "mailbox" or "immediate", or
+// VK_PRESENT_MODE_MAX_ENUM_KHR if there is none.
+VkPresentModeKHR GetPresentModeFromName(const char* name);
+// Returns the name of the given present mode, as accepted by
+// GetPresentModeFromName.
+const char* GetPresentModeName(VkPresentModeKHR present_mode);
 
 // Returns a uint32_t with only the lowest bit set.
 uint32_t inline GetLSB(uint32_t val) { return ((val - 1) ^ val) & val; }
@@ -207,9 +276,11 @@ VkShaderModule CreateShaderModule(VkDevice* device,
   };
   ::VkShaderModule raw_shader_module;
   LOG_ASSERT(==, device->GetLogger(), VK_SUCCESS,
-             (*device)->vkCreateShaderModule(*device, &create_info, nullptr,
+             (*device)->vkCreateShaderModule(*device, &create_info,
+                                             device->allocation_callbacks(),
                                              &raw_shader_module));
-  return VkShaderModule(raw_shader_module, nullptr, device);
+  return VkShaderModule(raw_shader_module, device->allocation_callbacks(),
+                        device);
 }
 
 // Returns the "index" queue from the given queue_family.
@@ -220,8 +291,12 @@ VkQueue inline GetQueue(VkDevice* device, uint32_t queue_family_index,
   return VkQueue(queue, device, queue_family_index);
 }
 
-// Creates a default pipeline cache, it does not load anything from disk.
-VkPipelineCache CreateDefaultPipelineCache(VkDevice* device);
+// Creates a default pipeline cache, seeded with |initial_data_size| bytes of
+// |initial_data| if given. It does not load anything from disk itself, see
+// LoadPipelineCacheFile.
+VkPipelineCache CreateDefaultPipelineCache(VkDevice* device,
+                                           const void* initial_data = nullptr,
+                                           size_t initial_data_size = 0);
 
 // Creates a query pool with the given query pool create info from the given
 // device if the given device is valid. Otherwise returns a query pool with
@@ -255,6 +330,13 @@ uint32_t inline GetMemoryIndex(VkDevice* device, logging::Logger* log,
   return memory_index;
 }
 
+// Returns true if the largest device-local memory heap of the given device
+// also has a memory type that is host-visible and host-coherent, as it does
+// on integrated and mobile GPUs, whose memory is shared with the host.
+// Small host-visible device-local heaps, such as those of discrete GPUs, do
+// not count.
+bool HasUnifiedMemory(const VkDevice& device);
+
 // Records a pipeline barrier to the given command buffer |cmd_buf| to change
 // the layout of the given |image| with the specified |subresource_range| from
 // |old_layout| with access mask |src_access_mask| to |new_layout| with access
@@ -278,10 +360,11 @@ inline VkFence CreateFence(VkDevice* device, bool signaled = false) {
       nullptr,                                                         // pNext
       signaled ? VkFenceCreateFlags(VK_FENCE_CREATE_SIGNALED_BIT) : 0  // flags
   };
-  LOG_ASSERT(
-      ==, device->GetLogger(), VK_SUCCESS,
-      (*device)->vkCreateFence(*device, &create_info, nullptr, &raw_fence));
-  return VkFence(raw_fence, nullptr, device);
+  LOG_ASSERT(==, device->GetLogger(), VK_SUCCESS,
+             (*device)->vkCreateFence(*device, &create_info,
+                                      device->allocation_callbacks(),
+                                      &raw_fence));
+  return VkFence(raw_fence, device->allocation_callbacks(), device);
 }
 
 inline VkSemaphore CreateSemaphore(VkDevice* device) {
@@ -292,9 +375,10 @@ inline VkSemaphore CreateSemaphore(VkDevice* device) {
       0,                                        // flags
   };
   LOG_ASSERT(==, device->GetLogger(), VK_SUCCESS,
-             (*device)->vkCreateSemaphore(*device, &create_info, nullptr,
+             (*device)->vkCreateSemaphore(*device, &create_info,
+                                          device->allocation_callbacks(),
                                           &raw_semaphore));
-  return VkSemaphore(raw_semaphore, nullptr, device);
+  return VkSemaphore(raw_semaphore, device->allocation_callbacks(), device);
 }
 
 inline VkEvent CreateEvent(VkDevice* device) {
@@ -304,10 +388,11 @@ inline VkEvent CreateEvent(VkDevice* device) {
       nullptr,                              // pNext
       0,                                    // flags
   };
-  LOG_ASSERT(
-      ==, device->GetLogger(), VK_SUCCESS,
-      (*device)->vkCreateEvent(*device, &create_info, nullptr, &raw_event));
-  return VkEvent(raw_event, nullptr, device);
+  LOG_ASSERT(==, device->GetLogger(), VK_SUCCESS,
+             (*device)->vkCreateEvent(*device, &create_info,
+                                      device->allocation_callbacks(),
+                                      &raw_event));
+  return VkEvent(raw_event, device->allocation_callbacks(), device);
 }
 
 // Returns the size of the given image extent specified through width, height,
@@ -315,6 +400,13 @@ inline VkEvent CreateEvent(VkDevice* device) {
 // format is not recognized.
 size_t GetImageExtentSizeInBytes(const VkExtent3D& extent, VkFormat format);
 
+// Returns the smallest multiple of minimum_alignment that is also a multiple
+// of the size of a texel block of the given format. The bufferOffset of a
+// copy between a buffer and an image of that format must be aligned to it, if
+// minimum_alignment is a multiple of 4.
+VkDeviceSize GetBufferImageCopyAlignment(VkFormat format,
+                                         VkDeviceSize minimum_alignment);
+
 // Returns true if all the request features are supported by the given physical
 // device, otherwise returns false. The supported features are returned from
 // Vulkan command vkGetPhysicalDeviceFeatures, the command is resolved by the
@@ -0,0 +1,182 @@
+/* Copyright 2017 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "vulkan_helpers/parallel_command_recorder.h"
+
+#include <algorithm>
+
+#include "vulkan_helpers/helper_functions.h"
+
+namespace vulkan {
+
+ParallelCommandRecorder::ParallelCommandRecorder(
+    containers::Allocator* allocator, VkDevice* device,
+    uint32_t queue_family_index, uint32_t num_frames, uint32_t num_threads)
+    : device_(device),
+      num_frames_(std::max(num_frames, 1u)),
+      num_threads_(num_threads != 0
+                       ? num_threads
+                       : std::max(std::thread::hardware_concurrency(), 1u)),
+      thread_frames_(allocator),
+      recorded_chunks_(allocator),
+      frame_(0),
+      inheritance_info_(nullptr),
+      num_chunks_(0),
+      record_chunk_(nullptr),
+      next_chunk_(0),
+      job_index_(0),
+      busy_workers_(0),
+      exiting_(false),
+      threads_(allocator),
+      frames_recorded_(0),
+      chunks_recorded_(0),
+      command_buffers_allocated_(0) {
+  // The pools are transient, since every command buffer recorded from them
+  // is only submitted once before its pool is reset.
+  thread_frames_.reserve(num_threads_ * num_frames_);
+  for (uint32_t i = 0; i < num_threads_ * num_frames_; ++i) {
+    thread_frames_.emplace_back(
+        allocator, CreateCommandPool(device_,
+                                     VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+                                     queue_family_index));
+  }
+  threads_.reserve(num_threads_ - 1);
+  for (uint32_t i = 1; i < num_threads_; ++i) {
+    threads_.emplace_back(&ParallelCommandRecorder::WorkerThread, this, i);
+  }
+}
+
+ParallelCommandRecorder::~ParallelCommandRecorder() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    exiting_ = true;
+  }
+  work_available_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+void ParallelCommandRecorder::Record(
+    uint32_t frame, VkCommandBuffer* primary,
+    const VkCommandBufferInheritanceInfo& inheritance_info,
+    uint32_t num_chunks, const RecordChunkFunction& record_chunk) {
+  LOG_ASSERT(<, device_->GetLogger(), frame, num_frames_);
+  for (uint32_t i = 0; i < num_threads_; ++i) {
+    ThreadFrame& thread_frame = thread_frames_[i * num_frames_ + frame];
+    if (thread_frame.num_used != 0) {
+      LOG_ASSERT(==, device_->GetLogger(), VK_SUCCESS,
+                 (*device_)->vkResetCommandPool(*device_, thread_frame.pool,
+                                                0));
+      thread_frame.num_used = 0;
+    }
+  }
+  recorded_chunks_.resize(num_chunks);
+
+  frame_ = frame;
+  inheritance_info_ = &inheritance_info;
+  num_chunks_ = num_chunks;
+  record_chunk_ = &record_chunk;
+  next_chunk_.store(0, std::memory_order_relaxed);
+
+  // A single chunk is not worth waking the workers for.
+  const bool use_workers = !threads_.empty() && num_chunks > 1;
+  if (use_workers) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      job_index_ += 1;
+      busy_workers_ = static_cast<uint32_t>(threads_.size());
+    }
+    work_available_.notify_all();
+  }
+  RecordChunks(0);
+  if (use_workers) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    job_done_.wait(lock, [this]() { return busy_workers_ == 0; });
+  }
+
+  if (num_chunks != 0) {
+    (*primary)->vkCmdExecuteCommands(*primary, num_chunks,
+                                     recorded_chunks_.data());
+  }
+  frames_recorded_ += 1;
+  chunks_recorded_ += num_chunks;
+}
+
+void ParallelCommandRecorder::WorkerThread(uint32_t thread_index) {
+  uint64_t last_job_index = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      work_available_.wait(lock, [this, last_job_index]() {
+        return exiting_ || job_index_ != last_job_index;
+      });
+      if (exiting_) {
+        return;
+      }
+      last_job_index = job_index_;
+    }
+    RecordChunks(thread_index);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      busy_workers_ -= 1;
+      if (busy_workers_ == 0) {
+        job_done_.notify_one();
+      }
+    }
+  }
+}
+
+void ParallelCommandRecorder::RecordChunks(uint32_t thread_index) {
+  ThreadFrame& thread_frame =
+      thread_frames_[thread_index * num_frames_ + frame_];
+  VkCommandBufferBeginInfo begin_info{
+      VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,  // sType
+      nullptr,                                      // pNext
+      VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,  // flags
+      inheritance_info_                             // pInheritanceInfo
+  };
+  if (inheritance_info_->renderPass != VK_NULL_HANDLE) {
+    begin_info.flags |= VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+  }
+
+  uint32_t chunk;
+  while ((chunk = next_chunk_.fetch_add(1, std::memory_order_relaxed)) <
+         num_chunks_) {
+    if (thread_frame.num_used == thread_frame.command_buffers.size()) {
+      thread_frame.command_buffers.push_back(CreateCommandBuffer(
+          &thread_frame.pool, VK_COMMAND_BUFFER_LEVEL_SECONDARY, device_));
+      command_buffers_allocated_.fetch_add(1, std::memory_order_relaxed);
+    }
+    VkCommandBuffer& command_buffer =
+        thread_frame.command_buffers[thread_frame.num_used++];
+    LOG_ASSERT(==, device_->GetLogger(), VK_SUCCESS,
+               command_buffer->vkBeginCommandBuffer(command_buffer,
+                                                    &begin_info));
+    (*record_chunk_)(chunk, &command_buffer);
+    LOG_ASSERT(==, device_->GetLogger(), VK_SUCCESS,
+               command_buffer->vkEndCommandBuffer(command_buffer));
+    recorded_chunks_[chunk] = command_buffer;
+  }
+}
+
+void ParallelCommandRecorder::LogStatistics(logging::Logger* log) const {
+  log->LogInfo("Parallel command recorder: ", frames_recorded_,
+               " frames recorded as ", chunks_recorded_, " chunks on ",
+               num_threads_, " threads, using ",
+               command_buffers_allocated_.load(), " secondary command buffers");
+}
+
+}  // namespace vulkan
@@ -0,0 +1,137 @@
+/* Copyright 2017 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_HELPERS_PARALLEL_COMMAND_RECORDER_H_
+#define VULKAN_HELPERS_PARALLEL_COMMAND_RECORDER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "support/containers/allocator.h"
+#include "support/containers/vector.h"
+#include "support/log/log.h"
+#include "vulkan_helpers/vulkan_header_wrapper.h"
+#include "vulkan_wrapper/command_buffer_wrapper.h"
+#include "vulkan_wrapper/device_wrapper.h"
+#include "vulkan_wrapper/sub_objects.h"
+
+namespace vulkan {
+
+// ParallelCommandRecorder splits the recording of a frame's work across
+// several threads.
+// The work is described as a number of chunks. Each chunk is recorded into
+// its own secondary command buffer by whichever thread picks it up, and the
+// secondary command buffers are then executed from the primary command
+// buffer, in chunk order, with a single vkCmdExecuteCommands.
+// Every recording thread has its own command pool for each frame, so no
+// command pool is ever used by two threads at once. The pools for a frame
+// are reset with vkResetCommandPool when that frame is next recorded, and
+// the secondary command buffers allocated from them are reused.
+// The calling thread records chunks too, so a recorder with a single thread
+// records everything serially, without starting any worker threads.
+class ParallelCommandRecorder {
+ public:
+  // Records a single chunk into the given secondary command buffer, which
+  // has already been begun, and is ended once this returns.
+  using RecordChunkFunction =
+      std::function<void(uint32_t chunk, VkCommandBuffer* command_buffer)>;
+
+  // Creates command pools for num_frames frames, for command buffers that
+  // will be submitted to queue_family_index. num_threads is the total number
+  // of threads that record, including the calling thread, or one per
+  // hardware thread if it is 0.
+  ParallelCommandRecorder(containers::Allocator* allocator, VkDevice* device,
+                          uint32_t queue_family_index, uint32_t num_frames,
+                          uint32_t num_threads = 0);
+  // Joins the worker threads.
+  ~ParallelCommandRecorder();
+
+  ParallelCommandRecorder(const ParallelCommandRecorder&) = delete;
+  ParallelCommandRecorder& operator=(const ParallelCommandRecorder&) = delete;
+
+  // Records num_chunks chunks with record_chunk, and executes them from
+  // primary. Every command buffer that was previously recorded for frame
+  // must have finished executing. If inheritance_info names a render pass,
+  // the chunks are recorded to continue it, and primary must be inside
+  // that render pass, begun with
+  // VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS. record_chunk is called
+  // from several threads at once, but never twice for the same chunk.
+  void Record(uint32_t frame, VkCommandBuffer* primary,
+              const VkCommandBufferInheritanceInfo& inheritance_info,
+              uint32_t num_chunks, const RecordChunkFunction& record_chunk);
+
+  uint32_t num_threads() const { return num_threads_; }
+  uint32_t num_frames() const { return num_frames_; }
+
+  // Logs how many frames and chunks were recorded, and how many secondary
+  // command buffers were needed to record them.
+  void LogStatistics(logging::Logger* log) const;
+
+ private:
+  // The command pool and secondary command buffers that one thread uses to
+  // record one frame.
+  struct ThreadFrame {
+    ThreadFrame(containers::Allocator* allocator, VkCommandPool pool)
+        : pool(std::move(pool)), command_buffers(allocator), num_used(0) {}
+    VkCommandPool pool;
+    containers::vector<VkCommandBuffer> command_buffers;
+    size_t num_used;
+  };
+
+  void WorkerThread(uint32_t thread_index);
+  // Records chunks until there are none left for the current job.
+  void RecordChunks(uint32_t thread_index);
+
+  VkDevice* device_;
+  const uint32_t num_frames_;
+  const uint32_t num_threads_;
+  // Indexed by thread_index * num_frames_ + frame. The calling thread
+  // uses thread index 0.
+  containers::vector<ThreadFrame> thread_frames_;
+  // The secondary command buffer that each chunk of the current job was
+  // recorded into.
+  containers::vector<::VkCommandBuffer> recorded_chunks_;
+
+  // The current job. These are only written while no worker is recording.
+  uint32_t frame_;
+  const VkCommandBufferInheritanceInfo* inheritance_info_;
+  uint32_t num_chunks_;
+  const RecordChunkFunction* record_chunk_;
+  std::atomic<uint32_t> next_chunk_;
+
+  std::mutex mutex_;
+  // Signaled when a job is started, or the recorder is being destroyed.
+  std::condition_variable work_available_;
+  // Signaled when the last worker has finished the current job.
+  std::condition_variable job_done_;
+  // Incremented for every job, so that a worker never runs one twice.
+  uint64_t job_index_;
+  // Number of workers that have not finished the current job.
+  uint32_t busy_workers_;
+  bool exiting_;
+  containers::vector<std::thread> threads_;
+
+  // Statistics.
+  uint64_t frames_recorded_;
+  uint64_t chunks_recorded_;
+  std::atomic<uint64_t> command_buffers_allocated_;
+};
+
+}  // namespace vulkan
+
+#endif  // VULKAN_HELPERS_PARALLEL_COMMAND_RECORDER_H_
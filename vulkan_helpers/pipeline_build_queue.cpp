@@ -0,0 +1,165 @@
+/* Copyright 2017 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "vulkan_helpers/pipeline_build_queue.h"
+
+#include <algorithm>
+
+#include "vulkan_helpers/vulkan_application.h"
+
+namespace vulkan {
+
+PipelineBuildQueue::PipelineBuildQueue(containers::Allocator* allocator,
+                                       VulkanApplication* application,
+                                       uint32_t num_threads,
+                                       uint32_t max_batch_size)
+    : allocator_(allocator),
+      application_(application),
+      max_batch_size_(std::max(max_batch_size, 1u)),
+      requests_(allocator),
+      outstanding_(0),
+      exiting_(false),
+      threads_(allocator) {
+  if (num_threads == 0) {
+    num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+  threads_.reserve(num_threads);
+  for (uint32_t i = 0; i < num_threads; ++i) {
+    threads_.emplace_back(&PipelineBuildQueue::WorkerThread, this);
+  }
+}
+
+PipelineBuildQueue::~PipelineBuildQueue() {
+  WaitIdle();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    exiting_ = true;
+  }
+  work_available_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+std::shared_future<::VkPipeline> PipelineBuildQueue::Add(
+    const VkGraphicsPipelineCreateInfo& create_info) {
+  Request request{
+      false, create_info, {},
+      std::promise<::VkPipeline>(
+          std::allocator_arg,
+          containers::StlCompatibleAllocator<::VkPipeline>(allocator_))};
+  return Enqueue(std::move(request));
+}
+
+std::shared_future<::VkPipeline> PipelineBuildQueue::Add(
+    const VkComputePipelineCreateInfo& create_info) {
+  Request request{
+      true, {}, create_info,
+      std::promise<::VkPipeline>(
+          std::allocator_arg,
+          containers::StlCompatibleAllocator<::VkPipeline>(allocator_))};
+  return Enqueue(std::move(request));
+}
+
+std::shared_future<::VkPipeline> PipelineBuildQueue::Enqueue(
+    Request request) {
+  std::shared_future<::VkPipeline> future = request.promise.get_future();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    requests_.push_back(std::move(request));
+    ++outstanding_;
+  }
+  work_available_.notify_one();
+  return future;
+}
+
+void PipelineBuildQueue::WaitIdle() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  idle_.wait(lock, [this]() { return outstanding_ == 0; });
+}
+
+void PipelineBuildQueue::WorkerThread() {
+  containers::vector<Request> batch(allocator_);
+  batch.reserve(max_batch_size_);
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      work_available_.wait(
+          lock, [this]() { return exiting_ || !requests_.empty(); });
+      if (requests_.empty()) {
+        return;
+      }
+      // Only consecutive requests of the same kind can share a
+      // vkCreate*Pipelines call.
+      const bool is_compute = requests_.front().is_compute;
+      while (!requests_.empty() && batch.size() < max_batch_size_ &&
+             requests_.front().is_compute == is_compute) {
+        batch.push_back(std::move(requests_.front()));
+        requests_.pop_front();
+      }
+    }
+    // Let another worker pick up whatever this one left behind.
+    work_available_.notify_one();
+
+    Build(&batch);
+    const uint32_t completed = static_cast<uint32_t>(batch.size());
+    batch.clear();
+
+    bool idle = false;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      outstanding_ -= completed;
+      idle = outstanding_ == 0;
+    }
+    if (idle) {
+      idle_.notify_all();
+    }
+  }
+}
+
+void PipelineBuildQueue::Build(containers::vector<Request>* batch) {
+  const uint32_t count = static_cast<uint32_t>(batch->size());
+  containers::vector<::VkPipeline> pipelines(count, VK_NULL_HANDLE,
+                                             allocator_);
+  VkResult result;
+  if (batch->front().is_compute) {
+    containers::vector<VkComputePipelineCreateInfo> infos(allocator_);
+    infos.reserve(count);
+    for (auto& request : *batch) {
+      infos.push_back(request.compute_info);
+    }
+    result = application_->CreateComputePipelines(count, infos.data(),
+                                                  pipelines.data());
+  } else {
+    containers::vector<VkGraphicsPipelineCreateInfo> infos(allocator_);
+    infos.reserve(count);
+    for (auto& request : *batch) {
+      infos.push_back(request.graphics_info);
+    }
+    result = application_->CreateGraphicsPipelines(count, infos.data(),
+                                                   pipelines.data());
+  }
+  if (result != VK_SUCCESS) {
+    application_->GetLogger()->LogError(
+        "Failed to create a batch of ", count, " pipelines: ", result);
+  }
+  // On failure, the pipelines that could not be created are left as
+  // VK_NULL_HANDLE, so the caller can tell which ones failed.
+  for (uint32_t i = 0; i < count; ++i) {
+    (*batch)[i].promise.set_value(pipelines[i]);
+  }
+}
+
+}  // namespace vulkan
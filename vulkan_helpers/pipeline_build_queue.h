@@ -0,0 +1,101 @@
+/* Copyright 2017 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_HELPERS_PIPELINE_BUILD_QUEUE_H_
+#define VULKAN_HELPERS_PIPELINE_BUILD_QUEUE_H_
+
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <thread>
+
+#include "support/containers/allocator.h"
+#include "support/containers/deque.h"
+#include "support/containers/vector.h"
+#include "vulkan_helpers/vulkan_header_wrapper.h"
+
+namespace vulkan {
+class VulkanApplication;
+
+// PipelineBuildQueue compiles pipelines in the background, against the
+// application's pipeline cache.
+// Pipelines are queued with VulkanGraphicsPipeline::Commit(queue) or by
+// passing the queue when creating a VulkanComputePipeline. Worker threads
+// then take consecutive requests of the same kind off the queue, and create
+// up to max_batch_size of them with a single vkCreate*Pipelines call.
+// Every request returns a future, so that the caller only has to wait for
+// the pipelines it is about to use.
+class PipelineBuildQueue {
+ public:
+  // Starts num_threads worker threads, or one per hardware thread if
+  // num_threads is 0.
+  PipelineBuildQueue(containers::Allocator* allocator,
+                     VulkanApplication* application, uint32_t num_threads = 0,
+                     uint32_t max_batch_size = 8);
+  // Waits for all queued pipelines to be created, and joins the workers.
+  ~PipelineBuildQueue();
+
+  PipelineBuildQueue(const PipelineBuildQueue&) = delete;
+  PipelineBuildQueue& operator=(const PipelineBuildQueue&) = delete;
+
+  // Queues the creation of a pipeline. Everything the create info points to
+  // must remain valid until the returned future is ready. The future holds
+  // VK_NULL_HANDLE if the pipeline could not be created. Ownership of the
+  // pipeline is passed to whoever reads the future.
+  std::shared_future<::VkPipeline> Add(
+      const VkGraphicsPipelineCreateInfo& create_info);
+  std::shared_future<::VkPipeline> Add(
+      const VkComputePipelineCreateInfo& create_info);
+
+  // Blocks until every pipeline queued so far has been created.
+  void WaitIdle();
+
+  uint32_t num_threads() const {
+    return static_cast<uint32_t>(threads_.size());
+  }
+
+ private:
+  struct Request {
+    bool is_compute;
+    VkGraphicsPipelineCreateInfo graphics_info;
+    VkComputePipelineCreateInfo compute_info;
+    std::promise<::VkPipeline> promise;
+  };
+
+  std::shared_future<::VkPipeline> Enqueue(Request request);
+  void WorkerThread();
+  // Creates the pipelines for all of the requests in the batch, which must
+  // all be of the same kind, and fulfills their promises.
+  void Build(containers::vector<Request>* batch);
+
+  containers::Allocator* allocator_;
+  VulkanApplication* application_;
+  const uint32_t max_batch_size_;
+
+  std::mutex mutex_;
+  // Signaled when a request is queued, or the queue is being destroyed.
+  std::condition_variable work_available_;
+  // Signaled when the last outstanding request has been completed.
+  std::condition_variable idle_;
+  containers::deque<Request> requests_;
+  // Number of requests that have been queued but not yet completed.
+  uint32_t outstanding_;
+  bool exiting_;
+  containers::vector<std::thread> threads_;
+};
+
+}  // namespace vulkan
+
+#endif  // VULKAN_HELPERS_PIPELINE_BUILD_QUEUE_H_
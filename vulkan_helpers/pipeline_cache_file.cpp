@@ -0,0 +1,173 @@
+/* Copyright 2017 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "vulkan_helpers/pipeline_cache_file.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+namespace vulkan {
+namespace {
+// Identifies a file written by SavePipelineCacheFile, "VKPC".
+const uint32_t kPipelineCacheFileMagic = 0x43504b56;
+// Must be changed whenever the layout of the file changes.
+const uint32_t kPipelineCacheFileVersion = 1;
+
+// The header we write in front of the data returned by vkGetPipelineCacheData.
+// The driver version is not part of the header the driver writes, but a new
+// driver may well produce different pipelines, so it is checked as well.
+struct PipelineCacheFileHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t vendor_id;
+  uint32_t device_id;
+  uint32_t driver_version;
+  uint8_t pipeline_cache_uuid[VK_UUID_SIZE];
+  uint64_t data_size;
+};
+
+// The layout of the header that the driver writes at the start of the data,
+// as given in the specification for vkGetPipelineCacheData.
+struct DriverPipelineCacheHeader {
+  uint32_t header_size;
+  uint32_t header_version;
+  uint32_t vendor_id;
+  uint32_t device_id;
+  uint8_t pipeline_cache_uuid[VK_UUID_SIZE];
+};
+
+bool MatchesDevice(VkDevice* device, uint32_t vendor_id, uint32_t device_id,
+                   const uint8_t* pipeline_cache_uuid) {
+  return vendor_id == device->vendor_id() && device_id == device->device_id() &&
+         memcmp(pipeline_cache_uuid, device->pipeline_cache_uuid(),
+                VK_UUID_SIZE) == 0;
+}
+}  // namespace
+
+bool LoadPipelineCacheFile(VkDevice* device, const char* file_name,
+                           containers::vector<uint8_t>* data) {
+  logging::Logger* log = device->GetLogger();
+  data->clear();
+  std::ifstream file(file_name, std::ios::in | std::ios::binary);
+  if (!file.is_open()) {
+    log->LogInfo("No pipeline cache found at ", file_name);
+    return false;
+  }
+
+  PipelineCacheFileHeader header;
+  if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+      header.magic != kPipelineCacheFileMagic ||
+      header.version != kPipelineCacheFileVersion) {
+    log->LogInfo("Ignoring ", file_name, ", it is not a pipeline cache");
+    return false;
+  }
+  if (!MatchesDevice(device, header.vendor_id, header.device_id,
+                     header.pipeline_cache_uuid) ||
+      header.driver_version != device->driver_version()) {
+    log->LogInfo("Ignoring ", file_name,
+                 ", it was written for a different device or driver");
+    return false;
+  }
+  if (header.data_size < sizeof(DriverPipelineCacheHeader)) {
+    log->LogInfo("Ignoring ", file_name, ", it is truncated");
+    return false;
+  }
+
+  data->resize(static_cast<size_t>(header.data_size));
+  if (!file.read(reinterpret_cast<char*>(data->data()), data->size())) {
+    log->LogInfo("Ignoring ", file_name, ", it is truncated");
+    data->clear();
+    return false;
+  }
+
+  DriverPipelineCacheHeader driver_header;
+  memcpy(&driver_header, data->data(), sizeof(driver_header));
+  if (driver_header.header_size < sizeof(driver_header) ||
+      driver_header.header_version != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+      !MatchesDevice(device, driver_header.vendor_id, driver_header.device_id,
+                     driver_header.pipeline_cache_uuid)) {
+    log->LogInfo("Ignoring ", file_name,
+                 ", the driver header does not match the device");
+    data->clear();
+    return false;
+  }
+
+  log->LogInfo("Loaded ", data->size(), " bytes of pipeline cache from ",
+               file_name);
+  return true;
+}
+
+bool SavePipelineCacheFile(containers::Allocator* allocator, VkDevice* device,
+                           VkPipelineCache* cache, const char* file_name) {
+  logging::Logger* log = device->GetLogger();
+  containers::vector<uint8_t> data(allocator);
+  size_t data_size = 0;
+  VkResult result = VK_INCOMPLETE;
+  // The cache may grow between the two calls if other threads are still
+  // creating pipelines, so try again until all of it fits.
+  while (result == VK_INCOMPLETE) {
+    if ((*device)->vkGetPipelineCacheData(*device, *cache, &data_size,
+                                          nullptr) != VK_SUCCESS) {
+      return false;
+    }
+    data.resize(data_size);
+    result = (*device)->vkGetPipelineCacheData(*device, *cache, &data_size,
+                                               data.data());
+  }
+  if (result != VK_SUCCESS) {
+    return false;
+  }
+  data.resize(data_size);
+
+  PipelineCacheFileHeader header;
+  header.magic = kPipelineCacheFileMagic;
+  header.version = kPipelineCacheFileVersion;
+  header.vendor_id = device->vendor_id();
+  header.device_id = device->device_id();
+  header.driver_version = device->driver_version();
+  memcpy(header.pipeline_cache_uuid, device->pipeline_cache_uuid(),
+         VK_UUID_SIZE);
+  header.data_size = data.size();
+
+  const std::string temp_file_name = std::string(file_name) + ".tmp";
+  {
+    std::ofstream file(temp_file_name.c_str(),
+                       std::ios::out | std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(data.data()), data.size());
+    file.close();
+    if (!file) {
+      log->LogError("Could not write the pipeline cache to ", temp_file_name);
+      std::remove(temp_file_name.c_str());
+      return false;
+    }
+  }
+#if defined _WIN32
+  // rename does not replace an existing file on Windows.
+  std::remove(file_name);
+#endif
+  if (std::rename(temp_file_name.c_str(), file_name) != 0) {
+    log->LogError("Could not move the pipeline cache to ", file_name);
+    std::remove(temp_file_name.c_str());
+    return false;
+  }
+  log->LogInfo("Saved ", data.size(), " bytes of pipeline cache to ",
+               file_name);
+  return true;
+}
+
+}  // namespace vulkan
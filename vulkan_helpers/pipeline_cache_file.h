@@ -0,0 +1,47 @@
+/* Copyright 2017 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_HELPERS_PIPELINE_CACHE_FILE_H_
+#define VULKAN_HELPERS_PIPELINE_CACHE_FILE_H_
+
+#include <cstdint>
+
+#include "support/containers/allocator.h"
+#include "support/containers/vector.h"
+#include "vulkan_wrapper/device_wrapper.h"
+#include "vulkan_wrapper/sub_objects.h"
+
+namespace vulkan {
+
+// Reads the pipeline cache data that SavePipelineCacheFile wrote to
+// |file_name| into |data|.
+// The data is only returned if it was written for the same vendor, device,
+// driver version and pipelineCacheUUID as |device|, and if the header that
+// the driver put in front of the data matches as well. Otherwise, or if the
+// file does not exist, false is returned and |data| is left empty.
+bool LoadPipelineCacheFile(VkDevice* device, const char* file_name,
+                           containers::vector<uint8_t>* data);
+
+// Writes the contents of |cache| to |file_name|, along with the properties of
+// |device| that LoadPipelineCacheFile validates.
+// The data is written to a temporary file which is then renamed to
+// |file_name|, so that an interrupted save never leaves a truncated file
+// behind. Returns false if the file could not be written.
+bool SavePipelineCacheFile(containers::Allocator* allocator, VkDevice* device,
+                           VkPipelineCache* cache, const char* file_name);
+
+}  // namespace vulkan
+
+#endif  // VULKAN_HELPERS_PIPELINE_CACHE_FILE_H_
@@ -0,0 +1,435 @@
+/* Copyright 2017 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "vulkan_helpers/readback_manager.h"
+
+#include <chrono>
+#include <cstring>
+#include <utility>
+
+#include "vulkan_helpers/helper_functions.h"
+
+namespace vulkan {
+
+namespace {
+// Every readback is at least this aligned in the ring, which keeps the
+// copies out of it fast.
+const VkDeviceSize kMinimumAlignment = 16;
+}  // namespace
+
+const VkDeviceSize ReadbackManager::kDefaultRingSize;
+
+ReadbackManager::ReadbackManager(
+    containers::Allocator* allocator, VulkanApplication* application,
+    VkQueue* queue,
+    containers::unique_ptr<VulkanApplication::Buffer> ring_buffer)
+    : allocator_(allocator),
+      application_(application),
+      device_(&application->device()),
+      queue_(queue),
+      ring_(std::move(ring_buffer)),
+      head_(0),
+      tail_(0),
+      readbacks_(allocator),
+      first_ticket_(1),
+      flushed_ticket_(0),
+      completed_ticket_(0),
+      reads_(allocator),
+      recorded_(false),
+      batches_(allocator),
+      command_pool_(
+          CreateDefaultCommandPool(allocator, *device_, queue->index())),
+      free_command_buffers_(allocator),
+      submissions_(allocator),
+      buffer_barriers_(allocator),
+      image_barriers_(allocator),
+      bytes_read_(0),
+      num_reads_(0),
+      num_flushes_(0),
+      fence_waits_(0),
+      oversized_reads_(0),
+      wait_nanoseconds_(0) {
+  LOG_ASSERT(!=, device_->GetLogger(), static_cast<char*>(nullptr),
+             ring_->base_address());
+}
+
+ReadbackManager::~ReadbackManager() { WaitIdle(); }
+
+ReadbackManager::Ticket ReadbackManager::ReadBuffer(
+    ::VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size,
+    VkAccessFlags src_access, VkPipelineStageFlags src_stages) {
+  VkDeviceSize destination_offset = 0;
+  ::VkBuffer destination =
+      Reserve(size, kMinimumAlignment, &destination_offset);
+  PendingRead read = {};
+  read.destination = destination;
+  read.buffer = buffer;
+  read.buffer_region = {offset, destination_offset, size};
+  read.image = VK_NULL_HANDLE;
+  read.src_access = src_access;
+  read.src_stages = src_stages;
+  reads_.push_back(read);
+  return first_ticket_ + readbacks_.size() - 1;
+}
+
+ReadbackManager::Ticket ReadbackManager::ReadImage(
+    ::VkImage image, VkFormat format, VkImageLayout layout,
+    const VkImageSubresourceLayers& subresource, const VkOffset3D& offset,
+    const VkExtent3D& extent, VkAccessFlags src_access,
+    VkPipelineStageFlags src_stages) {
+  const VkDeviceSize size =
+      GetImageExtentSizeInBytes(extent, format) * subresource.layerCount;
+  LOG_ASSERT(!=, device_->GetLogger(), VkDeviceSize(0), size);
+  VkDeviceSize destination_offset = 0;
+  ::VkBuffer destination = Reserve(
+      size, GetBufferImageCopyAlignment(format, kMinimumAlignment),
+      &destination_offset);
+  PendingRead read = {};
+  read.destination = destination;
+  read.buffer = VK_NULL_HANDLE;
+  read.image = image;
+  read.image_region = {destination_offset, 0,      0,
+                       subresource,        offset, extent};
+  read.layout = layout;
+  read.src_access = src_access;
+  read.src_stages = src_stages;
+  reads_.push_back(read);
+  return first_ticket_ + readbacks_.size() - 1;
+}
+
+::VkBuffer ReadbackManager::Reserve(VkDeviceSize size, VkDeviceSize alignment,
+                                    VkDeviceSize* offset) {
+  bytes_read_ += size;
+  num_reads_ += 1;
+
+  const VkDeviceSize capacity = ring_->size();
+  bool fits = false;
+  if (size <= capacity) {
+    // Readbacks never wrap around the end of the ring, the space up to the
+    // end is skipped instead.
+    VkDeviceSize start = head_ % capacity;
+    uint64_t position = head_;
+    VkDeviceSize aligned = (start + alignment - 1) / alignment * alignment;
+    if (aligned + size > capacity) {
+      position += capacity - start;
+      aligned = 0;
+    } else {
+      position += aligned - start;
+    }
+    // Free whatever has been released and has completed. Released tickets
+    // whose copies are still running are waited for, oldest first, but
+    // tickets that are still in use can only be waited for by their owners.
+    while (true) {
+      while (!batches_.empty() && CompleteOldest(false)) {
+      }
+      ReclaimReleased();
+      if (readbacks_.empty()) {
+        // Nothing is in use, so the space skipped at the end is free too.
+        tail_ = position;
+      }
+      if (position + size - tail_ <= capacity) {
+        fits = true;
+        break;
+      }
+      if (!readbacks_.front().released || first_ticket_ > flushed_ticket_) {
+        break;
+      }
+      CompleteOldest(true);
+    }
+    if (fits) {
+      head_ = position + size;
+      *offset = aligned;
+    }
+  }
+
+  Readback readback = {head_, fits ? *offset : 0, size, nullptr, false};
+  ::VkBuffer destination = *ring_;
+  if (!fits) {
+    oversized_reads_ += 1;
+    VkBufferCreateInfo create_info = {
+        VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,  // sType
+        nullptr,                               // pNext
+        0,                                     // flags
+        size,                                  // size
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT,      // usage
+        VK_SHARING_MODE_EXCLUSIVE,             // sharingMode
+        0,                                     // queueFamilyIndexCount
+        nullptr                                // pQueueFamilyIndices
+    };
+    readback.own_buffer = application_->CreateAndBindHostBuffer(&create_info);
+    destination = *readback.own_buffer;
+    *offset = 0;
+  }
+  readbacks_.push_back(std::move(readback));
+  return destination;
+}
+
+bool ReadbackManager::CompleteOldest(bool wait) {
+  Batch& batch = batches_.front();
+  if ((*device_)->vkGetFenceStatus(*device_, batch.fence) != VK_SUCCESS) {
+    if (!wait) {
+      return false;
+    }
+    fence_waits_ += 1;
+    LOG_ASSERT(==, device_->GetLogger(), VK_SUCCESS,
+               (*device_)->vkWaitForFences(*device_, 1, &batch.fence,
+                                           VK_FALSE, 0xFFFFFFFFFFFFFFFF));
+  }
+  // The host never writes to the ring, so invalidating all of it only
+  // discards cache lines that are stale anyway, and saves tracking the
+  // ranges that the batch wrote.
+  if (batch.last_ticket > completed_ticket_) {
+    ring_->invalidate();
+  }
+  for (Ticket ticket = completed_ticket_ + 1; ticket <= batch.last_ticket;
+       ++ticket) {
+    Readback& readback = GetReadback(ticket);
+    if (readback.own_buffer) {
+      readback.own_buffer->invalidate();
+    }
+  }
+  completed_ticket_ = batch.last_ticket;
+  application_->sync_object_pool()->ReleaseFence(batch.fence);
+  if (batch.command_buffer) {
+    free_command_buffers_.push_back(std::move(batch.command_buffer));
+  }
+  batches_.pop_front();
+  return true;
+}
+
+void ReadbackManager::ReclaimReleased() {
+  while (!readbacks_.empty() && readbacks_.front().released &&
+         first_ticket_ <= completed_ticket_) {
+    tail_ = readbacks_.front().ring_end;
+    readbacks_.pop_front();
+    first_ticket_ += 1;
+  }
+}
+
+ReadbackManager::Readback& ReadbackManager::GetReadback(Ticket ticket) {
+  LOG_ASSERT(>=, device_->GetLogger(), ticket, first_ticket_);
+  LOG_ASSERT(<, device_->GetLogger(), ticket,
+             first_ticket_ + readbacks_.size());
+  return readbacks_[static_cast<size_t>(ticket - first_ticket_)];
+}
+
+void ReadbackManager::Record(VkCommandBuffer* command_buffer) {
+  if (reads_.empty()) {
+    return;
+  }
+  recorded_ = true;
+
+  VkPipelineStageFlags src_stages = 0;
+  buffer_barriers_.clear();
+  image_barriers_.clear();
+  for (const PendingRead& read : reads_) {
+    src_stages |= read.src_stages;
+    if (read.image == VK_NULL_HANDLE) {
+      buffer_barriers_.push_back({
+          VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,  // sType
+          nullptr,                                  // pNext
+          read.src_access,                          // srcAccessMask
+          VK_ACCESS_TRANSFER_READ_BIT,              // dstAccessMask
+          VK_QUEUE_FAMILY_IGNORED,                  // srcQueueFamilyIndex
+          VK_QUEUE_FAMILY_IGNORED,                  // dstQueueFamilyIndex
+          read.buffer,                              // buffer
+          read.buffer_region.srcOffset,             // offset
+          read.buffer_region.size,                  // size
+      });
+      continue;
+    }
+    const VkImageSubresourceLayers& layers =
+        read.image_region.imageSubresource;
+    image_barriers_.push_back({
+        VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,  // sType
+        nullptr,                                 // pNext
+        read.src_access,                         // srcAccessMask
+        VK_ACCESS_TRANSFER_READ_BIT,             // dstAccessMask
+        read.layout,                             // oldLayout
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,    // newLayout
+        VK_QUEUE_FAMILY_IGNORED,                 // srcQueueFamilyIndex
+        VK_QUEUE_FAMILY_IGNORED,                 // dstQueueFamilyIndex
+        read.image,                              // image
+        {layers.aspectMask, layers.mipLevel, 1, layers.baseArrayLayer,
+         layers.layerCount},  // subresourceRange
+    });
+  }
+  // The ring space that the copies write to was last read by the host before
+  // it was released, which was before this was submitted, so only the
+  // sources have to be waited for.
+  (*command_buffer)
+      ->vkCmdPipelineBarrier(
+          *command_buffer,
+          src_stages == 0 ? static_cast<VkPipelineStageFlags>(
+                                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT)
+                          : src_stages,
+          VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr,
+          static_cast<uint32_t>(buffer_barriers_.size()),
+          buffer_barriers_.empty() ? nullptr : buffer_barriers_.data(),
+          static_cast<uint32_t>(image_barriers_.size()),
+          image_barriers_.empty() ? nullptr : image_barriers_.data());
+
+  for (const PendingRead& read : reads_) {
+    if (read.image == VK_NULL_HANDLE) {
+      (*command_buffer)
+          ->vkCmdCopyBuffer(*command_buffer, read.buffer, read.destination, 1,
+                            &read.buffer_region);
+    } else {
+      (*command_buffer)
+          ->vkCmdCopyImageToBuffer(*command_buffer, read.image,
+                                   VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                   read.destination, 1, &read.image_region);
+    }
+  }
+
+  // The images go back to their layouts before anything in the stages that
+  // last used them runs again, and the copies are made visible to the host.
+  for (VkImageMemoryBarrier& barrier : image_barriers_) {
+    barrier.dstAccessMask = barrier.srcAccessMask;
+    barrier.srcAccessMask = 0;
+    std::swap(barrier.oldLayout, barrier.newLayout);
+  }
+  VkMemoryBarrier host_barrier = {
+      VK_STRUCTURE_TYPE_MEMORY_BARRIER,  // sType
+      nullptr,                           // pNext
+      VK_ACCESS_TRANSFER_WRITE_BIT,      // srcAccessMask
+      VK_ACCESS_HOST_READ_BIT            // dstAccessMask
+  };
+  (*command_buffer)
+      ->vkCmdPipelineBarrier(
+          *command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+          VK_PIPELINE_STAGE_HOST_BIT | src_stages, 0, 1, &host_barrier, 0,
+          nullptr, static_cast<uint32_t>(image_barriers_.size()),
+          image_barriers_.empty() ? nullptr : image_barriers_.data());
+
+  reads_.clear();
+}
+
+VkResult ReadbackManager::Flush(SubmissionBatcher* batcher) {
+  if (reads_.empty() && !recorded_) {
+    return VK_SUCCESS;
+  }
+
+  Batch batch = {VK_NULL_HANDLE, 0, nullptr};
+  if (!reads_.empty()) {
+    if (free_command_buffers_.empty()) {
+      batch.command_buffer = containers::make_unique<VkCommandBuffer>(
+          allocator_, CreateDefaultCommandBuffer(&command_pool_, device_));
+    } else {
+      batch.command_buffer = std::move(free_command_buffers_.back());
+      free_command_buffers_.pop_back();
+    }
+    VkCommandBuffer& command_buffer = *batch.command_buffer;
+    VkCommandBufferBeginInfo begin_info = {
+        VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,  // sType
+        nullptr,                                      // pNext
+        VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,  // flags
+        nullptr                                       // pInheritanceInfo
+    };
+    command_buffer->vkBeginCommandBuffer(command_buffer, &begin_info);
+    Record(&command_buffer);
+    command_buffer->vkEndCommandBuffer(command_buffer);
+  }
+  // Every ticket handed out so far has been recorded, by now.
+  flushed_ticket_ = first_ticket_ + readbacks_.size() - 1;
+  batch.last_ticket = flushed_ticket_;
+  batch.fence = application_->sync_object_pool()->AcquireFence();
+
+  // Without a command buffer this only submits the fence, which still
+  // signals once the command buffers passed to Record() have completed.
+  VkResult result = VK_SUCCESS;
+  if (batch.command_buffer) {
+    VkSubmitInfo submit_info = {
+        VK_STRUCTURE_TYPE_SUBMIT_INFO,                // sType
+        nullptr,                                      // pNext
+        0,                                            // waitSemaphoreCount
+        nullptr,                                      // pWaitSemaphores
+        nullptr,                                      // pWaitDstStageMask
+        1,                                            // commandBufferCount
+        &batch.command_buffer->get_command_buffer(),  // pCommandBuffers
+        0,                                            // signalSemaphoreCount
+        nullptr                                       // pSignalSemaphores
+    };
+    if (batcher) {
+      batcher->Submit(submit_info);
+    } else {
+      submissions_.Add(submit_info);
+    }
+  }
+  if (batcher) {
+    result = batcher->Flush(batch.fence);
+  } else {
+    result = submissions_.Submit(queue_, batch.fence);
+  }
+  recorded_ = false;
+  num_flushes_ += 1;
+  batches_.push_back(std::move(batch));
+  return result;
+}
+
+bool ReadbackManager::IsComplete(Ticket ticket) {
+  while (ticket > completed_ticket_ && !batches_.empty() &&
+         CompleteOldest(false)) {
+  }
+  return ticket <= completed_ticket_;
+}
+
+ReadbackManager::Span ReadbackManager::Wait(Ticket ticket) {
+  LOG_ASSERT(<=, device_->GetLogger(), ticket, flushed_ticket_);
+  if (ticket > completed_ticket_) {
+    auto start = std::chrono::high_resolution_clock::now();
+    while (ticket > completed_ticket_) {
+      CompleteOldest(true);
+    }
+    wait_nanoseconds_ +=
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::high_resolution_clock::now() - start)
+            .count();
+  }
+  const Readback& readback = GetReadback(ticket);
+  const char* data = readback.own_buffer
+                         ? readback.own_buffer->base_address()
+                         : ring_->base_address() + readback.offset;
+  return {reinterpret_cast<const uint8_t*>(data),
+          static_cast<size_t>(readback.size)};
+}
+
+void ReadbackManager::CopyTo(Ticket ticket, void* dst) {
+  Span span = Wait(ticket);
+  memcpy(dst, span.data, span.size);
+}
+
+void ReadbackManager::Release(Ticket ticket) {
+  GetReadback(ticket).released = true;
+  ReclaimReleased();
+}
+
+void ReadbackManager::WaitIdle() {
+  while (!batches_.empty()) {
+    CompleteOldest(true);
+  }
+}
+
+void ReadbackManager::LogStatistics(logging::Logger* log) const {
+  log->LogInfo("Readback manager: ", bytes_read_, " bytes in ", num_reads_,
+               " copies and ", num_flushes_, " flushes, waited for the GPU ",
+               fence_waits_, " times, for ", wait_nanoseconds_ / 1e6,
+               "ms in total");
+  log->LogInfo("Readback manager: ", oversized_reads_,
+               " readbacks did not fit in the ", ring_->size(),
+               " byte ring");
+}
+
+}  // namespace vulkan
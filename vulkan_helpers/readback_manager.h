@@ -0,0 +1,217 @@
+/* Copyright 2017 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_HELPERS_READBACK_MANAGER_H_
+#define VULKAN_HELPERS_READBACK_MANAGER_H_
+
+#include <cstdint>
+
+#include "support/containers/allocator.h"
+#include "support/containers/deque.h"
+#include "support/containers/unique_ptr.h"
+#include "support/containers/vector.h"
+#include "support/log/log.h"
+#include "vulkan_helpers/submission_batcher.h"
+#include "vulkan_helpers/vulkan_application.h"
+#include "vulkan_helpers/vulkan_header_wrapper.h"
+#include "vulkan_wrapper/command_buffer_wrapper.h"
+#include "vulkan_wrapper/device_wrapper.h"
+#include "vulkan_wrapper/queue_wrapper.h"
+#include "vulkan_wrapper/sub_objects.h"
+
+namespace vulkan {
+
+// ReadbackManager copies data from buffers and images back to the host
+// through a single persistently mapped, and preferably host-cached, ring,
+// without waiting for the queue to go idle.
+// ReadBuffer() and ReadImage() reserve room for the data in the ring, queue
+// the copy into it, and return a ticket for it. Every queued copy is then
+// recorded together, between one pipeline barrier before and one after, by
+// the next Record() or Flush(), and each Flush() is submitted with a fence.
+// Once that fence has signalled, IsComplete() returns true for the tickets
+// that it covers, and Wait() returns the data where it lies in the ring,
+// without copying it. The data stays there until the ticket is released,
+// and ring space is reclaimed in the order that it was reserved, so a ticket
+// that is never released eventually sends every later readback through a
+// buffer of its own from the application's host-visible arena.
+// This is not thread-safe.
+class ReadbackManager {
+ public:
+  static const VkDeviceSize kDefaultRingSize = 4 * 1024 * 1024;
+
+  // Identifies a readback. 0 is never a valid ticket.
+  typedef uint64_t Ticket;
+
+  // The data of a completed readback, in mapped memory.
+  struct Span {
+    const uint8_t* begin() const { return data; }
+    const uint8_t* end() const { return data + size; }
+
+    const uint8_t* data;
+    size_t size;
+  };
+
+  // ring_buffer must be host-visible, persistently mapped, and created with
+  // VK_BUFFER_USAGE_TRANSFER_DST_BIT.
+  ReadbackManager(containers::Allocator* allocator,
+                  VulkanApplication* application, VkQueue* queue,
+                  containers::unique_ptr<VulkanApplication::Buffer>
+                      ring_buffer);
+  // Waits for every flushed copy to complete. Command buffers passed to
+  // Record() since the last Flush() must have completed already.
+  ~ReadbackManager();
+
+  ReadbackManager(const ReadbackManager&) = delete;
+  ReadbackManager& operator=(const ReadbackManager&) = delete;
+
+  // Queues a copy of size bytes at offset in buffer, which must have been
+  // created with VK_BUFFER_USAGE_TRANSFER_SRC_BIT. The copy waits for
+  // src_access in src_stages.
+  Ticket ReadBuffer(::VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size,
+                    VkAccessFlags src_access, VkPipelineStageFlags src_stages);
+  // Queues a copy of the given region of the layers of a mip level of image,
+  // whose format is format. The image is moved from layout to
+  // VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL for the copy, after waiting for
+  // src_access in src_stages, and then back to layout, before anything in
+  // src_stages uses it again.
+  Ticket ReadImage(::VkImage image, VkFormat format, VkImageLayout layout,
+                   const VkImageSubresourceLayers& subresource,
+                   const VkOffset3D& offset, const VkExtent3D& extent,
+                   VkAccessFlags src_access, VkPipelineStageFlags src_stages);
+
+  // Records every queued copy into command_buffer, so that it is ordered
+  // with the commands around it. command_buffer must be submitted to the
+  // manager's queue before the next Flush(), whose fence covers it.
+  void Record(VkCommandBuffer* command_buffer);
+  // Records every queued copy into a command buffer of the manager's own,
+  // and submits it along with a fence, through batcher or, if batcher is
+  // nullptr, straight to the queue. batcher must submit to the manager's
+  // queue. Nothing is submitted if nothing was queued or recorded since the
+  // last Flush().
+  VkResult Flush(SubmissionBatcher* batcher = nullptr);
+
+  // Returns whether the copy of ticket has completed, without blocking.
+  bool IsComplete(Ticket ticket);
+  // Blocks until the copy of ticket has completed, which it must have been
+  // flushed for, and returns its data. The data is valid until ticket is
+  // released.
+  Span Wait(Ticket ticket);
+  // Waits for ticket, and copies its data to dst, which must have room for
+  // all of it.
+  void CopyTo(Ticket ticket, void* dst);
+  // Gives the ring space of ticket back. Its data must no longer be used.
+  void Release(Ticket ticket);
+  // Blocks until every flushed copy has completed.
+  void WaitIdle();
+
+  bool has_pending_readbacks() const { return !reads_.empty(); }
+  VkDeviceSize ring_size() const { return ring_->size(); }
+
+  // Logs how much was read back, how often the host had to wait for it, and
+  // how often the ring had no room.
+  void LogStatistics(logging::Logger* log) const;
+
+ private:
+  struct PendingRead {
+    // The ring, or the buffer of a readback that did not fit in it.
+    ::VkBuffer destination;
+    // Exactly one of buffer and image is set.
+    ::VkBuffer buffer;
+    VkBufferCopy buffer_region;
+    ::VkImage image;
+    VkBufferImageCopy image_region;
+    VkImageLayout layout;
+    VkAccessFlags src_access;
+    VkPipelineStageFlags src_stages;
+  };
+
+  // Where the data of a ticket is.
+  struct Readback {
+    // The position of the ring that is free once this, and every older
+    // readback, has been released.
+    uint64_t ring_end;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    // Only set if the readback did not fit in the ring.
+    containers::unique_ptr<VulkanApplication::Buffer> own_buffer;
+    bool released;
+  };
+
+  // The work of a Flush(), and of every Record() since the previous one.
+  struct Batch {
+    ::VkFence fence;
+    // The newest ticket that the batch copies.
+    Ticket last_ticket;
+    // Only set if there were queued copies left for Flush() to record.
+    containers::unique_ptr<VkCommandBuffer> command_buffer;
+  };
+
+  // Reserves size bytes of the ring, or a buffer of its own, for the next
+  // ticket, and returns the buffer and *offset that the data is copied to.
+  ::VkBuffer Reserve(VkDeviceSize size, VkDeviceSize alignment,
+                     VkDeviceSize* offset);
+  // Marks the tickets of the oldest batch as complete. If wait is false, and
+  // its fence has not signalled yet, returns false instead.
+  bool CompleteOldest(bool wait);
+  // Frees the ring space of the oldest tickets that have been released and
+  // have completed.
+  void ReclaimReleased();
+  Readback& GetReadback(Ticket ticket);
+
+  containers::Allocator* allocator_;
+  VulkanApplication* application_;
+  VkDevice* device_;
+  VkQueue* queue_;
+  containers::unique_ptr<VulkanApplication::Buffer> ring_;
+  // Positions in the ring count every byte that was ever reserved in it, so
+  // that head_ - tail_ is the number of bytes in use, and the offset of a
+  // position is the position modulo the size of the ring.
+  uint64_t head_;
+  uint64_t tail_;
+  // The readbacks that have not been reclaimed yet, oldest first. The
+  // ticket of the first one is first_ticket_.
+  containers::deque<Readback> readbacks_;
+  Ticket first_ticket_;
+  // Every ticket up to these has been flushed, and has completed.
+  Ticket flushed_ticket_;
+  Ticket completed_ticket_;
+  containers::vector<PendingRead> reads_;
+  // Whether Record() was called since the last Flush().
+  bool recorded_;
+  containers::deque<Batch> batches_;
+  VkCommandPool command_pool_;
+  // The command buffers of completed batches.
+  containers::vector<containers::unique_ptr<VkCommandBuffer>>
+      free_command_buffers_;
+  // Used by Flush() when there is no batcher.
+  SubmissionList submissions_;
+  // Kept between calls to Record() so that they do not have to be
+  // reallocated.
+  containers::vector<VkBufferMemoryBarrier> buffer_barriers_;
+  containers::vector<VkImageMemoryBarrier> image_barriers_;
+
+  // Statistics.
+  uint64_t bytes_read_;
+  uint64_t num_reads_;
+  uint64_t num_flushes_;
+  uint64_t fence_waits_;
+  uint64_t oversized_reads_;
+  // Time spent waiting for copies in Wait().
+  uint64_t wait_nanoseconds_;
+};
+
+}  // namespace vulkan
+
+#endif  // VULKAN_HELPERS_READBACK_MANAGER_H_
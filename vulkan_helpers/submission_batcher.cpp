@@ -0,0 +1,152 @@
+/* Copyright 2017 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "vulkan_helpers/submission_batcher.h"
+
+#include "vulkan_helpers/submission_thread.h"
+
+namespace vulkan {
+
+SubmissionList::SubmissionList(containers::Allocator* allocator)
+    : batches_(allocator),
+      wait_semaphores_(allocator),
+      wait_stages_(allocator),
+      command_buffers_(allocator),
+      signal_semaphores_(allocator),
+      submit_infos_(allocator) {}
+
+void SubmissionList::Add(const VkSubmitInfo& submit_info) {
+  const bool merge = submit_info.waitSemaphoreCount == 0 &&
+                     !batches_.empty() && batches_.back().num_signals == 0;
+  if (!merge) {
+    batches_.push_back(Batch{wait_semaphores_.size(), 0,
+                             command_buffers_.size(), 0,
+                             signal_semaphores_.size(), 0});
+  }
+  Batch& batch = batches_.back();
+
+  wait_semaphores_.insert(
+      wait_semaphores_.end(), submit_info.pWaitSemaphores,
+      submit_info.pWaitSemaphores + submit_info.waitSemaphoreCount);
+  wait_stages_.insert(
+      wait_stages_.end(), submit_info.pWaitDstStageMask,
+      submit_info.pWaitDstStageMask + submit_info.waitSemaphoreCount);
+  batch.num_waits += submit_info.waitSemaphoreCount;
+
+  command_buffers_.insert(
+      command_buffers_.end(), submit_info.pCommandBuffers,
+      submit_info.pCommandBuffers + submit_info.commandBufferCount);
+  batch.num_command_buffers += submit_info.commandBufferCount;
+
+  signal_semaphores_.insert(
+      signal_semaphores_.end(), submit_info.pSignalSemaphores,
+      submit_info.pSignalSemaphores + submit_info.signalSemaphoreCount);
+  batch.num_signals += submit_info.signalSemaphoreCount;
+}
+
+VkResult SubmissionList::Submit(VkQueue* queue, ::VkFence fence) {
+  // The pointers are only filled in here, since the vectors may have moved
+  // while batches were being added.
+  submit_infos_.clear();
+  for (const Batch& batch : batches_) {
+    submit_infos_.push_back(VkSubmitInfo{
+        VK_STRUCTURE_TYPE_SUBMIT_INFO,                   // sType
+        nullptr,                                         // pNext
+        batch.num_waits,                                 // waitSemaphoreCount
+        wait_semaphores_.data() + batch.first_wait,      // pWaitSemaphores
+        wait_stages_.data() + batch.first_wait,          // pWaitDstStageMask
+        batch.num_command_buffers,                       // commandBufferCount
+        command_buffers_.data() +
+            batch.first_command_buffer,                  // pCommandBuffers
+        batch.num_signals,                               // signalSemaphoreCount
+        signal_semaphores_.data() + batch.first_signal,  // pSignalSemaphores
+    });
+  }
+  VkResult result = (*queue)->vkQueueSubmit(
+      *queue, static_cast<uint32_t>(submit_infos_.size()),
+      submit_infos_.empty() ? nullptr : submit_infos_.data(), fence);
+
+  batches_.clear();
+  wait_semaphores_.clear();
+  wait_stages_.clear();
+  command_buffers_.clear();
+  signal_semaphores_.clear();
+  return result;
+}
+
+void SubmissionList::swap(SubmissionList* other) {
+  batches_.swap(other->batches_);
+  wait_semaphores_.swap(other->wait_semaphores_);
+  wait_stages_.swap(other->wait_stages_);
+  command_buffers_.swap(other->command_buffers_);
+  signal_semaphores_.swap(other->signal_semaphores_);
+  submit_infos_.swap(other->submit_infos_);
+}
+
+SubmissionBatcher::SubmissionBatcher(containers::Allocator* allocator,
+                                     VkQueue* queue)
+    : queue_(queue),
+      thread_(nullptr),
+      queued_(allocator),
+      batches_queued_(0),
+      submit_infos_submitted_(0),
+      flushes_(0) {}
+
+void SubmissionBatcher::Submit(const VkSubmitInfo& submit_info) {
+  batches_queued_ += 1;
+  queued_.Add(submit_info);
+}
+
+void SubmissionBatcher::Submit(::VkCommandBuffer command_buffer) {
+  VkSubmitInfo submit_info{
+      VK_STRUCTURE_TYPE_SUBMIT_INFO,  // sType
+      nullptr,                        // pNext
+      0,                              // waitSemaphoreCount
+      nullptr,                        // pWaitSemaphores
+      nullptr,                        // pWaitDstStageMask,
+      1,                              // commandBufferCount
+      &command_buffer,                // pCommandBuffers
+      0,                              // signalSemaphoreCount
+      nullptr                         // pSignalSemaphores
+  };
+  Submit(submit_info);
+}
+
+VkResult SubmissionBatcher::Flush(::VkFence fence) {
+  if (queued_.empty() && fence == VK_NULL_HANDLE) {
+    return VK_SUCCESS;
+  }
+  flushes_ += 1;
+  submit_infos_submitted_ += queued_.size();
+  if (thread_) {
+    thread_->Submit(queue_, &queued_, fence);
+    return VK_SUCCESS;
+  }
+  return queued_.Submit(queue_, fence);
+}
+
+void SubmissionBatcher::set_submission_thread(SubmissionThread* thread) {
+  LOG_ASSERT(==, queue_->GetLogger(), true, queued_.empty());
+  thread_ = thread;
+}
+
+void SubmissionBatcher::LogStatistics(logging::Logger* log,
+                                      const char* name) const {
+  log->LogInfo(name, " submissions: ", batches_queued_,
+               " batches queued, submitted as ", submit_infos_submitted_,
+               " VkSubmitInfos in ", flushes_, " vkQueueSubmit calls");
+}
+
+}  // namespace vulkan
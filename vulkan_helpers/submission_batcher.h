@@ -0,0 +1,127 @@
+/* Copyright 2017 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_HELPERS_SUBMISSION_BATCHER_H_
+#define VULKAN_HELPERS_SUBMISSION_BATCHER_H_
+
+#include "support/containers/allocator.h"
+#include "support/containers/vector.h"
+#include "support/log/log.h"
+#include "vulkan_helpers/vulkan_header_wrapper.h"
+#include "vulkan_wrapper/queue_wrapper.h"
+
+namespace vulkan {
+class SubmissionThread;
+
+// SubmissionList holds the batches for a single vkQueueSubmit, with the
+// arrays that they point to.
+// A batch that does not wait on any semaphores is merged into the previous
+// one if that does not signal any semaphores. This can only make the merged
+// work wait for more, never for less.
+class SubmissionList {
+ public:
+  explicit SubmissionList(containers::Allocator* allocator);
+
+  // Adds the batch described by submit_info. The arrays that it points to
+  // are copied, so they do not have to outlive this call. Its pNext chain
+  // is ignored.
+  void Add(const VkSubmitInfo& submit_info);
+
+  // Submits every batch to queue with a single vkQueueSubmit, and clears
+  // the list. If fence is not VK_NULL_HANDLE, it is signalled once all of
+  // them have completed, even if the list was empty.
+  VkResult Submit(VkQueue* queue, ::VkFence fence);
+
+  // The number of VkSubmitInfos that Submit() would submit.
+  size_t size() const { return batches_.size(); }
+  bool empty() const { return batches_.empty(); }
+  // Exchanges the contents, and the memory that they use, of the two lists.
+  void swap(SubmissionList* other);
+
+ private:
+  struct Batch {
+    size_t first_wait;
+    uint32_t num_waits;
+    size_t first_command_buffer;
+    uint32_t num_command_buffers;
+    size_t first_signal;
+    uint32_t num_signals;
+  };
+
+  containers::vector<Batch> batches_;
+  containers::vector<::VkSemaphore> wait_semaphores_;
+  containers::vector<VkPipelineStageFlags> wait_stages_;
+  containers::vector<::VkCommandBuffer> command_buffers_;
+  containers::vector<::VkSemaphore> signal_semaphores_;
+  // Kept between submits so that it does not have to be reallocated.
+  containers::vector<VkSubmitInfo> submit_infos_;
+};
+
+// SubmissionBatcher collects the work that would otherwise be submitted to a
+// queue with many vkQueueSubmit calls, and submits all of it with a single
+// vkQueueSubmit in Flush().
+// Batches execute in the order they were queued, exactly as if each had been
+// submitted on its own, though they may be merged as by SubmissionList.
+// Anything that has to observe queued work, such as a wait on the queue or a
+// present of an image that the work signals, must come after a Flush().
+// If a SubmissionThread is set, Flush() hands the work to it instead, and
+// the vkQueueSubmit happens some time later on that thread. Presents and
+// waits on the queue must then also go through that thread.
+// This is not thread-safe, every batch must be queued from one thread.
+class SubmissionBatcher {
+ public:
+  SubmissionBatcher(containers::Allocator* allocator, VkQueue* queue);
+
+  SubmissionBatcher(const SubmissionBatcher&) = delete;
+  SubmissionBatcher& operator=(const SubmissionBatcher&) = delete;
+
+  // Queues the batch described by submit_info. The arrays that it points to
+  // are copied, so they do not have to outlive this call. Its pNext chain
+  // is ignored.
+  void Submit(const VkSubmitInfo& submit_info);
+  // Queues a single command buffer, with no semaphores.
+  void Submit(::VkCommandBuffer command_buffer);
+
+  // Submits every queued batch with a single vkQueueSubmit. If fence is not
+  // VK_NULL_HANDLE, it is signalled once all of them have completed, even if
+  // nothing was queued. With a SubmissionThread, this always returns
+  // VK_SUCCESS, and the thread checks the result of the submit.
+  VkResult Flush(::VkFence fence = VK_NULL_HANDLE);
+
+  // Sets the thread that Flush() hands work to, or submits directly if
+  // thread is nullptr. Nothing may be queued when this is called.
+  void set_submission_thread(SubmissionThread* thread);
+  SubmissionThread* submission_thread() { return thread_; }
+
+  bool empty() const { return queued_.empty(); }
+  VkQueue* queue() { return queue_; }
+
+  // Logs how many batches were queued, and how many vkQueueSubmit calls
+  // and VkSubmitInfos they were submitted with.
+  void LogStatistics(logging::Logger* log, const char* name) const;
+
+ private:
+  VkQueue* queue_;
+  SubmissionThread* thread_;
+  SubmissionList queued_;
+  // Statistics.
+  uint64_t batches_queued_;
+  uint64_t submit_infos_submitted_;
+  uint64_t flushes_;
+};
+
+}  // namespace vulkan
+
+#endif  // VULKAN_HELPERS_SUBMISSION_BATCHER_H_
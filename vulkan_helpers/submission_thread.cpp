@@ -0,0 +1,159 @@
+/* Copyright 2017 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "vulkan_helpers/submission_thread.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace vulkan {
+
+SubmissionThread::SubmissionThread(containers::Allocator* allocator,
+                                   logging::Logger* log, uint32_t capacity)
+    : log_(log),
+      ring_(allocator),
+      queued_(0),
+      completed_(0),
+      exiting_(false),
+      ring_full_waits_(0),
+      submits_(0),
+      presents_(0),
+      call_nanoseconds_(0) {
+  capacity = std::max(capacity, 1u);
+  ring_.reserve(capacity);
+  for (uint32_t i = 0; i < capacity; ++i) {
+    ring_.emplace_back(allocator);
+  }
+  thread_ = std::thread(&SubmissionThread::ThreadMain, this);
+}
+
+SubmissionThread::~SubmissionThread() {
+  exiting_.store(true, std::memory_order_release);
+  Notify(&work_queued_);
+  thread_.join();
+}
+
+uint64_t SubmissionThread::Submit(VkQueue* queue, SubmissionList* submissions,
+                                  ::VkFence fence) {
+  Work* work = Reserve();
+  work->queue = queue;
+  work->present = false;
+  // The slot's list was emptied by the thread, so this hands its memory
+  // back to the caller.
+  work->submissions.swap(submissions);
+  work->fence = fence;
+  return Publish();
+}
+
+uint64_t SubmissionThread::Present(VkQueue* queue,
+                                   const VkPresentInfoKHR& present_info) {
+  LOG_ASSERT(==, log_, 1u, present_info.swapchainCount);
+  Work* work = Reserve();
+  work->queue = queue;
+  work->present = true;
+  work->wait_semaphores.assign(
+      present_info.pWaitSemaphores,
+      present_info.pWaitSemaphores + present_info.waitSemaphoreCount);
+  work->swapchain = present_info.pSwapchains[0];
+  work->image_index = present_info.pImageIndices[0];
+  return Publish();
+}
+
+void SubmissionThread::Wait(uint64_t ticket) {
+  if (IsComplete(ticket)) {
+    return;
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  work_completed_.wait(lock, [this, ticket]() { return IsComplete(ticket); });
+}
+
+void SubmissionThread::Notify(std::condition_variable* condition) {
+  { std::lock_guard<std::mutex> lock(mutex_); }
+  condition->notify_all();
+}
+
+SubmissionThread::Work* SubmissionThread::Reserve() {
+  const uint64_t next = queued_.load(std::memory_order_relaxed);
+  if (next - completed_.load(std::memory_order_acquire) == ring_.size()) {
+    ring_full_waits_ += 1;
+    Wait(next + 1 - ring_.size());
+  }
+  return &ring_[next % ring_.size()];
+}
+
+uint64_t SubmissionThread::Publish() {
+  const uint64_t ticket = queued_.load(std::memory_order_relaxed) + 1;
+  queued_.store(ticket, std::memory_order_release);
+  Notify(&work_queued_);
+  return ticket;
+}
+
+void SubmissionThread::ThreadMain() {
+  uint64_t next = 0;
+  while (true) {
+    if (queued_.load(std::memory_order_acquire) == next) {
+      std::unique_lock<std::mutex> lock(mutex_);
+      work_queued_.wait(lock, [this, next]() {
+        return queued_.load(std::memory_order_acquire) != next ||
+               exiting_.load(std::memory_order_acquire);
+      });
+      // Anything queued before exiting_ was set is still made.
+      if (queued_.load(std::memory_order_acquire) == next) {
+        return;
+      }
+      continue;
+    }
+
+    Work& work = ring_[next % ring_.size()];
+    auto start = std::chrono::high_resolution_clock::now();
+    if (work.present) {
+      VkPresentInfoKHR present_info{
+          VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,  // sType
+          nullptr,                             // pNext
+          static_cast<uint32_t>(
+              work.wait_semaphores.size()),  // waitSemaphoreCount
+          work.wait_semaphores.data(),       // pWaitSemaphores
+          1,                                 // swapchainCount
+          &work.swapchain,                   // pSwapchains
+          &work.image_index,                 // pImageIndices
+          nullptr,                           // pResults
+      };
+      LOG_ASSERT(==, log_, VK_SUCCESS,
+                 (*work.queue)->vkQueuePresentKHR(*work.queue, &present_info));
+      presents_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      LOG_ASSERT(==, log_, VK_SUCCESS,
+                 work.submissions.Submit(work.queue, work.fence));
+      submits_.fetch_add(1, std::memory_order_relaxed);
+    }
+    call_nanoseconds_.fetch_add(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::high_resolution_clock::now() - start)
+            .count(),
+        std::memory_order_relaxed);
+    completed_.store(++next, std::memory_order_release);
+    Notify(&work_completed_);
+  }
+}
+
+void SubmissionThread::LogStatistics(logging::Logger* log) const {
+  const uint64_t calls = submits_.load() + presents_.load();
+  log->LogInfo("Submission thread: ", submits_.load(), " vkQueueSubmit and ",
+               presents_.load(), " vkQueuePresentKHR calls, averaging ",
+               calls == 0 ? 0.0 : call_nanoseconds_.load() / 1000.0 / calls,
+               "us each, ring full ", ring_full_waits_, " times");
+}
+
+}  // namespace vulkan
@@ -0,0 +1,137 @@
+/* Copyright 2017 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_HELPERS_SUBMISSION_THREAD_H_
+#define VULKAN_HELPERS_SUBMISSION_THREAD_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "support/containers/allocator.h"
+#include "support/containers/vector.h"
+#include "support/log/log.h"
+#include "vulkan_helpers/submission_batcher.h"
+#include "vulkan_helpers/vulkan_header_wrapper.h"
+#include "vulkan_wrapper/queue_wrapper.h"
+
+namespace vulkan {
+
+// SubmissionThread makes vkQueueSubmit and vkQueuePresentKHR calls on a
+// thread of its own, so that the time they spend in the driver does not
+// hold up the thread that records the work.
+// Work is passed to the thread through a fixed-size single-producer,
+// single-consumer ring, without taking any locks, and is submitted in the
+// order it was queued. Each piece of work gets a ticket, which can be
+// waited on to know that the call has been made.
+// Once a queue is used through the thread, nothing else may use it, or the
+// swapchains presented through it, until WaitIdle() has returned. In
+// particular, vkAcquireNextImageKHR must not be called on a swapchain while
+// a present to it is still queued, since both calls need the swapchain to
+// be externally synchronized; Wait() for the ticket of the present first.
+// The thread sleeps on a condition variable while it has no work, and so
+// does Wait(), so that neither spins. Only the ring itself is lock-free.
+// Every piece of work must be queued from the same thread.
+class SubmissionThread {
+ public:
+  // capacity is the number of pieces of work that can be waiting at once.
+  // Queuing more than that blocks until the thread catches up.
+  SubmissionThread(containers::Allocator* allocator, logging::Logger* log,
+                   uint32_t capacity = 8);
+  // Makes every call that is still queued, and joins the thread.
+  ~SubmissionThread();
+
+  SubmissionThread(const SubmissionThread&) = delete;
+  SubmissionThread& operator=(const SubmissionThread&) = delete;
+
+  // Takes every batch in submissions, leaving it empty, and queues them to
+  // be submitted to queue with a single vkQueueSubmit that signals fence.
+  uint64_t Submit(VkQueue* queue, SubmissionList* submissions,
+                  ::VkFence fence);
+  // Queues a present. present_info must name a single swapchain, and the
+  // semaphores it waits on are copied. Its pNext chain and pResults are
+  // ignored.
+  uint64_t Present(VkQueue* queue, const VkPresentInfoKHR& present_info);
+
+  // Returns true once the call for ticket has been made, without blocking.
+  bool IsComplete(uint64_t ticket) const {
+    return completed_.load(std::memory_order_acquire) >= ticket;
+  }
+  // Blocks until the call for ticket has been made.
+  void Wait(uint64_t ticket);
+  // Blocks until every call queued so far has been made.
+  void WaitIdle() { Wait(queued_.load(std::memory_order_relaxed)); }
+
+  // Logs how many calls were made on the thread, how long they took, and
+  // how often the ring was full.
+  void LogStatistics(logging::Logger* log) const;
+
+ private:
+  struct Work {
+    explicit Work(containers::Allocator* allocator)
+        : queue(nullptr),
+          present(false),
+          submissions(allocator),
+          fence(VK_NULL_HANDLE),
+          wait_semaphores(allocator),
+          swapchain(VK_NULL_HANDLE),
+          image_index(0) {}
+    VkQueue* queue;
+    // Presents have no submissions and no fence.
+    bool present;
+    SubmissionList submissions;
+    ::VkFence fence;
+    containers::vector<::VkSemaphore> wait_semaphores;
+    ::VkSwapchainKHR swapchain;
+    uint32_t image_index;
+  };
+
+  // Returns the next free slot in the ring, waiting for one if it is full.
+  Work* Reserve();
+  // Hands the slot returned by Reserve() to the thread, and returns its
+  // ticket.
+  uint64_t Publish();
+  void ThreadMain();
+  // Wakes up everything waiting on condition. The lock is taken so that
+  // a waiter cannot miss the change it was waiting for between checking it
+  // and going to sleep.
+  void Notify(std::condition_variable* condition);
+
+  logging::Logger* log_;
+  containers::vector<Work> ring_;
+  // The number of pieces of work queued, and made, so far. Only queued_ is
+  // written by the producer, and only completed_ by the thread.
+  std::atomic<uint64_t> queued_;
+  std::atomic<uint64_t> completed_;
+  std::atomic<bool> exiting_;
+  // Only used to sleep on the condition variables. The thread waits on
+  // work_queued_ for queued_ to change, or for exiting_ to be set, and
+  // Wait() waits on work_completed_ for completed_ to change.
+  std::mutex mutex_;
+  std::condition_variable work_queued_;
+  std::condition_variable work_completed_;
+  std::thread thread_;
+
+  // Statistics.
+  uint64_t ring_full_waits_;
+  std::atomic<uint64_t> submits_;
+  std::atomic<uint64_t> presents_;
+  std::atomic<uint64_t> call_nanoseconds_;
+};
+
+}  // namespace vulkan
+
+#endif  // VULKAN_HELPERS_SUBMISSION_THREAD_H_
@@ -0,0 +1,95 @@
+/* Copyright 2017 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "vulkan_helpers/sync_object_pool.h"
+
+#include "vulkan_helpers/helper_functions.h"
+
+namespace vulkan {
+
+SyncObjectPool::SyncObjectPool(containers::Allocator* allocator,
+                               VkDevice* device)
+    : device_(device),
+      semaphores_(allocator),
+      fences_(allocator),
+      free_semaphores_(allocator),
+      free_fences_(allocator),
+      released_fences_(allocator),
+      semaphore_acquires_(0),
+      fence_acquires_(0),
+      fence_resets_(0) {}
+
+::VkSemaphore SyncObjectPool::AcquireSemaphore() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  semaphore_acquires_ += 1;
+  if (free_semaphores_.empty()) {
+    semaphores_.push_back(CreateSemaphore(device_));
+    return semaphores_.back().get_raw_object();
+  }
+  ::VkSemaphore semaphore = free_semaphores_.back();
+  free_semaphores_.pop_back();
+  return semaphore;
+}
+
+void SyncObjectPool::ReleaseSemaphore(::VkSemaphore semaphore) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  free_semaphores_.push_back(semaphore);
+}
+
+::VkFence SyncObjectPool::AcquireFence() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  fence_acquires_ += 1;
+  if (free_fences_.empty() && !released_fences_.empty()) {
+    LOG_ASSERT(==, device_->GetLogger(), VK_SUCCESS,
+               (*device_)->vkResetFences(
+                   *device_, static_cast<uint32_t>(released_fences_.size()),
+                   released_fences_.data()));
+    fence_resets_ += 1;
+    free_fences_.swap(released_fences_);
+  }
+  if (free_fences_.empty()) {
+    fences_.push_back(CreateFence(device_));
+    return fences_.back().get_raw_object();
+  }
+  ::VkFence fence = free_fences_.back();
+  free_fences_.pop_back();
+  return fence;
+}
+
+void SyncObjectPool::ReleaseFence(::VkFence fence) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  released_fences_.push_back(fence);
+}
+
+size_t SyncObjectPool::num_semaphores_created() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return semaphores_.size();
+}
+
+size_t SyncObjectPool::num_fences_created() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return fences_.size();
+}
+
+void SyncObjectPool::LogStatistics(logging::Logger* log) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  log->LogInfo("Sync object pool: ", semaphores_.size(),
+               " semaphores created for ", semaphore_acquires_,
+               " acquires, ", fences_.size(), " fences created for ",
+               fence_acquires_, " acquires, ", fence_resets_,
+               " batched fence resets");
+}
+
+}  // namespace vulkan
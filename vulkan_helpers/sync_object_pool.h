@@ -0,0 +1,84 @@
+/* Copyright 2017 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_HELPERS_SYNC_OBJECT_POOL_H_
+#define VULKAN_HELPERS_SYNC_OBJECT_POOL_H_
+
+#include <mutex>
+
+#include "support/containers/allocator.h"
+#include "support/containers/vector.h"
+#include "support/log/log.h"
+#include "vulkan_helpers/vulkan_header_wrapper.h"
+#include "vulkan_wrapper/device_wrapper.h"
+#include "vulkan_wrapper/sub_objects.h"
+
+namespace vulkan {
+
+// SyncObjectPool recycles binary semaphores and fences, so that code which
+// needs them every frame does not create and destroy them every frame.
+// Every object is owned by the pool, and is destroyed with it.
+// Released fences may still be signalled. They are all reset with a single
+// vkResetFences call the next time the pool runs out of unsignalled fences.
+// All of the member functions are thread-safe.
+class SyncObjectPool {
+ public:
+  SyncObjectPool(containers::Allocator* allocator, VkDevice* device);
+
+  SyncObjectPool(const SyncObjectPool&) = delete;
+  SyncObjectPool& operator=(const SyncObjectPool&) = delete;
+
+  // Returns an unsignalled semaphore.
+  ::VkSemaphore AcquireSemaphore();
+  // Returns a semaphore to the pool. It must be unsignalled, and every
+  // submission that waits on or signals it must have completed.
+  void ReleaseSemaphore(::VkSemaphore semaphore);
+
+  // Returns an unsignalled fence.
+  ::VkFence AcquireFence();
+  // Returns a fence to the pool. It may be signalled, but any submission
+  // that signals it must have completed.
+  void ReleaseFence(::VkFence fence);
+
+  // The number of objects that have been created. Once an application has
+  // reached a steady state, these should stop growing.
+  size_t num_semaphores_created();
+  size_t num_fences_created();
+
+  // Logs how many objects were created, and how many times they were
+  // acquired.
+  void LogStatistics(logging::Logger* log);
+
+ private:
+  VkDevice* device_;
+
+  std::mutex mutex_;
+  // Every object created by the pool.
+  containers::vector<VkSemaphore> semaphores_;
+  containers::vector<VkFence> fences_;
+  // The objects that are ready to be acquired.
+  containers::vector<::VkSemaphore> free_semaphores_;
+  containers::vector<::VkFence> free_fences_;
+  // Fences that have been released, but not reset yet.
+  containers::vector<::VkFence> released_fences_;
+  // Statistics.
+  uint64_t semaphore_acquires_;
+  uint64_t fence_acquires_;
+  uint64_t fence_resets_;
+};
+
+}  // namespace vulkan
+
+#endif  // VULKAN_HELPERS_SYNC_OBJECT_POOL_H_
@@ -0,0 +1,607 @@
+/* Copyright 2017 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "vulkan_helpers/upload_manager.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "vulkan_helpers/helper_functions.h"
+#include "vulkan_helpers/submission_thread.h"
+
+namespace vulkan {
+
+namespace {
+// Every upload is at least this aligned in the ring, which keeps the
+// copies into it fast.
+const VkDeviceSize kMinimumAlignment = 16;
+}  // namespace
+
+const VkDeviceSize UploadManager::kDefaultStagingSize;
+
+UploadManager::UploadManager(
+    containers::Allocator* allocator, VulkanApplication* application,
+    VkQueue* queue,
+    containers::unique_ptr<VulkanApplication::Buffer> staging_buffer,
+    VkQueue* transfer_queue)
+    : allocator_(allocator),
+      application_(application),
+      device_(&application->device()),
+      queue_(queue),
+      transfer_queue_(
+          transfer_queue && transfer_queue->index() != queue->index()
+              ? transfer_queue
+              : nullptr),
+      staging_(std::move(staging_buffer)),
+      head_(0),
+      tail_(0),
+      copies_(allocator),
+      image_regions_(allocator),
+      own_buffers_(allocator),
+      recorded_(false),
+      batches_(allocator),
+      command_pool_(
+          CreateDefaultCommandPool(allocator, *device_, queue->index())),
+      free_command_buffers_(allocator),
+      free_transfer_command_buffers_(allocator),
+      submissions_(allocator),
+      transfer_submissions_(allocator),
+      buffer_barriers_(allocator),
+      image_barriers_(allocator),
+      bytes_uploaded_(0),
+      num_copies_(0),
+      num_flushes_(0),
+      transfer_flushes_(0),
+      fence_waits_(0),
+      oversized_uploads_(0),
+      staging_nanoseconds_(0) {
+  LOG_ASSERT(!=, device_->GetLogger(), static_cast<char*>(nullptr),
+             staging_->base_address());
+  if (transfer_queue_) {
+    transfer_command_pool_ = containers::make_unique<VkCommandPool>(
+        allocator_,
+        CreateDefaultCommandPool(allocator_, *device_,
+                                 transfer_queue_->index()));
+  }
+}
+
+UploadManager::~UploadManager() {
+  WaitIdle();
+  // Whatever is left starts with a Record() since the last Flush(), whose
+  // command buffer has completed already, so only the fences of the
+  // RecordWithFence() batches after it have to be waited for.
+  for (Batch& batch : batches_) {
+    if (batch.fence != VK_NULL_HANDLE) {
+      LOG_ASSERT(==, device_->GetLogger(), VK_SUCCESS,
+                 (*device_)->vkWaitForFences(*device_, 1, &batch.fence,
+                                             VK_FALSE, 0xFFFFFFFFFFFFFFFF));
+      application_->sync_object_pool()->ReleaseFence(batch.fence);
+    }
+  }
+}
+
+void UploadManager::UploadBuffer(::VkBuffer buffer, VkDeviceSize offset,
+                                 const void* data, VkDeviceSize size,
+                                 VkAccessFlags dst_access,
+                                 VkPipelineStageFlags dst_stages) {
+  VkDeviceSize source_offset = 0;
+  ::VkBuffer source = Stage(data, size, kMinimumAlignment, &source_offset);
+  PendingCopy copy = {};
+  copy.source = source;
+  copy.buffer = buffer;
+  copy.buffer_region = {source_offset, offset, size};
+  copy.image = VK_NULL_HANDLE;
+  copy.dst_access = dst_access;
+  copy.dst_stages = dst_stages;
+  copies_.push_back(copy);
+}
+
+void UploadManager::UploadImage(
+    ::VkImage image, VkFormat format, const VkImageSubresourceRange& range,
+    VkImageLayout old_layout, VkImageLayout new_layout, const void* data,
+    VkDeviceSize size, std::initializer_list<VkBufferImageCopy> regions,
+    VkAccessFlags dst_access, VkPipelineStageFlags dst_stages) {
+  VkDeviceSize source_offset = 0;
+  ::VkBuffer source = Stage(
+      data, size, GetBufferImageCopyAlignment(format, kMinimumAlignment),
+      &source_offset);
+  PendingCopy copy = {};
+  copy.source = source;
+  copy.buffer = VK_NULL_HANDLE;
+  copy.image = image;
+  copy.first_image_region = image_regions_.size();
+  copy.num_image_regions = static_cast<uint32_t>(regions.size());
+  copy.range = range;
+  copy.old_layout = old_layout;
+  copy.new_layout = new_layout;
+  copy.dst_access = dst_access;
+  copy.dst_stages = dst_stages;
+  for (VkBufferImageCopy region : regions) {
+    region.bufferOffset += source_offset;
+    image_regions_.push_back(region);
+  }
+  copies_.push_back(copy);
+}
+
+::VkBuffer UploadManager::Stage(const void* data, VkDeviceSize size,
+                                VkDeviceSize alignment,
+                                VkDeviceSize* offset) {
+  if (bytes_uploaded_ == 0) {
+    first_upload_ = std::chrono::high_resolution_clock::now();
+  }
+  bytes_uploaded_ += size;
+  num_copies_ += 1;
+
+  auto start = std::chrono::high_resolution_clock::now();
+  ::VkBuffer source = *staging_;
+  if (Allocate(size, alignment, offset)) {
+    memcpy(staging_->base_address() + *offset, data,
+           static_cast<size_t>(size));
+  } else {
+    oversized_uploads_ += 1;
+    VkBufferCreateInfo create_info = {
+        VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,  // sType
+        nullptr,                               // pNext
+        0,                                     // flags
+        size,                                  // size
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,      // usage
+        VK_SHARING_MODE_EXCLUSIVE,             // sharingMode
+        0,                                     // queueFamilyIndexCount
+        nullptr                                // pQueueFamilyIndices
+    };
+    own_buffers_.push_back(
+        application_->CreateAndBindHostBuffer(&create_info));
+    VulkanApplication::Buffer* buffer = own_buffers_.back().get();
+    memcpy(buffer->base_address(), data, static_cast<size_t>(size));
+    buffer->flush();
+    source = *buffer;
+    *offset = 0;
+  }
+  staging_nanoseconds_ +=
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::high_resolution_clock::now() - start)
+          .count();
+  return source;
+}
+
+bool UploadManager::Allocate(VkDeviceSize size, VkDeviceSize alignment,
+                             VkDeviceSize* offset) {
+  const VkDeviceSize capacity = staging_->size();
+  if (size > capacity) {
+    return false;
+  }
+  // Uploads never wrap around the end of the ring, the space up to the end
+  // is skipped instead.
+  VkDeviceSize start = head_ % capacity;
+  uint64_t position = head_;
+  VkDeviceSize aligned = (start + alignment - 1) / alignment * alignment;
+  if (aligned + size > capacity) {
+    position += capacity - start;
+    aligned = 0;
+  } else {
+    position += aligned - start;
+  }
+
+  // Free whatever has completed, and then wait for the rest, oldest first,
+  // until there is room.
+  while (!batches_.empty() && ReclaimOldest(false)) {
+  }
+  while (position + size - tail_ > capacity) {
+    if (batches_.empty() || !ReclaimOldest(true)) {
+      return false;
+    }
+  }
+  head_ = position + size;
+  *offset = aligned;
+  return true;
+}
+
+bool UploadManager::ReclaimOldest(bool wait) {
+  Batch& batch = batches_.front();
+  ::VkFence fence = batch.fence;
+  if (fence == VK_NULL_HANDLE) {
+    // The command buffer of a Record() has only been submitted once the
+    // next Flush() has been made.
+    auto flush = std::find_if(batches_.begin(), batches_.end(),
+                              [](const Batch& b) { return b.flushed; });
+    if (flush == batches_.end()) {
+      return false;
+    }
+    fence = flush->fence;
+  }
+  if ((*device_)->vkGetFenceStatus(*device_, fence) != VK_SUCCESS) {
+    if (!wait) {
+      return false;
+    }
+    fence_waits_ += 1;
+    LOG_ASSERT(==, device_->GetLogger(), VK_SUCCESS,
+               (*device_)->vkWaitForFences(*device_, 1, &fence, VK_FALSE,
+                                           0xFFFFFFFFFFFFFFFF));
+  }
+  tail_ = batch.ring_end;
+  if (batch.fence != VK_NULL_HANDLE) {
+    application_->sync_object_pool()->ReleaseFence(batch.fence);
+  }
+  if (batch.semaphore != VK_NULL_HANDLE) {
+    application_->sync_object_pool()->ReleaseSemaphore(
+        batch.release_semaphore);
+    application_->sync_object_pool()->ReleaseSemaphore(batch.semaphore);
+  }
+  if (batch.command_buffer) {
+    free_command_buffers_.push_back(std::move(batch.command_buffer));
+  }
+  if (batch.release_command_buffer) {
+    free_command_buffers_.push_back(std::move(batch.release_command_buffer));
+  }
+  if (batch.transfer_command_buffer) {
+    free_transfer_command_buffers_.push_back(
+        std::move(batch.transfer_command_buffer));
+  }
+  batches_.pop_front();
+  return true;
+}
+
+void UploadManager::Record(VkCommandBuffer* command_buffer) {
+  if (copies_.empty()) {
+    return;
+  }
+  recorded_ = true;
+  RecordBatch(command_buffer, VK_NULL_HANDLE);
+}
+
+::VkFence UploadManager::RecordWithFence(VkCommandBuffer* command_buffer) {
+  ::VkFence fence = application_->sync_object_pool()->AcquireFence();
+  RecordBatch(command_buffer, fence);
+  return fence;
+}
+
+void UploadManager::RecordBatch(VkCommandBuffer* command_buffer,
+                                ::VkFence fence) {
+  if (!copies_.empty()) {
+    RecordCopies(command_buffer, nullptr, nullptr);
+  }
+  Batch batch(allocator_);
+  batch.ring_end = head_;
+  batch.fence = fence;
+  batch.own_buffers.swap(own_buffers_);
+  batches_.push_back(std::move(batch));
+}
+
+VkPipelineStageFlags UploadManager::RecordCopies(
+    VkCommandBuffer* command_buffer, VkCommandBuffer* release_buffer,
+    VkCommandBuffer* acquire_buffer) {
+  const bool transfer = acquire_buffer != nullptr;
+  const uint32_t src_family =
+      transfer ? transfer_queue_->index() : VK_QUEUE_FAMILY_IGNORED;
+  const uint32_t dst_family =
+      transfer ? queue_->index() : VK_QUEUE_FAMILY_IGNORED;
+
+  // The copies have to wait for earlier commands that use what they
+  // overwrite, which are assumed to be in the stages that later reads are.
+  // On the manager's queue, a barrier in those stages is enough. With a
+  // transfer queue, the manager's queue releases the destinations after
+  // them instead, and the transfer queue acquires them, which buffers need
+  // barriers of their own for.
+  VkPipelineStageFlags dst_stages = 0;
+  buffer_barriers_.clear();
+  image_barriers_.clear();
+  for (const PendingCopy& copy : copies_) {
+    dst_stages |= copy.dst_stages;
+    if (copy.image == VK_NULL_HANDLE) {
+      if (transfer) {
+        buffer_barriers_.push_back({
+            VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,  // sType
+            nullptr,                                  // pNext
+            copy.dst_access,                          // srcAccessMask
+            VK_ACCESS_TRANSFER_WRITE_BIT,             // dstAccessMask
+            dst_family,                               // srcQueueFamilyIndex
+            src_family,                               // dstQueueFamilyIndex
+            copy.buffer,                              // buffer
+            copy.buffer_region.dstOffset,             // offset
+            copy.buffer_region.size,                  // size
+        });
+      }
+      continue;
+    }
+    image_barriers_.push_back({
+        VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,  // sType
+        nullptr,                                 // pNext
+        transfer ? copy.dst_access : 0,          // srcAccessMask
+        VK_ACCESS_TRANSFER_WRITE_BIT,            // dstAccessMask
+        copy.old_layout,                         // oldLayout
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,    // newLayout
+        dst_family,                              // srcQueueFamilyIndex
+        src_family,                              // dstQueueFamilyIndex
+        copy.image,                              // image
+        copy.range,                              // subresourceRange
+    });
+  }
+  // The staging memory is coherent, and was written before the submission,
+  // so the host writes are already visible to the transfers.
+  if (!transfer) {
+    (*command_buffer)
+        ->vkCmdPipelineBarrier(
+            *command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT | dst_stages,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr,
+            static_cast<uint32_t>(image_barriers_.size()),
+            image_barriers_.empty() ? nullptr : image_barriers_.data());
+  } else {
+    // A release ignores dstAccessMask, and an acquire srcAccessMask, so the
+    // same barriers release the destinations on the manager's queue and
+    // acquire them on the transfer queue. The acquire follows a semaphore
+    // wait in the transfer stage, which it has to chain with.
+    (*release_buffer)
+        ->vkCmdPipelineBarrier(
+            *release_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT | dst_stages,
+            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr,
+            static_cast<uint32_t>(buffer_barriers_.size()),
+            buffer_barriers_.empty() ? nullptr : buffer_barriers_.data(),
+            static_cast<uint32_t>(image_barriers_.size()),
+            image_barriers_.empty() ? nullptr : image_barriers_.data());
+    (*command_buffer)
+        ->vkCmdPipelineBarrier(
+            *command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr,
+            static_cast<uint32_t>(buffer_barriers_.size()),
+            buffer_barriers_.empty() ? nullptr : buffer_barriers_.data(),
+            static_cast<uint32_t>(image_barriers_.size()),
+            image_barriers_.empty() ? nullptr : image_barriers_.data());
+  }
+
+  buffer_barriers_.clear();
+  image_barriers_.clear();
+  for (const PendingCopy& copy : copies_) {
+    if (copy.image == VK_NULL_HANDLE) {
+      (*command_buffer)
+          ->vkCmdCopyBuffer(*command_buffer, copy.source, copy.buffer, 1,
+                            &copy.buffer_region);
+      buffer_barriers_.push_back({
+          VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,  // sType
+          nullptr,                                  // pNext
+          VK_ACCESS_TRANSFER_WRITE_BIT,             // srcAccessMask
+          copy.dst_access,                          // dstAccessMask
+          src_family,                               // srcQueueFamilyIndex
+          dst_family,                               // dstQueueFamilyIndex
+          copy.buffer,                              // buffer
+          copy.buffer_region.dstOffset,             // offset
+          copy.buffer_region.size,                  // size
+      });
+      continue;
+    }
+    (*command_buffer)
+        ->vkCmdCopyBufferToImage(*command_buffer, copy.source, copy.image,
+                                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                 copy.num_image_regions,
+                                 &image_regions_[copy.first_image_region]);
+    image_barriers_.push_back({
+        VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,  // sType
+        nullptr,                                 // pNext
+        VK_ACCESS_TRANSFER_WRITE_BIT,            // srcAccessMask
+        copy.dst_access,                         // dstAccessMask
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,    // oldLayout
+        copy.new_layout,                         // newLayout
+        src_family,                              // srcQueueFamilyIndex
+        dst_family,                              // dstQueueFamilyIndex
+        copy.image,                              // image
+        copy.range,                              // subresourceRange
+    });
+  }
+  if (!transfer) {
+    (*command_buffer)
+        ->vkCmdPipelineBarrier(
+            *command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            dst_stages == 0 ? static_cast<VkPipelineStageFlags>(
+                                  VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT)
+                            : dst_stages,
+            0, 0, nullptr, static_cast<uint32_t>(buffer_barriers_.size()),
+            buffer_barriers_.empty() ? nullptr : buffer_barriers_.data(),
+            static_cast<uint32_t>(image_barriers_.size()),
+            image_barriers_.empty() ? nullptr : image_barriers_.data());
+  } else {
+    // Likewise, the same barriers release the destinations on the transfer
+    // queue and acquire them on the manager's queue. The acquire follows a
+    // semaphore wait in dst_stages, which it has to chain with.
+    if (dst_stages == 0) {
+      dst_stages = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    }
+    (*command_buffer)
+        ->vkCmdPipelineBarrier(
+            *command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr,
+            static_cast<uint32_t>(buffer_barriers_.size()),
+            buffer_barriers_.empty() ? nullptr : buffer_barriers_.data(),
+            static_cast<uint32_t>(image_barriers_.size()),
+            image_barriers_.empty() ? nullptr : image_barriers_.data());
+    (*acquire_buffer)
+        ->vkCmdPipelineBarrier(
+            *acquire_buffer, dst_stages, dst_stages, 0, 0, nullptr,
+            static_cast<uint32_t>(buffer_barriers_.size()),
+            buffer_barriers_.empty() ? nullptr : buffer_barriers_.data(),
+            static_cast<uint32_t>(image_barriers_.size()),
+            image_barriers_.empty() ? nullptr : image_barriers_.data());
+  }
+
+  copies_.clear();
+  image_regions_.clear();
+  return dst_stages;
+}
+
+containers::unique_ptr<VkCommandBuffer> UploadManager::BeginCommandBuffer(
+    VkCommandPool* pool,
+    containers::vector<containers::unique_ptr<VkCommandBuffer>>*
+        free_buffers) {
+  containers::unique_ptr<VkCommandBuffer> command_buffer;
+  if (free_buffers->empty()) {
+    command_buffer = containers::make_unique<VkCommandBuffer>(
+        allocator_, CreateDefaultCommandBuffer(pool, device_));
+  } else {
+    command_buffer = std::move(free_buffers->back());
+    free_buffers->pop_back();
+  }
+  VkCommandBufferBeginInfo begin_info = {
+      VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,  // sType
+      nullptr,                                      // pNext
+      VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,  // flags
+      nullptr                                       // pInheritanceInfo
+  };
+  (*command_buffer)->vkBeginCommandBuffer(*command_buffer, &begin_info);
+  return command_buffer;
+}
+
+VkResult UploadManager::Flush(SubmissionBatcher* batcher) {
+  if (copies_.empty() && !recorded_) {
+    return VK_SUCCESS;
+  }
+
+  Batch batch(allocator_);
+  VkPipelineStageFlags wait_stages = 0;
+  if (!copies_.empty()) {
+    batch.command_buffer =
+        BeginCommandBuffer(&command_pool_, &free_command_buffers_);
+    VkCommandBuffer& command_buffer = *batch.command_buffer;
+    if (transfer_queue_) {
+      batch.release_command_buffer =
+          BeginCommandBuffer(&command_pool_, &free_command_buffers_);
+      VkCommandBuffer& release_buffer = *batch.release_command_buffer;
+      batch.transfer_command_buffer = BeginCommandBuffer(
+          transfer_command_pool_.get(), &free_transfer_command_buffers_);
+      VkCommandBuffer& transfer_buffer = *batch.transfer_command_buffer;
+      wait_stages =
+          RecordCopies(&transfer_buffer, &release_buffer, &command_buffer);
+      release_buffer->vkEndCommandBuffer(release_buffer);
+      transfer_buffer->vkEndCommandBuffer(transfer_buffer);
+      batch.release_semaphore =
+          application_->sync_object_pool()->AcquireSemaphore();
+      batch.semaphore = application_->sync_object_pool()->AcquireSemaphore();
+
+      // The release comes after everything that was queued on the manager's
+      // queue before this, which is where the destinations were last used.
+      VkSubmitInfo release_info = {
+          VK_STRUCTURE_TYPE_SUBMIT_INFO,         // sType
+          nullptr,                               // pNext
+          0,                                     // waitSemaphoreCount
+          nullptr,                               // pWaitSemaphores
+          nullptr,                               // pWaitDstStageMask
+          1,                                     // commandBufferCount
+          &release_buffer.get_command_buffer(),  // pCommandBuffers
+          1,                                     // signalSemaphoreCount
+          &batch.release_semaphore               // pSignalSemaphores
+      };
+      // The semaphore has to have been submitted for signalling before
+      // anything waits on it, so the release is submitted straight away.
+      if (batcher) {
+        batcher->Submit(release_info);
+        LOG_ASSERT(==, device_->GetLogger(), VK_SUCCESS, batcher->Flush());
+      } else {
+        submissions_.Add(release_info);
+        LOG_ASSERT(==, device_->GetLogger(), VK_SUCCESS,
+                   submissions_.Submit(queue_, ::VkFence(VK_NULL_HANDLE)));
+      }
+
+      VkPipelineStageFlags transfer_wait_stage =
+          VK_PIPELINE_STAGE_TRANSFER_BIT;
+      VkSubmitInfo transfer_info = {
+          VK_STRUCTURE_TYPE_SUBMIT_INFO,          // sType
+          nullptr,                                // pNext
+          1,                                      // waitSemaphoreCount
+          &batch.release_semaphore,               // pWaitSemaphores
+          &transfer_wait_stage,                   // pWaitDstStageMask
+          1,                                      // commandBufferCount
+          &transfer_buffer.get_command_buffer(),  // pCommandBuffers
+          1,                                      // signalSemaphoreCount
+          &batch.semaphore                        // pSignalSemaphores
+      };
+      transfer_submissions_.Add(transfer_info);
+      // If the release was handed to a submission thread, the copies are as
+      // well, so that they are submitted after it.
+      SubmissionThread* thread =
+          batcher ? batcher->submission_thread() : nullptr;
+      if (thread) {
+        thread->Submit(transfer_queue_, &transfer_submissions_,
+                       ::VkFence(VK_NULL_HANDLE));
+      } else {
+        LOG_ASSERT(==, device_->GetLogger(), VK_SUCCESS,
+                   transfer_submissions_.Submit(transfer_queue_,
+                                                ::VkFence(VK_NULL_HANDLE)));
+      }
+      transfer_flushes_ += 1;
+    } else {
+      RecordCopies(&command_buffer, nullptr, nullptr);
+    }
+    command_buffer->vkEndCommandBuffer(command_buffer);
+  }
+  batch.ring_end = head_;
+  batch.fence = application_->sync_object_pool()->AcquireFence();
+  batch.flushed = true;
+  batch.own_buffers.swap(own_buffers_);
+
+  // Without a command buffer this only submits the fence, which still
+  // signals once the command buffers passed to Record() have completed.
+  VkResult result = VK_SUCCESS;
+  if (batch.command_buffer) {
+    const bool waits = batch.semaphore != VK_NULL_HANDLE;
+    VkSubmitInfo submit_info = {
+        VK_STRUCTURE_TYPE_SUBMIT_INFO,                // sType
+        nullptr,                                      // pNext
+        waits ? 1u : 0u,                              // waitSemaphoreCount
+        waits ? &batch.semaphore : nullptr,           // pWaitSemaphores
+        waits ? &wait_stages : nullptr,               // pWaitDstStageMask
+        1,                                            // commandBufferCount
+        &batch.command_buffer->get_command_buffer(),  // pCommandBuffers
+        0,                                            // signalSemaphoreCount
+        nullptr                                       // pSignalSemaphores
+    };
+    if (batcher) {
+      batcher->Submit(submit_info);
+    } else {
+      submissions_.Add(submit_info);
+    }
+  }
+  if (batcher) {
+    result = batcher->Flush(batch.fence);
+  } else {
+    result = submissions_.Submit(queue_, batch.fence);
+  }
+  recorded_ = false;
+  num_flushes_ += 1;
+  last_flush_ = std::chrono::high_resolution_clock::now();
+  batches_.push_back(std::move(batch));
+  return result;
+}
+
+void UploadManager::WaitIdle() {
+  while (!batches_.empty() && ReclaimOldest(true)) {
+  }
+}
+
+void UploadManager::LogStatistics(logging::Logger* log) const {
+  const double megabytes = bytes_uploaded_ / (1024.0 * 1024.0);
+  const double seconds =
+      std::chrono::duration<double>(last_flush_ - first_upload_).count();
+  log->LogInfo("Upload manager: ", bytes_uploaded_, " bytes in ", num_copies_,
+               " copies and ", num_flushes_, " flushes, ", transfer_flushes_,
+               " of them copied on the transfer queue, ",
+               seconds > 0.0 ? megabytes / seconds : 0.0,
+               "MB/s since the first upload, staged at ",
+               staging_nanoseconds_ == 0
+                   ? 0.0
+                   : megabytes / (staging_nanoseconds_ / 1e9),
+               "MB/s");
+  log->LogInfo("Upload manager: waited for the GPU ", fence_waits_,
+               " times, ", oversized_uploads_, " uploads did not fit in the ",
+               staging_->size(), " byte staging ring");
+}
+
+}  // namespace vulkan
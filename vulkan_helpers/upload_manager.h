@@ -0,0 +1,277 @@
+/* Copyright 2017 Google Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VULKAN_HELPERS_UPLOAD_MANAGER_H_
+#define VULKAN_HELPERS_UPLOAD_MANAGER_H_
+
+#include <chrono>
+#include <initializer_list>
+
+#include "support/containers/allocator.h"
+#include "support/containers/deque.h"
+#include "support/containers/unique_ptr.h"
+#include "support/containers/vector.h"
+#include "support/log/log.h"
+#include "vulkan_helpers/submission_batcher.h"
+#include "vulkan_helpers/vulkan_application.h"
+#include "vulkan_helpers/vulkan_header_wrapper.h"
+#include "vulkan_wrapper/command_buffer_wrapper.h"
+#include "vulkan_wrapper/device_wrapper.h"
+#include "vulkan_wrapper/queue_wrapper.h"
+#include "vulkan_wrapper/sub_objects.h"
+
+namespace vulkan {
+
+// UploadManager copies data from the host into buffers and images through a
+// single persistently mapped staging ring, instead of a staging buffer, or a
+// series of vkCmdUpdateBuffer calls, per upload.
+// UploadBuffer() and UploadImage() copy the data into the ring straight
+// away, and queue the copy out of it. Every queued copy is then recorded
+// together, between one pipeline barrier before and one after, by the next
+// Record(), RecordWithFence() or Flush().
+// Each Flush() is submitted with a fence, which also covers the command
+// buffers passed to Record() before it, and RecordWithFence() returns a
+// fence for the command buffer that it records into. Ring space is
+// reclaimed in the order that it was used, so the space of a command buffer
+// is only reclaimed once it, and everything recorded before it, is covered
+// by a fence that has signalled. An application that uses Record() must
+// therefore call Flush() once it has submitted the command buffers.
+// When an upload does not fit, the manager waits for the oldest fenced work
+// that is still running. If the ring still has no room, or the upload is
+// larger than the ring, the data goes through a staging buffer of its own
+// from the application's host-visible arena, which is freed along with the
+// ring space of the command buffer that it was recorded into.
+// The destinations are used on the queue that the manager was created for.
+// If it was also given a transfer queue of another family, the copies that
+// Flush() records run there instead, usually on a DMA engine of their own.
+// The manager's queue then first releases the destinations to the transfer
+// queue, after the work that was submitted to it before the Flush(), and
+// signals a semaphore that the copies wait on. Once they are done, the
+// transfer queue releases the destinations back, and signals a semaphore
+// that the manager's queue waits on before acquiring them. The destinations
+// must have been created with VK_SHARING_MODE_EXCLUSIVE.
+// This is not thread-safe.
+class UploadManager {
+ public:
+  static const VkDeviceSize kDefaultStagingSize = 4 * 1024 * 1024;
+
+  // staging_buffer is the ring. It must be host-coherent, persistently
+  // mapped, and created with VK_BUFFER_USAGE_TRANSFER_SRC_BIT. If
+  // transfer_queue is not nullptr, it must also be shared with the family of
+  // transfer_queue.
+  UploadManager(containers::Allocator* allocator,
+                VulkanApplication* application, VkQueue* queue,
+                containers::unique_ptr<VulkanApplication::Buffer>
+                    staging_buffer,
+                VkQueue* transfer_queue = nullptr);
+  // Waits for every flushed copy to complete. Command buffers passed to
+  // Record() since the last Flush() must have completed already.
+  ~UploadManager();
+
+  UploadManager(const UploadManager&) = delete;
+  UploadManager& operator=(const UploadManager&) = delete;
+
+  // Queues a copy of size bytes of data to offset in buffer, which must have
+  // been created with VK_BUFFER_USAGE_TRANSFER_DST_BIT. Once it has been
+  // copied, the data is made visible to dst_access in dst_stages.
+  // data is no longer needed once this returns.
+  void UploadBuffer(::VkBuffer buffer, VkDeviceSize offset, const void* data,
+                    VkDeviceSize size, VkAccessFlags dst_access,
+                    VkPipelineStageFlags dst_stages);
+  // Queues a copy of size bytes of data into the given regions of image,
+  // whose bufferOffsets are relative to data. The range of the image is
+  // moved from old_layout to VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL for the
+  // copy, and then to new_layout, and made visible to dst_access in
+  // dst_stages. format is the format of the image, whose texel size the
+  // copy must be aligned to.
+  void UploadImage(::VkImage image, VkFormat format,
+                   const VkImageSubresourceRange& range,
+                   VkImageLayout old_layout, VkImageLayout new_layout,
+                   const void* data, VkDeviceSize size,
+                   std::initializer_list<VkBufferImageCopy> regions,
+                   VkAccessFlags dst_access, VkPipelineStageFlags dst_stages);
+
+  // Records every queued copy into command_buffer, so that it is ordered
+  // with the commands around it. command_buffer must be submitted to the
+  // manager's queue before the next Flush(), since that reclaims the ring
+  // space that it reads.
+  void Record(VkCommandBuffer* command_buffer);
+  // Records every queued copy into command_buffer like Record(), but
+  // returns a fence, owned by the manager, that reclaims the ring space once
+  // it has signalled, instead of the next Flush(). The fence must be
+  // signalled by the submission of command_buffer, or by a later one to the
+  // same queue, and must not be waited on or reset by the caller.
+  // This is for callers that submit their own command buffers without
+  // knowing whether anything else has been recorded but not yet submitted.
+  ::VkFence RecordWithFence(VkCommandBuffer* command_buffer);
+  // Records every queued copy into a command buffer of the manager's own,
+  // and submits it along with a fence, through batcher or, if batcher is
+  // nullptr, straight to the queue. batcher must submit to the manager's
+  // queue. Nothing is submitted if nothing was queued or recorded since the
+  // last Flush().
+  // With a transfer queue, the release of the destinations is submitted to
+  // the manager's queue first, through batcher, which is flushed for it.
+  // The copies are then submitted to the transfer queue, on the batcher's
+  // submission thread if it has one, so that they are submitted after the
+  // release that they wait for. What is then submitted to the manager's
+  // queue waits for them, and acquires their destinations.
+  VkResult Flush(SubmissionBatcher* batcher = nullptr);
+  // Blocks until every flushed copy has completed, and reclaims the ring
+  // space up to the oldest Record() since the last Flush().
+  void WaitIdle();
+
+  bool has_pending_uploads() const { return !copies_.empty(); }
+  VkDeviceSize staging_size() const { return staging_->size(); }
+  // Returns the queue that Flush() makes its copies on.
+  VkQueue* copy_queue() { return transfer_queue_ ? transfer_queue_ : queue_; }
+
+  // Logs how much was uploaded, how fast, and how often uploads had to wait
+  // for the ring or did not fit in it.
+  void LogStatistics(logging::Logger* log) const;
+
+ private:
+  struct PendingCopy {
+    // The ring, or the staging buffer of an upload that did not fit in it.
+    ::VkBuffer source;
+    // Exactly one of buffer and image is set.
+    ::VkBuffer buffer;
+    VkBufferCopy buffer_region;
+    ::VkImage image;
+    size_t first_image_region;
+    uint32_t num_image_regions;
+    VkImageSubresourceRange range;
+    VkImageLayout old_layout;
+    VkImageLayout new_layout;
+    VkAccessFlags dst_access;
+    VkPipelineStageFlags dst_stages;
+  };
+
+  // The work of a Flush(), Record() or RecordWithFence().
+  // The fence is always submitted to the manager's queue, after anything
+  // that the batch submits to the transfer queue, so it covers both.
+  struct Batch {
+    explicit Batch(containers::Allocator* allocator)
+        : ring_end(0),
+          fence(VK_NULL_HANDLE),
+          flushed(false),
+          release_semaphore(VK_NULL_HANDLE),
+          semaphore(VK_NULL_HANDLE),
+          own_buffers(allocator) {}
+    // The position of the ring that is free once fence has signalled.
+    uint64_t ring_end;
+    // VK_NULL_HANDLE for a Record(), whose batch is covered by the fence of
+    // the next flushed batch instead.
+    ::VkFence fence;
+    // Whether the batch was made by Flush().
+    bool flushed;
+    // Only set if there were queued copies left for Flush() to record. With
+    // a transfer queue, release_command_buffer releases the destinations and
+    // signals release_semaphore, transfer_command_buffer waits for it, makes
+    // the copies and signals semaphore, and command_buffer only acquires the
+    // destinations again.
+    containers::unique_ptr<VkCommandBuffer> command_buffer;
+    containers::unique_ptr<VkCommandBuffer> release_command_buffer;
+    containers::unique_ptr<VkCommandBuffer> transfer_command_buffer;
+    ::VkSemaphore release_semaphore;
+    ::VkSemaphore semaphore;
+    containers::vector<containers::unique_ptr<VulkanApplication::Buffer>>
+        own_buffers;
+  };
+
+  // Copies data into the ring, or into a staging buffer of its own, and
+  // returns the buffer and *offset that it was copied to.
+  ::VkBuffer Stage(const void* data, VkDeviceSize size,
+                   VkDeviceSize alignment, VkDeviceSize* offset);
+  // Finds room for size bytes in the ring, waiting for older batches if
+  // necessary. Returns false if there is none.
+  bool Allocate(VkDeviceSize size, VkDeviceSize alignment,
+                VkDeviceSize* offset);
+  // Frees the ring space of the oldest batch. If wait is false, and its
+  // fence has not signalled yet, returns false instead. Also returns false
+  // if the oldest batch came from Record(), and has not been flushed yet.
+  bool ReclaimOldest(bool wait);
+  // Records every queued copy into command_buffer, and adds a batch for it
+  // that is reclaimed once fence has signalled.
+  void RecordBatch(VkCommandBuffer* command_buffer, ::VkFence fence);
+  // Records every queued copy into command_buffer. If release_buffer and
+  // acquire_buffer are not nullptr, command_buffer is for the transfer
+  // queue. release_buffer then releases the destinations from the manager's
+  // queue, command_buffer acquires them, makes the copies, and releases them
+  // back, and acquire_buffer acquires them on the manager's queue again.
+  // Returns the stages that use the destinations.
+  VkPipelineStageFlags RecordCopies(VkCommandBuffer* command_buffer,
+                                    VkCommandBuffer* release_buffer,
+                                    VkCommandBuffer* acquire_buffer);
+  // Returns a command buffer from free_buffers, or a new one from pool, and
+  // begins it.
+  containers::unique_ptr<VkCommandBuffer> BeginCommandBuffer(
+      VkCommandPool* pool,
+      containers::vector<containers::unique_ptr<VkCommandBuffer>>*
+          free_buffers);
+
+  containers::Allocator* allocator_;
+  VulkanApplication* application_;
+  VkDevice* device_;
+  VkQueue* queue_;
+  // nullptr unless the manager has a transfer queue of another family.
+  VkQueue* transfer_queue_;
+  containers::unique_ptr<VulkanApplication::Buffer> staging_;
+  // Positions in the ring count every byte that was ever allocated from it,
+  // so that head_ - tail_ is the number of bytes in use, and the offset of a
+  // position is the position modulo the size of the ring.
+  uint64_t head_;
+  uint64_t tail_;
+  containers::vector<PendingCopy> copies_;
+  containers::vector<VkBufferImageCopy> image_regions_;
+  // The staging buffers of uploads that did not fit in the ring, and have
+  // not been recorded yet.
+  containers::vector<containers::unique_ptr<VulkanApplication::Buffer>>
+      own_buffers_;
+  // Whether Record() was called since the last Flush().
+  bool recorded_;
+  containers::deque<Batch> batches_;
+  VkCommandPool command_pool_;
+  // The command buffers of reclaimed batches.
+  containers::vector<containers::unique_ptr<VkCommandBuffer>>
+      free_command_buffers_;
+  // Only created if there is a transfer queue.
+  containers::unique_ptr<VkCommandPool> transfer_command_pool_;
+  containers::vector<containers::unique_ptr<VkCommandBuffer>>
+      free_transfer_command_buffers_;
+  // Used by Flush() when there is no batcher, and for the transfer queue.
+  SubmissionList submissions_;
+  SubmissionList transfer_submissions_;
+  // Kept between calls to Record() so that they do not have to be
+  // reallocated.
+  containers::vector<VkBufferMemoryBarrier> buffer_barriers_;
+  containers::vector<VkImageMemoryBarrier> image_barriers_;
+
+  // Statistics.
+  uint64_t bytes_uploaded_;
+  uint64_t num_copies_;
+  uint64_t num_flushes_;
+  // The flushes whose copies were made on the transfer queue.
+  uint64_t transfer_flushes_;
+  uint64_t fence_waits_;
+  uint64_t oversized_uploads_;
+  // Time spent copying data into staging memory.
+  uint64_t staging_nanoseconds_;
+  std::chrono::high_resolution_clock::time_point first_upload_;
+  std::chrono::high_resolution_clock::time_point last_flush_;
+};
+
+}  // namespace vulkan
+
+#endif  // VULKAN_HELPERS_UPLOAD_MANAGER_H_
@@ -16,43 +16,208 @@
 #include "vulkan_helpers/vulkan_application.h"
 
 #include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <tuple>
 
 #include "support/containers/unordered_map.h"
 #include "vulkan_helpers/helper_functions.h"
+#include "vulkan_helpers/pipeline_build_queue.h"
+#include "vulkan_helpers/pipeline_cache_file.h"
+#include "vulkan_helpers/readback_manager.h"
+#include "vulkan_helpers/upload_manager.h"
 #include "vulkan_helpers/vulkan_model.h"
 
 typedef void(VKAPI_PTR* PFN_vkSetSwapchainCallback)(
     VkSwapchainKHR, void(void*, uint8_t*, size_t), void*);
 
 namespace vulkan {
-VkDescriptorPool DescriptorSet::CreateDescriptorPool(
-    containers::Allocator* allocator, VkDevice* device,
-    std::initializer_list<VkDescriptorSetLayoutBinding> bindings) {
-  containers::unordered_map<uint32_t, uint32_t> counts(allocator);
-  for (auto binding : bindings) {
-    counts[static_cast<uint32_t>(binding.descriptorType)] +=
-        binding.descriptorCount;
+namespace {
+const uint32_t kAllBufferBits = (VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT << 1) - 1;
+
+// Returns the 64-bit FNV-1a hash of the given bytes.
+uint64_t HashBytes(const void* data, size_t size) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ bytes[i]) * 1099511628211ull;
+  }
+  return hash;
+}
+
+// Appends the bytes of every value to the key. The values must not contain
+// any padding or pointers.
+void AppendToKey(containers::vector<uint8_t>*) {}
+
+template <typename T, typename... Rest>
+void AppendToKey(containers::vector<uint8_t>* key, const T& value,
+                 const Rest&... rest) {
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+  key->insert(key->end(), bytes, bytes + sizeof(T));
+  AppendToKey(key, rest...);
+}
+
+// Appends the count and the bytes of the first count values to the key.
+template <typename T>
+void AppendArrayToKey(containers::vector<uint8_t>* key, const T* values,
+                      size_t count) {
+  AppendToKey(key, static_cast<uint32_t>(count));
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(values);
+  key->insert(key->end(), bytes, bytes + sizeof(T) * count);
+}
+
+// Appends the size and the bytes of every element of the array to the key.
+template <typename T>
+void AppendArrayToKey(containers::vector<uint8_t>* key,
+                      const containers::vector<T>& values) {
+  AppendArrayToKey(key, values.data(), values.size());
+}
+
+// Appends the attachment indices of the references to the key, but not their
+// layouts, which do not affect render pass compatibility.
+void AppendReferencesToKey(containers::vector<uint8_t>* key,
+                           const VkAttachmentReference* references,
+                           uint32_t count) {
+  AppendToKey(key, count);
+  for (uint32_t i = 0; i < count; ++i) {
+    AppendToKey(key, references[i].attachment);
+  }
+}
+
+// Appends everything about the render pass that its compatibility with other
+// render passes depends on to the key. That leaves out the load and store
+// operations, and the image layouts.
+void AppendRenderPassToKey(containers::vector<uint8_t>* key,
+                           const VkRenderPassCreateInfo& create_info) {
+  AppendToKey(key, create_info.attachmentCount);
+  for (uint32_t i = 0; i < create_info.attachmentCount; ++i) {
+    const VkAttachmentDescription& attachment = create_info.pAttachments[i];
+    AppendToKey(key, attachment.flags, attachment.format, attachment.samples);
+  }
+  AppendToKey(key, create_info.subpassCount);
+  for (uint32_t i = 0; i < create_info.subpassCount; ++i) {
+    const VkSubpassDescription& subpass = create_info.pSubpasses[i];
+    AppendToKey(key, subpass.flags, subpass.pipelineBindPoint);
+    AppendReferencesToKey(key, subpass.pInputAttachments,
+                          subpass.inputAttachmentCount);
+    AppendReferencesToKey(key, subpass.pColorAttachments,
+                          subpass.colorAttachmentCount);
+    AppendReferencesToKey(
+        key, subpass.pResolveAttachments,
+        subpass.pResolveAttachments ? subpass.colorAttachmentCount : 0);
+    AppendReferencesToKey(key, subpass.pDepthStencilAttachment,
+                          subpass.pDepthStencilAttachment ? 1 : 0);
+    AppendArrayToKey(key, subpass.pPreserveAttachments,
+                     subpass.preserveAttachmentCount);
+  }
+  AppendArrayToKey(key, create_info.pDependencies,
+                   create_info.dependencyCount);
+}
+}  // namespace
+
+size_t ByteKeyHash::operator()(
+    const containers::vector<uint8_t>& key) const {
+  return static_cast<size_t>(HashBytes(key.data(), key.size()));
+}
+
+SharedPipeline& SharedPipeline::operator=(SharedPipeline&& other) {
+  if (this != &other) {
+    reset();
+    application_ = other.application_;
+    pipeline_ = other.pipeline_;
+    other.pipeline_ = VK_NULL_HANDLE;
   }
+  return *this;
+}
 
-  containers::vector<VkDescriptorPoolSize> pool_sizes(allocator);
-  pool_sizes.reserve(counts.size());
-  for (auto p : counts) {
-    pool_sizes.push_back({static_cast<VkDescriptorType>(p.first), p.second});
+void SharedPipeline::reset() {
+  if (pipeline_ != VK_NULL_HANDLE) {
+    application_->ReleaseSharedPipeline(pipeline_);
+    pipeline_ = VK_NULL_HANDLE;
   }
+}
 
-  return vulkan::CreateDescriptorPool(
-      device, static_cast<uint32_t>(pool_sizes.size()), pool_sizes.data(), 1);
+SharedShaderModule& SharedShaderModule::operator=(
+    SharedShaderModule&& other) {
+  if (this != &other) {
+    reset();
+    application_ = other.application_;
+    module_ = other.module_;
+    other.module_ = VK_NULL_HANDLE;
+  }
+  return *this;
+}
+
+void SharedShaderModule::reset() {
+  if (module_ != VK_NULL_HANDLE) {
+    application_->ReleaseShaderModule(module_);
+    module_ = VK_NULL_HANDLE;
+  }
+}
+
+PipelineLayout::PipelineLayout(
+    containers::Allocator* allocator, VulkanApplication* application,
+    std::initializer_list<std::initializer_list<VkDescriptorSetLayoutBinding>>
+        layouts,
+    std::initializer_list<VkPushConstantRange> push_constant_ranges)
+    : descriptor_set_layouts_(allocator),
+      compatibility_key_(allocator),
+      pipeline_layout_(VK_NULL_HANDLE,
+                       application->device().allocation_callbacks(),
+                       &application->device()) {
+  VkDevice& device = application->device();
+  descriptor_set_layouts_.reserve(layouts.size());
+  for (auto binding_list : layouts) {
+    descriptor_set_layouts_.push_back(
+        application->GetCachedDescriptorSetLayout(binding_list));
+  }
+  const uint32_t num_ranges =
+      static_cast<uint32_t>(push_constant_ranges.size());
+  const VkPushConstantRange* ranges =
+      num_ranges ? push_constant_ranges.begin() : nullptr;
+  // The set layouts are never destroyed before the application, so their
+  // handles identify their bindings.
+  AppendArrayToKey(&compatibility_key_, descriptor_set_layouts_);
+  AppendArrayToKey(&compatibility_key_, ranges, num_ranges);
+  VkPipelineLayoutCreateInfo create_info = {
+      VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,          // sType
+      nullptr,                                                // pNext
+      0,                                                      // flags
+      static_cast<uint32_t>(descriptor_set_layouts_.size()),  // setLayoutCount
+      descriptor_set_layouts_.data(),                         // pSetLayouts
+      num_ranges,  // pushConstantRangeCount
+      ranges,      // pPushConstantRanges
+  };
+
+  ::VkPipelineLayout layout;
+  LOG_ASSERT(==, device.GetLogger(), VK_SUCCESS,
+             device->vkCreatePipelineLayout(device, &create_info,
+                                            device.allocation_callbacks(),
+                                            &layout));
+  pipeline_layout_.initialize(layout);
 }
 
 DescriptorSet::DescriptorSet(
-    containers::Allocator* allocator, VkDevice* device,
+    VulkanApplication* application,
     std::initializer_list<VkDescriptorSetLayoutBinding> bindings)
-    : pool_(CreateDescriptorPool(allocator, device, bindings)),
-      layout_(CreateDescriptorSetLayout(allocator, device, bindings)),
-      set_(AllocateDescriptorSet(device, pool_.get_raw_object(),
-                                 layout_.get_raw_object())) {}
+    : descriptor_allocator_(application->descriptor_allocator()),
+      layout_(application->GetCachedDescriptorSetLayout(bindings)),
+      pool_(VK_NULL_HANDLE),
+      set_(descriptor_allocator_->Allocate(layout_, bindings, &pool_)) {}
+
+DescriptorSet::DescriptorSet(DescriptorSet&& other)
+    : descriptor_allocator_(other.descriptor_allocator_),
+      layout_(other.layout_),
+      pool_(other.pool_),
+      set_(other.set_) {
+  other.set_ = VK_NULL_HANDLE;
+}
+
+DescriptorSet::~DescriptorSet() {
+  if (set_ != VK_NULL_HANDLE) {
+    descriptor_allocator_->Free(pool_, set_);
+  }
+}
 
 VulkanApplication::VulkanApplication(
     containers::Allocator* allocator, logging::Logger* log,
@@ -61,32 +226,126 @@ VulkanApplication::VulkanApplication(
     const VkPhysicalDeviceFeatures& features, uint32_t host_buffer_size,
     uint32_t device_image_size, uint32_t device_buffer_size,
     uint32_t coherent_buffer_size, bool use_async_compute_queue,
-    bool use_sparse_binding)
+    bool use_sparse_binding, VkPresentModeKHR present_mode,
+    uint32_t swapchain_image_count, bool use_transfer_queue,
+    const std::initializer_list<const char*> optional_extensions,
+    const VkPhysicalDeviceFeatures& optional_features)
+    : VulkanApplication(allocator, log, entry_data, false, extensions,
+                        features, host_buffer_size, device_image_size,
+                        device_buffer_size, coherent_buffer_size,
+                        use_async_compute_queue, use_sparse_binding,
+                        present_mode, swapchain_image_count,
+                        use_transfer_queue, optional_extensions,
+                        optional_features) {}
+
+VulkanApplication::VulkanApplication(
+    containers::Allocator* allocator, logging::Logger* log,
+    const entry::EntryData* entry_data, ComputeOnly,
+    const std::initializer_list<const char*> extensions,
+    const VkPhysicalDeviceFeatures& features, uint32_t host_buffer_size,
+    uint32_t device_image_size, uint32_t device_buffer_size,
+    uint32_t coherent_buffer_size)
+    : VulkanApplication(allocator, log, entry_data, true, extensions,
+                        features, host_buffer_size, device_image_size,
+                        device_buffer_size, coherent_buffer_size, false,
+                        false, VK_PRESENT_MODE_MAX_ENUM_KHR, 0, false, {},
+                        {0}) {}
+
+VulkanApplication::VulkanApplication(
+    containers::Allocator* allocator, logging::Logger* log,
+    const entry::EntryData* entry_data, bool compute_only,
+    const std::initializer_list<const char*> extensions,
+    const VkPhysicalDeviceFeatures& features, uint32_t host_buffer_size,
+    uint32_t device_image_size, uint32_t device_buffer_size,
+    uint32_t coherent_buffer_size, bool use_async_compute_queue,
+    bool use_sparse_binding, VkPresentModeKHR present_mode,
+    uint32_t swapchain_image_count, bool use_transfer_queue,
+    const std::initializer_list<const char*> optional_extensions,
+    const VkPhysicalDeviceFeatures& optional_features)
     : allocator_(allocator),
       log_(log),
       entry_data_(entry_data),
+      construction_start_(std::chrono::high_resolution_clock::now()),
+      compute_only_(compute_only),
+      device_extensions_(allocator_),
+      enabled_features_(features),
       swapchain_images_(allocator_),
       render_queue_(nullptr),
       present_queue_(nullptr),
+      sparse_binding_queue_(nullptr),
       render_queue_index_(0u),
       present_queue_index_(0u),
+      transfer_queue_index_(0xFFFFFFFF),
+      allocation_callbacks_(allocator_, log_),
       library_wrapper_(allocator_, log_),
-      instance_(CreateInstanceForApplication(allocator_, &library_wrapper_,
-                                             entry_data_)),
-      surface_(CreateDefaultSurface(&instance_, entry_data_)),
-      device_(CreateDevice(extensions, features, use_async_compute_queue,
-                           use_sparse_binding)),
-      swapchain_(CreateDefaultSwapchain(&instance_, &device_, &surface_,
-                                        allocator_, render_queue_index_,
-                                        present_queue_index_, entry_data_)),
-      command_pool_(CreateDefaultCommandPool(allocator_, device_)),
-      pipeline_cache_(CreateDefaultPipelineCache(&device_)),
+      instance_(compute_only
+                    ? CreateEmptyInstance(allocator_, &library_wrapper_,
+                                          allocation_callbacks_.get())
+                    : CreateInstanceForApplication(
+                          allocator_, &library_wrapper_, entry_data_,
+                          allocation_callbacks_.get())),
+      surface_(compute_only ? VkSurfaceKHR(VK_NULL_HANDLE, nullptr, &instance_)
+                            : CreateDefaultSurface(&instance_, entry_data_)),
+      device_(compute_only
+                  ? CreateComputeDevice(extensions, features)
+                  : CreateDevice(extensions, features, use_async_compute_queue,
+                                 use_sparse_binding, use_transfer_queue,
+                                 optional_extensions, optional_features)),
+      swapchain_(compute_only
+                     ? VkSwapchainKHR(VK_NULL_HANDLE, nullptr, &device_, 0, 0,
+                                      0, VK_FORMAT_UNDEFINED)
+                     : CreateDefaultSwapchain(
+                           &instance_, &device_, &surface_, allocator_,
+                           render_queue_index_, present_queue_index_,
+                           entry_data_, present_mode, swapchain_image_count)),
+      command_pool_(
+          CreateDefaultCommandPool(allocator_, device_, render_queue_index_)),
+      pipeline_cache_(CreatePipelineCache()),
+      descriptor_allocator_(allocator_, &device_, true),
+      sync_object_pool_(allocator_, &device_),
+      utility_command_buffers_(allocator_, &device_, render_queue_index_, 1),
+      pipeline_cache_initial_size_(GetPipelineCacheSize()),
+      pipelines_created_(0),
+      pipeline_creation_microseconds_(0),
+      shared_pipelines_(allocator_),
+      shared_pipeline_references_(allocator_),
+      shared_pipeline_hits_(0),
+      shared_pipeline_misses_(0),
+      shader_modules_(allocator_),
+      shader_module_keys_(allocator_),
+      shader_module_hits_(0),
+      shader_module_misses_(0),
+      shader_module_creation_microseconds_(0),
+      shader_module_saved_microseconds_(0),
+      render_pass_cache_(allocator_),
+      framebuffer_cache_(allocator_),
+      render_pass_cache_hits_(0),
+      render_pass_cache_misses_(0),
+      framebuffer_cache_hits_(0),
+      framebuffer_cache_misses_(0),
+      framebuffer_cache_evictions_(0),
+      render_pass_compatibility_keys_(allocator_),
+      descriptor_set_layout_cache_(allocator_),
+      descriptor_set_layout_cache_hits_(0),
+      descriptor_set_layout_cache_misses_(0),
+      host_buffer_size_(host_buffer_size),
+      coherent_buffer_size_(coherent_buffer_size),
+      device_buffer_size_(device_buffer_size),
+      device_image_size_(device_image_size),
       should_exit_(false) {
+  for (const char* extension : extensions) {
+    device_extensions_.emplace_back(
+        extension, containers::StlCompatibleAllocator<char>(allocator_));
+  }
   if (!device_.is_valid()) {
     return;
   }
+  if (transfer_queue_concrete_) {
+    transfer_command_buffers_ = containers::make_unique<CommandBufferRing>(
+        allocator_, allocator_, &device_, transfer_queue_index_, 1);
+  }
 
-  if (entry_data->output_frame_index() >= 1) {
+  if (!compute_only_ && entry_data->output_frame_index() >= 1) {
     PFN_vkSetSwapchainCallback set_callback =
         reinterpret_cast<PFN_vkSetSwapchainCallback>(
             device_.getProcAddrFunction()(device_, "vkSetSwapchainCallback"));
@@ -127,139 +386,456 @@ VulkanApplication::VulkanApplication(
     set_callback(swapchain_, &cb_data::fn, cb);
   }
 
-  vulkan::LoadContainer(log_, device_->vkGetSwapchainImagesKHR,
-                        &swapchain_images_, device_, swapchain_);
-  // Relevant spec sections for determining what memory we will be allowed
-  // to use for our buffer allocations.
-  //  The memoryTypeBits member is identical for all VkBuffer objects created
-  //  with the same value for the flags and usage members in the
-  //  VkBufferCreateInfo structure passed to vkCreateBuffer. Further, if
-  //  usage1 and usage2 of type VkBufferUsageFlags are such that the bits set
-  //  in usage2 are a subset of the bits set in usage1, and they have the same
-  //  flags, then the bits set in memoryTypeBits returned for usage1 must be a
-  //  subset of the bits set in memoryTypeBits returned for usage2, for all
-  //  values of flags.
+  if (!compute_only_) {
+    vulkan::LoadContainer(log_, device_->vkGetSwapchainImagesKHR,
+                          &swapchain_images_, device_, swapchain_);
+  }
 
-  // Therefore we should be able to satisfy all buffer requests for non
-  // sparse memory bindings if we do the following:
-  // For our host visible bits, we will use:
-  // VK_BUFFER_USAGE_TRANSFER_SRC_BIT
-  // VK_BUFFER_USAGE_TRANSFER_DST_BIT
-  // For our device buffers we will use ALL bits.
-  // This means we can use this memory for everything.
-  // Furthermore for both types, we will have ZERO flags
-  // set (we do not want to do sparse binding.)
+  // The memory arenas are not allocated here, but the first time they are
+  // used, since most applications only ever use a few of them.
+  log_->LogInfo(
+      compute_only_ ? "Compute-only application" : "Application",
+      " startup took ",
+      std::chrono::duration<float, std::milli>(
+          std::chrono::high_resolution_clock::now() - construction_start_)
+          .count(),
+      "ms");
+}
 
-  containers::unique_ptr<VulkanArena>* device_memories[3] = {
-      &host_accessible_heap_, &device_only_buffer_heap_, &coherent_heap_};
-  uint32_t device_memory_sizes[3] = {host_buffer_size, device_buffer_size,
-                                     coherent_buffer_size};
-
-  const uint32_t kAllBufferBits =
-      (VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT << 1) - 1;
-
-  VkBufferUsageFlags usages[3] = {
-      VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-      kAllBufferBits, kAllBufferBits};
-  VkMemoryPropertyFlags property_flags[3] = {
-      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT};
-
-  for (size_t i = 0; i < 3; ++i) {
-    // 1) Create a tiny buffer so that we can determine what memory flags are
-    // required.
-    VkBufferCreateInfo create_info = {
-        VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,  // sType
-        nullptr,                               // pNext
-        0,                                     // flags
-        1,                                     // size
-        usages[i],                             // usage
-        VK_SHARING_MODE_EXCLUSIVE,             // sharingMode
-        0,                                     // queueFamilyIndexCount
-        nullptr,                               //  pQueueFamilyIndices
-    };
-    ::VkBuffer buffer;
-    LOG_ASSERT(==, log_,
-               device_->vkCreateBuffer(device_, &create_info, nullptr, &buffer),
-               VK_SUCCESS);
-    // Get the memory requirements for this buffer.
-    VkMemoryRequirements requirements;
-    device_->vkGetBufferMemoryRequirements(device_, buffer, &requirements);
-    device_->vkDestroyBuffer(device_, buffer, nullptr);
-
-    uint32_t memory_index = GetMemoryIndex(
-        &device_, log_, requirements.memoryTypeBits, property_flags[i]);
-    *device_memories[i] = containers::make_unique<VulkanArena>(
-        allocator_, allocator_, log_, device_memory_sizes[i], memory_index,
-        &device_,
-        (property_flags[i] & (VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                              VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) != 0);
-  }
-
-  // Same idea as above, but for image memory.
-  // The relevant bits from the spec are:
-  //  The memoryTypeBits member is identical for all VkImage objects created
-  //  with the same combination of values for the tiling member and the
-  //  VK_IMAGE_CREATE_SPARSE_BINDING_BIT bit of the flags member and the
-  //  VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT of the usage member in the
-  //  VkImageCreateInfo structure passed to vkCreateImage.
-  {
-    VkImageCreateInfo image_create_info{
-        VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,  // sType
-        nullptr,                              // pNext
-        0,                                    // flags
-        VK_IMAGE_TYPE_2D,                     // imageType
-        VK_FORMAT_R8G8B8A8_UNORM,             // format
-        {
-            // extent
-            1,  // width
-            1,  // height
-            1,  // depth
-        },
-        1,                                    // mipLevels
-        1,                                    // arrayLayers
-        VK_SAMPLE_COUNT_1_BIT,                // samples
-        VK_IMAGE_TILING_OPTIMAL,              // tiling
-        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,  // usage
-        VK_SHARING_MODE_EXCLUSIVE,            // sharingMode
-        0,                                    // queueFamilyIndexCount
-        nullptr,                              // pQueueFamilyIndices
-        VK_IMAGE_LAYOUT_UNDEFINED,            // initialLayout
-    };
-    ::VkImage image;
-    LOG_ASSERT(
-        ==, log_,
-        device_->vkCreateImage(device_, &image_create_info, nullptr, &image),
-        VK_SUCCESS);
-    VkMemoryRequirements requirements;
-    device_->vkGetImageMemoryRequirements(device_, image, &requirements);
-    device_->vkDestroyImage(device_, image, nullptr);
+VulkanApplication::~VulkanApplication() {
+  if (device_.is_valid()) {
+    LogPipelineCacheStatistics();
+    // Every VulkanGraphicsPipeline should have been destroyed by now, but
+    // make sure that no pipelines are leaked if one was not.
+    for (auto& shared : shared_pipelines_) {
+      device_->vkDestroyPipeline(device_, shared.second,
+                                 device_.allocation_callbacks());
+    }
+    LogShaderModuleCacheStatistics();
+    LogRenderPassCacheStatistics();
+    LogDescriptorSetLayoutCacheStatistics();
+    descriptor_allocator_.LogStatistics(log_);
+    sync_object_pool_.LogStatistics(log_);
+    utility_command_buffers_.LogStatistics(log_, "Utility");
+    if (transfer_command_buffers_) {
+      transfer_command_buffers_->LogStatistics(log_, "Transfer");
+    }
+    if (upload_manager_) {
+      upload_manager_->LogStatistics(log_);
+    }
+    if (readback_manager_) {
+      readback_manager_->LogStatistics(log_);
+    }
+    for (auto& shared : shader_modules_) {
+      device_->vkDestroyShaderModule(device_, shared.second.module,
+                                     device_.allocation_callbacks());
+    }
+    if (entry_data_->pipeline_cache_file()) {
+      SavePipelineCacheFile(allocator_, &device_, &pipeline_cache_,
+                            entry_data_->pipeline_cache_file());
+    }
+  }
+  // allocation_callbacks_ logs its statistics once every other member has
+  // been destroyed, so that the bytes still live are leaks.
+}
+
+VkPipelineCache VulkanApplication::CreatePipelineCache() {
+  // Since this is called by the constructor be careful not to
+  // use any data other than what has already been initialized.
+  // allocator_, log_, entry_data_, library_wrapper_, instance_,
+  // device_
+  containers::vector<uint8_t> initial_data(allocator_);
+  if (device_.is_valid() && entry_data_->pipeline_cache_file()) {
+    LoadPipelineCacheFile(&device_, entry_data_->pipeline_cache_file(),
+                          &initial_data);
+  }
+  return CreateDefaultPipelineCache(
+      &device_, initial_data.empty() ? nullptr : initial_data.data(),
+      initial_data.size());
+}
+
+size_t VulkanApplication::GetPipelineCacheSize() {
+  size_t size = 0;
+  if (device_.is_valid()) {
+    device_->vkGetPipelineCacheData(device_, pipeline_cache_, &size, nullptr);
+  }
+  return size;
+}
+
+void VulkanApplication::RecordPipelineCreation(
+    uint32_t count, std::chrono::high_resolution_clock::time_point start) {
+  auto microseconds = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::high_resolution_clock::now() - start);
+  pipeline_creation_microseconds_ += microseconds.count();
+  pipelines_created_ += count;
+}
 
-    uint32_t memory_index =
-        GetMemoryIndex(&device_, log_, requirements.memoryTypeBits,
-                       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    device_only_image_heap_ = containers::make_unique<VulkanArena>(
-        allocator_, allocator_, log_, device_image_size, memory_index, &device_,
-        false);
+VkResult VulkanApplication::CreateGraphicsPipelines(
+    uint32_t count, const VkGraphicsPipelineCreateInfo* create_infos,
+    ::VkPipeline* pipelines) {
+  auto start = std::chrono::high_resolution_clock::now();
+  VkResult result = device_->vkCreateGraphicsPipelines(
+      device_, pipeline_cache_, count, create_infos,
+      device_.allocation_callbacks(), pipelines);
+  RecordPipelineCreation(count, start);
+  return result;
+}
+
+VkResult VulkanApplication::CreateComputePipelines(
+    uint32_t count, const VkComputePipelineCreateInfo* create_infos,
+    ::VkPipeline* pipelines) {
+  auto start = std::chrono::high_resolution_clock::now();
+  VkResult result = device_->vkCreateComputePipelines(
+      device_, pipeline_cache_, count, create_infos,
+      device_.allocation_callbacks(), pipelines);
+  RecordPipelineCreation(count, start);
+  return result;
+}
+
+void VulkanApplication::LogPipelineCacheStatistics() {
+  // The size of the cache is only measured here and when it is created, since
+  // vkGetPipelineCacheData can be expensive. If the cache did not grow, every
+  // pipeline was found in it.
+  log_->LogInfo("Pipeline cache: ", pipelines_created_.load(),
+                " pipelines created in ",
+                pipeline_creation_microseconds_.load() / 1000.0f,
+                "ms, cache grew from ", pipeline_cache_initial_size_, " to ",
+                GetPipelineCacheSize(), " bytes");
+  std::lock_guard<std::mutex> lock(shared_pipelines_mutex_);
+  log_->LogInfo("Pipeline state cache: ", shared_pipeline_hits_, " hits, ",
+                shared_pipeline_misses_, " misses, ", shared_pipelines_.size(),
+                " unique pipelines live");
+}
+
+::VkPipeline VulkanApplication::FindSharedPipeline(
+    const containers::vector<uint8_t>& key) {
+  std::lock_guard<std::mutex> lock(shared_pipelines_mutex_);
+  auto it = shared_pipelines_.find(key);
+  if (it == shared_pipelines_.end()) {
+    ++shared_pipeline_misses_;
+    return VK_NULL_HANDLE;
   }
+  ++shared_pipeline_hits_;
+  ++shared_pipeline_references_.find(it->second)->second.count;
+  return it->second;
+}
+
+::VkPipeline VulkanApplication::AddSharedPipeline(
+    const containers::vector<uint8_t>& key, ::VkPipeline pipeline) {
+  std::lock_guard<std::mutex> lock(shared_pipelines_mutex_);
+  auto inserted = shared_pipelines_.insert(std::make_pair(key, pipeline));
+  if (!inserted.second) {
+    device_->vkDestroyPipeline(device_, pipeline,
+                               device_.allocation_callbacks());
+    pipeline = inserted.first->second;
+    ++shared_pipeline_references_.find(pipeline)->second.count;
+    return pipeline;
+  }
+  shared_pipeline_references_.insert(std::make_pair(
+      pipeline, SharedPipelineReferences{1, &inserted.first->first}));
+  return pipeline;
+}
+
+void VulkanApplication::ReleaseSharedPipeline(::VkPipeline pipeline) {
+  std::lock_guard<std::mutex> lock(shared_pipelines_mutex_);
+  auto it = shared_pipeline_references_.find(pipeline);
+  LOG_ASSERT(==, log_, false, it == shared_pipeline_references_.end());
+  if (--it->second.count != 0) {
+    return;
+  }
+  shared_pipelines_.erase(shared_pipelines_.find(*it->second.key));
+  shared_pipeline_references_.erase(it);
+  device_->vkDestroyPipeline(device_, pipeline,
+                             device_.allocation_callbacks());
+}
+
+::VkShaderModule VulkanApplication::AcquireShaderModule(const uint32_t* code,
+                                                        size_t code_size) {
+  VkShaderModuleCreateInfo create_info{
+      VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,  // sType
+      nullptr,                                      // pNext
+      0,                                            // flags
+      code_size,                                    // codeSize
+      code                                          // pCode
+  };
+  return AcquireShaderModule(create_info);
+}
+
+::VkShaderModule VulkanApplication::AcquireShaderModule(
+    const VkShaderModuleCreateInfo& create_info) {
+  // The structures in a pNext chain cannot be compared, so modules that are
+  // created with one are never shared. They are keyed by their own handle
+  // rather than by their code, behind a different first byte.
+  const bool shareable = create_info.pNext == nullptr;
+  containers::vector<uint8_t> key(allocator_);
+  if (shareable) {
+    AppendToKey(&key, static_cast<uint8_t>(0), create_info.flags);
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(create_info.pCode);
+    key.insert(key.end(), bytes, bytes + create_info.codeSize);
+    std::lock_guard<std::mutex> lock(shader_modules_mutex_);
+    auto it = shader_modules_.find(key);
+    if (it != shader_modules_.end()) {
+      ++shader_module_hits_;
+      shader_module_saved_microseconds_ += it->second.creation_microseconds;
+      ++it->second.references;
+      return it->second.module;
+    }
+  }
+
+  // Do not hold the lock while the driver parses the module, so that other
+  // threads can still use the cache.
+  auto start = std::chrono::high_resolution_clock::now();
+  ::VkShaderModule module;
+  LOG_ASSERT(==, log_, VK_SUCCESS,
+             device_->vkCreateShaderModule(device_, &create_info,
+                                           device_.allocation_callbacks(),
+                                           &module));
+  if (!shareable) {
+    AppendToKey(&key, static_cast<uint8_t>(1), module);
+  }
+  const uint64_t microseconds =
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::high_resolution_clock::now() - start)
+          .count();
+
+  std::lock_guard<std::mutex> lock(shader_modules_mutex_);
+  shader_module_creation_microseconds_ += microseconds;
+  auto inserted = shader_modules_.insert(
+      std::make_pair(std::move(key),
+                     SharedShaderModuleEntry{module, 1, microseconds}));
+  if (!inserted.second) {
+    // Another thread created the same module in the meantime.
+    device_->vkDestroyShaderModule(device_, module,
+                                   device_.allocation_callbacks());
+    ++shader_module_hits_;
+    ++inserted.first->second.references;
+    return inserted.first->second.module;
+  }
+  ++shader_module_misses_;
+  shader_module_keys_.insert(std::make_pair(module, &inserted.first->first));
+  return module;
+}
+
+void VulkanApplication::ReleaseShaderModule(::VkShaderModule module) {
+  std::lock_guard<std::mutex> lock(shader_modules_mutex_);
+  auto key = shader_module_keys_.find(module);
+  LOG_ASSERT(==, log_, false, key == shader_module_keys_.end());
+  auto it = shader_modules_.find(*key->second);
+  if (--it->second.references != 0) {
+    return;
+  }
+  shader_module_keys_.erase(key);
+  shader_modules_.erase(it);
+  device_->vkDestroyShaderModule(device_, module,
+                                 device_.allocation_callbacks());
+}
+
+::VkRenderPass VulkanApplication::GetCachedRenderPass(
+    std::initializer_list<VkAttachmentDescription> attachments,
+    std::initializer_list<VkSubpassDescription> subpasses,
+    std::initializer_list<VkSubpassDependency> dependencies) {
+  containers::vector<uint8_t> key(allocator_);
+  AppendArrayToKey(&key, attachments.begin(), attachments.size());
+  AppendToKey(&key, static_cast<uint32_t>(subpasses.size()));
+  for (const VkSubpassDescription& subpass : subpasses) {
+    AppendToKey(&key, subpass.flags, subpass.pipelineBindPoint);
+    AppendArrayToKey(&key, subpass.pInputAttachments,
+                     subpass.inputAttachmentCount);
+    AppendArrayToKey(&key, subpass.pColorAttachments,
+                     subpass.colorAttachmentCount);
+    AppendArrayToKey(&key, subpass.pResolveAttachments,
+                     subpass.pResolveAttachments
+                         ? subpass.colorAttachmentCount
+                         : 0);
+    AppendArrayToKey(&key, subpass.pDepthStencilAttachment,
+                     subpass.pDepthStencilAttachment ? 1 : 0);
+    AppendArrayToKey(&key, subpass.pPreserveAttachments,
+                     subpass.preserveAttachmentCount);
+  }
+  AppendArrayToKey(&key, dependencies.begin(), dependencies.size());
+
+  std::lock_guard<std::mutex> lock(render_pass_cache_mutex_);
+  auto it = render_pass_cache_.find(key);
+  if (it != render_pass_cache_.end()) {
+    ++render_pass_cache_hits_;
+    return it->second;
+  }
+  ++render_pass_cache_misses_;
+  it = render_pass_cache_
+           .insert(std::make_pair(
+               std::move(key),
+               CreateRenderPass(attachments, subpasses, dependencies)))
+           .first;
+  return it->second;
+}
+
+::VkFramebuffer VulkanApplication::GetCachedFramebuffer(
+    ::VkRenderPass render_pass, std::initializer_list<::VkImageView> views,
+    uint32_t width, uint32_t height, uint32_t layers) {
+  containers::vector<uint8_t> key(allocator_);
+  AppendToKey(&key, render_pass, width, height, layers);
+  AppendArrayToKey(&key, views.begin(), views.size());
+
+  std::lock_guard<std::mutex> lock(render_pass_cache_mutex_);
+  auto it = framebuffer_cache_.find(key);
+  if (it != framebuffer_cache_.end()) {
+    ++framebuffer_cache_hits_;
+    return it->second.framebuffer;
+  }
+  ++framebuffer_cache_misses_;
+  containers::vector<::VkImageView> attachments(views, allocator_);
+  VkFramebufferCreateInfo create_info{
+      VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,           // sType
+      nullptr,                                             // pNext
+      0,                                                   // flags
+      render_pass,                                         // renderPass
+      static_cast<uint32_t>(attachments.size()),           // attachmentCount
+      attachments.size() ? attachments.data() : nullptr,  // pAttachments
+      width,                                               // width
+      height,                                              // height
+      layers                                               // layers
+  };
+  ::VkFramebuffer raw_framebuffer;
+  LOG_ASSERT(==, log_, VK_SUCCESS,
+             device_->vkCreateFramebuffer(device_, &create_info,
+                                          device_.allocation_callbacks(),
+                                          &raw_framebuffer));
+  it = framebuffer_cache_
+           .insert(std::make_pair(
+               std::move(key),
+               CachedFramebuffer{
+                   std::move(attachments),
+                   VkFramebuffer(raw_framebuffer,
+                                 device_.allocation_callbacks(), &device_)}))
+           .first;
+  return it->second.framebuffer;
+}
+
+void VulkanApplication::EvictFramebuffers(::VkImageView view) {
+  std::lock_guard<std::mutex> lock(render_pass_cache_mutex_);
+  for (auto it = framebuffer_cache_.begin(); it != framebuffer_cache_.end();) {
+    const auto& views = it->second.views;
+    if (std::find(views.begin(), views.end(), view) != views.end()) {
+      it = framebuffer_cache_.erase(it);
+      ++framebuffer_cache_evictions_;
+    } else {
+      ++it;
+    }
+  }
+}
+
+void VulkanApplication::RecordRenderPassCompatibility(
+    ::VkRenderPass render_pass, const VkRenderPassCreateInfo& create_info) {
+  containers::vector<uint8_t> key(allocator_);
+  AppendRenderPassToKey(&key, create_info);
+  std::lock_guard<std::mutex> lock(render_pass_compatibility_mutex_);
+  // A render pass that had the same handle must have been destroyed.
+  render_pass_compatibility_keys_[render_pass] = std::move(key);
+}
+
+void VulkanApplication::AppendRenderPassCompatibilityKey(
+    ::VkRenderPass render_pass, containers::vector<uint8_t>* key) {
+  std::lock_guard<std::mutex> lock(render_pass_compatibility_mutex_);
+  auto it = render_pass_compatibility_keys_.find(render_pass);
+  LOG_ASSERT(==, log_, false, it == render_pass_compatibility_keys_.end());
+  AppendArrayToKey(key, it->second);
+}
+
+void VulkanApplication::LogRenderPassCacheStatistics() {
+  std::lock_guard<std::mutex> lock(render_pass_cache_mutex_);
+  log_->LogInfo("Render pass cache: ", render_pass_cache_hits_, " hits, ",
+                render_pass_cache_misses_, " misses");
+  log_->LogInfo("Framebuffer cache: ", framebuffer_cache_hits_, " hits, ",
+                framebuffer_cache_misses_, " misses, ",
+                framebuffer_cache_evictions_, " evictions");
+}
+
+::VkDescriptorSetLayout VulkanApplication::GetCachedDescriptorSetLayout(
+    std::initializer_list<VkDescriptorSetLayoutBinding> bindings) {
+  containers::vector<uint8_t> key(allocator_);
+  AppendToKey(&key, static_cast<uint32_t>(bindings.size()));
+  for (const VkDescriptorSetLayoutBinding& binding : bindings) {
+    AppendToKey(&key, binding.binding, binding.descriptorType,
+                binding.descriptorCount, binding.stageFlags);
+    AppendArrayToKey(&key, binding.pImmutableSamplers,
+                     binding.pImmutableSamplers ? binding.descriptorCount
+                                                : 0);
+  }
+
+  std::lock_guard<std::mutex> lock(descriptor_set_layout_cache_mutex_);
+  auto it = descriptor_set_layout_cache_.find(key);
+  if (it != descriptor_set_layout_cache_.end()) {
+    ++descriptor_set_layout_cache_hits_;
+    return it->second;
+  }
+  ++descriptor_set_layout_cache_misses_;
+  it = descriptor_set_layout_cache_
+           .insert(std::make_pair(
+               std::move(key),
+               CreateDescriptorSetLayout(allocator_, &device_, bindings)))
+           .first;
+  return it->second;
+}
+
+void VulkanApplication::LogDescriptorSetLayoutCacheStatistics() {
+  std::lock_guard<std::mutex> lock(descriptor_set_layout_cache_mutex_);
+  log_->LogInfo("Descriptor set layout cache: ",
+                descriptor_set_layout_cache_hits_, " hits, ",
+                descriptor_set_layout_cache_misses_, " misses");
+}
+
+bool VulkanApplication::HasDeviceExtension(const char* name) const {
+  for (const auto& extension : device_extensions_) {
+    if (extension == name) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void VulkanApplication::LogShaderModuleCacheStatistics() {
+  std::lock_guard<std::mutex> lock(shader_modules_mutex_);
+  log_->LogInfo("Shader module cache: ", shader_module_hits_, " hits, ",
+                shader_module_misses_, " misses, ",
+                shader_module_creation_microseconds_ / 1000.0f,
+                "ms spent creating shader modules, ",
+                shader_module_saved_microseconds_ / 1000.0f, "ms saved");
 }
 
 VkDevice VulkanApplication::CreateDevice(
     const std::initializer_list<const char*> extensions,
     const VkPhysicalDeviceFeatures& features, bool create_async_compute_queue,
-    bool use_sparse_binding) {
+    bool use_sparse_binding, bool create_transfer_queue,
+    const std::initializer_list<const char*> optional_extensions,
+    const VkPhysicalDeviceFeatures& optional_features) {
   // Since this is called by the constructor be careful not to
   // use any data other than what has already been initialized.
-  // allocator_, log_, entry_data_, library_wrapper_, instance_,
-  // surface_
+  // allocator_, log_, entry_data_, device_extensions_, enabled_features_,
+  // library_wrapper_, instance_, surface_
 
+  containers::vector<const char*> enabled_optional_extensions(
+      optional_extensions, allocator_);
+  VkPhysicalDeviceFeatures enabled_optional_features = optional_features;
   vulkan::VkDevice device(vulkan::CreateDeviceForSwapchain(
       allocator_, &instance_, &surface_, &render_queue_index_,
       &present_queue_index_, extensions, features,
       entry_data_->prefer_separate_present(),
       create_async_compute_queue ? &compute_queue_index_ : nullptr,
-      use_sparse_binding ? &sparse_binding_queue_index_ : nullptr));
+      use_sparse_binding ? &sparse_binding_queue_index_ : nullptr,
+      create_transfer_queue ? &transfer_queue_index_ : nullptr,
+      &enabled_optional_extensions, &enabled_optional_features));
   if (device.is_valid()) {
+    VkBool32* enabled = reinterpret_cast<VkBool32*>(&enabled_features_);
+    const VkBool32* optional =
+        reinterpret_cast<const VkBool32*>(&enabled_optional_features);
+    for (size_t i = 0;
+         i < sizeof(VkPhysicalDeviceFeatures) / sizeof(VkBool32); ++i) {
+      enabled[i] = enabled[i] || optional[i] ? VK_TRUE : VK_FALSE;
+    }
+    for (const char* extension : enabled_optional_extensions) {
+      device_extensions_.emplace_back(
+          extension, containers::StlCompatibleAllocator<char>(allocator_));
+    }
     if (render_queue_index_ == present_queue_index_) {
       render_queue_concrete_ = containers::make_unique<VkQueue>(
           allocator_, GetQueue(&device, render_queue_index_));
@@ -295,15 +871,277 @@ VkDevice VulkanApplication::CreateDevice(
       log_->LogInfo("### Got sparse binding queue: ",
                     sparse_binding_queue_->get_raw_object());
     }
+    if (create_transfer_queue) {
+      if (transfer_queue_index_ != 0xFFFFFFFF) {
+        // The family is never shared with another queue, so this is always
+        // its first queue.
+        transfer_queue_concrete_ = containers::make_unique<VkQueue>(
+            allocator_, GetQueue(&device, transfer_queue_index_, 0));
+        log_->LogInfo("Using transfer-only queue family ",
+                      transfer_queue_index_, " for copies");
+      } else {
+        log_->LogInfo(
+            "No transfer-only queue family, copies use the render queue");
+      }
+    }
+  }
+  return std::move(device);
+}
+
+VkDevice VulkanApplication::CreateComputeDevice(
+    const std::initializer_list<const char*> extensions,
+    const VkPhysicalDeviceFeatures& features) {
+  // Since this is called by the constructor be careful not to
+  // use any data other than what has already been initialized.
+  // allocator_, log_, entry_data_, library_wrapper_, instance_
+
+  vulkan::VkDevice device(vulkan::CreateComputeDevice(
+      allocator_, &instance_, &render_queue_index_, extensions, features));
+  if (device.is_valid()) {
+    present_queue_index_ = render_queue_index_;
+    render_queue_concrete_ = containers::make_unique<VkQueue>(
+        allocator_, GetQueue(&device, render_queue_index_));
+    render_queue_ = render_queue_concrete_.get();
+    present_queue_ = render_queue_concrete_.get();
   }
   return std::move(device);
 }
 
+VulkanArena* VulkanApplication::host_accessible_heap() {
+  std::lock_guard<std::mutex> lock(heap_creation_mutex_);
+  if (!host_accessible_heap_) {
+    host_accessible_heap_ = CreateBufferHeap(
+        host_buffer_size_,
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+  }
+  return host_accessible_heap_.get();
+}
+
+VulkanArena* VulkanApplication::coherent_heap() {
+  std::lock_guard<std::mutex> lock(heap_creation_mutex_);
+  if (!coherent_heap_) {
+    coherent_heap_ =
+        CreateBufferHeap(coherent_buffer_size_, kAllBufferBits,
+                         VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  }
+  return coherent_heap_.get();
+}
+
+VulkanArena* VulkanApplication::device_only_buffer_heap() {
+  std::lock_guard<std::mutex> lock(heap_creation_mutex_);
+  if (!device_only_buffer_heap_) {
+    // With unified memory, the device buffers are mapped as well, so that
+    // their data can be written in place rather than copied from staging
+    // memory.
+    const bool unified = unified_memory();
+    device_only_buffer_heap_ = CreateBufferHeap(
+        device_buffer_size_, kAllBufferBits,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        unified ? VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+                : 0);
+    if (unified) {
+      log_->LogInfo("Unified memory: device buffers are host-visible");
+    }
+  }
+  return device_only_buffer_heap_.get();
+}
+
+VulkanArena* VulkanApplication::device_only_image_heap() {
+  std::lock_guard<std::mutex> lock(heap_creation_mutex_);
+  if (!device_only_image_heap_) {
+    device_only_image_heap_ = CreateImageHeap(device_image_size_);
+  }
+  return device_only_image_heap_.get();
+}
+
+UploadManager* VulkanApplication::upload_manager() {
+  if (!upload_manager_) {
+    {
+      std::lock_guard<std::mutex> lock(heap_creation_mutex_);
+      // Coherent memory saves flushing every upload, and nothing ever reads
+      // the ring back, so it does not need to be cached.
+      staging_heap_ = CreateBufferHeap(
+          static_cast<uint32_t>(UploadManager::kDefaultStagingSize),
+          VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+              VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    }
+    // The ring is read by the copies recorded for the render queue, and by
+    // those that the manager makes on the transfer queue.
+    const uint32_t queue_families[] = {render_queue_index_,
+                                       transfer_queue_index_};
+    const bool shared = transfer_queue_concrete_ != nullptr;
+    VkBufferCreateInfo create_info{
+        VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,  // sType
+        nullptr,                               // pNext
+        0,                                     // flags
+        UploadManager::kDefaultStagingSize,    // size
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,      // usage
+        shared ? VK_SHARING_MODE_CONCURRENT
+               : VK_SHARING_MODE_EXCLUSIVE,  // sharingMode
+        shared ? 2u : 0u,                    // queueFamilyIndexCount
+        shared ? queue_families : nullptr    // pQueueFamilyIndices
+    };
+    upload_manager_ = containers::make_unique<UploadManager>(
+        allocator_, allocator_, this, render_queue_,
+        CreateAndBindBuffer(staging_heap_.get(), &create_info),
+        transfer_queue_concrete_.get());
+  }
+  return upload_manager_.get();
+}
+
+ReadbackManager* VulkanApplication::readback_manager() {
+  if (!readback_manager_) {
+    {
+      std::lock_guard<std::mutex> lock(heap_creation_mutex_);
+      // The host reads the ring, which is much faster from cached memory.
+      // It is invalidated instead of being coherent.
+      readback_heap_ = CreateBufferHeap(
+          static_cast<uint32_t>(ReadbackManager::kDefaultRingSize),
+          VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+          VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+    }
+    VkBufferCreateInfo create_info{
+        VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,  // sType
+        nullptr,                               // pNext
+        0,                                     // flags
+        ReadbackManager::kDefaultRingSize,     // size
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT,      // usage
+        VK_SHARING_MODE_EXCLUSIVE,             // sharingMode
+        0,                                     // queueFamilyIndexCount
+        nullptr                                // pQueueFamilyIndices
+    };
+    readback_manager_ = containers::make_unique<ReadbackManager>(
+        allocator_, allocator_, this, render_queue_,
+        CreateAndBindBuffer(readback_heap_.get(), &create_info));
+  }
+  return readback_manager_.get();
+}
+
+containers::unique_ptr<VulkanArena> VulkanApplication::CreateBufferHeap(
+    uint32_t size, VkBufferUsageFlags usages,
+    VkMemoryPropertyFlags property_flags,
+    VkMemoryPropertyFlags preferred_flags) {
+  // Relevant spec sections for determining what memory we will be allowed
+  // to use for our buffer allocations.
+  //  The memoryTypeBits member is identical for all VkBuffer objects created
+  //  with the same value for the flags and usage members in the
+  //  VkBufferCreateInfo structure passed to vkCreateBuffer. Further, if
+  //  usage1 and usage2 of type VkBufferUsageFlags are such that the bits set
+  //  in usage2 are a subset of the bits set in usage1, and they have the same
+  //  flags, then the bits set in memoryTypeBits returned for usage1 must be a
+  //  subset of the bits set in memoryTypeBits returned for usage2, for all
+  //  values of flags.
+
+  // Therefore we should be able to satisfy all buffer requests for non
+  // sparse memory bindings if we do the following:
+  // For our host visible bits, we will use:
+  // VK_BUFFER_USAGE_TRANSFER_SRC_BIT
+  // VK_BUFFER_USAGE_TRANSFER_DST_BIT
+  // For our device buffers we will use ALL bits.
+  // This means we can use this memory for everything.
+  // Furthermore for both types, we will have ZERO flags
+  // set (we do not want to do sparse binding.)
+
+  // 1) Create a tiny buffer so that we can determine what memory flags are
+  // required.
+  VkBufferCreateInfo create_info = {
+      VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,  // sType
+      nullptr,                               // pNext
+      0,                                     // flags
+      1,                                     // size
+      usages,                                // usage
+      VK_SHARING_MODE_EXCLUSIVE,             // sharingMode
+      0,                                     // queueFamilyIndexCount
+      nullptr,                               //  pQueueFamilyIndices
+  };
+  ::VkBuffer buffer;
+  LOG_ASSERT(==, log_,
+             device_->vkCreateBuffer(device_, &create_info,
+                                     device_.allocation_callbacks(), &buffer),
+             VK_SUCCESS);
+  // Get the memory requirements for this buffer.
+  VkMemoryRequirements requirements;
+  device_->vkGetBufferMemoryRequirements(device_, buffer, &requirements);
+  device_->vkDestroyBuffer(device_, buffer, device_.allocation_callbacks());
+
+  if (preferred_flags != 0) {
+    const VkPhysicalDeviceMemoryProperties& properties =
+        device_.physical_device_memory_properties();
+    const VkMemoryPropertyFlags flags = property_flags | preferred_flags;
+    for (uint32_t i = 0; i < properties.memoryTypeCount; ++i) {
+      if ((requirements.memoryTypeBits & (1u << i)) &&
+          (properties.memoryTypes[i].propertyFlags & flags) == flags) {
+        property_flags = flags;
+        break;
+      }
+    }
+  }
+  uint32_t memory_index = GetMemoryIndex(
+      &device_, log_, requirements.memoryTypeBits, property_flags);
+  return containers::make_unique<VulkanArena>(
+      allocator_, allocator_, log_, size, memory_index, &device_,
+      (property_flags & (VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                         VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) != 0);
+}
+
+containers::unique_ptr<VulkanArena> VulkanApplication::CreateImageHeap(
+    uint32_t size) {
+  // Same idea as for buffers, but for image memory.
+  // The relevant bits from the spec are:
+  //  The memoryTypeBits member is identical for all VkImage objects created
+  //  with the same combination of values for the tiling member and the
+  //  VK_IMAGE_CREATE_SPARSE_BINDING_BIT bit of the flags member and the
+  //  VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT of the usage member in the
+  //  VkImageCreateInfo structure passed to vkCreateImage.
+  VkImageCreateInfo image_create_info{
+      VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,  // sType
+      nullptr,                              // pNext
+      0,                                    // flags
+      VK_IMAGE_TYPE_2D,                     // imageType
+      VK_FORMAT_R8G8B8A8_UNORM,             // format
+      {
+          // extent
+          1,  // width
+          1,  // height
+          1,  // depth
+      },
+      1,                                    // mipLevels
+      1,                                    // arrayLayers
+      VK_SAMPLE_COUNT_1_BIT,                // samples
+      VK_IMAGE_TILING_OPTIMAL,              // tiling
+      VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,  // usage
+      VK_SHARING_MODE_EXCLUSIVE,            // sharingMode
+      0,                                    // queueFamilyIndexCount
+      nullptr,                              // pQueueFamilyIndices
+      VK_IMAGE_LAYOUT_UNDEFINED,            // initialLayout
+  };
+  ::VkImage image;
+  LOG_ASSERT(==, log_,
+             device_->vkCreateImage(device_, &image_create_info,
+                                    device_.allocation_callbacks(), &image),
+             VK_SUCCESS);
+  VkMemoryRequirements requirements;
+  device_->vkGetImageMemoryRequirements(device_, image, &requirements);
+  device_->vkDestroyImage(device_, image, device_.allocation_callbacks());
+
+  uint32_t memory_index =
+      GetMemoryIndex(&device_, log_, requirements.memoryTypeBits,
+                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  return containers::make_unique<VulkanArena>(allocator_, allocator_, log_,
+                                              size, memory_index, &device_,
+                                              false);
+}
+
 containers::unique_ptr<VulkanApplication::Image>
 VulkanApplication::CreateAndBindImage(const VkImageCreateInfo* create_info) {
   ::VkImage image;
   LOG_ASSERT(==, log_,
-             device_->vkCreateImage(device_, create_info, nullptr, &image),
+             device_->vkCreateImage(device_, create_info,
+                                    device_.allocation_callbacks(), &image),
              VK_SUCCESS);
   VkMemoryRequirements requirements;
   device_->vkGetImageMemoryRequirements(device_, image, &requirements);
@@ -311,7 +1149,7 @@ VulkanApplication::CreateAndBindImage(const VkImageCreateInfo* create_info) {
   ::VkDeviceMemory memory;
   ::VkDeviceSize offset;
 
-  AllocationToken* token = device_only_image_heap_->AllocateMemory(
+  AllocationToken* token = device_only_image_heap()->AllocateMemory(
       requirements.size, requirements.alignment, &memory, &offset, nullptr);
 
   device_->vkBindImageMemory(device_, image, memory, offset);
@@ -319,8 +1157,9 @@ VulkanApplication::CreateAndBindImage(const VkImageCreateInfo* create_info) {
   // We have to do it this way because Image is private and friended,
   // so we cannot go through make_unique.
   Image* img = new (allocator_->malloc(sizeof(Image)))
-      Image(device_only_image_heap_.get(), token,
-            VkImage(image, nullptr, &device_), create_info->format);
+      Image(device_only_image_heap(), token,
+            VkImage(image, device_.allocation_callbacks(), &device_),
+            create_info->format);
 
   return containers::unique_ptr<Image>(
       img, containers::UniqueDeleter(allocator_, sizeof(Image)));
@@ -334,7 +1173,8 @@ VulkanApplication::CreateAndBindSparseImage(
   LOG_ASSERT(==, log_, sparse_binding_queue_ != nullptr, true);
   ::VkImage image;
   LOG_ASSERT(==, log_,
-             device_->vkCreateImage(device_, create_info, nullptr, &image),
+             device_->vkCreateImage(device_, create_info,
+                                    device_.allocation_callbacks(), &image),
              VK_SUCCESS);
   VkMemoryRequirements requirements;
   device_->vkGetImageMemoryRequirements(device_, image, &requirements);
@@ -348,7 +1188,7 @@ VulkanApplication::CreateAndBindSparseImage(
   for (size_t i = 0; i < num_slice; i++) {
     ::VkDeviceMemory memory;
     ::VkDeviceSize offset;
-    AllocationToken* token = device_only_image_heap_->AllocateMemory(
+    AllocationToken* token = device_only_image_heap()->AllocateMemory(
         slice_size, requirements.alignment, &memory, &offset, nullptr);
     tokens.push_back(token);
     binds.emplace_back(
@@ -380,8 +1220,9 @@ VulkanApplication::CreateAndBindSparseImage(
   // We have to do it this way because Image is private and friended,
   // so we cannot go through make_unique.
   SparseImage* img = new (allocator_->malloc(sizeof(SparseImage)))
-      SparseImage(device_only_image_heap_.get(), std::move(tokens),
-                  VkImage(image, nullptr, &device_), create_info->format);
+      SparseImage(device_only_image_heap(), std::move(tokens),
+                  VkImage(image, device_.allocation_callbacks(), &device_),
+                  create_info->format);
 
   return containers::unique_ptr<SparseImage>(
       img, containers::UniqueDeleter(allocator_, sizeof(Image)));
@@ -402,12 +1243,14 @@ containers::unique_ptr<VkImageView> VulkanApplication::CreateImageView(
       subresource_range,
   };
   ::VkImageView raw_view;
-  LOG_ASSERT(
-      ==, log_,
-      device_->vkCreateImageView(device_, &create_info, nullptr, &raw_view),
-      VK_SUCCESS);
+  LOG_ASSERT(==, log_,
+             device_->vkCreateImageView(device_, &create_info,
+                                        device_.allocation_callbacks(),
+                                        &raw_view),
+             VK_SUCCESS);
   return containers::make_unique<vulkan::VkImageView>(
-      allocator_, VkImageView(raw_view, nullptr, &device_));
+      allocator_,
+      VkImageView(raw_view, device_.allocation_callbacks(), &device_));
 }
 
 containers::unique_ptr<VulkanApplication::Buffer>
@@ -415,7 +1258,8 @@ VulkanApplication::CreateAndBindBuffer(VulkanArena* heap,
                                        const VkBufferCreateInfo* create_info) {
   ::VkBuffer buffer;
   LOG_ASSERT(==, log_,
-             device_->vkCreateBuffer(device_, create_info, nullptr, &buffer),
+             device_->vkCreateBuffer(device_, create_info,
+                                     device_.allocation_callbacks(), &buffer),
              VK_SUCCESS);
   // Get the memory requirements for this buffer.
   VkMemoryRequirements requirements;
@@ -430,10 +1274,12 @@ VulkanApplication::CreateAndBindBuffer(VulkanArena* heap,
 
   device_->vkBindBufferMemory(device_, buffer, memory, offset);
 
-  Buffer* buff = new (allocator_->malloc(sizeof(Buffer))) Buffer(
-      heap, token, VkBuffer(buffer, nullptr, &device_), base_address, device_,
-      memory, offset, requirements.size, &(device_->vkFlushMappedMemoryRanges),
-      &(device_->vkInvalidateMappedMemoryRanges));
+  Buffer* buff = new (allocator_->malloc(sizeof(Buffer)))
+      Buffer(heap, token,
+             VkBuffer(buffer, device_.allocation_callbacks(), &device_),
+             base_address, device_, memory, offset, requirements.size,
+             &(device_->vkFlushMappedMemoryRanges),
+             &(device_->vkInvalidateMappedMemoryRanges));
   return containers::unique_ptr<Buffer>(
       buff, containers::UniqueDeleter(allocator_, sizeof(Buffer)));
 }
@@ -441,13 +1287,13 @@ VulkanApplication::CreateAndBindBuffer(VulkanArena* heap,
 containers::unique_ptr<VulkanApplication::Buffer>
 VulkanApplication::CreateAndBindHostBuffer(
     const VkBufferCreateInfo* create_info) {
-  return CreateAndBindBuffer(host_accessible_heap_.get(), create_info);
+  return CreateAndBindBuffer(host_accessible_heap(), create_info);
 }
 
 containers::unique_ptr<VulkanApplication::Buffer>
 VulkanApplication::CreateAndBindCoherentBuffer(
     const VkBufferCreateInfo* create_info) {
-  return CreateAndBindBuffer(coherent_heap_.get(), create_info);
+  return CreateAndBindBuffer(coherent_heap(), create_info);
 }
 
 containers::unique_ptr<VulkanApplication::Buffer>
@@ -485,7 +1331,7 @@ VulkanApplication::CreateAndBindDefaultExclusiveCoherentBuffer(
 containers::unique_ptr<VulkanApplication::Buffer>
 VulkanApplication::CreateAndBindDeviceBuffer(
     const VkBufferCreateInfo* create_info) {
-  return CreateAndBindBuffer(device_only_buffer_heap_.get(), create_info);
+  return CreateAndBindBuffer(device_only_buffer_heap(), create_info);
 }
 
 containers::unique_ptr<VulkanApplication::Buffer>
@@ -517,26 +1363,25 @@ containers::unique_ptr<VkBufferView> VulkanApplication::CreateBufferView(
       range,                                      // range
   };
   ::VkBufferView raw_view;
-  LOG_ASSERT(
-      ==, log_,
-      device_->vkCreateBufferView(device_, &create_info, nullptr, &raw_view),
-      VK_SUCCESS);
+  LOG_ASSERT(==, log_,
+             device_->vkCreateBufferView(device_, &create_info,
+                                         device_.allocation_callbacks(),
+                                         &raw_view),
+             VK_SUCCESS);
   return containers::make_unique<vulkan::VkBufferView>(
-      allocator_, VkBufferView(raw_view, nullptr, &device_));
+      allocator_,
+      VkBufferView(raw_view, device_.allocation_callbacks(), &device_));
 }
 
-std::tuple<bool, VkCommandBuffer, BufferPointer>
-VulkanApplication::FillImageLayersData(
+std::tuple<bool, VkCommandBuffer> VulkanApplication::FillImageLayersData(
     Image* img, const VkImageSubresourceLayers& image_subresource,
     const VkOffset3D& image_offset, const VkExtent3D& image_extent,
     VkImageLayout initial_img_layout, const containers::vector<uint8_t>& data,
     std::initializer_list<::VkSemaphore> wait_semaphores,
     std::initializer_list<::VkSemaphore> signal_semaphores, ::VkFence fence) {
   auto failure_return = std::make_tuple(
-      false,
-      VkCommandBuffer(static_cast<::VkCommandBuffer>(VK_NULL_HANDLE),
-                      &command_pool_, &device_),
-      BufferPointer(nullptr));
+      false, VkCommandBuffer(static_cast<::VkCommandBuffer>(VK_NULL_HANDLE),
+                             &command_pool_, &device_));
   if (!img) {
     log_->LogError("FillImageLayersData(): The given *img is nullptr");
     return failure_return;
@@ -554,83 +1399,32 @@ VulkanApplication::FillImageLayersData(
   containers::vector<VkPipelineStageFlags> wait_dst_stage_masks(
       waits.size(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, allocator_);
 
-  // Prepare the buffer to be used for data copying.
-  VkBufferCreateInfo buf_create_info{
-      VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-      nullptr,
-      0,
-      data.size(),
-      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-      VK_SHARING_MODE_EXCLUSIVE,
-      0,
-      nullptr,
-  };
-  BufferPointer src_buffer = CreateAndBindHostBuffer(&buf_create_info);
-  std::copy_n(data.begin(), data.size(), src_buffer->base_address());
-  src_buffer->flush();
+  // The data is copied into the staging ring, and the barriers that change
+  // the layout of the image and make the data in it available to every
+  // following command are recorded along with the copy.
+  UploadManager* uploads = upload_manager();
+  VkBufferImageCopy copy_info{
+      0, 0, 0, image_subresource, image_offset, image_extent};
+  uploads->UploadImage(*img, img->format(),
+                       {
+                           image_subresource.aspectMask,
+                           image_subresource.mipLevel,
+                           1,
+                           image_subresource.baseArrayLayer,
+                           image_subresource.layerCount,
+                       },
+                       initial_img_layout,
+                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, data.data(),
+                       data.size(), {copy_info}, kAllReadBits,
+                       VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
 
-  // Get a command buffer and add commands/barriers to it.
   VkCommandBuffer command_buffer = GetCommandBuffer();
   VkCommandBufferBeginInfo cmd_begin_info{
       VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, nullptr, 0, nullptr};
   command_buffer->vkBeginCommandBuffer(command_buffer, &cmd_begin_info);
-  // Add a buffer barrier so that the flushed memory becomes visible to the
-  // device.
-  VkBufferMemoryBarrier buffer_barrier{
-      VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-      nullptr,
-      VK_ACCESS_HOST_WRITE_BIT,
-      VK_ACCESS_TRANSFER_READ_BIT,
-      VK_QUEUE_FAMILY_IGNORED,
-      VK_QUEUE_FAMILY_IGNORED,
-      *src_buffer,
-      0,
-      data.size(),
-  };
-  // Add an image barrier to change the layout set its access bit to transfer
-  // write.
-  VkImageMemoryBarrier image_barrier{
-      VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-      nullptr,
-      0,  // Change to write access, no read-after-write risk.
-      VK_ACCESS_TRANSFER_WRITE_BIT,
-      initial_img_layout,
-      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-      VK_QUEUE_FAMILY_IGNORED,
-      VK_QUEUE_FAMILY_IGNORED,
-      *img,
-      // subresource range, only deal one mip level
-      {
-          image_subresource.aspectMask,
-          image_subresource.mipLevel,
-          1,
-          image_subresource.baseArrayLayer,
-          image_subresource.layerCount,
-      }};
-  command_buffer->vkCmdPipelineBarrier(
-      command_buffer, VK_PIPELINE_STAGE_HOST_BIT,
-      VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1, &buffer_barrier, 1,
-      &image_barrier);
-  // Copy data to the image.
-  VkBufferImageCopy copy_info{
-      0, 0, 0, image_subresource, image_offset, image_extent};
-  command_buffer->vkCmdCopyBufferToImage(command_buffer, *src_buffer, *img,
-                                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                                         1, &copy_info);
-  // Add a global barrier at the end to make sure the data written to the
-  // image is available globally.
-  VkMemoryBarrier end_barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr,
-                              VK_ACCESS_TRANSFER_WRITE_BIT, kAllReadBits};
-  command_buffer->vkCmdPipelineBarrier(
-      command_buffer,
-      VK_PIPELINE_STAGE_TRANSFER_BIT,     // The data in image is produced at
-                                          // 'trasfer' stage
-      VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,  // The data should be available at
-                                          // the
-                                          // very begining for following
-                                          // commands.
-      0, 1, &end_barrier, 0, nullptr, 0, nullptr);
-
+  // This does not Flush() the manager, since the command buffers that
+  // others have passed to Record() may not have been submitted yet.
+  ::VkFence upload_fence = uploads->RecordWithFence(&command_buffer);
   command_buffer->vkEndCommandBuffer(command_buffer);
   // Submit the command buffer.
   ::VkCommandBuffer raw_cmd_buf = command_buffer.get_command_buffer();
@@ -647,8 +1441,9 @@ VulkanApplication::FillImageLayersData(
       signals.size() == 0 ? nullptr : signals.data()    // pSignalSemaphores
   };
   (*render_queue_)->vkQueueSubmit(render_queue(), 1, &submit_info, fence);
-  return std::make_tuple(true, std::move(command_buffer),
-                         std::move(src_buffer));
+  // This only signals the fence that lets the staging space be reused.
+  (*render_queue_)->vkQueueSubmit(render_queue(), 0, nullptr, upload_fence);
+  return std::make_tuple(true, std::move(command_buffer));
 }
 
 const size_t MAX_UPDATE_SIZE = 65536;
@@ -747,37 +1542,25 @@ bool VulkanApplication::DumpImageLayersData(
     return false;
   }
 
-  data->reserve(image_size);
-  VkBufferCreateInfo buf_create_info = {
-      VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,  // sType
-      nullptr,                               // pNext
-      0,                                     // createFlags
-      image_size,                            // size
-      VK_BUFFER_USAGE_TRANSFER_DST_BIT,      // usage
-      VK_SHARING_MODE_EXCLUSIVE,             // sharingMode
-      0,                                     // queueFamilyIndexCount
-      nullptr                                // pQueueFamilyIndices
-  };
-  vulkan::BufferPointer dst_buffer = CreateAndBindHostBuffer(&buf_create_info);
+  // The data is copied into the readback manager's ring. Copies that others
+  // have queued on it go out on their own first, as they may not be
+  // allowed on the transfer queue.
+  ReadbackManager* readbacks = readback_manager();
+  if (readbacks->has_pending_readbacks()) {
+    readbacks->Flush();
+  }
 
-  // Get a command buffer and add commands/barriers to it.
-  VkCommandBuffer command_buffer = GetCommandBuffer();
+  // With a transfer queue, the render queue releases the image to it, the
+  // copy runs there, and the image is then handed back to the render queue,
+  // with a semaphore between each step.
+  VkQueue* transfer_queue = transfer_queue_concrete_.get();
+  const uint32_t render_family =
+      transfer_queue ? render_queue_index_ : VK_QUEUE_FAMILY_IGNORED;
+  const uint32_t copy_family =
+      transfer_queue ? transfer_queue_index_ : VK_QUEUE_FAMILY_IGNORED;
   VkCommandBufferBeginInfo cmd_begin_info{
       VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, nullptr, 0, nullptr};
-  command_buffer->vkBeginCommandBuffer(command_buffer, &cmd_begin_info);
 
-  // Add a buffer barrier to set the access bit to transfer write.
-  VkBufferMemoryBarrier buffer_barrier{
-      VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-      nullptr,
-      0,  // Change to write access, no read-after-write risk
-      VK_ACCESS_TRANSFER_WRITE_BIT,
-      VK_QUEUE_FAMILY_IGNORED,
-      VK_QUEUE_FAMILY_IGNORED,
-      *dst_buffer,
-      0,
-      data->size(),
-  };
   // Add an image barrier to change the layout and set its access bit to
   // transfer read.
   VkImageMemoryBarrier image_barrier{
@@ -787,8 +1570,8 @@ bool VulkanApplication::DumpImageLayersData(
       VK_ACCESS_TRANSFER_READ_BIT,
       initial_img_layout,
       VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-      VK_QUEUE_FAMILY_IGNORED,
-      VK_QUEUE_FAMILY_IGNORED,
+      render_family,
+      copy_family,
       *img,
       // subresource range, only deal with one mip level
       {
@@ -798,24 +1581,73 @@ bool VulkanApplication::DumpImageLayersData(
           image_subresource.baseArrayLayer,
           image_subresource.layerCount,
       }};
+
+  ::VkSemaphore to_transfer = VK_NULL_HANDLE;
+  ::VkSemaphore from_transfer = VK_NULL_HANDLE;
+  if (transfer_queue) {
+    VkCommandBuffer& release_buffer = *utility_command_buffers_.Get();
+    release_buffer->vkBeginCommandBuffer(release_buffer, &cmd_begin_info);
+    release_buffer->vkCmdPipelineBarrier(
+        release_buffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1,
+        &image_barrier);
+    release_buffer->vkEndCommandBuffer(release_buffer);
+    to_transfer = sync_object_pool_.AcquireSemaphore();
+    VkSubmitInfo release_info{
+        VK_STRUCTURE_TYPE_SUBMIT_INFO,           // sType
+        nullptr,                                 // pNext
+        uint32_t(waits.size()),                  // waitSemaphoreCount
+        waits.empty() ? nullptr : waits.data(),  // pWaitSemaphores
+        waits.empty() ? nullptr
+                      : wait_dst_stage_masks.data(),  // pWaitDstStageMask
+        1,                                            // commandBufferCount
+        &release_buffer.get_command_buffer(),         // pCommandBuffers
+        1,                                            // signalSemaphoreCount
+        &to_transfer                                  // pSignalSemaphores
+    };
+    LOG_ASSERT(==, log_, VK_SUCCESS,
+               (*render_queue_)
+                   ->vkQueueSubmit(render_queue(), 1, &release_info,
+                                   ::VkFence(VK_NULL_HANDLE)));
+    // The copy only has to wait for the release, which waited for the
+    // caller's semaphores.
+    waits.assign(1, to_transfer);
+    wait_dst_stage_masks.assign(1, VK_PIPELINE_STAGE_TRANSFER_BIT);
+  }
+
+  // Get a recycled command buffer and add commands/barriers to it.
+  VkCommandBuffer& command_buffer = transfer_queue
+                                        ? *transfer_command_buffers_->Get()
+                                        : *utility_command_buffers_.Get();
+  command_buffer->vkBeginCommandBuffer(command_buffer, &cmd_begin_info);
+
+  // On the transfer queue, the image barrier acquires the image. Either way
+  // it leaves the image in the layout that the copy reads it in.
   command_buffer->vkCmdPipelineBarrier(
       command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
-      VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1, &buffer_barrier, 1,
+      VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
       &image_barrier);
-  // Copy data from the image.
-  VkBufferImageCopy copy_info{
-      0, 0, 0, image_subresource, image_offset, image_extent};
-  command_buffer->vkCmdCopyImageToBuffer(command_buffer, *img,
-                                         VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                                         *dst_buffer, 1, &copy_info);
-
-  // Add a global barrier to make sure the data written to buffer is available
-  // globally.
-  VkMemoryBarrier end_barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr,
-                              VK_ACCESS_TRANSFER_WRITE_BIT, kAllReadBits};
-  command_buffer->vkCmdPipelineBarrier(
-      command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
-      VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &end_barrier, 0, nullptr, 0, nullptr);
+  // The manager's own barriers around the copy only wait for the one above,
+  // and make the copy visible to the host.
+  ReadbackManager::Ticket ticket = readbacks->ReadImage(
+      *img, img->format(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+      image_subresource, image_offset, image_extent, 0,
+      VK_PIPELINE_STAGE_TRANSFER_BIT);
+  readbacks->Record(&command_buffer);
+  if (transfer_queue) {
+    // The image was only read, so handing it back needs no memory
+    // dependency, and keeps it in the transfer source layout.
+    image_barrier.srcAccessMask = 0;
+    image_barrier.dstAccessMask = 0;
+    image_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    image_barrier.srcQueueFamilyIndex = copy_family;
+    image_barrier.dstQueueFamilyIndex = render_family;
+    command_buffer->vkCmdPipelineBarrier(
+        command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1,
+        &image_barrier);
+    from_transfer = sync_object_pool_.AcquireSemaphore();
+  }
   command_buffer->vkEndCommandBuffer(command_buffer);
   // Submit the command buffer.
   ::VkCommandBuffer raw_cmd_buf = command_buffer.get_command_buffer();
@@ -828,18 +1660,52 @@ bool VulkanApplication::DumpImageLayersData(
                         : wait_dst_stage_masks.data(),  // pWaitDstStageMask
       1,                                                // commandBufferCount
       &raw_cmd_buf,                                     // pCommandBuffers
-      0,                                                // signalSemaphoreCount
-      nullptr                                           // pSignalSemaphores
+      transfer_queue ? 1u : 0u,                         // signalSemaphoreCount
+      transfer_queue ? &from_transfer : nullptr         // pSignalSemaphores
   };
-  (*render_queue_)
-      ->vkQueueSubmit(render_queue(), 1, &submit_info,
-                      static_cast<::VkFence>(VK_NULL_HANDLE));
-  (*render_queue_)->vkQueueWaitIdle(render_queue());
-  // Copy the data from the buffer to |data|.
-  dst_buffer->invalidate();
-  std::for_each(dst_buffer->base_address(),
-                dst_buffer->base_address() + image_size,
-                [&data](uint8_t c) { data->push_back(c); });
+  if (transfer_queue) {
+    LOG_ASSERT(==, log_, VK_SUCCESS,
+               (*transfer_queue)
+                   ->vkQueueSubmit(*transfer_queue, 1, &submit_info,
+                                   ::VkFence(VK_NULL_HANDLE)));
+    // The render queue takes the image back before anything else that is
+    // submitted to it uses it, and the manager's fence covers both queues'
+    // work.
+    VkCommandBuffer& acquire_buffer = *utility_command_buffers_.Get();
+    acquire_buffer->vkBeginCommandBuffer(acquire_buffer, &cmd_begin_info);
+    acquire_buffer->vkCmdPipelineBarrier(
+        acquire_buffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1,
+        &image_barrier);
+    acquire_buffer->vkEndCommandBuffer(acquire_buffer);
+    const VkPipelineStageFlags acquire_stage =
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    submit_info.pWaitSemaphores = &from_transfer;
+    submit_info.pWaitDstStageMask = &acquire_stage;
+    submit_info.waitSemaphoreCount = 1;
+    submit_info.pCommandBuffers = &acquire_buffer.get_command_buffer();
+    submit_info.signalSemaphoreCount = 0;
+    submit_info.pSignalSemaphores = nullptr;
+  }
+  LOG_ASSERT(==, log_, VK_SUCCESS,
+             (*render_queue_)
+                 ->vkQueueSubmit(render_queue(), 1, &submit_info,
+                                 ::VkFence(VK_NULL_HANDLE)));
+  // This only submits the manager's fence, so that just this submission is
+  // waited for, rather than the whole queue going idle.
+  readbacks->Flush();
+  const size_t data_offset = data->size();
+  data->resize(data_offset + image_size);
+  readbacks->CopyTo(ticket, data->data() + data_offset);
+  readbacks->Release(ticket);
+  if (transfer_queue) {
+    sync_object_pool_.ReleaseSemaphore(to_transfer);
+    sync_object_pool_.ReleaseSemaphore(from_transfer);
+    transfer_command_buffers_->Advance(VK_NULL_HANDLE);
+  }
+  // The command buffers have completed, so they can be reused straight
+  // away.
+  utility_command_buffers_.Advance(VK_NULL_HANDLE);
   return true;
 }
 
@@ -867,7 +1733,7 @@ VulkanArena::VulkanArena(containers::Allocator* allocator, logging::Logger* log,
       base_address_(nullptr),
       device_(*device),
       unmap_memory_function_(nullptr),
-      memory_(VK_NULL_HANDLE, nullptr, device),
+      memory_(VK_NULL_HANDLE, device->allocation_callbacks(), device),
       log_(log) {
   // Actually allocate the bytes for this heap.
   VkMemoryAllocateInfo allocate_info{
@@ -901,7 +1767,8 @@ VulkanArena::VulkanArena(containers::Allocator* allocator, logging::Logger* log,
       allocate_info.allocationSize = buffer_size;
     }
 
-    res = (*device)->vkAllocateMemory(*device, &allocate_info, nullptr,
+    res = (*device)->vkAllocateMemory(*device, &allocate_info,
+                                      device->allocation_callbacks(),
                                       &device_memory);
     // If we cannot even allocate 1/4 of the requested memory, it is time to
     // fail.
@@ -957,6 +1824,7 @@ AllocationToken* VulkanArena::AllocateMemory(::VkDeviceSize size,
                                              ::VkDeviceMemory* memory,
                                              ::VkDeviceSize* offset,
                                              char** base_address) {
+  std::lock_guard<std::mutex> lock(mutex_);
   // If we are mapped memory, then no matter what alignment says, we
   // must also be aligned to kMaxNonCoherentAtomSize AND
   // for all intents and purposes our size must be a multiple of
@@ -1058,6 +1926,7 @@ AllocationToken* VulkanArena::AllocateMemory(::VkDeviceSize size,
 }
 
 void VulkanArena::FreeMemory(AllocationToken* token) {
+  std::lock_guard<std::mutex> lock(mutex_);
   bool atAll = false;
   // First try to coalesce this with its previous block.
   while (token->prev && !token->prev->in_use) {
@@ -1100,9 +1969,9 @@ void VulkanArena::FreeMemory(AllocationToken* token) {
 VulkanGraphicsPipeline::VulkanGraphicsPipeline(containers::Allocator* allocator,
                                                PipelineLayout* layout,
                                                VulkanApplication* application,
-                                               VkRenderPass* render_pass,
+                                               ::VkRenderPass render_pass,
                                                uint32_t subpass)
-    : render_pass_(*render_pass),
+    : render_pass_(render_pass),
       subpass_(subpass),
       application_(application),
       stages_(allocator),
@@ -1112,8 +1981,9 @@ VulkanGraphicsPipeline::VulkanGraphicsPipeline(containers::Allocator* allocator,
       shader_modules_(allocator),
       attachments_(allocator),
       layout_(*layout),
-      contained_stages_(0),
-      pipeline_(VK_NULL_HANDLE, nullptr, &application->device()) {
+      layout_key_(layout->compatibility_key()),
+      pending_state_key_(allocator),
+      contained_stages_(0) {
   MemoryClear(&vertex_input_state_);
   MemoryClear(&input_assembly_state_);
   MemoryClear(&tessellation_state_);
@@ -1188,20 +2058,8 @@ void VulkanGraphicsPipeline::AddShader(VkShaderStageFlagBits stage,
   LOG_ASSERT(==, application_->GetLogger(), stage,
              stage & VK_SHADER_STAGE_ALL_GRAPHICS);
   contained_stages_ |= stage;
-  VkShaderModuleCreateInfo create_info{
-      VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,  // sType
-      nullptr,                                      // pNext
-      0,                                            // flags
-      numCodeWords * 4,                             // codeSize
-      code                                          // pCode
-  };
-
-  ::VkShaderModule module;
-  LOG_ASSERT(==, application_->GetLogger(), VK_SUCCESS,
-             application_->device()->vkCreateShaderModule(
-                 application_->device(), &create_info, nullptr, &module));
-  shader_modules_.push_back(
-      VkShaderModule(module, nullptr, &application_->device()));
+  shader_modules_.push_back(SharedShaderModule(
+      application_, application_->AcquireShaderModule(code, numCodeWords * 4)));
 
   stages_.push_back({
       VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,  // sType
@@ -1283,7 +2141,13 @@ void VulkanGraphicsPipeline::SetInputStreams(VulkanModel* model) {
                          &vertex_attribute_descriptions_);
 }
 
-void VulkanGraphicsPipeline::Commit() {
+VulkanGraphicsPipeline::~VulkanGraphicsPipeline() {
+  if (pending_pipeline_.valid()) {
+    Wait();
+  }
+}
+
+VkGraphicsPipelineCreateInfo VulkanGraphicsPipeline::PrepareCreateInfo() {
   vertex_input_state_.vertexBindingDescriptionCount =
       static_cast<uint32_t>(vertex_binding_descriptions_.size());
   vertex_input_state_.pVertexBindingDescriptions =
@@ -1332,29 +2196,107 @@ void VulkanGraphicsPipeline::Commit() {
       VK_NULL_HANDLE,                                   // basePipelineHandle
       0                                                 // basePipelineIndex
   };
-  ::VkPipeline pipeline;
-  LOG_ASSERT(==, application_->GetLogger(), VK_SUCCESS,
-             application_->device()->vkCreateGraphicsPipelines(
-                 application_->device(), application_->pipeline_cache(), 1,
-                 &create_info, nullptr, &pipeline));
-  pipeline_.initialize(pipeline);
+  return create_info;
+}
+
+containers::vector<uint8_t> VulkanGraphicsPipeline::GetStateKey() {
+  containers::vector<uint8_t> key(application_->GetAllocator());
+  AppendToKey(&key, static_cast<uint32_t>(stages_.size()));
+  for (size_t i = 0; i < stages_.size(); ++i) {
+    // The shader module cache only has one module for each SPIR-V binary,
+    // and the module is not destroyed while this pipeline uses it.
+    AppendToKey(&key, stages_[i].stage, stages_[i].module);
+    const char* name = stages_[i].pName;
+    key.insert(key.end(), name, name + strlen(name) + 1);
+  }
+  AppendArrayToKey(&key, vertex_binding_descriptions_);
+  AppendArrayToKey(&key, vertex_attribute_descriptions_);
+  AppendToKey(&key, input_assembly_state_.topology,
+              input_assembly_state_.primitiveRestartEnable,
+              tessellation_state_.patchControlPoints);
+  AppendToKey(&key, viewport_, scissor_);
+  const VkPipelineRasterizationStateCreateInfo& raster = rasterization_state_;
+  AppendToKey(&key, raster.flags, raster.depthClampEnable,
+              raster.rasterizerDiscardEnable, raster.polygonMode,
+              raster.cullMode, raster.frontFace, raster.depthBiasEnable,
+              raster.depthBiasConstantFactor, raster.depthBiasClamp,
+              raster.depthBiasSlopeFactor, raster.lineWidth);
+  const VkPipelineMultisampleStateCreateInfo& multisample = multisample_state_;
+  AppendToKey(&key, multisample.rasterizationSamples,
+              multisample.sampleShadingEnable, multisample.minSampleShading,
+              multisample.alphaToCoverageEnable,
+              multisample.alphaToOneEnable);
+  AppendArrayToKey(&key, multisample.pSampleMask,
+                   multisample.pSampleMask
+                       ? (multisample.rasterizationSamples + 31) / 32
+                       : 0);
+  const VkPipelineDepthStencilStateCreateInfo& depth = depth_stencil_state_;
+  AppendToKey(&key, depth.flags, depth.depthTestEnable,
+              depth.depthWriteEnable, depth.depthCompareOp,
+              depth.depthBoundsTestEnable, depth.stencilTestEnable,
+              depth.front, depth.back, depth.minDepthBounds,
+              depth.maxDepthBounds);
+  AppendToKey(&key, color_blend_state_.logicOpEnable,
+              color_blend_state_.logicOp, color_blend_state_.blendConstants);
+  AppendArrayToKey(&key, attachments_);
+  AppendArrayToKey(&key, dynamic_states_);
+  // The handles of the layout and the render pass may be reused once they
+  // are destroyed, so they are described by what their compatibility with
+  // other layouts and render passes depends on instead.
+  AppendArrayToKey(&key, layout_key_);
+  application_->AppendRenderPassCompatibilityKey(render_pass_, &key);
+  AppendToKey(&key, subpass_);
+  return key;
+}
+
+void VulkanGraphicsPipeline::Commit() {
+  containers::vector<uint8_t> key = GetStateKey();
+  ::VkPipeline pipeline = application_->FindSharedPipeline(key);
+  if (pipeline == VK_NULL_HANDLE) {
+    VkGraphicsPipelineCreateInfo create_info = PrepareCreateInfo();
+    LOG_ASSERT(
+        ==, application_->GetLogger(), VK_SUCCESS,
+        application_->CreateGraphicsPipelines(1, &create_info, &pipeline));
+    pipeline = application_->AddSharedPipeline(key, pipeline);
+  }
+  pipeline_ = SharedPipeline(application_, pipeline);
+}
+
+void VulkanGraphicsPipeline::Commit(PipelineBuildQueue* queue) {
+  pending_state_key_ = GetStateKey();
+  ::VkPipeline pipeline = application_->FindSharedPipeline(pending_state_key_);
+  if (pipeline != VK_NULL_HANDLE) {
+    pipeline_ = SharedPipeline(application_, pipeline);
+    return;
+  }
+  pending_pipeline_ = queue->Add(PrepareCreateInfo());
+}
+
+void VulkanGraphicsPipeline::Wait() {
+  if (!pending_pipeline_.valid()) {
+    return;
+  }
+  ::VkPipeline pipeline = pending_pipeline_.get();
+  pending_pipeline_ = std::shared_future<::VkPipeline>();
+  LOG_ASSERT(!=, application_->GetLogger(),
+             static_cast<::VkPipeline>(VK_NULL_HANDLE), pipeline);
+  pipeline_ = SharedPipeline(
+      application_,
+      application_->AddSharedPipeline(pending_state_key_, pipeline));
 }
 
 VulkanComputePipeline::VulkanComputePipeline(
     containers::Allocator* allocator, PipelineLayout* layout,
     VulkanApplication* application,
     const VkShaderModuleCreateInfo& shader_module_create_info,
-    const char* shader_entry, const VkSpecializationInfo* specialization_info)
+    const char* shader_entry, const VkSpecializationInfo* specialization_info,
+    PipelineBuildQueue* build_queue)
     : application_(application),
-      pipeline_(VK_NULL_HANDLE, nullptr, &application->device()),
-      shader_module_(VK_NULL_HANDLE, nullptr, &application->device()),
+      pipeline_(VK_NULL_HANDLE, application->device().allocation_callbacks(),
+                &application->device()),
+      shader_module_(application, application->AcquireShaderModule(
+                                      shader_module_create_info)),
       layout_(*layout) {
-  ::VkShaderModule raw_module;
-  LOG_ASSERT(==, application_->GetLogger(), VK_SUCCESS,
-             application_->device()->vkCreateShaderModule(
-                 application_->device(), &shader_module_create_info, nullptr,
-                 &raw_module));
-  shader_module_.initialize(raw_module);
   VkPipelineShaderStageCreateInfo shader_stage_create_info{
       VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,  // sType
       nullptr,                                              // pNext
@@ -1375,11 +2317,31 @@ VulkanComputePipeline::VulkanComputePipeline(
       0,                                               // basePipelineIndex
   };
 
+  if (build_queue) {
+    pending_pipeline_ = build_queue->Add(pipeline_create_info);
+    return;
+  }
   ::VkPipeline pipeline;
   LOG_ASSERT(==, application_->GetLogger(), VK_SUCCESS,
-             application_->device()->vkCreateComputePipelines(
-                 application_->device(), application_->pipeline_cache(), 1,
-                 &pipeline_create_info, nullptr, &pipeline));
+             application_->CreateComputePipelines(1, &pipeline_create_info,
+                                                  &pipeline));
+  pipeline_.initialize(pipeline);
+}
+
+VulkanComputePipeline::~VulkanComputePipeline() {
+  if (pending_pipeline_.valid()) {
+    Wait();
+  }
+}
+
+void VulkanComputePipeline::Wait() {
+  if (!pending_pipeline_.valid()) {
+    return;
+  }
+  ::VkPipeline pipeline = pending_pipeline_.get();
+  pending_pipeline_ = std::shared_future<::VkPipeline>();
+  LOG_ASSERT(!=, application_->GetLogger(),
+             static_cast<::VkPipeline>(VK_NULL_HANDLE), pipeline);
   pipeline_.initialize(pipeline);
 }
 
@@ -18,10 +18,17 @@
 
 #include "support/containers/allocator.h"
 #include "support/containers/ordered_multimap.h"
+#include "support/containers/string.h"
+#include "support/containers/unordered_map.h"
 #include "support/containers/vector.h"
 #include "support/entry/entry.h"
 #include "support/log/log.h"
+#include "vulkan_helpers/allocation_callbacks.h"
+#include "vulkan_helpers/command_buffer_ring.h"
+#include "vulkan_helpers/descriptor_allocator.h"
+#include "vulkan_helpers/descriptor_writer.h"
 #include "vulkan_helpers/helper_functions.h"
+#include "vulkan_helpers/sync_object_pool.h"
 #include "vulkan_wrapper/command_buffer_wrapper.h"
 #include "vulkan_wrapper/device_wrapper.h"
 #include "vulkan_wrapper/instance_wrapper.h"
@@ -30,14 +37,22 @@
 #include "vulkan_wrapper/sub_objects.h"
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <mutex>
 
 namespace vulkan {
 struct VulkanModel;
 struct AllocationToken;
+class PipelineBuildQueue;
+class ReadbackManager;
+class UploadManager;
 
 // This class represents a location in GPU memory for storing data.
 // You can suballocate memory from this region, and return memory to the
 // arena for future use.
+// Memory may be allocated and freed from multiple threads at once.
 class VulkanArena {
  public:
   // If map==true then the memory for this Arena is mapped to a host-visible
@@ -61,6 +76,8 @@ class VulkanArena {
 
  private:
   containers::Allocator* allocator_;
+  // Guards freeblocks_ and the list of blocks starting at first_block_.
+  std::mutex mutex_;
   containers::ordered_multimap<::VkDeviceSize, AllocationToken*> freeblocks_;
   AllocationToken* first_block_;
   char* base_address_;
@@ -73,7 +90,68 @@ class VulkanArena {
 class VulkanApplication;
 class PipelineLayout;
 
+// Hashes the byte strings used as keys by the object caches of
+// VulkanApplication.
+struct ByteKeyHash {
+  size_t operator()(const containers::vector<uint8_t>& key) const;
+};
+
+// SharedPipeline holds one reference to a pipeline owned by the
+// VulkanApplication's pipeline state cache, and releases it when destroyed.
+class SharedPipeline {
+ public:
+  SharedPipeline() : application_(nullptr), pipeline_(VK_NULL_HANDLE) {}
+  // Takes over a reference returned by VulkanApplication::FindSharedPipeline
+  // or VulkanApplication::AddSharedPipeline.
+  SharedPipeline(VulkanApplication* application, ::VkPipeline pipeline)
+      : application_(application), pipeline_(pipeline) {}
+  SharedPipeline(SharedPipeline&& other)
+      : application_(other.application_), pipeline_(other.pipeline_) {
+    other.pipeline_ = VK_NULL_HANDLE;
+  }
+  SharedPipeline& operator=(SharedPipeline&& other);
+  SharedPipeline(const SharedPipeline&) = delete;
+  SharedPipeline& operator=(const SharedPipeline&) = delete;
+  ~SharedPipeline() { reset(); }
+
+  operator ::VkPipeline() const { return pipeline_; }
+
+ private:
+  void reset();
+
+  VulkanApplication* application_;
+  ::VkPipeline pipeline_;
+};
+
+// SharedShaderModule holds one reference to a shader module owned by the
+// VulkanApplication's shader module cache, and releases it when destroyed.
+class SharedShaderModule {
+ public:
+  SharedShaderModule() : application_(nullptr), module_(VK_NULL_HANDLE) {}
+  // Takes over a reference returned by VulkanApplication::AcquireShaderModule.
+  SharedShaderModule(VulkanApplication* application, ::VkShaderModule module)
+      : application_(application), module_(module) {}
+  SharedShaderModule(SharedShaderModule&& other)
+      : application_(other.application_), module_(other.module_) {
+    other.module_ = VK_NULL_HANDLE;
+  }
+  SharedShaderModule& operator=(SharedShaderModule&& other);
+  SharedShaderModule(const SharedShaderModule&) = delete;
+  SharedShaderModule& operator=(const SharedShaderModule&) = delete;
+  ~SharedShaderModule() { reset(); }
+
+  operator ::VkShaderModule() const { return module_; }
+
+ private:
+  void reset();
+
+  VulkanApplication* application_;
+  ::VkShaderModule module_;
+};
+
 // Customizable Graphics pipeline state.
+// Pipelines with identical state share a single VkPipeline, see
+// VulkanApplication::FindSharedPipeline.
 // Defaults to the following properties:
 //    Dynamic Viewport & Scissor
 //    POLYGON_MODE_FILL
@@ -96,7 +174,7 @@ class VulkanGraphicsPipeline {
 
   VulkanGraphicsPipeline(containers::Allocator* allocator,
                          PipelineLayout* layout, VulkanApplication* application,
-                         VkRenderPass* render_pass, uint32_t subpass);
+                         ::VkRenderPass render_pass, uint32_t subpass);
   VulkanGraphicsPipeline(containers::Allocator* allocator)
       : stages_(allocator),
         dynamic_states_(allocator),
@@ -104,9 +182,13 @@ class VulkanGraphicsPipeline {
         vertex_attribute_descriptions_(allocator),
         shader_modules_(allocator),
         attachments_(allocator),
-        pipeline_(VK_NULL_HANDLE, nullptr, nullptr) {}
+        layout_key_(allocator),
+        pending_state_key_(allocator) {}
 
   VulkanGraphicsPipeline(VulkanGraphicsPipeline&& other) = default;
+  // Waits for the pipeline if it is still being built by a
+  // PipelineBuildQueue.
+  ~VulkanGraphicsPipeline();
 
   template <int N>
   void AddShader(VkShaderStageFlagBits stage, const char* entry,
@@ -154,10 +236,26 @@ class VulkanGraphicsPipeline {
     return depth_stencil_state_;
   }
 
+  // Creates the pipeline from the current state.
   void Commit();
+  // Queues the creation of the pipeline on the given build queue instead.
+  // Wait() must be called before the pipeline is used, and the pipeline must
+  // neither be modified nor moved until then, since the build queue reads
+  // its state while compiling.
+  void Commit(PipelineBuildQueue* queue);
+  // Blocks until a pipeline queued with Commit(queue) has been created.
+  // Does nothing if the pipeline has already been created.
+  void Wait();
   operator ::VkPipeline() const { return pipeline_; }
 
  private:
+  // Points the create info structures at the current state, and returns the
+  // VkGraphicsPipelineCreateInfo that uses them.
+  VkGraphicsPipelineCreateInfo PrepareCreateInfo();
+  // Returns the bytes of all of the state that affects the created
+  // pipeline.
+  containers::vector<uint8_t> GetStateKey();
+
   ::VkRenderPass render_pass_;
   uint32_t subpass_;
   VulkanApplication* application_;
@@ -178,35 +276,58 @@ class VulkanGraphicsPipeline {
       vertex_binding_descriptions_;
   containers::vector<VkVertexInputAttributeDescription>
       vertex_attribute_descriptions_;
-  containers::vector<VkShaderModule> shader_modules_;
+  containers::vector<SharedShaderModule> shader_modules_;
   containers::vector<VkPipelineColorBlendAttachmentState> attachments_;
   ::VkPipelineLayout layout_;
-  VkPipeline pipeline_;
+  // The compatibility key of layout_, see PipelineLayout.
+  containers::vector<uint8_t> layout_key_;
+  SharedPipeline pipeline_;
+  // Set while the pipeline is being built by a PipelineBuildQueue.
+  std::shared_future<::VkPipeline> pending_pipeline_;
+  // The state key of the pipeline that is being built.
+  containers::vector<uint8_t> pending_state_key_;
   uint32_t contained_stages_;
 };
 
 // Customizable Compute pipeline state.
 class VulkanComputePipeline {
  public:
+  // If build_queue is not nullptr, the pipeline is queued on it rather than
+  // created immediately, and Wait() must be called before it is used.
+  // In that case shader_entry and specialization_info must remain valid until
+  // Wait() returns.
   VulkanComputePipeline(
       containers::Allocator* allocator, PipelineLayout* layout,
       VulkanApplication* application,
       const VkShaderModuleCreateInfo& shader_module_create_info,
       const char* shader_entry,
-      const VkSpecializationInfo* specialization_info = nullptr);
+      const VkSpecializationInfo* specialization_info = nullptr,
+      PipelineBuildQueue* build_queue = nullptr);
   VulkanComputePipeline(VulkanComputePipeline&& other) = default;
+  // Waits for the pipeline if it is still being built by a
+  // PipelineBuildQueue.
+  ~VulkanComputePipeline();
 
+  // Blocks until a pipeline queued on a PipelineBuildQueue has been created.
+  // Does nothing if the pipeline has already been created.
+  void Wait();
   operator ::VkPipeline() const { return pipeline_; }
 
  private:
   VulkanApplication* application_;
   VkPipeline pipeline_;
-  VkShaderModule shader_module_;
+  // Set while the pipeline is being built by a PipelineBuildQueue.
+  std::shared_future<::VkPipeline> pending_pipeline_;
+  SharedShaderModule shader_module_;
   ::VkPipelineLayout layout_;
 };
 
 // PipelineLayout holds a VkPipelineLayout object as well as as set of
-// VkDescriptorSetLayout objects used to create that pipeline layout.
+// VkDescriptorSetLayout objects used to create that pipeline layout. The
+// descriptor set layouts come from the application's layout cache.
+// The layout may also contain push constant ranges, which are the cheapest
+// way to pass small amounts of per-draw data to the shaders, see
+// VkCommandBuffer::PushConstants.
 class PipelineLayout {
  public:
   PipelineLayout(PipelineLayout&& other) = default;
@@ -215,72 +336,54 @@ class PipelineLayout {
   operator VkPipelineLayout&() { return pipeline_layout_; }
   operator ::VkPipelineLayout() const { return pipeline_layout_; }
 
+  // Returns bytes that are equal for two layouts exactly when the layouts
+  // are compatible, since they have the same set layouts and push constant
+  // ranges.
+  const containers::vector<uint8_t>& compatibility_key() const {
+    return compatibility_key_;
+  }
+
  private:
-  // TODO(awoloszyn): Handle push constants here too
   PipelineLayout(
-      containers::Allocator* allocator, VkDevice* device,
+      containers::Allocator* allocator, VulkanApplication* application,
       std::initializer_list<std::initializer_list<VkDescriptorSetLayoutBinding>>
-          layouts)
-      : pipeline_layout_(VK_NULL_HANDLE, nullptr, device),
-        descriptor_set_layouts_(allocator) {
-    containers::vector<::VkDescriptorSetLayout> raw_layouts(allocator);
-    raw_layouts.reserve(layouts.size());
-
-    descriptor_set_layouts_.reserve(layouts.size());
-    for (auto binding_list : layouts) {
-      descriptor_set_layouts_.emplace_back(
-          CreateDescriptorSetLayout(allocator, device, binding_list));
-      raw_layouts.push_back(descriptor_set_layouts_.back());
-    }
-    VkPipelineLayoutCreateInfo create_info = {
-        VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,  // sType
-        nullptr,                                        // pNext
-        0,                                              // flags
-        static_cast<uint32_t>(raw_layouts.size()),      // setLayoutCount
-        raw_layouts.data(),                             // pSetLayouts
-        0,        // pushConstantRangeCount
-        nullptr,  // pPushConstantRanges
-    };
-
-    ::VkPipelineLayout layout;
-    LOG_ASSERT(==, device->GetLogger(), VK_SUCCESS,
-               (*device)->vkCreatePipelineLayout(*device, &create_info, nullptr,
-                                                 &layout));
-    pipeline_layout_.initialize(layout);
-  }
+          layouts,
+      std::initializer_list<VkPushConstantRange> push_constant_ranges);
   friend class VulkanApplication;
-  containers::vector<VkDescriptorSetLayout> descriptor_set_layouts_;
+  // Owned by the application's descriptor set layout cache.
+  containers::vector<::VkDescriptorSetLayout> descriptor_set_layouts_;
+  containers::vector<uint8_t> compatibility_key_;
   VkPipelineLayout pipeline_layout_;
 };
 
-// DescriptorSet holds a VkDescriptorSet object and the pool and layout used for
-// allocating it.
+// DescriptorSet holds a VkDescriptorSet object and the layout used for
+// allocating it. The set comes from one of the shared pools of a
+// DescriptorAllocator, and is returned to it when the DescriptorSet is
+// destroyed.
 class DescriptorSet {
  public:
+  DescriptorSet(DescriptorSet&& other);
+  ~DescriptorSet();
+
   operator ::VkDescriptorSet() const { return set_; }
 
-  const ::VkDescriptorSet& raw_set() const { return set_.get_raw_object(); }
-  ::VkDescriptorPool pool() const { return pool_.get_raw_object(); }
-  ::VkDescriptorSetLayout layout() const { return layout_.get_raw_object(); }
+  const ::VkDescriptorSet& raw_set() const { return set_; }
+  ::VkDescriptorPool pool() const { return pool_; }
+  ::VkDescriptorSetLayout layout() const { return layout_; }
 
  private:
   friend class VulkanApplication;
 
-  static VkDescriptorPool CreateDescriptorPool(
-      containers::Allocator* allocator, VkDevice* device,
-      std::initializer_list<VkDescriptorSetLayoutBinding> bindings);
-
   // Creates a descriptor set with one descriptor according to the given
-  // |binding|.
-  DescriptorSet(containers::Allocator* allocator, VkDevice* device,
+  // |binding|, allocated from the application's DescriptorAllocator.
+  DescriptorSet(VulkanApplication* application,
                 std::initializer_list<VkDescriptorSetLayoutBinding> bindings);
 
-  // Pools is designed to amortize the cost of descriptor set allocation.
-  // But here we create a dedicated pool for each descriptor set. It suffers
-  // for performance, but is easy to write.
-  VkDescriptorPool pool_;
-  VkDescriptorSetLayout layout_;
-  VkDescriptorSet set_;
+  DescriptorAllocator* descriptor_allocator_;
+  // Owned by the application's descriptor set layout cache.
+  ::VkDescriptorSetLayout layout_;
+  ::VkDescriptorPool pool_;
+  ::VkDescriptorSet set_;
 };
 
 // VulkanApplication holds all of the data needed for a typical single-threaded
@@ -420,22 +523,52 @@ class VulkanApplication {
         invalidate_memory_range_;
   };
 
+  // Selects the compute-only constructor below.
+  struct ComputeOnly {};
+
   // On creation creates an instance, device, surface, swapchain, queues,
   // and command pool for the application.
-  // It also creates 3 memory arenas with the given sizes.
+  // It also sets up 4 memory arenas with the given sizes. Each arena is
+  // only allocated the first time it is used.
   //  One for host-visible buffers.
+  //  One for host-coherent buffers.
   //  One for device-only-accessible buffers.
   //  One for device-only images.
+  // The swapchain prefers present_mode and swapchain_image_count, as
+  // described for CreateDefaultSwapchain.
+  // If use_transfer_queue is true, and the device has a transfer-only queue
+  // family, a queue is also created from it for transfer_queue().
+  // The device is created with every one of the optional_extensions that it
+  // supports, see HasDeviceExtension, and likewise with every one of the
+  // optional_features, see enabled_features().
+  VulkanApplication(
+      containers::Allocator* allocator, logging::Logger* log,
+      const entry::EntryData* entry_data,
+      const std::initializer_list<const char*> extensions = {},
+      const VkPhysicalDeviceFeatures& features = {0},
+      uint32_t host_buffer_size = 1024 * 128,
+      uint32_t device_image_size = 1024 * 128,
+      uint32_t device_buffer_size = 1024 * 128,
+      uint32_t coherent_buffer_size = 1024 * 128,
+      bool use_async_compute_queue = false, bool use_sparse_binding = false,
+      VkPresentModeKHR present_mode = VK_PRESENT_MODE_MAX_ENUM_KHR,
+      uint32_t swapchain_image_count = 0, bool use_transfer_queue = false,
+      const std::initializer_list<const char*> optional_extensions = {},
+      const VkPhysicalDeviceFeatures& optional_features = {0});
+  // Creates an application that never presents. No surface or swapchain is
+  // created, the instance and device are created without WSI extensions, and
+  // the device is created with a single queue from the queue family best
+  // suited to compute work. render_queue() and present_queue() both return
+  // that queue, and swapchain_images() is empty.
   VulkanApplication(containers::Allocator* allocator, logging::Logger* log,
-                    const entry::EntryData* entry_data,
+                    const entry::EntryData* entry_data, ComputeOnly,
                     const std::initializer_list<const char*> extensions = {},
                     const VkPhysicalDeviceFeatures& features = {0},
                     uint32_t host_buffer_size = 1024 * 128,
                     uint32_t device_image_size = 1024 * 128,
                     uint32_t device_buffer_size = 1024 * 128,
-                    uint32_t coherent_buffer_size = 1024 * 128,
-                    bool use_async_compute_queue = false,
-                    bool use_sparse_binding = false);
+                    uint32_t coherent_buffer_size = 1024 * 128);
+  ~VulkanApplication();
 
   // Creates an image from the given create_info, and binds memory from the
   // device-only image Arena.
@@ -470,7 +603,10 @@ class VulkanApplication {
   containers::unique_ptr<Buffer> CreateAndBindDefaultExclusiveCoherentBuffer(
       VkDeviceSize size, VkBufferUsageFlags usages);
   // Creates a buffer from the given create_info, and binds memory from the
-  // device-only-accessible buffer Arena.
+  // device-only-accessible buffer Arena. With unified_memory(), the arena is
+  // usually host-coherent and mapped too, in which case the buffer has a
+  // base_address() that its data can be written to directly, instead of
+  // being staged.
   containers::unique_ptr<Buffer> CreateAndBindDeviceBuffer(
       const VkBufferCreateInfo* create_info);
   // Creates a buffer with the given size, usage flags from the device-only
@@ -494,15 +630,32 @@ class VulkanApplication {
   // VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL. If the operation can not be done
   // successfully, this method returns false and a command buffer wrapping
   // VK_NULL_HANDLE, the layout of the image will not be changed.
-  std::tuple<bool, VkCommandBuffer,
-             containers::unique_ptr<VulkanApplication::Buffer>>
-  FillImageLayersData(
+  // The data is staged through upload_manager(), whose ring space is
+  // reclaimed by a fence of its own, so this does not Flush() the manager.
+  std::tuple<bool, VkCommandBuffer> FillImageLayersData(
       Image* img, const VkImageSubresourceLayers& image_subresource,
       const VkOffset3D& image_offset, const VkExtent3D& image_extent,
       VkImageLayout initial_img_layout, const containers::vector<uint8_t>& data,
       std::initializer_list<::VkSemaphore> wait_semaphores,
       std::initializer_list<::VkSemaphore> signal_semaphores, ::VkFence fence);
 
+  // Returns the manager through which data is uploaded from the host to
+  // buffers and images used on the render queue, creating it and its
+  // staging ring the first time it is requested. The copies that it makes
+  // itself run on transfer_queue() if there is one. It must only be used
+  // from one thread at a time.
+  UploadManager* upload_manager();
+
+  // Returns the manager through which data is read back from buffers and
+  // images used on the render queue, without waiting for the queue to go
+  // idle, creating it and its host-cached ring the first time it is
+  // requested. It must only be used from one thread at a time.
+  ReadbackManager* readback_manager();
+
+  // Returns true if the device's main device-local memory is also
+  // host-visible and coherent, as on integrated and mobile GPUs.
+  bool unified_memory() const { return HasUnifiedMemory(device_); }
+
   // Fills a small buffer with the given data.
   // This inserts a series of calls to vkCmdUpdateBuffer into the given
   // command_buffer, so it is
@@ -528,6 +681,10 @@ class VulkanApplication {
   // returns true and changes the source image layout to
   // VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL if the operation is done
   // successfully, otherwise returns false and keeps the layout unchanged.
+  // If there is a transfer_queue(), the copy runs there, and the image is
+  // handed over to it and back from the render queue around the copy. The
+  // data is read back through readback_manager(), and only this copy is
+  // waited for.
   bool DumpImageLayersData(
       Image* img, const VkImageSubresourceLayers& image_subresource,
       const VkOffset3D& image_offset, const VkExtent3D& image_extent,
@@ -626,49 +783,136 @@ class VulkanApplication {
   // queue, present queue or, if applicable, the compute queue.
   VkQueue& sparse_binding_queue() { return *sparse_binding_queue_; }
 
+  // Returns the queue from a transfer-only queue family, whose copies run
+  // alongside the work on the other queues.
+  // If this application was not configured with a transfer queue, or the
+  // device has no such queue family, returns nullptr, and copies should be
+  // made on the render queue instead.
+  VkQueue* transfer_queue() { return transfer_queue_concrete_.get(); }
+
   // Returns the device that was created for this application.
   VkDevice& device() { return device_; }
   VkInstance& instance() { return instance_; }
 
+  // The pipeline cache is loaded from entry_data->pipeline_cache_file() when
+  // the application is created, and saved back to it when it is destroyed.
   VkPipelineCache& pipeline_cache() { return pipeline_cache_; }
 
+  // Creates |count| pipelines from the given create infos through the
+  // application's pipeline cache, and records how long it took.
+  VkResult CreateGraphicsPipelines(
+      uint32_t count, const VkGraphicsPipelineCreateInfo* create_infos,
+      ::VkPipeline* pipelines);
+  VkResult CreateComputePipelines(
+      uint32_t count, const VkComputePipelineCreateInfo* create_infos,
+      ::VkPipeline* pipelines);
+
+  // Logs how many pipelines were created, how long it took, and how much
+  // the pipeline cache grew since it was created.
+  void LogPipelineCacheStatistics();
+
+  // The pipeline state cache lets pipelines with identical state share a
+  // single VkPipeline. The state key holds the bytes of every piece of
+  // state that went into the pipeline.
+  // Returns a new reference to the pipeline that was added with the given
+  // state key, or VK_NULL_HANDLE if there is none.
+  ::VkPipeline FindSharedPipeline(const containers::vector<uint8_t>& key);
+  // Adds a newly created pipeline to the pipeline state cache, and returns a
+  // reference to it. If another thread added a pipeline with the same key in
+  // the meantime, the given pipeline is destroyed and a reference to the
+  // other one is returned instead.
+  ::VkPipeline AddSharedPipeline(const containers::vector<uint8_t>& key,
+                                 ::VkPipeline pipeline);
+  // Releases a reference returned by FindSharedPipeline or AddSharedPipeline.
+  // The pipeline is destroyed along with its last reference.
+  void ReleaseSharedPipeline(::VkPipeline pipeline);
+
   logging::Logger* GetLogger() { return log_; }
 
-  // Creates and returns a shader module from the given spirv code.
+  // Returns a shader module for the given spirv code from the shader module
+  // cache.
   template <int size>
-  VkShaderModule CreateShaderModule(uint32_t (&vals)[size]) {
-    VkShaderModuleCreateInfo create_info{
-        VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,  // sType
-        nullptr,                                      // pNext
-        0,                                            // flags
-        4 * size,                                     // codeSize
-        vals                                          // pCode
-    };
-    ::VkShaderModule module;
-    LOG_ASSERT(
-        ==, log_, VK_SUCCESS,
-        device_->vkCreateShaderModule(device_, &create_info, nullptr, &module));
-    return VkShaderModule(module, nullptr, &device_);
+  SharedShaderModule CreateShaderModule(uint32_t (&vals)[size]) {
+    return SharedShaderModule(this, AcquireShaderModule(vals, 4 * size));
   }
 
+  // The shader module cache lets every user of the same SPIR-V share a
+  // single VkShaderModule, so that the driver only parses it once.
+  // Returns a new reference to the module for the given code, creating the
+  // module if it does not exist yet.
+  ::VkShaderModule AcquireShaderModule(const uint32_t* code, size_t code_size);
+  // The same, for a module with the flags of create_info. If create_info has
+  // a pNext chain, a new module is always created with it, and not shared.
+  ::VkShaderModule AcquireShaderModule(
+      const VkShaderModuleCreateInfo& create_info);
+  // Releases a reference returned by AcquireShaderModule. The module is
+  // destroyed along with its last reference.
+  void ReleaseShaderModule(::VkShaderModule module);
+  // Logs how often the shader module cache was hit, and how much time was
+  // spent creating shader modules and saved by reusing them.
+  void LogShaderModuleCacheStatistics();
+
   // Returns true if the Present queue is not the same as the present queue.
   bool HasSeparatePresentQueue() const {
     return present_queue_ != render_queue_;
   }
 
+  // Returns true if this application was created without a surface and
+  // swapchain.
+  bool is_compute_only() const { return compute_only_; }
+
   // Creates and returns a PipelineLayout from the given
   // DescriptorSetLayoutBindings
   PipelineLayout CreatePipelineLayout(
       std::initializer_list<std::initializer_list<VkDescriptorSetLayoutBinding>>
-          layouts) {
-    return PipelineLayout(allocator_, &device_, layouts);
+          layouts,
+      std::initializer_list<VkPushConstantRange> push_constant_ranges = {}) {
+    return PipelineLayout(allocator_, this, layouts, push_constant_ranges);
   }
 
   // Allocates a descriptor set with one descriptor according to the given
   // |binding|.
+  // The set is allocated from the application's shared descriptor pools.
   DescriptorSet AllocateDescriptorSet(
       std::initializer_list<VkDescriptorSetLayoutBinding> bindings) {
-    return DescriptorSet(allocator_, &device_, bindings);
+    return DescriptorSet(this, bindings);
+  }
+
+  // Returns the allocator that backs AllocateDescriptorSet.
+  DescriptorAllocator* descriptor_allocator() { return &descriptor_allocator_; }
+
+  // Returns the pool of recycled semaphores and fences. Code that needs
+  // a semaphore or fence for every frame should take them from here, rather
+  // than creating new ones.
+  SyncObjectPool* sync_object_pool() { return &sync_object_pool_; }
+
+  // Returns the descriptor set layout for the given bindings, creating it if
+  // no identical layout has been requested before. The layout is owned by
+  // the application, and lives as long as it does.
+  ::VkDescriptorSetLayout GetCachedDescriptorSetLayout(
+      std::initializer_list<VkDescriptorSetLayoutBinding> bindings);
+
+  // Logs the hit rate of the descriptor set layout cache.
+  void LogDescriptorSetLayoutCacheStatistics();
+
+  // Creates an update template for sets with the given layout. It uses
+  // VK_KHR_descriptor_update_template if the device was created with it.
+  containers::unique_ptr<DescriptorUpdateTemplate>
+  CreateDescriptorUpdateTemplate(
+      ::VkDescriptorSetLayout layout,
+      std::initializer_list<VkDescriptorUpdateTemplateEntryKHR> entries) {
+    return containers::make_unique<DescriptorUpdateTemplate>(
+        allocator_, allocator_, &device_,
+        HasDeviceExtension(VK_KHR_DESCRIPTOR_UPDATE_TEMPLATE_EXTENSION_NAME),
+        layout, entries);
+  }
+
+  // Returns true if the device was created with the given extension.
+  bool HasDeviceExtension(const char* name) const;
+  // Returns the features that the device was created with, including the
+  // optional ones that it supports.
+  const VkPhysicalDeviceFeatures& enabled_features() const {
+    return enabled_features_;
   }
 
   VkSwapchainKHR& swapchain() { return swapchain_; }
@@ -677,7 +921,9 @@ class VulkanApplication {
     return swapchain_images_;
   }
   // Creates a render pass, from the given VkAttachmentDescriptions,
-  // VkSubpassDescriptions, and VkSubpassDependencies
+  // VkSubpassDescriptions, and VkSubpassDependencies.
+  // Only render passes created here, or by GetCachedRenderPass, may be used
+  // with a VulkanGraphicsPipeline.
   VkRenderPass CreateRenderPass(
       std::initializer_list<VkAttachmentDescription> attachments,
       std::initializer_list<VkSubpassDescription> subpasses,
@@ -703,14 +949,57 @@ class VulkanApplication {
 
     ::VkRenderPass render_pass;
     LOG_ASSERT(==, log_, VK_SUCCESS,
-               device_->vkCreateRenderPass(device_, &create_info, nullptr,
+               device_->vkCreateRenderPass(device_, &create_info,
+                                           device_.allocation_callbacks(),
                                            &render_pass));
-    return vulkan::VkRenderPass(render_pass, nullptr, &device_);
+    RecordRenderPassCompatibility(render_pass, create_info);
+    return vulkan::VkRenderPass(render_pass, device_.allocation_callbacks(),
+                                &device_);
   }
 
+  // Returns a render pass from the render pass cache with the given
+  // VkAttachmentDescriptions, VkSubpassDescriptions, and
+  // VkSubpassDependencies, creating it if no identical render pass has been
+  // requested before. The render pass is owned by the application, and
+  // lives as long as it does.
+  ::VkRenderPass GetCachedRenderPass(
+      std::initializer_list<VkAttachmentDescription> attachments,
+      std::initializer_list<VkSubpassDescription> subpasses,
+      std::initializer_list<VkSubpassDependency> dependencies);
+
+  // Returns a framebuffer from the framebuffer cache for the given render
+  // pass, attachments and extent, creating it if necessary. This is cheap
+  // enough to be called every frame. The framebuffer is owned by the
+  // application, and lives until one of its attachments is passed to
+  // EvictFramebuffers, or until the application is destroyed.
+  ::VkFramebuffer GetCachedFramebuffer(
+      ::VkRenderPass render_pass, std::initializer_list<::VkImageView> views,
+      uint32_t width, uint32_t height, uint32_t layers = 1);
+
+  // Destroys every cached framebuffer that uses the given image view. This
+  // must be called before an image view that was passed to
+  // GetCachedFramebuffer is destroyed, so that a new view that reuses the
+  // handle never gets a stale framebuffer.
+  void EvictFramebuffers(::VkImageView view);
+
+  // Appends bytes that are equal for two render passes only if they are
+  // compatible to key. render_pass must have been created by
+  // CreateRenderPass.
+  void AppendRenderPassCompatibilityKey(::VkRenderPass render_pass,
+                                        containers::vector<uint8_t>* key);
+
+  // Logs the hit rates of the render pass and framebuffer caches.
+  void LogRenderPassCacheStatistics();
+
   VulkanGraphicsPipeline CreateGraphicsPipeline(PipelineLayout* layout,
                                                 VkRenderPass* render_pass,
                                                 uint32_t subpass_) {
+    return VulkanGraphicsPipeline(allocator_, layout, this, *render_pass,
+                                  subpass_);
+  }
+  VulkanGraphicsPipeline CreateGraphicsPipeline(PipelineLayout* layout,
+                                                ::VkRenderPass render_pass,
+                                                uint32_t subpass_) {
     return VulkanGraphicsPipeline(allocator_, layout, this, render_pass,
                                   subpass_);
   }
@@ -718,14 +1007,17 @@ class VulkanApplication {
   // Creates and returns a compute pipeline a shader module created from the
   // given shader module create info and shader stage created with the shader
   // model and the given shader entry point.
+  // If build_queue is not nullptr, the pipeline is built asynchronously,
+  // see VulkanComputePipeline.
   VulkanComputePipeline CreateComputePipeline(
       PipelineLayout* layout,
       const VkShaderModuleCreateInfo& shader_module_create_info,
       const char* shader_entry,
-      const VkSpecializationInfo* specialization_info = nullptr) {
+      const VkSpecializationInfo* specialization_info = nullptr,
+      PipelineBuildQueue* build_queue = nullptr) {
     return VulkanComputePipeline(allocator_, layout, this,
                                  shader_module_create_info, shader_entry,
-                                 specialization_info);
+                                 specialization_info, build_queue);
   }
 
   bool should_exit() const { return should_exit_.load(); }
@@ -746,24 +1038,90 @@ class VulkanApplication {
 
   containers::Allocator* GetAllocator() { return allocator_; }
 
+  // Returns the callbacks through which the driver allocates host memory
+  // from this application's allocator, along with their statistics.
+  AllocationCallbacks& allocation_callbacks() { return allocation_callbacks_; }
+
  private:
+  // Both public constructors delegate to this one.
+  VulkanApplication(containers::Allocator* allocator, logging::Logger* log,
+                    const entry::EntryData* entry_data, bool compute_only,
+                    const std::initializer_list<const char*> extensions,
+                    const VkPhysicalDeviceFeatures& features,
+                    uint32_t host_buffer_size, uint32_t device_image_size,
+                    uint32_t device_buffer_size, uint32_t coherent_buffer_size,
+                    bool use_async_compute_queue, bool use_sparse_binding,
+                    VkPresentModeKHR present_mode,
+                    uint32_t swapchain_image_count, bool use_transfer_queue,
+                    const std::initializer_list<const char*>
+                        optional_extensions,
+                    const VkPhysicalDeviceFeatures& optional_features);
+
   containers::unique_ptr<Buffer> CreateAndBindBuffer(
       VulkanArena* heap, const VkBufferCreateInfo* create_info);
 
   // Intended to be called by the constructor to create the device, since
-  // VkDevice does not have a default constructor.
-  VkDevice CreateDevice(const std::initializer_list<const char*> extensions,
-                        const VkPhysicalDeviceFeatures& features,
-                        bool create_async_compute_queue,
-                        bool use_sparse_binding);
+  // VkDevice does not have a default constructor. The optional extensions
+  // that the device is created with are added to device_extensions_, and the
+  // optional features to enabled_features_.
+  VkDevice CreateDevice(
+      const std::initializer_list<const char*> extensions,
+      const VkPhysicalDeviceFeatures& features,
+      bool create_async_compute_queue, bool use_sparse_binding,
+      bool create_transfer_queue,
+      const std::initializer_list<const char*> optional_extensions,
+      const VkPhysicalDeviceFeatures& optional_features);
+
+  // Intended to be called by the compute-only constructor to create the
+  // device, which only has a single compute queue.
+  VkDevice CreateComputeDevice(
+      const std::initializer_list<const char*> extensions,
+      const VkPhysicalDeviceFeatures& features);
+
+  // Return the memory arenas, allocating them the first time they are
+  // requested.
+  VulkanArena* host_accessible_heap();
+  VulkanArena* coherent_heap();
+  VulkanArena* device_only_buffer_heap();
+  VulkanArena* device_only_image_heap();
+
+  // Creates an arena of the given size for buffers of the given usage, from
+  // the first memory type with the given property flags, and also with
+  // preferred_flags if there is such a type.
+  containers::unique_ptr<VulkanArena> CreateBufferHeap(
+      uint32_t size, VkBufferUsageFlags usages,
+      VkMemoryPropertyFlags property_flags,
+      VkMemoryPropertyFlags preferred_flags = 0);
+  // Creates an arena of the given size for optimally tiled images.
+  containers::unique_ptr<VulkanArena> CreateImageHeap(uint32_t size);
+
+  // Creates the pipeline cache, seeded with the contents of
+  // entry_data_->pipeline_cache_file() if it is valid for this device.
+  VkPipelineCache CreatePipelineCache();
+  // Returns the current size of the pipeline cache data in bytes.
+  size_t GetPipelineCacheSize();
+  // Remembers what the compatibility of render_pass, created from
+  // create_info, depends on, for AppendRenderPassCompatibilityKey.
+  void RecordRenderPassCompatibility(::VkRenderPass render_pass,
+                                     const VkRenderPassCreateInfo& create_info);
+  // Records the creation of |count| pipelines, which started at |start|.
+  void RecordPipelineCreation(
+      uint32_t count, std::chrono::high_resolution_clock::time_point start);
 
   containers::Allocator* allocator_;
   logging::Logger* log_;
   const entry::EntryData* entry_data_;
+  const std::chrono::high_resolution_clock::time_point construction_start_;
+  const bool compute_only_;
+  // The extensions the device was created with.
+  containers::vector<containers::string> device_extensions_;
+  // The features the device was created with.
+  VkPhysicalDeviceFeatures enabled_features_;
   containers::unique_ptr<VkQueue> render_queue_concrete_;
   containers::unique_ptr<VkQueue> present_queue_concrete_;
   containers::unique_ptr<VkQueue> sparse_binding_queue_concrete_;
   containers::unique_ptr<VkQueue> async_compute_queue_concrete_;
+  containers::unique_ptr<VkQueue> transfer_queue_concrete_;
   VkQueue* render_queue_;
   VkQueue* present_queue_;
   VkQueue* sparse_binding_queue_;
@@ -771,7 +1129,11 @@ class VulkanApplication {
   uint32_t present_queue_index_;
   uint32_t compute_queue_index_;
   uint32_t sparse_binding_queue_index_;
+  uint32_t transfer_queue_index_;
 
+  // This must outlive every Vulkan object created by the application. It
+  // logs its statistics when it is destroyed, after all of them.
+  AllocationCallbacks allocation_callbacks_;
   LibraryWrapper library_wrapper_;
   VkInstance instance_;
   VkSurfaceKHR surface_;
@@ -779,10 +1141,98 @@ class VulkanApplication {
   VkSwapchainKHR swapchain_;
   VkCommandPool command_pool_;
   VkPipelineCache pipeline_cache_;
+  // Every DescriptorSet is allocated from here.
+  DescriptorAllocator descriptor_allocator_;
+  SyncObjectPool sync_object_pool_;
+  // The command buffers used by helpers that wait for their own work, such
+  // as DumpImageLayersData.
+  CommandBufferRing utility_command_buffers_;
+  // The same, for the transfer queue, if there is one.
+  containers::unique_ptr<CommandBufferRing> transfer_command_buffers_;
+  // Statistics about the pipelines created through pipeline_cache_.
+  const size_t pipeline_cache_initial_size_;
+  std::atomic<uint32_t> pipelines_created_;
+  std::atomic<uint64_t> pipeline_creation_microseconds_;
+  // The pipeline state cache.
+  struct SharedPipelineReferences {
+    uint32_t count;
+    // Points at the key in shared_pipelines_.
+    const containers::vector<uint8_t>* key;
+  };
+  std::mutex shared_pipelines_mutex_;
+  containers::unordered_map<containers::vector<uint8_t>, ::VkPipeline,
+                            ByteKeyHash>
+      shared_pipelines_;
+  containers::unordered_map<::VkPipeline, SharedPipelineReferences>
+      shared_pipeline_references_;
+  uint32_t shared_pipeline_hits_;
+  uint32_t shared_pipeline_misses_;
+  // The shader module cache, keyed by the bytes of the SPIR-V.
+  struct SharedShaderModuleEntry {
+    ::VkShaderModule module;
+    uint32_t references;
+    // How long the driver took to create the module.
+    uint64_t creation_microseconds;
+  };
+  std::mutex shader_modules_mutex_;
+  containers::unordered_map<containers::vector<uint8_t>,
+                            SharedShaderModuleEntry, ByteKeyHash>
+      shader_modules_;
+  // Points at the keys in shader_modules_.
+  containers::unordered_map<::VkShaderModule,
+                            const containers::vector<uint8_t>*>
+      shader_module_keys_;
+  uint32_t shader_module_hits_;
+  uint32_t shader_module_misses_;
+  uint64_t shader_module_creation_microseconds_;
+  uint64_t shader_module_saved_microseconds_;
+  // The render pass and framebuffer caches, keyed by the bytes of their
+  // create infos.
+  struct CachedFramebuffer {
+    containers::vector<::VkImageView> views;
+    VkFramebuffer framebuffer;
+  };
+  std::mutex render_pass_cache_mutex_;
+  containers::unordered_map<containers::vector<uint8_t>, VkRenderPass,
+                            ByteKeyHash>
+      render_pass_cache_;
+  containers::unordered_map<containers::vector<uint8_t>, CachedFramebuffer,
+                            ByteKeyHash>
+      framebuffer_cache_;
+  uint32_t render_pass_cache_hits_;
+  uint32_t render_pass_cache_misses_;
+  uint32_t framebuffer_cache_hits_;
+  uint32_t framebuffer_cache_misses_;
+  uint32_t framebuffer_cache_evictions_;
+  // The compatibility keys of every render pass created by CreateRenderPass.
+  // They have a mutex of their own, as GetCachedRenderPass creates render
+  // passes while it holds render_pass_cache_mutex_.
+  std::mutex render_pass_compatibility_mutex_;
+  containers::unordered_map<::VkRenderPass, containers::vector<uint8_t>>
+      render_pass_compatibility_keys_;
+  // The descriptor set layout cache, keyed by the bytes of the bindings.
+  std::mutex descriptor_set_layout_cache_mutex_;
+  containers::unordered_map<containers::vector<uint8_t>, VkDescriptorSetLayout,
+                            ByteKeyHash>
+      descriptor_set_layout_cache_;
+  uint32_t descriptor_set_layout_cache_hits_;
+  uint32_t descriptor_set_layout_cache_misses_;
+  // Guards the lazy creation of the arenas below.
+  std::mutex heap_creation_mutex_;
+  const uint32_t host_buffer_size_;
+  const uint32_t coherent_buffer_size_;
+  const uint32_t device_buffer_size_;
+  const uint32_t device_image_size_;
   containers::unique_ptr<VulkanArena> host_accessible_heap_;
   containers::unique_ptr<VulkanArena> coherent_heap_;
   containers::unique_ptr<VulkanArena> device_only_image_heap_;
   containers::unique_ptr<VulkanArena> device_only_buffer_heap_;
+  // The memory of the upload manager's staging ring, which must outlive it.
+  containers::unique_ptr<VulkanArena> staging_heap_;
+  containers::unique_ptr<UploadManager> upload_manager_;
+  // The same, for the readback manager's ring.
+  containers::unique_ptr<VulkanArena> readback_heap_;
+  containers::unique_ptr<ReadbackManager> readback_manager_;
   containers::vector<::VkImage> swapchain_images_;
   std::atomic<bool> should_exit_;
 };
@@ -790,13 +1240,9 @@ class VulkanApplication {
 inline containers::vector<uint32_t> GetHostVisibleBufferData(
     containers::Allocator* allocator, vulkan::VulkanApplication::Buffer* buf) {
   buf->invalidate();
-  uint32_t* p = reinterpret_cast<uint32_t*>(buf->base_address());
-  containers::vector<uint32_t> data(allocator);
-  data.reserve(static_cast<size_t>(
-      buf->size() / static_cast<VkDeviceSize>(sizeof(uint32_t))));
-  std::for_each(p, p + buf->size() / sizeof(uint32_t),
-                [&data](uint32_t w) { data.push_back(w); });
-  return data;
+  const uint32_t* p = reinterpret_cast<const uint32_t*>(buf->base_address());
+  return containers::vector<uint32_t>(
+      p, p + static_cast<size_t>(buf->size() / sizeof(uint32_t)), allocator);
 }
 
 using BufferPointer = containers::unique_ptr<VulkanApplication::Buffer>;
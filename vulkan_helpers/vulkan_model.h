@@ -19,8 +19,10 @@
 #include "support/containers/allocator.h"
 #include "support/containers/vector.h"
 #include "support/log/log.h"
+#include "vulkan_helpers/upload_manager.h"
 #include "vulkan_helpers/vulkan_application.h"
 
+#include <cstring>
 #include <initializer_list>
 
 namespace vulkan {
@@ -70,12 +72,13 @@ struct VulkanModel {
       : VulkanModel(allocator, logger, t.num_vertices, t.positions, t.uv,
                     t.normals, t.num_indices, t.indices) {}
 
-  // Creates the vertex and index buffers. Adds transfer commands to
-  // CmdBuffer to populate the vertex and index buffers with data.
+  // Creates the vertex and index buffers. Stages their data through the
+  // application's upload manager, and records the copies into cmdBuffer,
+  // which must be submitted to the render queue, followed by a Flush() of
+  // the manager, as the sample framework does after initialization. If the
+  // buffers are mapped, as they are with unified memory, the data is written
+  // into them directly, and nothing is recorded.
   // If this model has already been initialized, then this re-initializes it.
-  // TODO(awoloszyn):
-  // Currently all uploads are done with vkCmdUpdateBuffer. If many large models
-  // are created, then switch to a staging + data buffer.
   void InitializeData(vulkan::VulkanApplication* application,
                       vulkan::VkCommandBuffer* cmdBuffer) {
     VkBufferCreateInfo create_info = {
@@ -89,9 +92,6 @@ struct VulkanModel {
         0,
         nullptr};
     vertexBuffer_ = application->CreateAndBindDeviceBuffer(&create_info);
-    application->FillSmallBuffer(
-        vertexBuffer_.get(), static_cast<const void*>(positions_),
-        vertex_data_size_, 0, cmdBuffer, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT);
 
     create_info.usage =
         VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
@@ -99,9 +99,22 @@ struct VulkanModel {
 
     indexBuffer_ = application->CreateAndBindDeviceBuffer(&create_info);
 
-    application->FillSmallBuffer(
-        indexBuffer_.get(), static_cast<const void*>(indices_),
-        index_data_size_, 0, cmdBuffer, VK_ACCESS_INDEX_READ_BIT);
+    // The memory is coherent, and the draws that read it are submitted
+    // after this, so the writes need neither a flush nor a barrier.
+    if (vertexBuffer_->base_address() && indexBuffer_->base_address()) {
+      memcpy(vertexBuffer_->base_address(), positions_, vertex_data_size_);
+      memcpy(indexBuffer_->base_address(), indices_, index_data_size_);
+      return;
+    }
+
+    UploadManager* uploads = application->upload_manager();
+    uploads->UploadBuffer(*vertexBuffer_, 0, positions_, vertex_data_size_,
+                          VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
+                          VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+    uploads->UploadBuffer(*indexBuffer_, 0, indices_, index_data_size_,
+                          VK_ACCESS_INDEX_READ_BIT,
+                          VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+    uploads->Record(cmdBuffer);
   }
 
   // Releases all resources held by this model.
@@ -162,10 +175,17 @@ struct VulkanModel {
   // command-buffer. This binds the vertex and index buffers, and issues
   // the draw call.
   void Draw(vulkan::VkCommandBuffer* cmdBuffer) {
-    ::VkBuffer buffers[3] = {*vertexBuffer_, *vertexBuffer_, *vertexBuffer_};
+    DrawWithVertexBuffer(cmdBuffer, *vertexBuffer_, 0);
+  }
+
+  // Draws this model like Draw(), but with the vertex data at offset in
+  // vertex_buffer, which must be laid out like vertex_data().
+  void DrawWithVertexBuffer(vulkan::VkCommandBuffer* cmdBuffer,
+                            ::VkBuffer vertex_buffer, ::VkDeviceSize offset) {
+    ::VkBuffer buffers[3] = {vertex_buffer, vertex_buffer, vertex_buffer};
     ::VkDeviceSize offsets[3] = {
-        0, num_vertices_ * POSITION_SIZE,
-        num_vertices_ * (POSITION_SIZE + TEXCOORD_SIZE)};
+        offset, offset + num_vertices_ * POSITION_SIZE,
+        offset + num_vertices_ * (POSITION_SIZE + TEXCOORD_SIZE)};
     (*cmdBuffer)->vkCmdBindVertexBuffers(*cmdBuffer, 0, 3, buffers, offsets);
     (*cmdBuffer)
         ->vkCmdBindIndexBuffer(*cmdBuffer, *indexBuffer_, 0,
@@ -191,6 +211,10 @@ struct VulkanModel {
                            instance_count, 0, 0, 0);
   }
 
+  // The vertex data of this model, as it is laid out in its vertex buffer.
+  const void* vertex_data() const { return positions_; }
+  size_t vertex_data_size() const { return vertex_data_size_; }
+
  private:
   const float* positions_;
   const float* texture_coords_;
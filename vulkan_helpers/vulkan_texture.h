@@ -19,6 +19,7 @@
 #include "support/containers/allocator.h"
 #include "support/containers/vector.h"
 #include "support/log/log.h"
+#include "vulkan_helpers/upload_manager.h"
 #include "vulkan_helpers/vulkan_application.h"
 
 #include <initializer_list>
@@ -56,30 +57,16 @@ struct VulkanTexture {
                       static_cast<const void*>(t.data), sizeof(t.data),
                       sparse_binding_block_size) {}
 
-  // Creates the image object.
-  // Also creates a temporary buffer object for the upload data
+  // Creates the image object, and stages the data through the application's
+  // upload manager, recording the copy into cmdBuffer, which must be
+  // submitted to the render queue, followed by a Flush() of the manager, as
+  // the sample framework does after initialization.
   // If this image has already been initialized, then this re-initializes it.
-  // Returns the temporary buffer used to upload the image. This should/can
-  // be safely deleted once the given command buffer has executed.
   // The image is transitioned into "VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL"
   // during the upload operation.
   void InitializeData(vulkan::VulkanApplication* application,
                       vulkan::VkCommandBuffer* cmdBuffer,
                       VkImageUsageFlags usage = VK_IMAGE_USAGE_SAMPLED_BIT) {
-    VkBufferCreateInfo create_info = {
-        VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,  // sType
-        nullptr,                               // pNext
-        0,                                     // flags
-        data_size_,                            // size
-        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,      // usage
-        VK_SHARING_MODE_EXCLUSIVE,
-        0,
-        nullptr};
-    upload_buffer_ = application->CreateAndBindHostBuffer(&create_info);
-    void* copy_base = upload_buffer_->base_address();
-    memcpy(copy_base, data_, data_size_);
-    upload_buffer_->flush();
-
     VkImageCreateInfo image_create_info = {
         VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,  // sType
         nullptr,                              // pNext
@@ -119,41 +106,15 @@ struct VulkanTexture {
         {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1}};
 
     ::VkImageView raw_view;
-    LOG_ASSERT(
-        ==, logger_, VK_SUCCESS,
-        application->device()->vkCreateImageView(
-            application->device(), &view_create_info, nullptr, &raw_view));
+    LOG_ASSERT(==, logger_, VK_SUCCESS,
+               application->device()->vkCreateImageView(
+                   application->device(), &view_create_info,
+                   application->device().allocation_callbacks(), &raw_view));
     image_view_ = containers::make_unique<vulkan::VkImageView>(
         allocator_,
-        vulkan::VkImageView(raw_view, nullptr, &application->device()));
-
-    VkImageMemoryBarrier barrier = {
-        VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,  // sType
-        nullptr,                                 // pNext
-        0,                                       // srcAccessMask
-        VK_ACCESS_TRANSFER_WRITE_BIT,            // dstAccessMask
-        VK_IMAGE_LAYOUT_UNDEFINED,               // oldLayout
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,    // newLayout
-        VK_QUEUE_FAMILY_IGNORED,                 // srcQueueFamilyIndex
-        VK_QUEUE_FAMILY_IGNORED,                 // dstQueueFamilyIndex
-        image(),                                 // image
-        {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1}};
-    VkBufferMemoryBarrier buffer_barrier = {
-        VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,  // sType
-        nullptr,                                  // pNext
-        VK_ACCESS_HOST_WRITE_BIT,                 // srcAccessMask
-        VK_ACCESS_TRANSFER_READ_BIT,              // dstAccessMask
-        VK_QUEUE_FAMILY_IGNORED,                  // srcQueueFamilyIndex
-        VK_QUEUE_FAMILY_IGNORED,                  // dstQueueFamilyIndex
-        *upload_buffer_,                          // buffer
-        0,                                        // offset
-        data_size_,                               // size
-    };
-
-    (*cmdBuffer)
-        ->vkCmdPipelineBarrier(*cmdBuffer, VK_PIPELINE_STAGE_HOST_BIT,
-                               VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1,
-                               &buffer_barrier, 1, &barrier);
+        vulkan::VkImageView(raw_view,
+                            application->device().allocation_callbacks(),
+                            &application->device()));
 
     VkBufferImageCopy copy_params = {
         0,                                     // bufferOffset
@@ -166,23 +127,20 @@ struct VulkanTexture {
 
     };
 
-    (*cmdBuffer)
-        ->vkCmdCopyBufferToImage(*cmdBuffer, *upload_buffer_, image(),
-                                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
-                                 &copy_params);
-    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    (*cmdBuffer)
-        ->vkCmdPipelineBarrier(*cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
-                               VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT, 0, 0,
-                               nullptr, 0, nullptr, 1, &barrier);
+    UploadManager* uploads = application->upload_manager();
+    uploads->UploadImage(image(), format_,
+                         {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1},
+                         VK_IMAGE_LAYOUT_UNDEFINED,
+                         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, data_,
+                         data_size_, {copy_params}, VK_ACCESS_SHADER_READ_BIT,
+                         VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT);
+    uploads->Record(cmdBuffer);
   }
 
-  // When the initialiation is complete, call this method, and the temporary
-  // buffer will be released.
-  void InitializationComplete() { upload_buffer_.reset(); }
+  // The staging memory belongs to the application's upload manager, which
+  // reclaims it at the Flush() after cmdBuffer was submitted, so there is
+  // nothing left to release once the initialization is complete.
+  void InitializationComplete() {}
 
   ::VkImage image() const {
     return image_ != nullptr ? ::VkImage(*image_) : ::VkImage(*sparse_image_);
@@ -199,7 +157,6 @@ struct VulkanTexture {
   logging::Logger* logger_;
   size_t sparse_binding_block_size_;
 
-  containers::unique_ptr<vulkan::VulkanApplication::Buffer> upload_buffer_;
   containers::unique_ptr<vulkan::VulkanApplication::Image> image_;
   containers::unique_ptr<vulkan::VulkanApplication::SparseImage> sparse_image_;
   containers::unique_ptr<vulkan::VkImageView> image_view_;
@@ -70,6 +70,18 @@ class VkCommandBuffer {
  public:
   const ::VkCommandBuffer& get_command_buffer() const { return command_buffer_; }
   operator ::VkCommandBuffer() const { return command_buffer_; }
+
+  // Records the update of the push constants of the given layout at |offset|
+  // with the bytes of |value|. The layout must have a push constant range for
+  // |stages| that covers them.
+  template <typename T>
+  void PushConstants(::VkPipelineLayout layout, VkShaderStageFlags stages,
+                     const T& value, uint32_t offset = 0) {
+    static_assert(sizeof(T) % 4 == 0,
+                  "Push constant updates must be a multiple of 4 bytes");
+    functions_->vkCmdPushConstants(command_buffer_, layout, stages, offset,
+                                   static_cast<uint32_t>(sizeof(T)), &value);
+  }
   CommandBufferFunctions* operator->() { return functions_; }
   CommandBufferFunctions& operator*() { return *functions_; }
 };
@@ -38,8 +38,8 @@ class VkDevice {
   VkDevice(VkDevice&& other) = default;
   // This does not retain a reference to the VkInstance, or the
   // VkAllocationCallbacks object, it does take ownership of the device.
-  // If properties is not nullptr, then the device_id, vendor_id and
-  // driver_version will be copied out of it.
+  // If properties is not nullptr, then the device_id, vendor_id,
+  // driver_version and pipeline_cache_uuid will be copied out of it.
   VkDevice(containers::Allocator* container_allocator, ::VkDevice device,
            VkAllocationCallbacks* allocator, VkInstance* instance,
            VkPhysicalDeviceProperties* properties = nullptr,
@@ -52,6 +52,7 @@ class VkDevice {
         vendor_id_(0),
         driver_version_(0),
         physical_device_memory_properties_({0}) {
+    memset(pipeline_cache_uuid_, 0, sizeof(pipeline_cache_uuid_));
     if (has_allocator_) {
       allocator_ = *allocator;
     } else {
@@ -65,6 +66,8 @@ class VkDevice {
       device_id_ = properties->deviceID;
       vendor_id_ = properties->vendorID;
       driver_version_ = properties->driverVersion;
+      memcpy(pipeline_cache_uuid_, properties->pipelineCacheUUID,
+             sizeof(pipeline_cache_uuid_));
     }
     // Initialize the lazily resolved device functions.
     functions_ = containers::make_unique<DeviceFunctions>(
@@ -89,8 +92,18 @@ class VkDevice {
   uint32_t device_id() const { return device_id_; }
   uint32_t vendor_id() const { return vendor_id_; }
   uint32_t driver_version() const { return driver_version_; }
+  // Returns the VK_UUID_SIZE bytes of the pipelineCacheUUID of the physical
+  // device.
+  const uint8_t* pipeline_cache_uuid() const { return pipeline_cache_uuid_; }
   bool is_valid() { return device_ != VK_NULL_HANDLE; }
 
+  // Returns the allocation callbacks this device was created with, or nullptr
+  // if it was created without any. Objects created from this device should
+  // be created and destroyed with the same callbacks.
+  VkAllocationCallbacks* allocation_callbacks() {
+    return has_allocator_ ? &allocator_ : nullptr;
+  }
+
   logging::Logger* GetLogger() { return log_; }
 
   DeviceFunctions* functions() { return functions_.get(); }
@@ -117,6 +130,7 @@ class VkDevice {
   uint32_t device_id_;
   uint32_t vendor_id_;
   uint32_t driver_version_;
+  uint8_t pipeline_cache_uuid_[VK_UUID_SIZE];
   VkPhysicalDeviceMemoryProperties physical_device_memory_properties_;
 
  public:
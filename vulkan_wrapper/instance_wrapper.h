@@ -81,6 +81,12 @@ class VkInstance {
 
   InstanceFunctions* functions() { return functions_.get(); }
 
+  // Returns the allocation callbacks this instance was created with, or
+  // nullptr if it was created without any.
+  VkAllocationCallbacks* allocation_callbacks() {
+    return has_allocator_ ? &allocator_ : nullptr;
+  }
+
  private:
   ::VkInstance instance_;
   bool has_allocator_;
@@ -16,8 +16,10 @@
 #ifndef VULKAN_WRAPPER_LAZY_FUNCTION_H_
 #define VULKAN_WRAPPER_LAZY_FUNCTION_H_
 
+#include <atomic>
+
 // This wraps a lazily initialized function pointer. It will be resolved
-// when it is first called.
+// when it is first called. It may be called from multiple threads at once.
 template <typename T, typename HANDLE, typename WRAPPER>
 class LazyFunction {
  public:
@@ -25,6 +27,11 @@ class LazyFunction {
   // In practice this is expected to be used with string constants.
   LazyFunction(HANDLE handle, const char* function_name, WRAPPER* wrapper)
       : handle_(handle), function_name_(function_name), wrapper_(wrapper) {}
+  LazyFunction(const LazyFunction& other)
+      : handle_(other.handle_),
+        function_name_(other.function_name_),
+        wrapper_(other.wrapper_),
+        ptr_(other.ptr_.load(std::memory_order_acquire)) {}
 
   // When this functor is called, it will check if the function pointer
   // has been resolved. If not it will resolve it and then call the function.
@@ -36,16 +43,20 @@ class LazyFunction {
   HANDLE handle_;
   const char* function_name_;
   WRAPPER* wrapper_;
-  T ptr_ = nullptr;
+  std::atomic<T> ptr_{nullptr};
 };
 
 template <typename T, typename HANDLE, typename WRAPPER>
 template <typename... Args>
 typename std::result_of<T(Args...)>::type LazyFunction<T, HANDLE, WRAPPER>::
 operator()(const Args&... args) {
-  if (!ptr_) {
-    ptr_ = reinterpret_cast<T>(wrapper_->getProcAddr(handle_, function_name_));
-    if (ptr_) {
+  T ptr = ptr_.load(std::memory_order_acquire);
+  if (!ptr) {
+    // Several threads may race to resolve the function, but they will all
+    // resolve it to the same pointer.
+    ptr = reinterpret_cast<T>(wrapper_->getProcAddr(handle_, function_name_));
+    ptr_.store(ptr, std::memory_order_release);
+    if (ptr) {
       wrapper_->GetLogger()->LogInfo(function_name_, " for instance ", handle_,
                                      " resolved");
     } else {
@@ -53,7 +64,7 @@ operator()(const Args&... args) {
                                       " could not be resolved, crashing now");
     }
   }
-  return ptr_(args...);
+  return ptr(args...);
 }
 
 #endif  //  VULKAN_WRAPPER_LAZY_FUNCTION_H_
\ No newline at end of file